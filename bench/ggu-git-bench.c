@@ -0,0 +1,1311 @@
+/*
+ * Copyright 2011 Colomban Wendling <ban@herbesfolles.org>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+/*
+ * Timing harness for git-lib, built with `make bench` and never installed.
+ * 
+ *   ggu-git-bench [OPTION...] SCENARIO REPOSITORY [FILE]
+ * 
+ * Each scenario runs an operation the plugin does on a real repository a
+ * few times and prints how long it took.  Results are only comparable
+ * between runs on the same machine and repository.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <glib.h>
+#include <glib-object.h>
+#include <gio/gio.h>
+#include <gtk/gtk.h>
+
+#include "ggu-glib-compat.h"
+#include "ggu-git-branch.h"
+#include "ggu-git-log.h"
+#include "ggu-git-show.h"
+#include "ggu-git-blame-entry.h"
+#include "ggu-git-parallel.h"
+#include "ggu-git-cache.h"
+#include "ggu-git-files-changed-entry.h"
+#include "ggu-git-utils.h"
+#include "ggu-history-store.h"
+#include "ggu-history-view.h"
+#include "ggu-files-changed-store.h"
+#include "ggu-files-changed-view.h"
+
+
+/* size of the chunks in which the log parser is fed, like Git's output */
+#define LOG_CHUNK_SIZE  65536
+
+
+typedef struct _Options Options;
+struct _Options
+{
+  gint          iterations;
+  gint          ballast;    /* MiB of memory to touch before running */
+  gint          rows;       /* number of rows of synthetic histories */
+  const gchar  *rev;
+  const gchar  *dir;
+  const gchar  *file;
+};
+
+typedef struct _Timing Timing;
+struct _Timing
+{
+  const gchar  *label;
+  guint         n;
+  gint64        total;
+  gint64        min;
+  gint64        max;
+};
+
+typedef struct _Scenario Scenario;
+struct _Scenario
+{
+  const gchar  *name;
+  const gchar  *description;
+  gboolean    (*run)  (const Options  *options,
+                       GError        **error);
+};
+
+
+static void
+timing_init (Timing      *timing,
+             const gchar *label)
+{
+  timing->label = label;
+  timing->n     = 0;
+  timing->total = 0;
+  timing->min   = G_MAXINT64;
+  timing->max   = 0;
+}
+
+static void
+timing_add (Timing *timing,
+            gint64  start)
+{
+  gint64 elapsed = g_get_monotonic_time () - start;
+  
+  timing->n++;
+  timing->total += elapsed;
+  timing->min = MIN (timing->min, elapsed);
+  timing->max = MAX (timing->max, elapsed);
+}
+
+static void
+timing_print (const Timing *timing)
+{
+  if (timing->n == 0) {
+    printf ("  %-24s no run\n", timing->label);
+  } else {
+    printf ("  %-24s %10.3f ms  (min %.3f, max %.3f, %u runs)\n",
+            timing->label,
+            timing->total / (gdouble) timing->n / 1000.0,
+            timing->min / 1000.0, timing->max / 1000.0, timing->n);
+  }
+}
+
+/* resident memory of the process, in KiB, or 0 if unknown */
+static gulong
+get_rss (void)
+{
+  gchar  *contents;
+  gulong  size = 0;
+  gulong  resident = 0;
+  
+  if (g_file_get_contents ("/proc/self/statm", &contents, NULL, NULL)) {
+    if (sscanf (contents, "%lu %lu", &size, &resident) != 2) {
+      resident = 0;
+    }
+    g_free (contents);
+  }
+  
+  return resident * (gulong) (sysconf (_SC_PAGESIZE) / 1024);
+}
+
+/* how much the resident memory grew since it was @start KiB */
+static gulong
+get_rss_growth (gulong start)
+{
+  gulong rss = get_rss ();
+  
+  return rss > start ? rss - start : 0;
+}
+
+static void
+print_environment (void)
+{
+  struct rlimit limit;
+  
+  printf ("  resident memory          %lu KiB\n", get_rss ());
+  if (getrlimit (RLIMIT_NOFILE, &limit) == 0) {
+    printf ("  file descriptor limit    %lu\n", (gulong) limit.rlim_cur);
+  }
+}
+
+
+#if defined (__GLIBC__)
+
+/* GLib no longer lets a program hook g_malloc(), so count the allocations
+ * of the whole process by interposing the C library allocator */
+extern void  *__libc_malloc   (size_t size);
+extern void  *__libc_calloc   (size_t n_members,
+                               size_t size);
+extern void  *__libc_realloc  (void  *mem,
+                               size_t size);
+
+static gint G_n_allocations = 0;
+
+void *
+malloc (size_t size)
+{
+  g_atomic_int_inc (&G_n_allocations);
+  return __libc_malloc (size);
+}
+
+void *
+calloc (size_t n_members,
+        size_t size)
+{
+  g_atomic_int_inc (&G_n_allocations);
+  return __libc_calloc (n_members, size);
+}
+
+void *
+realloc (void  *mem,
+         size_t size)
+{
+  g_atomic_int_inc (&G_n_allocations);
+  return __libc_realloc (mem, size);
+}
+
+/* number of allocations so far, or -1 if unknown */
+static gint
+get_n_allocations (void)
+{
+  return g_atomic_int_get (&G_n_allocations);
+}
+
+#else /* ! __GLIBC__ */
+
+static gint
+get_n_allocations (void)
+{
+  return -1;
+}
+
+#endif /* ! __GLIBC__ */
+
+/* how many allocations were made since there were @start, or -1 */
+static gint
+get_n_allocations_since (gint start)
+{
+  return start < 0 ? -1 : get_n_allocations () - start;
+}
+
+/* prints how many bytes per second of a @size bytes input @timing shows */
+static void
+print_throughput (const Timing *timing,
+                  gsize         size)
+{
+  if (timing->n > 0 && timing->total > 0) {
+    /* bytes per microsecond are megabytes per second */
+    printf ("  %-24s %10.1f MB/s\n", timing->label,
+            size / (timing->total / (gdouble) timing->n));
+  }
+}
+
+static void
+print_allocations (const gchar *label,
+                   gint         n_allocations,
+                   guint        n_entries)
+{
+  if (n_allocations < 0) {
+    printf ("  %-24s unknown\n", label);
+  } else {
+    printf ("  %-24s %10.2f per entry\n", label,
+            n_allocations / (gdouble) MAX (n_entries, 1));
+  }
+}
+
+
+/* runs the main loop until an asynchronous operation completes */
+typedef struct _Wait Wait;
+struct _Wait
+{
+  GMainLoop    *loop;
+  GAsyncResult *result;
+};
+
+static void
+wait_ready (GObject      *object,
+            GAsyncResult *result,
+            gpointer      data)
+{
+  Wait *wait = data;
+  
+  wait->result = g_object_ref (result);
+  g_main_loop_quit (wait->loop);
+}
+
+static void
+wait_init (Wait *wait)
+{
+  wait->loop = g_main_loop_new (NULL, FALSE);
+  wait->result = NULL;
+}
+
+/* returns the result of the operation, to unref after calling _finish() */
+static GAsyncResult *
+wait_run (Wait *wait)
+{
+  GAsyncResult *result;
+  
+  if (! wait->result) {
+    g_main_loop_run (wait->loop);
+  }
+  result = wait->result;
+  wait->result = NULL;
+  
+  return result;
+}
+
+static void
+wait_clear (Wait *wait)
+{
+  g_main_loop_unref (wait->loop);
+}
+
+
+/* spawning: a trivial command through GLib's g_spawn_sync() and through
+ * git-lib, which uses posix_spawn() when available.  run with --ballast and
+ * under different `ulimit -n` to see how both scale with the size of the
+ * process and its file descriptor limit */
+static gboolean
+bench_spawn (const Options  *options,
+             GError        **error)
+{
+  gchar        *argv[] = { (gchar *) "git", (gchar *) "branch", NULL };
+  GguGitBranch *brancher = ggu_git_branch_new ();
+  Timing        g_spawn;
+  Timing        git_lib;
+  Wait          wait;
+  gint          i;
+  gboolean      success = TRUE;
+  
+  timing_init (&g_spawn, "g_spawn_sync()");
+  timing_init (&git_lib, "git-lib");
+  wait_init (&wait);
+  for (i = 0; success && i < options->iterations; i++) {
+    GAsyncResult *result;
+    gint64        start;
+    gint          status;
+    
+    start = g_get_monotonic_time ();
+    success = g_spawn_sync (options->dir, argv, NULL,
+                            G_SPAWN_SEARCH_PATH |
+                            G_SPAWN_STDOUT_TO_DEV_NULL |
+                            G_SPAWN_STDERR_TO_DEV_NULL,
+                            NULL, NULL, NULL, NULL, &status, error);
+    if (success) {
+      timing_add (&g_spawn, start);
+      
+      start = g_get_monotonic_time ();
+      ggu_git_branch_list_async (brancher, options->dir, NULL,
+                                 wait_ready, &wait);
+      result = wait_run (&wait);
+      success = ggu_git_branch_list_finish (brancher, NULL, result,
+                                            error) != NULL;
+      g_object_unref (result);
+      if (success) {
+        timing_add (&git_lib, start);
+      }
+    }
+  }
+  wait_clear (&wait);
+  g_object_unref (brancher);
+  
+  print_environment ();
+  timing_print (&g_spawn);
+  timing_print (&git_lib);
+  
+  return success;
+}
+
+/* loads the whole history of @rev and @file with @logger.  returns the
+ * number of entries, or -1 on error */
+static gint
+load_history (GguGitLog    *logger,
+              const gchar  *dir,
+              const gchar  *rev,
+              const gchar  *file,
+              GError      **error)
+{
+  Wait    wait;
+  gint    n_entries = 0;
+  GError *err = NULL;
+  
+  wait_init (&wait);
+  ggu_git_log_log_async (logger, dir, rev, file, NULL, wait_ready, &wait);
+  for (;;) {
+    GAsyncResult *result = wait_run (&wait);
+    GList        *entries;
+    
+    entries = ggu_git_log_log_finish (logger, result, &err);
+    g_object_unref (result);
+    if (err) {
+      g_propagate_error (error, err);
+      n_entries = -1;
+      break;
+    }
+    n_entries += (gint) g_list_length (entries);
+    if (ggu_git_log_is_complete (logger)) {
+      break;
+    }
+    ggu_git_log_log_more_async (logger, NULL, wait_ready, &wait);
+  }
+  wait_clear (&wait);
+  
+  return n_entries;
+}
+
+/* counts the lines of the output of @argv run in @dir, or -1 on error */
+static gint
+count_output_lines (const gchar  *dir,
+                    gchar       **argv,
+                    GError      **error)
+{
+  gchar  *output;
+  gchar  *p;
+  gint    n_lines = 0;
+  
+  if (! g_spawn_sync (dir, argv, NULL,
+                      G_SPAWN_SEARCH_PATH | G_SPAWN_STDERR_TO_DEV_NULL,
+                      NULL, NULL, &output, NULL, NULL, error)) {
+    return -1;
+  }
+  for (p = output; (p = strchr (p, '\n')); p++) {
+    n_lines++;
+  }
+  g_free (output);
+  
+  return n_lines;
+}
+
+/* file history: the native commit-graph walk git-lib does for a file,
+ * against asking `git log` for the same commits */
+static gboolean
+bench_walk (const Options  *options,
+            GError        **error)
+{
+  gchar    *argv[] = {
+    (gchar *) "git", (gchar *) "log", (gchar *) "--format=%H",
+    (gchar *) "--", (gchar *) options->file, NULL
+  };
+  gchar    *graph;
+  gchar    *graphs;
+  Timing    native;
+  Timing    git_log;
+  gint      n_native = 0;
+  gint      n_git_log = 0;
+  gint      i;
+  
+  if (! options->file) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                 "This scenario needs a FILE");
+    return FALSE;
+  }
+  
+  timing_init (&native, "native walk");
+  timing_init (&git_log, "git log");
+  for (i = 0; i < options->iterations; i++) {
+    GguGitLog  *logger = ggu_git_log_new ();
+    gint64      start;
+    
+    /* a new object each time, not to measure a resumed walk */
+    start = g_get_monotonic_time ();
+    n_native = load_history (logger, options->dir, NULL, options->file, error);
+    g_object_unref (logger);
+    if (n_native < 0) {
+      return FALSE;
+    }
+    timing_add (&native, start);
+    
+    start = g_get_monotonic_time ();
+    n_git_log = count_output_lines (options->dir, argv, error);
+    if (n_git_log < 0) {
+      return FALSE;
+    }
+    timing_add (&git_log, start);
+  }
+  
+  graph = g_build_filename (options->dir, ".git", "objects", "info",
+                            "commit-graph", NULL);
+  graphs = g_build_filename (options->dir, ".git", "objects", "info",
+                             "commit-graphs", NULL);
+  printf ("  commit-graph             %s\n",
+          (g_file_test (graph, G_FILE_TEST_EXISTS) ||
+           g_file_test (graphs, G_FILE_TEST_IS_DIR))
+          ? "yes" : "no, git-lib falls back to Git");
+  g_free (graph);
+  g_free (graphs);
+  printf ("  commits                  %d (native), %d (git log)\n",
+          n_native, n_git_log);
+  timing_print (&native);
+  timing_print (&git_log);
+  
+  return TRUE;
+}
+
+/* feeds @output to git-lib's log parser in chunks, like Git's output arrives.
+ * returns the result holding the entries, or %NULL on error */
+static GAsyncResult *
+parse_log_output (GguGitLog    *logger,
+                  const gchar  *output,
+                  gsize         length,
+                  GError      **error)
+{
+  GguGitParser       *parser = _ggu_git_log_parser_new ();
+  GSimpleAsyncResult *result;
+  GString            *data = g_string_sized_new (LOG_CHUNK_SIZE * 2);
+  gsize               pos = 0;
+  gboolean            eof = FALSE;
+  gboolean            success = TRUE;
+  
+  result = g_simple_async_result_new (G_OBJECT (logger), NULL, NULL,
+                                      parse_log_output);
+  while (success && ! eof) {
+    gsize n = MIN (LOG_CHUNK_SIZE, length - pos);
+    gsize consumed = 0;
+    
+    g_string_append_len (data, output + pos, (gssize) n);
+    pos += n;
+    eof = (pos == length);
+    success = parser->parse (parser, GGU_GIT (logger), data->str, data->len,
+                             eof, &consumed, result, NULL);
+    g_string_erase (data, 0, (gssize) consumed);
+  }
+  parser->free (parser);
+  g_string_free (data, TRUE);
+  
+  if (! success) {
+    g_simple_async_result_propagate_error (result, error);
+    g_object_unref (result);
+    return NULL;
+  }
+  
+  return G_ASYNC_RESULT (result);
+}
+
+/* parses @data in place, making each entry own a copy of its summary like
+ * it was done before entries shared buffers.  returns the entries */
+static GList *
+parse_log_output_with_copies (gchar *data)
+{
+  GList *entries = NULL;
+  gchar *p = data;
+  
+  for (;;) {
+    gchar          *fields[4];
+    gchar          *sep;
+    GguGitLogEntry *entry;
+    guint           i;
+    
+    while (g_ascii_isspace (*p)) {
+      p++;
+    }
+    for (i = 0; i < G_N_ELEMENTS (fields); i++) {
+      fields[i] = p;
+      sep = strchr (p, '\xff');
+      if (! sep) {
+        return g_list_reverse (entries);
+      }
+      *sep = 0;
+      p = sep + 1;
+    }
+    
+    entry = ggu_git_log_entry_new ();
+    entry->oid        = ggu_git_oid_intern_hex (fields[0], -1);
+    entry->timestamp  = g_ascii_strtoll (fields[1], NULL, 10);
+    entry->author     = ggu_git_intern_utf8 (fields[2]);
+    entry->summary    = g_strdup (fields[3]);
+    ggu_git_log_entry_update_display (entry);
+    entries = g_list_prepend (entries, entry);
+  }
+}
+
+/* runs the idles the log parser queued to report its entries */
+static void
+flush_idles (void)
+{
+  while (g_main_context_iteration (NULL, FALSE));
+}
+
+/* log parsing: git-lib's parser over the captured output of `git log` for
+ * --rev, or FILE, against making each entry own copies of its fields */
+static gboolean
+bench_log_parse (const Options  *options,
+                 GError        **error)
+{
+  GguGitLog  *logger = ggu_git_log_new ();
+  gchar     **log_argv = _ggu_git_log_get_argv (logger);
+  GPtrArray  *argv = g_ptr_array_new ();
+  gchar      *output;
+  gsize       length;
+  Timing      copies;
+  Timing      parser;
+  gint        n_copies_allocations = -1;
+  gint        n_parser_allocations = -1;
+  gulong      rss_delta = 0;
+  guint       n_entries = 0;
+  gint        i;
+  gboolean    success = TRUE;
+  
+  for (i = 0; log_argv[i]; i++) {
+    g_ptr_array_add (argv, log_argv[i]);
+  }
+  g_ptr_array_add (argv, (gchar *) options->rev);
+  if (options->file) {
+    g_ptr_array_add (argv, (gchar *) "--");
+    g_ptr_array_add (argv, (gchar *) options->file);
+  }
+  g_ptr_array_add (argv, NULL);
+  success = g_spawn_sync (options->dir, (gchar **) argv->pdata, NULL,
+                          G_SPAWN_SEARCH_PATH | G_SPAWN_STDERR_TO_DEV_NULL,
+                          NULL, NULL, &output, NULL, NULL, error);
+  g_ptr_array_free (argv, TRUE);
+  g_strfreev (log_argv);
+  if (! success) {
+    g_object_unref (logger);
+    return FALSE;
+  }
+  length = strlen (output);
+  
+  timing_init (&copies, "owning copies");
+  timing_init (&parser, "git-lib parser");
+  for (i = 0; success && i < options->iterations; i++) {
+    GAsyncResult *result;
+    GList        *entries;
+    gchar        *data;
+    gulong        rss_start;
+    gint          n_allocations;
+    gint64        start;
+    
+    /* it parses in place, so it gets a copy made outside of the timing */
+    data = g_strdup (output);
+    n_allocations = get_n_allocations ();
+    start = g_get_monotonic_time ();
+    entries = parse_log_output_with_copies (data);
+    timing_add (&copies, start);
+    n_copies_allocations = get_n_allocations_since (n_allocations);
+    g_list_free_full (entries, (GDestroyNotify) ggu_git_log_entry_unref);
+    g_free (data);
+    
+    rss_start = get_rss ();
+    n_allocations = get_n_allocations ();
+    start = g_get_monotonic_time ();
+    result = parse_log_output (logger, output, length, error);
+    if (! result) {
+      success = FALSE;
+    } else {
+      GSimpleAsyncResult *simple = G_SIMPLE_ASYNC_RESULT (result);
+      
+      timing_add (&parser, start);
+      n_parser_allocations = get_n_allocations_since (n_allocations);
+      /* the entries are held by the result */
+      rss_delta = get_rss_growth (rss_start);
+      entries = g_simple_async_result_get_op_res_gpointer (simple);
+      n_entries = g_list_length (entries);
+      g_object_unref (result);
+    }
+    flush_idles ();
+  }
+  g_object_unref (logger);
+  
+  if (success) {
+    printf ("  output size              %lu KiB\n", (gulong) (length / 1024));
+    printf ("  commits                  %u\n", n_entries);
+    printf ("  git-lib parser memory    %lu KiB\n", rss_delta);
+    timing_print (&copies);
+    timing_print (&parser);
+    print_throughput (&copies, length);
+    print_throughput (&parser, length);
+    print_allocations ("owning copies", n_copies_allocations, n_entries);
+    print_allocations ("git-lib parser", n_parser_allocations, n_entries);
+  }
+  g_free (output);
+  
+  return success;
+}
+
+/* history loading: the whole history of the repository through git-lib,
+ * with the memory the entries take and how many author strings they share */
+static gboolean
+bench_history (const Options  *options,
+               GError        **error)
+{
+  Timing      timing;
+  gulong      rss_delta = 0;
+  guint       n_entries = 0;
+  guint       n_authors = 0;
+  gint        i;
+  
+  timing_init (&timing, "load");
+  for (i = 0; i < options->iterations; i++) {
+    GguGitLog    *logger = ggu_git_log_new ();
+    GAsyncResult *result;
+    GList        *entries;
+    GList        *item;
+    GHashTable   *authors;
+    Wait          wait;
+    gulong        rss_start;
+    gint64        start;
+    GError       *err = NULL;
+    
+    rss_start = get_rss ();
+    start = g_get_monotonic_time ();
+    wait_init (&wait);
+    /* the default max count gets everything at once */
+    ggu_git_log_log_async (logger, options->dir, NULL, options->file, NULL,
+                           wait_ready, &wait);
+    result = wait_run (&wait);
+    wait_clear (&wait);
+    entries = ggu_git_log_log_finish (logger, result, &err);
+    if (err) {
+      g_propagate_error (error, err);
+      g_object_unref (result);
+      g_object_unref (logger);
+      return FALSE;
+    }
+    timing_add (&timing, start);
+    
+    /* the entries are held by the result */
+    rss_delta = get_rss_growth (rss_start);
+    authors = g_hash_table_new (NULL, NULL);
+    for (item = entries; item; item = item->next) {
+      GguGitLogEntry *entry = item->data;
+      
+      g_hash_table_insert (authors, (gpointer) entry->author, NULL);
+    }
+    n_entries = g_list_length (entries);
+    n_authors = g_hash_table_size (authors);
+    g_hash_table_destroy (authors);
+    g_object_unref (result);
+    g_object_unref (logger);
+  }
+  
+  printf ("  commits                  %u\n", n_entries);
+  printf ("  author strings           %u\n", n_authors);
+  printf ("  memory                   %lu KiB\n", rss_delta);
+  timing_print (&timing);
+  
+  return TRUE;
+}
+
+/* blame: the blame of FILE, with the memory its entries take and how many
+ * author strings they share */
+static gboolean
+bench_blame (const Options  *options,
+             GError        **error)
+{
+  GguGitShow *shower = ggu_git_show_new ();
+  Timing      timing;
+  gulong      rss_delta = 0;
+  guint       n_lines = 0;
+  guint       n_authors = 0;
+  gint        i;
+  gboolean    success = TRUE;
+  
+  if (! options->file) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                 "This scenario needs a FILE");
+    g_object_unref (shower);
+    return FALSE;
+  }
+  
+  timing_init (&timing, "blame");
+  for (i = 0; success && i < options->iterations; i++) {
+    GAsyncResult *result;
+    GList        *entries;
+    GList        *item;
+    GHashTable   *authors;
+    Wait          wait;
+    gulong        rss_start;
+    gint64        start;
+    GError       *err = NULL;
+    
+    rss_start = get_rss ();
+    start = g_get_monotonic_time ();
+    wait_init (&wait);
+    ggu_git_blame_async (shower, options->dir, NULL, options->file, NULL,
+                         wait_ready, &wait);
+    result = wait_run (&wait);
+    wait_clear (&wait);
+    entries = ggu_git_blame_finish (shower, result, &err);
+    if (err) {
+      g_propagate_error (error, err);
+      success = FALSE;
+    } else {
+      timing_add (&timing, start);
+      
+      /* the entries are held by the result */
+      rss_delta = get_rss_growth (rss_start);
+      authors = g_hash_table_new (NULL, NULL);
+      for (item = entries; item; item = item->next) {
+        GguGitBlameEntry *entry = item->data;
+        
+        g_hash_table_insert (authors, (gpointer) entry->author, NULL);
+      }
+      n_lines = g_list_length (entries);
+      n_authors = g_hash_table_size (authors);
+      g_hash_table_destroy (authors);
+    }
+    g_object_unref (result);
+  }
+  g_object_unref (shower);
+  
+  if (success) {
+    printf ("  lines                    %u\n", n_lines);
+    printf ("  author strings           %u\n", n_authors);
+    printf ("  memory                   %lu KiB\n", rss_delta);
+    timing_print (&timing);
+  }
+  
+  return success;
+}
+
+/* a copy of @str made valid UTF-8 one character at a time, the way it was
+ * done before the word-at-a-time kernel */
+static gchar *
+normalize_per_char (const gchar *str,
+                    gsize        length)
+{
+  GString     *copy = g_string_sized_new (length);
+  const gchar *p = str;
+  const gchar *end = str + length;
+  
+  while (p < end) {
+    gunichar c = g_utf8_get_char_validated (p, end - p);
+    
+    if (c == (gunichar) -1 || c == (gunichar) -2) {
+      g_string_append_unichar (copy, 0xfffd);
+      p++;
+    } else {
+      g_string_append_unichar (copy, c);
+      p = g_utf8_next_char (p);
+    }
+  }
+  
+  return g_string_free (copy, FALSE);
+}
+
+/* files changed: listing the changes of --rev, without and with the cache */
+static gboolean
+bench_changes (const Options  *options,
+               GError        **error)
+{
+  GguGitShow *shower = ggu_git_show_new ();
+  Timing      uncached;
+  Timing      cached;
+  guint       n_files = 0;
+  gint        i;
+  gboolean    success = TRUE;
+  
+  timing_init (&uncached, "uncached");
+  timing_init (&cached, "cached");
+  for (i = 0; success && i < options->iterations * 2; i++) {
+    GAsyncResult *result;
+    GList        *entries;
+    Wait          wait;
+    gint64        start;
+    GError       *err = NULL;
+    
+    /* every other run gets the list from the cache */
+    if (i % 2 == 0) {
+      ggu_git_cache_clear ();
+    }
+    start = g_get_monotonic_time ();
+    wait_init (&wait);
+    ggu_git_list_files_changed_async (shower, options->dir, options->rev,
+                                      NULL, wait_ready, &wait);
+    result = wait_run (&wait);
+    wait_clear (&wait);
+    entries = ggu_git_list_files_changed_finish (shower, result, &err);
+    if (err) {
+      g_propagate_error (error, err);
+      success = FALSE;
+    } else {
+      timing_add (i % 2 == 0 ? &uncached : &cached, start);
+      n_files = g_list_length (entries);
+    }
+    g_object_unref (result);
+  }
+  g_object_unref (shower);
+  
+  if (success) {
+    printf ("  files                    %u\n", n_files);
+    timing_print (&uncached);
+    timing_print (&cached);
+  }
+  
+  return success;
+}
+
+/* parallel parsing: the blame of FILE parsed with 1 thread, then 2, 4 and
+ * so on up to the number of processors, included.  outputs below a few MiB are always
+ * parsed on one thread */
+static gboolean
+bench_parallel (const Options  *options,
+                GError        **error)
+{
+  GguGitShow *shower = ggu_git_show_new ();
+  guint       n_processors = (guint) g_get_num_processors ();
+  guint       n_threads;
+  gboolean    success = TRUE;
+  
+  if (! options->file) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                 "This scenario needs a FILE");
+    g_object_unref (shower);
+    return FALSE;
+  }
+  
+  for (n_threads = 1; success && n_threads <= n_processors;
+       n_threads = (n_threads < n_processors && n_threads * 2 > n_processors
+                    ? n_processors : n_threads * 2)) {
+    Timing  timing;
+    gchar  *label;
+    gint    i;
+    
+    label = g_strdup_printf ("%u thread(s)", n_threads);
+    timing_init (&timing, label);
+    _ggu_git_parse_records_set_max_threads (n_threads);
+    for (i = 0; success && i < options->iterations; i++) {
+      GAsyncResult *result;
+      Wait          wait;
+      gint64        start;
+      GError       *err = NULL;
+      
+      start = g_get_monotonic_time ();
+      wait_init (&wait);
+      ggu_git_blame_async (shower, options->dir, NULL, options->file, NULL,
+                           wait_ready, &wait);
+      result = wait_run (&wait);
+      wait_clear (&wait);
+      ggu_git_blame_finish (shower, result, &err);
+      g_object_unref (result);
+      if (err) {
+        g_propagate_error (error, err);
+        success = FALSE;
+      } else {
+        timing_add (&timing, start);
+      }
+    }
+    timing_print (&timing);
+    g_free (label);
+  }
+  _ggu_git_parse_records_set_max_threads (0);
+  g_object_unref (shower);
+  
+  return success;
+}
+
+/* text normalization: throughput of the UTF-8 repair and reflow kernel over
+ * the commit messages of the repository */
+static gboolean
+bench_normalize (const Options  *options,
+                 GError        **error)
+{
+  gchar    *argv[] = {
+    (gchar *) "git", (gchar *) "log", (gchar *) "--format=%B%x1e", NULL
+  };
+  gchar    *output;
+  Timing    per_char;
+  Timing    validate;
+  Timing    reflow;
+  gint      i;
+  
+  if (! g_spawn_sync (options->dir, argv, NULL,
+                      G_SPAWN_SEARCH_PATH | G_SPAWN_STDERR_TO_DEV_NULL,
+                      NULL, NULL, &output, NULL, NULL, error)) {
+    return FALSE;
+  }
+  
+  timing_init (&per_char, "per character");
+  timing_init (&validate, "kernel");
+  timing_init (&reflow, "kernel, reflowing");
+  for (i = 0; i < options->iterations; i++) {
+    const gchar  *message;
+    const gchar  *end;
+    gint64        start;
+    
+    /* each message separately, like the plugin does */
+    start = g_get_monotonic_time ();
+    for (message = output; (end = strchr (message, '\x1e')); message = end + 1) {
+      g_free (normalize_per_char (message, (gsize) (end - message)));
+    }
+    timing_add (&per_char, start);
+    
+    start = g_get_monotonic_time ();
+    for (message = output; (end = strchr (message, '\x1e')); message = end + 1) {
+      g_free (ggu_git_utf8_normalize (message, (gsize) (end - message), FALSE));
+    }
+    timing_add (&validate, start);
+    
+    start = g_get_monotonic_time ();
+    for (message = output; (end = strchr (message, '\x1e')); message = end + 1) {
+      g_free (ggu_git_utf8_normalize (message, (gsize) (end - message), TRUE));
+    }
+    timing_add (&reflow, start);
+  }
+  
+  printf ("  messages size            %lu KiB\n", (gulong) (strlen (output) / 1024));
+  timing_print (&per_char);
+  timing_print (&validate);
+  timing_print (&reflow);
+  g_free (output);
+  
+  return TRUE;
+}
+
+/* a synthetic history of @n_entries entries, with a few different authors
+ * like a real one */
+static GguGitLogEntry **
+create_entries (guint n_entries)
+{
+  GguGitLogEntry  **entries = g_new (GguGitLogEntry *, n_entries);
+  guint             i;
+  
+  for (i = 0; i < n_entries; i++) {
+    GguGitLogEntry *entry = ggu_git_log_entry_new ();
+    guint8          raw[GGU_GIT_OID_SHA1_SIZE] = { 0 };
+    gchar           author[32];
+    
+    memcpy (raw, &i, sizeof i);
+    g_snprintf (author, sizeof author, "Author %u", i % 200);
+    entry->oid        = ggu_git_oid_intern_raw (raw, sizeof raw);
+    entry->timestamp  = 1300000000 + (gint64) i * 600;
+    entry->author     = ggu_git_intern_utf8 (author);
+    entry->summary    = g_strdup_printf ("Change number %u of the history", i);
+    ggu_git_log_entry_update_display (entry);
+    entries[i] = entry;
+  }
+  
+  return entries;
+}
+
+static void
+free_entries (GguGitLogEntry  **entries,
+              guint             n_entries)
+{
+  guint i;
+  
+  for (i = 0; i < n_entries; i++) {
+    ggu_git_log_entry_unref (entries[i]);
+  }
+  g_free (entries);
+}
+
+/* history store: filling a GguHistoryStore with --rows entries and reading
+ * every row back like a view scrolling through all of them does */
+static gboolean
+bench_store (const Options  *options,
+             GError        **error)
+{
+  guint             n_rows = (guint) options->rows;
+  GguGitLogEntry  **entries;
+  gulong            rss_start;
+  gulong            rss_entries;
+  gulong            rss_store;
+  Timing            append;
+  Timing            scroll;
+  gint              i;
+  
+  rss_start = get_rss ();
+  entries = create_entries (n_rows);
+  rss_entries = get_rss ();
+  
+  timing_init (&append, "append");
+  timing_init (&scroll, "read all rows");
+  rss_store = rss_entries;
+  for (i = 0; i < options->iterations; i++) {
+    GguHistoryStore  *store = ggu_history_store_new ();
+    GtkTreeModel     *model = GTK_TREE_MODEL (store);
+    gint64            start;
+    guint             row;
+    gsize             length = 0;
+    
+    start = g_get_monotonic_time ();
+    ggu_history_store_append_entries (store, entries, n_rows);
+    timing_add (&append, start);
+    rss_store = MAX (rss_store, get_rss ());
+    
+    start = g_get_monotonic_time ();
+    for (row = 0; row < n_rows; row++) {
+      GtkTreeIter     iter;
+      GguGitLogEntry *entry;
+      
+      gtk_tree_model_iter_nth_child (model, &iter, NULL, (gint) row);
+      entry = ggu_history_store_get_entry (store, &iter);
+      /* what the cells read */
+      length += strlen (entry->short_hash) + strlen (entry->summary);
+    }
+    timing_add (&scroll, start);
+    g_object_unref (store);
+    
+    if (length == 0) {
+      /* only there so that the reads aren't optimized out */
+      printf ("  no text read\n");
+    }
+  }
+  free_entries (entries, n_rows);
+  
+  printf ("  rows                     %u\n", n_rows);
+  printf ("  entries memory           %lu KiB\n", rss_entries - rss_start);
+  printf ("  store memory             %lu KiB\n", rss_store - rss_entries);
+  timing_print (&append);
+  timing_print (&scroll);
+  
+  return TRUE;
+}
+
+/* sets the cells of every column of @view for each of its top-level rows,
+ * which is what drawing them does apart from the drawing itself */
+static void
+render_rows (GtkTreeView *view,
+             Timing      *timing)
+{
+  GtkTreeModel *model = gtk_tree_view_get_model (view);
+  GList        *columns = gtk_tree_view_get_columns (view);
+  GtkTreeIter   iter;
+  gint64        start;
+  
+  start = g_get_monotonic_time ();
+  if (gtk_tree_model_get_iter_first (model, &iter)) {
+    do {
+      GList *column;
+      
+      for (column = columns; column; column = column->next) {
+        gtk_tree_view_column_cell_set_cell_data (column->data, model, &iter,
+                                                 FALSE, FALSE);
+      }
+    } while (gtk_tree_model_iter_next (model, &iter));
+  }
+  timing_add (timing, start);
+  g_list_free (columns);
+}
+
+static GList *
+create_files_changed_entries (guint n_entries)
+{
+  GList  *entries = NULL;
+  guint8  raw[GGU_GIT_OID_SHA1_SIZE] = { 0 };
+  guint   i;
+  
+  for (i = 0; i < n_entries; i++) {
+    GguGitFilesChangedEntry *entry = ggu_git_files_changed_entry_new ();
+    
+    entry->oid      = ggu_git_oid_intern_raw (raw, sizeof raw);
+    entry->path     = g_strdup_printf ("dir%u/file%u.c", i % 100, i);
+    entry->added    = i % 1000;
+    entry->removed  = i % 300;
+    ggu_git_files_changed_entry_update_display (entry);
+    entries = g_list_prepend (entries, entry);
+  }
+  
+  return g_list_reverse (entries);
+}
+
+/* cell rendering: the cell data functions of the history and files changed
+ * views for each of --rows rows, as when scrolling through all of them.
+ * this needs a display */
+static gboolean
+bench_render (const Options  *options,
+              GError        **error)
+{
+  guint                 n_rows = (guint) options->rows;
+  GguGitLogEntry      **entries;
+  GList                *files;
+  GguHistoryStore      *history_store;
+  GguFilesChangedStore *files_store;
+  GtkWidget            *history_view;
+  GtkWidget            *files_view;
+  Timing                history;
+  Timing                files_changed;
+  gint                  i;
+  
+  if (! gtk_init_check (NULL, NULL)) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                 "This scenario needs a display");
+    return FALSE;
+  }
+  
+  entries = create_entries (n_rows);
+  history_store = ggu_history_store_new ();
+  ggu_history_store_append_entries (history_store, entries, n_rows);
+  free_entries (entries, n_rows);
+  history_view = g_object_ref_sink (ggu_history_view_new (history_store));
+  
+  files = create_files_changed_entries (n_rows);
+  files_store = ggu_files_changed_store_new ();
+  ggu_files_changed_store_set_entries (files_store, files);
+  g_list_free_full (files, (GDestroyNotify) ggu_git_files_changed_entry_unref);
+  files_view = g_object_ref_sink (ggu_files_changed_view_new (files_store));
+  
+  timing_init (&history, "history view");
+  timing_init (&files_changed, "files changed view");
+  for (i = 0; i < options->iterations; i++) {
+    render_rows (GTK_TREE_VIEW (history_view), &history);
+    render_rows (GTK_TREE_VIEW (files_view), &files_changed);
+  }
+  
+  printf ("  rows                     %u\n", n_rows);
+  timing_print (&history);
+  timing_print (&files_changed);
+  
+  gtk_widget_destroy (history_view);
+  g_object_unref (history_view);
+  g_object_unref (history_store);
+  gtk_widget_destroy (files_view);
+  g_object_unref (files_view);
+  g_object_unref (files_store);
+  
+  return TRUE;
+}
+
+
+static const Scenario scenarios[] = {
+  { "spawn", "spawn Git through g_spawn_sync() and git-lib", bench_spawn },
+  { "walk", "list the history of FILE natively and with git log", bench_walk },
+  { "history", "load the whole history of the repository, or of FILE",
+    bench_history },
+  { "log", "parse the output of git log for --rev, or FILE", bench_log_parse },
+  { "changes", "list the files changed by --rev", bench_changes },
+  { "blame", "blame FILE", bench_blame },
+  { "parallel", "blame FILE parsing with more and more threads",
+    bench_parallel },
+  { "normalize", "repair and reflow the commit messages of the repository",
+    bench_normalize },
+  { "store", "fill a history store with --rows entries and read them back",
+    bench_store },
+  { "render", "set the cells of --rows rows of the history and changes views",
+    bench_render }
+};
+
+
+static const Scenario *
+find_scenario (const gchar *name)
+{
+  guint i;
+  
+  for (i = 0; i < G_N_ELEMENTS (scenarios); i++) {
+    if (strcmp (scenarios[i].name, name) == 0) {
+      return &scenarios[i];
+    }
+  }
+  
+  return NULL;
+}
+
+static gchar *
+scenarios_summary (void)
+{
+  GString *summary = g_string_new ("Scenarios:");
+  guint    i;
+  
+  for (i = 0; i < G_N_ELEMENTS (scenarios); i++) {
+    g_string_append_printf (summary, "\n  %-16s%s",
+                            scenarios[i].name, scenarios[i].description);
+  }
+  
+  return g_string_free (summary, FALSE);
+}
+
+int
+main (int     argc,
+      char  **argv)
+{
+  Options         options = { 5, 0, 100000, "HEAD", NULL, NULL };
+  GOptionEntry    entries[] = {
+    { "iterations", 'n', 0, G_OPTION_ARG_INT, &options.iterations,
+      "Number of times to run each operation (default: 5)", "N" },
+    { "ballast", 'b', 0, G_OPTION_ARG_INT, &options.ballast,
+      "Grow the process by SIZE MiB before running", "SIZE" },
+    { "rows", 'r', 0, G_OPTION_ARG_INT, &options.rows,
+      "Number of rows of synthetic histories (default: 100000)", "N" },
+    { "rev", 0, 0, G_OPTION_ARG_STRING, &options.rev,
+      "Revision to list the changes or history of (default: HEAD)", "REV" },
+    { NULL }
+  };
+  GOptionContext *context;
+  const Scenario *scenario;
+  GError         *error = NULL;
+  gchar          *ballast = NULL;
+  gchar          *summary;
+  int             rv = 1;
+  
+#if ! GLIB_CHECK_VERSION (2, 36, 0)
+  g_type_init ();
+#endif
+  
+  context = g_option_context_new ("SCENARIO REPOSITORY [FILE]");
+  g_option_context_add_main_entries (context, entries, NULL);
+  summary = scenarios_summary ();
+  g_option_context_set_summary (context, summary);
+  g_free (summary);
+  if (! g_option_context_parse (context, &argc, &argv, &error)) {
+    fprintf (stderr, "%s\n", error->message);
+    g_error_free (error);
+  } else if (argc < 3 || argc > 4 ||
+             options.iterations < 1 || options.rows < 1) {
+    gchar *help = g_option_context_get_help (context, TRUE, NULL);
+    
+    fprintf (stderr, "%s", help);
+    g_free (help);
+  } else if (! (scenario = find_scenario (argv[1]))) {
+    fprintf (stderr, "Unknown scenario \"%s\"\n", argv[1]);
+  } else {
+    options.dir = argv[2];
+    options.file = argc > 3 ? argv[3] : NULL;
+    if (options.ballast > 0) {
+      gsize size = (gsize) options.ballast * 1024 * 1024;
+      
+      /* touch it so it really is resident */
+      ballast = g_malloc (size);
+      memset (ballast, 1, size);
+    }
+    
+    printf ("%s:\n", scenario->name);
+    if (scenario->run (&options, &error)) {
+      rv = 0;
+    } else {
+      fprintf (stderr, "%s failed: %s\n", scenario->name,
+               error ? error->message : "unknown error");
+      g_clear_error (&error);
+    }
+    g_free (ballast);
+  }
+  g_option_context_free (context);
+  
+  return rv;
+}
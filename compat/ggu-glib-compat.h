@@ -73,6 +73,47 @@ __GGU_g_simple_async_result_take_error (GSimpleAsyncResult *simple,
 # define g_simple_async_result_take_error __GGU_g_simple_async_result_take_error
 #endif
 
+/* g_get_num_processors() */
+#if ! defined (g_get_num_processors) && \
+    ! GLIB_CHECK_VERSION (2, 35, 3)
+# ifdef G_OS_UNIX
+#  include <unistd.h>
+# endif
+static inline guint
+__GGU_g_get_num_processors (void)
+{
+# if defined (G_OS_UNIX) && defined (_SC_NPROCESSORS_ONLN)
+  long n = sysconf (_SC_NPROCESSORS_ONLN);
+  
+  if (n > 0) {
+    return (guint) n;
+  }
+# endif
+  return 1;
+}
+# define g_get_num_processors __GGU_g_get_num_processors
+#endif
+
+/* g_memdup2() */
+#if ! defined (g_memdup2) && \
+    ! GLIB_CHECK_VERSION (2, 67, 3)
+# include <string.h>
+static inline gpointer
+__GGU_g_memdup2 (gconstpointer mem,
+                 gsize         byte_size)
+{
+  gpointer new_mem = NULL;
+  
+  if (mem && byte_size != 0) {
+    new_mem = g_malloc (byte_size);
+    memcpy (new_mem, mem, byte_size);
+  }
+  
+  return new_mem;
+}
+# define g_memdup2 __GGU_g_memdup2
+#endif
+
 /* G_DEFINE_BOXED_TYPE() -- stolen from GLib with slight modifications */
 #ifndef G_DEFINE_BOXED_TYPE
 # define G_DEFINE_BOXED_TYPE(TypeName, type_name, copy_func, free_func)        \
@@ -3,8 +3,9 @@
 #include <string.h>
 #include <glib.h>
 
-#include "ggu-git-wrapper-log.h"
-#include "ggu-git-wrapper-branch-list.h"
+#include "ggu-git-log.h"
+#include "ggu-git-branch.h"
+#include "ggu-git-oid.h"
 
 static GMainLoop *P_loop = NULL;
 static gint       P_refs = 0;
@@ -27,43 +28,58 @@ loop_pop (void)
 
 
 static void
-log_result_callback (GList         *commits,
-                     const GError  *error,
+log_result_callback (GObject       *object,
+                     GAsyncResult  *result,
                      gpointer       data)
 {
+  GList  *entries;
+  GError *error = NULL;
+  
   loop_pop ();
   
+  entries = ggu_git_log_log_finish (GGU_GIT_LOG (object), result, &error);
   if (error) {
     g_warning ("%s", error->message);
+    g_error_free (error);
   } else {
     printf ("=== Commit(s) ===\n");
-    for (; commits; commits = commits->next) {
-      GguGitCommit *commit = commits->data;
+    for (; entries; entries = entries->next) {
+      GguGitLogEntry *entry = entries->data;
+      gchar           hex[GGU_GIT_OID_HEX_SIZE];
       
-      printf ("%.7s -- %s\n", commit->hash, commit->summary);
+      printf ("%.7s -- %s\n", ggu_git_oid_to_hex (entry->oid, hex),
+              entry->summary);
     }
   }
+  g_object_unref (object);
 }
 
 static void
-branch_list_result_callback (GList         *branches,
-                             const gchar   *current_branch,
-                             const GError  *error,
+branch_list_result_callback (GObject       *object,
+                             GAsyncResult  *result,
                              gpointer       data)
 {
+  GList        *branches;
+  const gchar  *current_branch = NULL;
+  GError       *error = NULL;
+  
   loop_pop ();
   
+  branches = ggu_git_branch_list_finish (GGU_GIT_BRANCH (object),
+                                         &current_branch, result, &error);
   if (error) {
     g_warning ("%s", error->message);
+    g_error_free (error);
   } else {
     printf ("=== Branch(es) ===\n");
     for (; branches; branches = branches->next) {
       gchar *branch = branches->data;
       
       printf ("%c %s\n",
-              strcmp (branch, current_branch) == 0 ? '*' : ' ', branch);
+              g_strcmp0 (branch, current_branch) == 0 ? '*' : ' ', branch);
     }
   }
+  g_object_unref (object);
 }
 
 static int
@@ -82,33 +98,13 @@ ggu_git_wrapper_test_main (int     argc,
     dir = g_path_get_dirname (path);
     file = g_path_get_basename (path);
     loop_push ();
-    ggu_git_log (dir, NULL, file, log_result_callback, NULL);
+    ggu_git_log_log_async (ggu_git_log_new (), dir, NULL, file, NULL,
+                           log_result_callback, NULL);
     loop_push ();
-    ggu_git_branch_list (dir, branch_list_result_callback, NULL);
+    ggu_git_branch_list_async (ggu_git_branch_new (), dir, NULL,
+                               branch_list_result_callback, NULL);
     rv = 0;
     
-    {
-      GList  *l;
-      GError *err = NULL;
-      
-      l = ggu_git_log_sync (dir, NULL, file, &err);
-      if (err) {
-        g_warning ("%s", err->message);
-        g_error_free (err);
-      } else {
-        printf ("=== Commit(s) ===\n");
-        while (l) {
-          GguGitCommit *commit = l->data;
-          GList *next = l->next;
-          
-          printf ("%.7s -- %s\n", commit->hash, commit->summary);
-          ggu_git_commit_unref (commit);
-          g_list_free_1 (l);
-          l = next;
-        }
-      }
-    }
-    
     g_free (file);
     g_free (dir);
     g_free (path);
@@ -128,6 +124,9 @@ main (int     argc,
 {
   int rv;
   
+#if ! GLIB_CHECK_VERSION (2, 36, 0)
+  g_type_init ();
+#endif
   P_loop = g_main_loop_new (NULL, FALSE);
   rv = ggu_git_wrapper_test_main (argc, argv);
   if (rv == 0 && P_loop) {
@@ -25,6 +25,7 @@
 #include <glib-object.h>
 
 #include "ggu-glib-compat.h"
+#include "ggu-git-utils.h"
 
 
 G_DEFINE_BOXED_TYPE (GguGitBlameEntry,
@@ -77,8 +78,12 @@ void
 ggu_git_blame_entry_unref (GguGitBlameEntry *entry)
 {
   if (g_atomic_int_dec_and_test (&entry->ref_count)) {
-    g_free (entry->hash);
-    g_free (entry->author);
+    if (entry->oid) {
+      ggu_git_oid_unref (entry->oid);
+    }
+    if (entry->author) {
+      ggu_git_interned_unref (entry->author);
+    }
     g_slice_free1 (sizeof *entry, entry);
   }
 }
@@ -25,6 +25,8 @@
 #include <glib.h>
 #include <glib-object.h>
 
+#include "ggu-git-oid.h"
+
 G_BEGIN_DECLS
 
 
@@ -35,21 +37,21 @@ typedef struct _GguGitBlameEntry GguGitBlameEntry;
 /**
  * GguGitBlameEntry:
  * @line: The line this entry is for
- * @hash: The hash of the commit lats modifying the line
- * @author: The author of the last commit modifying this line
+ * @oid: The ID of the commit last modifying the line
+ * @author: The author of the last commit modifying this line, interned with
+ *          ggu_git_intern_utf8()
  * 
  * Blame information for a line.
  */
 struct _GguGitBlameEntry
 {
   /*< private >*/
-  gint      ref_count;
+  gint          ref_count;
   
   /*< public >*/
-  /*guint64   hash;*/
-  gulong    line;
-  gchar    *hash;
-  gchar    *author;
+  gulong        line;
+  GguGitOid    *oid;
+  const gchar  *author;
 };
 
 
@@ -138,23 +138,41 @@ branch_list_op_free (BranchListOp *op)
   g_free (op);
 }
 
-static void
-ggu_git_branch_list_parse_output (GguGit             *obj,
-                                  const gchar        *output,
-                                  GSimpleAsyncResult *result,
-                                  GCancellable       *cancellable)
+typedef struct _BranchListParser BranchListParser;
+struct _BranchListParser
 {
+  GguGitParser  parent;
   BranchListOp *op;
+};
+
+static gboolean
+branch_list_parser_parse (GguGitParser       *parser,
+                          GguGit             *git,
+                          gchar              *data,
+                          gsize               length,
+                          gboolean            eof,
+                          gsize              *consumed,
+                          GSimpleAsyncResult *result,
+                          GCancellable       *cancellable)
+{
+  BranchListParser *self = (BranchListParser *) parser;
+  const gchar      *output = data;
+  const gchar      *end = data + length;
   
-  op = g_malloc (sizeof *op);
-  op->branches = NULL;
-  op->current = NULL;
-  
-  while (*output) {
+  while (output < end) {
     gboolean      current = FALSE;
     const gchar  *start;
+    const gchar  *line_end;
     gchar        *branch;
     
+    line_end = memchr (output, '\n', (gsize) (end - output));
+    if (! line_end) {
+      if (! eof) {
+        break;
+      }
+      line_end = end;
+    }
+    
     if (*output == '*') {
       output++;
       current = TRUE;
@@ -162,21 +180,53 @@ ggu_git_branch_list_parse_output (GguGit             *obj,
     while (*output == ' ') {
       output++;
     }
-    for (start = output; *output && *output != '\n'; output++) {
-    }
+    start = output;
+    output = line_end;
     branch = g_strndup (start, (gsize)(output - start));
-    if (*output) {
+    if (output < end) {
       output++;
     }
     if (current) {
-      op->current = branch;
+      self->op->current = branch;
     }
-    op->branches = g_list_prepend (op->branches, branch);
+    self->op->branches = g_list_prepend (self->op->branches, branch);
   }
-  op->branches = g_list_reverse (op->branches);
+  *consumed = (gsize) (output - data);
+  
+  if (eof) {
+    self->op->branches = g_list_reverse (self->op->branches);
+    g_simple_async_result_set_op_res_gpointer (result, self->op,
+                                               (GDestroyNotify) branch_list_op_free);
+    self->op = NULL;
+  }
+  
+  return TRUE;
+}
+
+static void
+branch_list_parser_free (GguGitParser *parser)
+{
+  BranchListParser *self = (BranchListParser *) parser;
+  
+  if (self->op) {
+    branch_list_op_free (self->op);
+  }
+  g_free (self);
+}
+
+static GguGitParser *
+branch_list_parser_new (void)
+{
+  BranchListParser *self;
+  
+  self = g_malloc (sizeof *self);
+  self->parent.parse  = branch_list_parser_parse;
+  self->parent.free   = branch_list_parser_free;
+  self->op            = g_malloc (sizeof *self->op);
+  self->op->branches  = NULL;
+  self->op->current   = NULL;
   
-  g_simple_async_result_set_op_res_gpointer (result, op,
-                                             (GDestroyNotify) branch_list_op_free);
+  return (GguGitParser *) self;
 }
 
 void
@@ -193,9 +243,10 @@ ggu_git_branch_list_async (GguGitBranch        *self,
   };
   
   g_object_set (self, "dir", dir, NULL);
-  _ggu_git_run_async (GGU_GIT (self), (gchar **) argv,
-                      ggu_git_branch_list_parse_output, G_PRIORITY_DEFAULT,
-                      cancellable, callback, user_data);
+  _ggu_git_run_streaming_async (GGU_GIT (self), (gchar **) argv,
+                                branch_list_parser_new (),
+                                ggu_git_get_priority (GGU_GIT (self)),
+                                cancellable, callback, user_data);
 }
 
 /**
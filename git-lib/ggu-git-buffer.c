@@ -0,0 +1,119 @@
+/*
+ * Copyright 2011 Colomban Wendling <ban@herbesfolles.org>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+/*
+ * A reference-counted block of memory, so that several objects can point
+ * inside the same output instead of each owning copies of their parts.
+ */
+
+#include "ggu-git-buffer.h"
+
+#include <string.h>
+#include <glib.h>
+
+
+struct _GguGitBuffer
+{
+  gint    ref_count;
+  gsize   length;
+  gchar   data[1]; /* actually @length bytes followed by a 0 */
+};
+
+
+/**
+ * ggu_git_buffer_new:
+ * @data: The data to copy
+ * @length: The length of @data
+ * 
+ * Creates a new buffer holding a copy of @data, followed by a terminating 0
+ * that is not part of @length.
+ * 
+ * Returns: A new #GguGitBuffer
+ */
+GguGitBuffer *
+ggu_git_buffer_new (const gchar *data,
+                    gsize        length)
+{
+  GguGitBuffer *buffer;
+  
+  buffer = ggu_git_buffer_sized_new (length);
+  memcpy (buffer->data, data, length);
+  
+  return buffer;
+}
+
+/**
+ * ggu_git_buffer_sized_new:
+ * @length: The length of the buffer
+ * 
+ * Creates a new buffer of @length uninitialized bytes followed by a
+ * terminating 0, to be filled through ggu_git_buffer_get_data().
+ * 
+ * Returns: A new #GguGitBuffer
+ */
+GguGitBuffer *
+ggu_git_buffer_sized_new (gsize length)
+{
+  GguGitBuffer *buffer;
+  
+  buffer = g_malloc (G_STRUCT_OFFSET (GguGitBuffer, data) + length + 1);
+  buffer->ref_count = 1;
+  buffer->length = length;
+  buffer->data[length] = 0;
+  
+  return buffer;
+}
+
+GguGitBuffer *
+ggu_git_buffer_ref (GguGitBuffer *buffer)
+{
+  g_atomic_int_inc (&buffer->ref_count);
+  return buffer;
+}
+
+void
+ggu_git_buffer_unref (GguGitBuffer *buffer)
+{
+  if (g_atomic_int_dec_and_test (&buffer->ref_count)) {
+    g_free (buffer);
+  }
+}
+
+/**
+ * ggu_git_buffer_get_data:
+ * @buffer: A #GguGitBuffer
+ * @length: Return location for the length of the data, or %NULL
+ * 
+ * Gets the data of the buffer.  It may be modified in place by whoever
+ * created the buffer, as long as it isn't shared yet.
+ * 
+ * Returns: The data, followed by a terminating 0 not part of @length
+ */
+gchar *
+ggu_git_buffer_get_data (GguGitBuffer *buffer,
+                         gsize        *length)
+{
+  if (length) {
+    *length = buffer->length;
+  }
+  
+  return buffer->data;
+}
@@ -0,0 +1,44 @@
+/*
+ * Copyright 2011 Colomban Wendling <ban@herbesfolles.org>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+#ifndef H_GGU_GIT_BUFFER
+#define H_GGU_GIT_BUFFER
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+
+typedef struct _GguGitBuffer GguGitBuffer;
+
+
+GguGitBuffer   *ggu_git_buffer_new        (const gchar *data,
+                                           gsize        length);
+GguGitBuffer   *ggu_git_buffer_sized_new  (gsize length);
+GguGitBuffer   *ggu_git_buffer_ref        (GguGitBuffer *buffer);
+void            ggu_git_buffer_unref      (GguGitBuffer *buffer);
+gchar          *ggu_git_buffer_get_data   (GguGitBuffer *buffer,
+                                           gsize        *length);
+
+
+G_END_DECLS
+
+#endif /* guard */
@@ -0,0 +1,253 @@
+/*
+ * Copyright 2011 Colomban Wendling <ban@herbesfolles.org>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+/*
+ * Cache of the data Git gives about a commit.  A commit never changes once
+ * it exists, so neither do its message, changes or diffs: they are keyed by
+ * the commit ID and never need invalidating.  The cache is bounded by a byte
+ * budget, evicting the least recently used values first.
+ */
+
+#include "ggu-git-cache.h"
+
+#include <string.h>
+#include <glib.h>
+#include <glib-object.h>
+
+#include "ggu-git-oid.h"
+
+
+typedef struct _CacheEntry CacheEntry;
+struct _CacheEntry
+{
+  gchar          *key;
+  gpointer        value;
+  gsize           size;
+  GBoxedCopyFunc  copy;
+  GDestroyNotify  free_value;
+  GList           link; /* in the LRU queue, its data is the entry */
+};
+
+
+G_LOCK_DEFINE_STATIC (cache);
+static GHashTable  *cache_entries = NULL;
+static GQueue       cache_lru = G_QUEUE_INIT; /* most recently used first */
+static gsize        cache_size = 0;
+static gsize        cache_budget = GGU_GIT_CACHE_DEFAULT_BUDGET;
+static guint64      cache_hits = 0;
+static guint64      cache_misses = 0;
+
+
+static gchar *
+cache_key (GguGitCacheKind  kind,
+           const GguGitOid *oid,
+           const gchar     *path)
+{
+  gchar hex[GGU_GIT_OID_HEX_SIZE];
+  
+  return g_strdup_printf ("%d:%s:%s", kind, ggu_git_oid_to_hex (oid, hex),
+                          path ? path : "");
+}
+
+static void
+cache_entry_free (CacheEntry *entry)
+{
+  g_free (entry->key);
+  entry->free_value (entry->value);
+  g_slice_free1 (sizeof *entry, entry);
+}
+
+/* must be called with the lock held */
+static void
+cache_remove (CacheEntry *entry)
+{
+  g_queue_unlink (&cache_lru, &entry->link);
+  g_hash_table_remove (cache_entries, entry->key);
+  cache_size -= entry->size;
+  cache_entry_free (entry);
+}
+
+/* must be called with the lock held */
+static void
+cache_evict (gsize budget)
+{
+  while (cache_size > budget) {
+    cache_remove (g_queue_peek_tail (&cache_lru));
+  }
+}
+
+/**
+ * ggu_git_cache_set_budget:
+ * @budget: The maximum size of the cache, in bytes
+ * 
+ * Sets how much memory the cached commit data may use.  A budget of 0
+ * disables the cache.
+ */
+void
+ggu_git_cache_set_budget (gsize budget)
+{
+  G_LOCK (cache);
+  cache_budget = budget;
+  cache_evict (budget);
+  G_UNLOCK (cache);
+}
+
+gsize
+ggu_git_cache_get_budget (void)
+{
+  gsize budget;
+  
+  G_LOCK (cache);
+  budget = cache_budget;
+  G_UNLOCK (cache);
+  
+  return budget;
+}
+
+/**
+ * ggu_git_cache_get_stats:
+ * @hits: Return location for the number of lookups that found a value, or
+ *        %NULL
+ * @misses: Return location for the number of lookups that didn't, or %NULL
+ * @size: Return location for the current size of the cache, or %NULL
+ * 
+ * Gets statistics about the cache usage.
+ */
+void
+ggu_git_cache_get_stats (guint64 *hits,
+                         guint64 *misses,
+                         gsize   *size)
+{
+  G_LOCK (cache);
+  if (hits) {
+    *hits = cache_hits;
+  }
+  if (misses) {
+    *misses = cache_misses;
+  }
+  if (size) {
+    *size = cache_size;
+  }
+  G_UNLOCK (cache);
+}
+
+/**
+ * ggu_git_cache_clear:
+ * 
+ * Drops all the cached values.
+ */
+void
+ggu_git_cache_clear (void)
+{
+  G_LOCK (cache);
+  cache_evict (0);
+  G_UNLOCK (cache);
+}
+
+/**
+ * _ggu_git_cache_lookup:
+ * @kind: The kind of the value
+ * @oid: The commit the value is about
+ * @path: The path the value is about, or %NULL
+ * @value: Return location for a copy of the value
+ * 
+ * Looks up a value in the cache, marking it as recently used.
+ * 
+ * Returns: Whether the value was found
+ */
+gboolean
+_ggu_git_cache_lookup (GguGitCacheKind   kind,
+                       const GguGitOid  *oid,
+                       const gchar      *path,
+                       gpointer         *value)
+{
+  gchar      *key = cache_key (kind, oid, path);
+  CacheEntry *entry = NULL;
+  
+  G_LOCK (cache);
+  if (cache_entries) {
+    entry = g_hash_table_lookup (cache_entries, key);
+  }
+  if (entry) {
+    cache_hits++;
+    g_queue_unlink (&cache_lru, &entry->link);
+    g_queue_push_head_link (&cache_lru, &entry->link);
+    *value = entry->copy (entry->value);
+  } else {
+    cache_misses++;
+  }
+  G_UNLOCK (cache);
+  g_free (key);
+  
+  return entry != NULL;
+}
+
+/**
+ * _ggu_git_cache_insert:
+ * @kind: The kind of the value
+ * @oid: The commit the value is about
+ * @path: The path the value is about, or %NULL
+ * @value: (transfer full): The value
+ * @size: Approximate memory used by @value, in bytes
+ * @copy: Function giving a copy of @value, or a new reference to it
+ * @free_value: Function freeing @value and its copies
+ * 
+ * Adds a value to the cache, evicting the least recently used ones if the
+ * budget would be exceeded.  Values larger than the whole budget and values
+ * already in the cache are freed right away.
+ */
+void
+_ggu_git_cache_insert (GguGitCacheKind   kind,
+                       const GguGitOid  *oid,
+                       const gchar      *path,
+                       gpointer          value,
+                       gsize             size,
+                       GBoxedCopyFunc    copy,
+                       GDestroyNotify    free_value)
+{
+  CacheEntry *entry;
+  
+  entry = g_slice_alloc (sizeof *entry);
+  entry->key        = cache_key (kind, oid, path);
+  entry->value      = value;
+  entry->size       = size + sizeof *entry + strlen (entry->key);
+  entry->copy       = copy;
+  entry->free_value = free_value;
+  entry->link.data  = entry;
+  entry->link.prev  = NULL;
+  entry->link.next  = NULL;
+  
+  G_LOCK (cache);
+  if (G_UNLIKELY (! cache_entries)) {
+    cache_entries = g_hash_table_new (g_str_hash, g_str_equal);
+  }
+  if (entry->size > cache_budget ||
+      g_hash_table_lookup (cache_entries, entry->key)) {
+    G_UNLOCK (cache);
+    cache_entry_free (entry);
+    return;
+  }
+  cache_evict (cache_budget - entry->size);
+  g_hash_table_insert (cache_entries, entry->key, entry);
+  g_queue_push_head_link (&cache_lru, &entry->link);
+  cache_size += entry->size;
+  G_UNLOCK (cache);
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright 2011 Colomban Wendling <ban@herbesfolles.org>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+#ifndef H_GGU_GIT_CACHE
+#define H_GGU_GIT_CACHE
+
+#include <glib.h>
+#include <glib-object.h>
+
+#include "ggu-git-oid.h"
+
+G_BEGIN_DECLS
+
+
+/* the default size of the cache, in bytes */
+#define GGU_GIT_CACHE_DEFAULT_BUDGET (32 * 1024 * 1024)
+
+typedef enum
+{
+  GGU_GIT_CACHE_FILES_CHANGED,  /* GList of GguGitFilesChangedEntry */
+  GGU_GIT_CACHE_MESSAGE,        /* the full message, a string */
+  GGU_GIT_CACHE_DIFF            /* the diff, a string */
+} GguGitCacheKind;
+
+
+void        ggu_git_cache_set_budget  (gsize budget);
+gsize       ggu_git_cache_get_budget  (void);
+void        ggu_git_cache_get_stats   (guint64 *hits,
+                                       guint64 *misses,
+                                       gsize   *size);
+void        ggu_git_cache_clear       (void);
+
+gboolean    _ggu_git_cache_lookup     (GguGitCacheKind   kind,
+                                       const GguGitOid  *oid,
+                                       const gchar      *path,
+                                       gpointer         *value);
+void        _ggu_git_cache_insert     (GguGitCacheKind   kind,
+                                       const GguGitOid  *oid,
+                                       const gchar      *path,
+                                       gpointer          value,
+                                       gsize             size,
+                                       GBoxedCopyFunc    copy,
+                                       GDestroyNotify    free_value);
+
+
+G_END_DECLS
+
+#endif /* guard */
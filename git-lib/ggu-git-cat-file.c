@@ -0,0 +1,652 @@
+/*
+ * Copyright 2011 Colomban Wendling <ban@herbesfolles.org>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+/*
+ * Long-lived `git cat-file --batch` processes.
+ * 
+ * Getting a blob through a new `git show` for each request pays the process
+ * startup and the repository opening every time.  Instead, we keep one
+ * `git cat-file --batch` process per repository and write requests to it.
+ * Requests are pipelined: a thread can write its request while another one
+ * is still reading its response, responses being read in request order.
+ * 
+ * A process that dies is replaced on the next request, and processes that
+ * were not used for IDLE_TIMEOUT seconds are shut down.  Cancelling a request
+ * kills the process, as its output would be left in the middle of a
+ * response.
+ * 
+ * This must only be used from worker threads, as it blocks.
+ */
+
+#include "ggu-git-cat-file.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <poll.h>
+#include <glib.h>
+#include <gio/gio.h>
+
+#include "ggu-git.h"
+#include "ggu-git-utils.h"
+
+
+/* how long an unused process is kept around */
+#define IDLE_TIMEOUT  60 /* s */
+/* size of the chunks in which responses are read */
+#define READ_SIZE     65536
+
+
+typedef struct _CatFile CatFile;
+struct _CatFile
+{
+  gint      ref_count;
+  gchar    *key;
+  GPid      pid;
+  gint      in_fd;
+  gint      out_fd;
+  
+  /* serializes writing requests */
+  GMutex    write_lock;
+  guint64   next_ticket;
+  
+  /* protects the 3 fields below */
+  GMutex    read_lock;
+  GCond     read_cond;
+  guint64   reading;      /* the ticket whose response is to be read next */
+  gboolean  dead;
+  
+  /* only accessed by the thread whose turn it is to read */
+  GString  *buffer;
+  gsize     buffer_pos;
+  gint      cancel_fd;
+  
+  /* protected by G_lock */
+  guint     n_users;
+  gint64    last_used;
+};
+
+
+static GMutex       G_lock;
+static GHashTable  *G_processes = NULL; /* key -> CatFile */
+static guint        G_reaper_id = 0;
+
+
+static gchar *
+cat_file_key (const gchar *git_path,
+              const gchar *dir)
+{
+  return g_strdup_printf ("%lu:%s:%s", (gulong) strlen (git_path), git_path,
+                          dir ? dir : "");
+}
+
+static void
+cat_file_child_watch (GPid    pid,
+                      gint    status,
+                      gpointer data)
+{
+  g_spawn_close_pid (pid);
+}
+
+static CatFile *
+cat_file_ref (CatFile *cat)
+{
+  g_atomic_int_inc (&cat->ref_count);
+  return cat;
+}
+
+static void
+cat_file_unref (CatFile *cat)
+{
+  if (g_atomic_int_dec_and_test (&cat->ref_count)) {
+    /* closing its input is enough for a healthy process to exit */
+    close (cat->in_fd);
+    close (cat->out_fd);
+    if (cat->dead) {
+      kill (-cat->pid, SIGKILL);
+    }
+    /* don't block for reaping it */
+    g_child_watch_add (cat->pid, cat_file_child_watch, NULL);
+    
+    g_mutex_clear (&cat->write_lock);
+    g_mutex_clear (&cat->read_lock);
+    g_cond_clear (&cat->read_cond);
+    g_string_free (cat->buffer, TRUE);
+    g_free (cat->key);
+    g_slice_free1 (sizeof *cat, cat);
+  }
+}
+
+static CatFile *
+cat_file_spawn (const gchar  *git_path,
+                const gchar  *dir,
+                gchar        *key,
+                GError      **error)
+{
+  gchar    *argv[] = { (gchar *) git_path, "cat-file", "--batch", NULL };
+  CatFile  *cat;
+  GPid      pid;
+  gint      in_fd;
+  gint      out_fd;
+  
+  if (! _ggu_git_spawn (dir, argv, &pid, &in_fd, &out_fd, NULL, error)) {
+    return NULL;
+  }
+  
+  cat = g_slice_alloc (sizeof *cat);
+  cat->ref_count    = 1;
+  cat->key          = key;
+  cat->pid          = pid;
+  cat->in_fd        = in_fd;
+  cat->out_fd       = out_fd;
+  g_mutex_init (&cat->write_lock);
+  cat->next_ticket  = 0;
+  g_mutex_init (&cat->read_lock);
+  g_cond_init (&cat->read_cond);
+  cat->reading      = 0;
+  cat->dead         = FALSE;
+  cat->buffer       = g_string_sized_new (READ_SIZE);
+  cat->buffer_pos   = 0;
+  cat->cancel_fd    = -1;
+  cat->n_users      = 0;
+  cat->last_used    = g_get_monotonic_time ();
+  
+  return cat;
+}
+
+/* shuts down processes that were not used for a while */
+static gboolean
+reaper_timeout (gpointer data)
+{
+  GHashTableIter  iter;
+  gpointer        value;
+  gint64          now = g_get_monotonic_time ();
+  gboolean        keep;
+  
+  g_mutex_lock (&G_lock);
+  g_hash_table_iter_init (&iter, G_processes);
+  while (g_hash_table_iter_next (&iter, NULL, &value)) {
+    CatFile *cat = value;
+    
+    if (cat->n_users == 0 &&
+        now - cat->last_used >= IDLE_TIMEOUT * G_TIME_SPAN_SECOND) {
+      g_hash_table_iter_remove (&iter);
+    }
+  }
+  keep = g_hash_table_size (G_processes) > 0;
+  if (! keep) {
+    G_reaper_id = 0;
+  }
+  g_mutex_unlock (&G_lock);
+  
+  return keep;
+}
+
+/* gets a running process for the repository, spawning one if needed */
+static CatFile *
+cat_file_acquire (const gchar  *git_path,
+                  const gchar  *dir,
+                  GError      **error)
+{
+  CatFile  *cat;
+  gchar    *key;
+  
+  key = cat_file_key (git_path, dir);
+  
+  g_mutex_lock (&G_lock);
+  if (G_UNLIKELY (! G_processes)) {
+    G_processes = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+                                         (GDestroyNotify) cat_file_unref);
+  }
+  cat = g_hash_table_lookup (G_processes, key);
+  if (cat) {
+    gboolean dead;
+    
+    g_mutex_lock (&cat->read_lock);
+    dead = cat->dead;
+    g_mutex_unlock (&cat->read_lock);
+    if (dead) {
+      g_hash_table_remove (G_processes, key);
+      cat = NULL;
+    }
+  }
+  if (cat) {
+    g_free (key);
+  } else {
+    cat = cat_file_spawn (git_path, dir, key, error);
+    if (! cat) {
+      g_free (key);
+    } else {
+      g_hash_table_insert (G_processes, cat->key, cat);
+      if (! G_reaper_id) {
+        G_reaper_id = g_timeout_add_seconds (IDLE_TIMEOUT, reaper_timeout,
+                                             NULL);
+      }
+    }
+  }
+  if (cat) {
+    cat->n_users++;
+    cat_file_ref (cat);
+  }
+  g_mutex_unlock (&G_lock);
+  
+  return cat;
+}
+
+static void
+cat_file_release (CatFile *cat)
+{
+  g_mutex_lock (&G_lock);
+  cat->n_users--;
+  cat->last_used = g_get_monotonic_time ();
+  g_mutex_unlock (&G_lock);
+  cat_file_unref (cat);
+}
+
+static gboolean
+write_all (gint          fd,
+           const gchar  *data,
+           gsize         length,
+           GError      **error)
+{
+  while (length > 0) {
+    gssize n = write (fd, data, length);
+    
+    if (n < 0) {
+      gint errsv = errno;
+      
+      if (errsv == EINTR) {
+        continue;
+      }
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+                   "Failed to write to Git: %s", g_strerror (errsv));
+      return FALSE;
+    }
+    data += n;
+    length -= (gsize) n;
+  }
+  
+  return TRUE;
+}
+
+/* waits for Git's output to be readable, unless the request gets cancelled */
+static gboolean
+wait_readable (CatFile  *cat,
+               GError  **error)
+{
+  struct pollfd fds[2];
+  nfds_t        n_fds = 1;
+  
+  fds[0].fd = cat->out_fd;
+  fds[0].events = POLLIN;
+  if (cat->cancel_fd >= 0) {
+    fds[1].fd = cat->cancel_fd;
+    fds[1].events = POLLIN;
+    n_fds++;
+  }
+  for (;;) {
+    if (poll (fds, n_fds, -1) < 0) {
+      gint errsv = errno;
+      
+      if (errsv == EINTR) {
+        continue;
+      }
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+                   "Failed to wait for Git output: %s", g_strerror (errsv));
+      return FALSE;
+    }
+    if (n_fds > 1 && fds[1].revents) {
+      g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_CANCELLED,
+                           "Operation was cancelled");
+      return FALSE;
+    }
+    if (fds[0].revents) {
+      return TRUE;
+    }
+  }
+}
+
+/* reads at most @size bytes into @data */
+static gssize
+read_some (CatFile  *cat,
+           gchar    *data,
+           gsize     size,
+           GError  **error)
+{
+  gssize n;
+  
+  if (! wait_readable (cat, error)) {
+    return -1;
+  }
+  do {
+    n = read (cat->out_fd, data, size);
+  } while (n < 0 && errno == EINTR);
+  if (n < 0) {
+    gint errsv = errno;
+    
+    g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+                 "Failed to read Git output: %s", g_strerror (errsv));
+  } else if (n == 0) {
+    g_set_error_literal (error, GGU_GIT_ERROR, GGU_GIT_ERROR_CRASHED,
+                         "Git terminated unexpectedly");
+    n = -1;
+  }
+  
+  return n;
+}
+
+/* makes sure at least @size bytes are buffered */
+static gboolean
+fill_buffer (CatFile  *cat,
+             gsize     size,
+             GError  **error)
+{
+  if (cat->buffer_pos > 0) {
+    g_string_erase (cat->buffer, 0, (gssize) cat->buffer_pos);
+    cat->buffer_pos = 0;
+  }
+  while (cat->buffer->len < size) {
+    gsize   len = cat->buffer->len;
+    gssize  n;
+    
+    g_string_set_size (cat->buffer, len + READ_SIZE);
+    n = read_some (cat, cat->buffer->str + len, READ_SIZE, error);
+    g_string_truncate (cat->buffer, n < 0 ? len : len + (gsize) n);
+    if (n < 0) {
+      return FALSE;
+    }
+  }
+  
+  return TRUE;
+}
+
+/* reads a line, and returns it without the line feed.  the returned string is
+ * valid until the next read */
+static gchar *
+read_line (CatFile  *cat,
+           GError  **error)
+{
+  for (;;) {
+    gchar *start = cat->buffer->str + cat->buffer_pos;
+    gchar *eol;
+    
+    eol = memchr (start, '\n', cat->buffer->len - cat->buffer_pos);
+    if (eol) {
+      *eol = 0;
+      cat->buffer_pos = (gsize) (eol + 1 - cat->buffer->str);
+      return start;
+    }
+    if (! fill_buffer (cat, cat->buffer->len - cat->buffer_pos + 1, error)) {
+      return NULL;
+    }
+  }
+}
+
+/* reads exactly @size bytes into @data */
+static gboolean
+read_exact (CatFile  *cat,
+            gchar    *data,
+            gsize     size,
+            GError  **error)
+{
+  gsize avail = MIN (size, cat->buffer->len - cat->buffer_pos);
+  
+  memcpy (data, cat->buffer->str + cat->buffer_pos, avail);
+  cat->buffer_pos += avail;
+  while (avail < size) {
+    gssize n = read_some (cat, data + avail, size - avail, error);
+    
+    if (n < 0) {
+      return FALSE;
+    }
+    avail += (gsize) n;
+  }
+  
+  return TRUE;
+}
+
+/* reads a response.  returns %FALSE if the communication with Git failed, in
+ * which case the process is unusable.  if the object could not be read,
+ * *@content is %NULL and @error is set. */
+static gboolean
+read_response (CatFile      *cat,
+               const gchar  *object,
+               gchar       **content,
+               gsize        *length,
+               GError      **error)
+{
+  gchar    *line;
+  gchar   **fields;
+  gsize     size = 0;
+  gboolean  found;
+  
+  *content = NULL;
+  line = read_line (cat, error);
+  if (! line) {
+    return FALSE;
+  }
+  
+  /* either "<hash> <type> <size>" or "<object> missing" (or "ambiguous") */
+  fields = g_strsplit (line, " ", 0);
+  found = (g_strv_length (fields) == 3 &&
+           ggu_git_is_hash (fields[0]) &&
+           g_ascii_isdigit (fields[2][0]));
+  if (found) {
+    gchar *end;
+    
+    size = (gsize) g_ascii_strtoull (fields[2], &end, 10);
+    found = (*end == 0);
+  }
+  
+  if (! found) {
+    g_set_error (error, GGU_GIT_ERROR, GGU_GIT_ERROR_FAILED,
+                 "Object \"%s\" does not exist", object);
+  } else {
+    gchar *data = g_malloc (size + 1);
+    gchar  lf;
+    
+    /* content followed by a line feed */
+    if (! read_exact (cat, data, size, error) ||
+        ! read_exact (cat, &lf, 1, error)) {
+      g_free (data);
+      g_strfreev (fields);
+      return FALSE;
+    }
+    data[size] = 0;
+    
+    /* we only handle blobs, `git show` is better at showing the rest */
+    if (strcmp (fields[1], "blob") != 0) {
+      g_set_error (error, GGU_GIT_ERROR, GGU_GIT_ERROR_FAILED,
+                   "Object \"%s\" is a %s, not a blob", object, fields[1]);
+      g_free (data);
+    } else {
+      *content = data;
+      if (length) {
+        *length = size;
+      }
+    }
+  }
+  g_strfreev (fields);
+  
+  return TRUE;
+}
+
+/* marks @cat as unusable and kills it, so it doesn't keep working (and maybe
+ * fetching) for nobody.  must be called with the read lock held */
+static void
+cat_file_kill (CatFile *cat)
+{
+  if (! cat->dead) {
+    cat->dead = TRUE;
+    kill (-cat->pid, SIGKILL);
+  }
+  g_cond_broadcast (&cat->read_cond);
+}
+
+static void
+request_cancelled_handler (GCancellable *cancellable,
+                           CatFile      *cat)
+{
+  g_mutex_lock (&cat->read_lock);
+  g_cond_broadcast (&cat->read_cond);
+  g_mutex_unlock (&cat->read_lock);
+}
+
+/* performs a request on @cat.  returns %FALSE if the communication with Git
+ * failed or the request got cancelled, see read_response() */
+static gboolean
+cat_file_request (CatFile      *cat,
+                  const gchar  *object,
+                  gchar       **content,
+                  gsize        *length,
+                  GCancellable *cancellable,
+                  GError      **error)
+{
+  guint64   ticket;
+  gboolean  success;
+  gchar    *request;
+  gulong    cancelled_id = 0;
+  
+  *content = NULL;
+  request = g_strconcat (object, "\n", NULL);
+  g_mutex_lock (&cat->write_lock);
+  ticket = cat->next_ticket++;
+  success = write_all (cat->in_fd, request, strlen (request), error);
+  g_mutex_unlock (&cat->write_lock);
+  g_free (request);
+  
+  /* wake up if cancelled while waiting for our turn */
+  if (cancellable) {
+    cancelled_id = g_cancellable_connect (cancellable,
+                                          G_CALLBACK (request_cancelled_handler),
+                                          cat, NULL);
+  }
+  g_mutex_lock (&cat->read_lock);
+  if (! success) {
+    cat_file_kill (cat);
+  }
+  while (! cat->dead && cat->reading != ticket &&
+         ! g_cancellable_is_cancelled (cancellable)) {
+    g_cond_wait (&cat->read_cond, &cat->read_lock);
+  }
+  if (! cat->dead && cat->reading != ticket) {
+    /* our response would be read by the next request */
+    g_cancellable_set_error_if_cancelled (cancellable, error);
+    cat_file_kill (cat);
+    success = FALSE;
+  } else if (cat->dead) {
+    if (success) {
+      g_set_error_literal (error, GGU_GIT_ERROR, GGU_GIT_ERROR_CRASHED,
+                           "Git terminated unexpectedly");
+    }
+    g_cond_broadcast (&cat->read_cond);
+    success = FALSE;
+  }
+  g_mutex_unlock (&cat->read_lock);
+  g_cancellable_disconnect (cancellable, cancelled_id);
+  if (! success) {
+    return FALSE;
+  }
+  
+  /* it's our turn, nobody else touches the buffer until we're done */
+  cat->cancel_fd = cancellable ? g_cancellable_get_fd (cancellable) : -1;
+  success = read_response (cat, object, content, length, error);
+  if (cat->cancel_fd >= 0) {
+    g_cancellable_release_fd (cancellable);
+    cat->cancel_fd = -1;
+  }
+  
+  g_mutex_lock (&cat->read_lock);
+  if (success) {
+    cat->reading++;
+    g_cond_broadcast (&cat->read_cond);
+  } else {
+    cat_file_kill (cat);
+  }
+  g_mutex_unlock (&cat->read_lock);
+  
+  return success;
+}
+
+/**
+ * _ggu_git_cat_file_get:
+ * @git_path: Path to Git
+ * @dir: The repository directory
+ * @object: The object to get, like "rev:path"
+ * @length: Return location for the length of the content, or %NULL
+ * @cancellable: A #GCancellable, or %NULL
+ * @error: Return location for errors, or %NULL to ignore them
+ * 
+ * Gets the content of a blob through the persistent `git cat-file --batch`
+ * process of the repository, starting it if needed.  This blocks, so it
+ * should only be called from a worker thread.
+ * 
+ * @object may not contain line feeds.
+ * 
+ * Returns: The content of the blob, followed by a terminating 0 not part of
+ *          @length, or %NULL on error
+ */
+gchar *
+_ggu_git_cat_file_get (const gchar   *git_path,
+                       const gchar   *dir,
+                       const gchar   *object,
+                       gsize         *length,
+                       GCancellable  *cancellable,
+                       GError       **error)
+{
+  gchar  *content = NULL;
+  guint   attempt;
+  
+  g_return_val_if_fail (git_path != NULL, NULL);
+  g_return_val_if_fail (object != NULL && ! strchr (object, '\n'), NULL);
+  
+  /* if the process died since last use, retry once with a new one */
+  for (attempt = 0; attempt < 2; attempt++) {
+    GError   *err = NULL;
+    CatFile  *cat;
+    gboolean  alive;
+    
+    if (g_cancellable_set_error_if_cancelled (cancellable, error)) {
+      break;
+    }
+    
+    cat = cat_file_acquire (git_path, dir, error);
+    if (! cat) {
+      break;
+    }
+    alive = cat_file_request (cat, object, &content, length, cancellable,
+                              &err);
+    cat_file_release (cat);
+    
+    if (alive || attempt > 0 ||
+        g_error_matches (err, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+      if (err) {
+        g_propagate_error (error, err);
+      }
+      break;
+    }
+    g_error_free (err);
+  }
+  
+  return content;
+}
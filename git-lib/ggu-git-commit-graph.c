@@ -0,0 +1,714 @@
+/*
+ * Copyright 2011 Colomban Wendling <ban@herbesfolles.org>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+/*
+ * Read-only access to a repository's commit-graph, without Git.
+ * 
+ * The commit-graph, either a single file or a chain of split graphs, gives
+ * the tree, parents and date of commits without having to inflate them.  It
+ * may also hold changed-path Bloom filters, telling which paths a commit
+ * surely didn't change compared to its first parent.
+ * 
+ * The format is described in Git's gitformat-commit-graph(5).
+ */
+
+#include "ggu-git-commit-graph.h"
+
+#include <string.h>
+#include <glib.h>
+
+#include "ggu-git-odb.h"
+#include "ggu-git-utils.h"
+
+
+#define CHUNK_ID(a, b, c, d) \
+  ((guint32) (a) << 24 | (guint32) (b) << 16 | (guint32) (c) << 8 | (guint32) (d))
+
+#define GRAPH_SIGNATURE       CHUNK_ID ('C', 'G', 'P', 'H')
+#define GRAPH_VERSION         1
+#define GRAPH_HASH_SHA1       1
+#define GRAPH_HEADER_SIZE     8
+#define GRAPH_CHUNK_SIZE      12    /* size of a chunk table entry */
+#define GRAPH_DATA_SIZE       (GGU_GIT_ODB_OID_SIZE + 16)
+#define GRAPH_PARENT_NONE     0x70000000
+#define GRAPH_EXTRA_EDGES     0x80000000
+#define GRAPH_LAST_EDGE       0x80000000
+
+#define CHUNK_OID_FANOUT      CHUNK_ID ('O', 'I', 'D', 'F')
+#define CHUNK_OID_LOOKUP      CHUNK_ID ('O', 'I', 'D', 'L')
+#define CHUNK_DATA            CHUNK_ID ('C', 'D', 'A', 'T')
+#define CHUNK_EXTRA_EDGES     CHUNK_ID ('E', 'D', 'G', 'E')
+#define CHUNK_BLOOM_INDEX     CHUNK_ID ('B', 'I', 'D', 'X')
+#define CHUNK_BLOOM_DATA      CHUNK_ID ('B', 'D', 'A', 'T')
+
+#define BLOOM_HEADER_SIZE     12
+#define BLOOM_SEED0           0x293ae76f
+#define BLOOM_SEED1           0x7e646e2c
+
+
+typedef struct _Layer Layer;
+struct _Layer
+{
+  GMappedFile  *map;
+  guint32       base;       /* number of commits in the layers below */
+  guint32       n_commits;
+  const guint8 *fanout;
+  const guint8 *oids;
+  const guint8 *data;
+  const guint8 *edges;
+  guint32       n_edges;
+  
+  /* changed-path Bloom filters, or NULL */
+  const guint8 *bloom_index;
+  const guint8 *bloom_data;
+  gsize         bloom_data_len;
+  guint32       bloom_version;
+  guint32       bloom_n_hashes;
+};
+
+struct _GguGitCommitGraph
+{
+  GPtrArray    *layers;       /* base layer first */
+  guint32       n_commits;
+  const Layer  *bloom_layer;  /* the one whose Bloom settings we use */
+};
+
+struct _GguGitBloomKey
+{
+  guint32   version;
+  guint32   n_hashes;
+  guint     n_keys;
+  guint32  *hashes;     /* @n_hashes hashes for each key */
+};
+
+
+static inline guint32
+get_be32 (const guint8 *p)
+{
+  return ((guint32) p[0] << 24) | ((guint32) p[1] << 16) |
+         ((guint32) p[2] << 8)  |  (guint32) p[3];
+}
+
+static inline guint64
+get_be64 (const guint8 *p)
+{
+  return ((guint64) get_be32 (p) << 32) | get_be32 (p + 4);
+}
+
+
+/* layers */
+
+static void
+layer_free (Layer *layer)
+{
+  g_mapped_file_unref (layer->map);
+  g_slice_free1 (sizeof *layer, layer);
+}
+
+static Layer *
+layer_load (const gchar *path,
+            guint        n_bases,
+            guint32      base)
+{
+  Layer        *layer;
+  GMappedFile  *map;
+  const guint8 *data;
+  gsize         len;
+  guint         n_chunks;
+  guint         i;
+  gsize         oids_len = 0;
+  gsize         data_len = 0;
+  gsize         bloom_index_len = 0;
+  
+  map = g_mapped_file_new (path, FALSE, NULL);
+  if (! map) {
+    return NULL;
+  }
+  data = (const guint8 *) g_mapped_file_get_contents (map);
+  len = g_mapped_file_get_length (map);
+  if (len < GRAPH_HEADER_SIZE ||
+      get_be32 (data) != GRAPH_SIGNATURE ||
+      data[4] != GRAPH_VERSION ||
+      data[5] != GRAPH_HASH_SHA1 ||
+      data[7] != n_bases) {
+    g_mapped_file_unref (map);
+    return NULL;
+  }
+  n_chunks = data[6];
+  if (len < GRAPH_HEADER_SIZE + (n_chunks + 1) * GRAPH_CHUNK_SIZE) {
+    g_mapped_file_unref (map);
+    return NULL;
+  }
+  
+  layer = g_slice_alloc0 (sizeof *layer);
+  layer->map = map;
+  layer->base = base;
+  for (i = 0; i < n_chunks; i++) {
+    const guint8 *entry = data + GRAPH_HEADER_SIZE + i * GRAPH_CHUNK_SIZE;
+    guint64       offset = get_be64 (entry + 4);
+    guint64       end = get_be64 (entry + GRAPH_CHUNK_SIZE + 4);
+    const guint8 *chunk = data + offset;
+    gsize         size;
+    
+    if (offset > end || end > len) {
+      layer_free (layer);
+      return NULL;
+    }
+    size = (gsize) (end - offset);
+    switch (get_be32 (entry)) {
+      case CHUNK_OID_FANOUT:
+        if (size == 256 * 4) {
+          layer->fanout = chunk;
+        }
+        break;
+      case CHUNK_OID_LOOKUP:
+        layer->oids = chunk;
+        oids_len = size;
+        break;
+      case CHUNK_DATA:
+        layer->data = chunk;
+        data_len = size;
+        break;
+      case CHUNK_EXTRA_EDGES:
+        layer->edges = chunk;
+        layer->n_edges = (guint32) MIN (size / 4, G_MAXUINT32);
+        break;
+      case CHUNK_BLOOM_INDEX:
+        layer->bloom_index = chunk;
+        bloom_index_len = size;
+        break;
+      case CHUNK_BLOOM_DATA:
+        if (size >= BLOOM_HEADER_SIZE) {
+          layer->bloom_version = get_be32 (chunk);
+          layer->bloom_n_hashes = get_be32 (chunk + 4);
+          layer->bloom_data = chunk + BLOOM_HEADER_SIZE;
+          layer->bloom_data_len = size - BLOOM_HEADER_SIZE;
+        }
+        break;
+    }
+  }
+  
+  if (! layer->fanout || ! layer->oids || ! layer->data) {
+    layer_free (layer);
+    return NULL;
+  }
+  layer->n_commits = get_be32 (layer->fanout + 255 * 4);
+  if (oids_len != (gsize) layer->n_commits * GGU_GIT_ODB_OID_SIZE ||
+      data_len != (gsize) layer->n_commits * GRAPH_DATA_SIZE ||
+      layer->n_commits >= GGU_GIT_COMMIT_GRAPH_NO_POS - base) {
+    layer_free (layer);
+    return NULL;
+  }
+  /* Bloom filters are optional, just ignore them if we don't get them */
+  if (! layer->bloom_index || ! layer->bloom_data ||
+      bloom_index_len != (gsize) layer->n_commits * 4 ||
+      (layer->bloom_version != 1 && layer->bloom_version != 2) ||
+      layer->bloom_n_hashes == 0 || layer->bloom_n_hashes > 32) {
+    layer->bloom_index = NULL;
+    layer->bloom_data = NULL;
+  }
+  
+  return layer;
+}
+
+static const Layer *
+find_layer (GguGitCommitGraph *graph,
+            guint32            pos)
+{
+  guint i;
+  
+  if (pos >= graph->n_commits) {
+    return NULL;
+  }
+  for (i = graph->layers->len; i > 0; i--) {
+    const Layer *layer = g_ptr_array_index (graph->layers, i - 1);
+    
+    if (pos >= layer->base) {
+      return layer;
+    }
+  }
+  
+  return NULL;
+}
+
+
+/* graph */
+
+/* checks whether the repository has anything that changes the parents of
+ * commits, in which case Git doesn't trust the graph either */
+static gboolean
+graph_compatible (GguGitOdb *odb)
+{
+  const gchar  *common_dir = _ggu_git_odb_get_common_dir (odb);
+  gchar        *path;
+  gchar        *contents;
+  gboolean      compatible = TRUE;
+  GDir         *dir;
+  
+  path = g_build_filename (common_dir, "shallow", NULL);
+  compatible = ! g_file_test (path, G_FILE_TEST_EXISTS);
+  g_free (path);
+  if (compatible) {
+    path = g_build_filename (common_dir, "info", "grafts", NULL);
+    compatible = ! g_file_test (path, G_FILE_TEST_EXISTS);
+    g_free (path);
+  }
+  if (compatible) {
+    path = g_build_filename (common_dir, "refs", "replace", NULL);
+    dir = g_dir_open (path, 0, NULL);
+    if (dir) {
+      compatible = g_dir_read_name (dir) == NULL;
+      g_dir_close (dir);
+    }
+    g_free (path);
+  }
+  if (compatible) {
+    path = g_build_filename (common_dir, "packed-refs", NULL);
+    if (g_file_get_contents (path, &contents, NULL, NULL)) {
+      compatible = strstr (contents, " refs/replace/") == NULL;
+      g_free (contents);
+    }
+    g_free (path);
+  }
+  
+  return compatible;
+}
+
+/* loads the split graph layers, stopping at the first one that isn't
+ * valid like Git does */
+static void
+load_chain (GguGitCommitGraph *graph,
+            const gchar       *graphs_dir)
+{
+  gchar  *path;
+  gchar  *contents;
+  gchar **lines;
+  guint   i;
+  
+  path = g_build_filename (graphs_dir, "commit-graph-chain", NULL);
+  if (! g_file_get_contents (path, &contents, NULL, NULL)) {
+    g_free (path);
+    return;
+  }
+  g_free (path);
+  
+  lines = g_strsplit (contents, "\n", 0);
+  for (i = 0; lines[i] && *lines[i]; i++) {
+    gchar *name;
+    Layer *layer;
+    
+    if (! ggu_git_is_hash (lines[i]) || graph->layers->len > 0xff) {
+      break;
+    }
+    name = g_strconcat ("graph-", lines[i], ".graph", NULL);
+    path = g_build_filename (graphs_dir, name, NULL);
+    layer = layer_load (path, graph->layers->len, graph->n_commits);
+    g_free (path);
+    g_free (name);
+    if (! layer) {
+      break;
+    }
+    g_ptr_array_add (graph->layers, layer);
+    graph->n_commits += layer->n_commits;
+  }
+  g_strfreev (lines);
+  g_free (contents);
+}
+
+/**
+ * _ggu_git_commit_graph_open:
+ * @odb: A #GguGitOdb
+ * 
+ * Loads the commit-graph of a repository.  The graph is a snapshot: commits
+ * created after it was written are not part of it.
+ * 
+ * Returns: A new #GguGitCommitGraph, or %NULL if the repository doesn't have
+ *          a usable one
+ */
+GguGitCommitGraph *
+_ggu_git_commit_graph_open (GguGitOdb *odb)
+{
+  GguGitCommitGraph  *graph;
+  gchar              *info_dir;
+  gchar              *path;
+  Layer              *layer;
+  guint               i;
+  
+  if (! graph_compatible (odb)) {
+    return NULL;
+  }
+  
+  graph = g_slice_alloc0 (sizeof *graph);
+  graph->layers = g_ptr_array_new_with_free_func ((GDestroyNotify) layer_free);
+  info_dir = g_build_filename (_ggu_git_odb_get_common_dir (odb),
+                               "objects", "info", NULL);
+  path = g_build_filename (info_dir, "commit-graph", NULL);
+  layer = layer_load (path, 0, 0);
+  g_free (path);
+  if (layer) {
+    g_ptr_array_add (graph->layers, layer);
+    graph->n_commits = layer->n_commits;
+  } else {
+    path = g_build_filename (info_dir, "commit-graphs", NULL);
+    load_chain (graph, path);
+    g_free (path);
+  }
+  g_free (info_dir);
+  
+  if (graph->layers->len == 0) {
+    _ggu_git_commit_graph_free (graph);
+    return NULL;
+  }
+  /* like Git, use the settings of the topmost layer with Bloom filters */
+  for (i = graph->layers->len; i > 0 && ! graph->bloom_layer; i--) {
+    layer = g_ptr_array_index (graph->layers, i - 1);
+    if (layer->bloom_data) {
+      graph->bloom_layer = layer;
+    }
+  }
+  
+  return graph;
+}
+
+void
+_ggu_git_commit_graph_free (GguGitCommitGraph *graph)
+{
+  g_ptr_array_free (graph->layers, TRUE);
+  g_slice_free1 (sizeof *graph, graph);
+}
+
+/**
+ * _ggu_git_commit_graph_find:
+ * @graph: A #GguGitCommitGraph
+ * @oid: The raw ID of a commit
+ * @pos: Return location for the position of the commit in the graph
+ * 
+ * Returns: Whether the commit is in the graph
+ */
+gboolean
+_ggu_git_commit_graph_find (GguGitCommitGraph *graph,
+                            const guint8      *oid,
+                            guint32           *pos)
+{
+  guint i;
+  
+  for (i = 0; i < graph->layers->len; i++) {
+    const Layer *layer = g_ptr_array_index (graph->layers, i);
+    guint32      lo = oid[0] ? get_be32 (layer->fanout + (oid[0] - 1) * 4) : 0;
+    guint32      hi = get_be32 (layer->fanout + oid[0] * 4);
+    
+    if (hi > layer->n_commits) {
+      continue;
+    }
+    while (lo < hi) {
+      guint32 mid = lo + (hi - lo) / 2;
+      gint    cmp = memcmp (layer->oids + (gsize) mid * GGU_GIT_ODB_OID_SIZE,
+                            oid, GGU_GIT_ODB_OID_SIZE);
+      
+      if (cmp == 0) {
+        *pos = layer->base + mid;
+        return TRUE;
+      } else if (cmp < 0) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+  }
+  
+  return FALSE;
+}
+
+/**
+ * _ggu_git_commit_graph_get_oid:
+ * @graph: A #GguGitCommitGraph
+ * @pos: The position of a commit in the graph
+ * 
+ * Returns: The raw ID of the commit, or %NULL if @pos is invalid
+ */
+const guint8 *
+_ggu_git_commit_graph_get_oid (GguGitCommitGraph *graph,
+                               guint32            pos)
+{
+  const Layer *layer = find_layer (graph, pos);
+  
+  if (! layer) {
+    return NULL;
+  }
+  
+  return layer->oids + (gsize) (pos - layer->base) * GGU_GIT_ODB_OID_SIZE;
+}
+
+/**
+ * _ggu_git_commit_graph_get_commit:
+ * @graph: A #GguGitCommitGraph
+ * @pos: The position of a commit in the graph
+ * @tree: Return location for the raw ID of the commit's tree
+ * @parents: A #GArray of #guint32 to fill with the graph positions of the
+ *           commit's parents
+ * @date: Return location for the committer date of the commit
+ * 
+ * Returns: %FALSE if @pos is invalid or the graph is corrupt
+ */
+gboolean
+_ggu_git_commit_graph_get_commit (GguGitCommitGraph *graph,
+                                  guint32            pos,
+                                  guint8             tree[GGU_GIT_ODB_OID_SIZE],
+                                  GArray            *parents,
+                                  gint64            *date)
+{
+  const Layer  *layer = find_layer (graph, pos);
+  const guint8 *p;
+  guint32       parent;
+  
+  if (! layer) {
+    return FALSE;
+  }
+  
+  p = layer->data + (gsize) (pos - layer->base) * GRAPH_DATA_SIZE;
+  memcpy (tree, p, GGU_GIT_ODB_OID_SIZE);
+  p += GGU_GIT_ODB_OID_SIZE;
+  
+  g_array_set_size (parents, 0);
+  parent = get_be32 (p);
+  if (parent != GRAPH_PARENT_NONE) {
+    if (parent >= graph->n_commits) {
+      return FALSE;
+    }
+    g_array_append_val (parents, parent);
+  }
+  parent = get_be32 (p + 4);
+  if (parent != GRAPH_PARENT_NONE) {
+    if (parent & GRAPH_EXTRA_EDGES) {
+      /* octopus merge, the other parents are in the extra edges list */
+      guint32 i = parent & ~GRAPH_EXTRA_EDGES;
+      guint32 edge;
+      
+      do {
+        if (i >= layer->n_edges) {
+          return FALSE;
+        }
+        edge = get_be32 (layer->edges + (gsize) i++ * 4);
+        parent = edge & ~GRAPH_LAST_EDGE;
+        if (parent >= graph->n_commits) {
+          return FALSE;
+        }
+        g_array_append_val (parents, parent);
+      } while (! (edge & GRAPH_LAST_EDGE));
+    } else if (parent >= graph->n_commits) {
+      return FALSE;
+    } else {
+      g_array_append_val (parents, parent);
+    }
+  }
+  /* the date uses the 34 lower bits, the rest is the generation number */
+  *date = (gint64) (get_be32 (p + 8) & 0x3) << 32 | get_be32 (p + 12);
+  
+  return TRUE;
+}
+
+
+/* changed-path Bloom filters */
+
+static inline guint32
+rotl32 (guint32 value,
+        guint   count)
+{
+  return (value << count) | (value >> (32 - count));
+}
+
+/* the version 1 filters were written hashing chars as signed, which gives
+ * different hashes for non-ASCII paths */
+static inline guint32
+hash_byte (gchar    c,
+           gboolean signed_chars)
+{
+  return signed_chars ? (guint32) (gint32) (gint8) c : (guint32) (guint8) c;
+}
+
+/* 32 bits Murmur3, as used by Git */
+static guint32
+murmur3 (guint32      seed,
+         const gchar *data,
+         gsize        len,
+         gboolean     signed_chars)
+{
+  const guint32 c1 = 0xcc9e2d51;
+  const guint32 c2 = 0x1b873593;
+  guint32       h = seed;
+  guint32       k;
+  gsize         i;
+  
+  for (i = 0; i + 4 <= len; i += 4) {
+    k = hash_byte (data[i], signed_chars) |
+        hash_byte (data[i + 1], signed_chars) << 8 |
+        hash_byte (data[i + 2], signed_chars) << 16 |
+        hash_byte (data[i + 3], signed_chars) << 24;
+    k *= c1;
+    k = rotl32 (k, 15);
+    k *= c2;
+    h ^= k;
+    h = rotl32 (h, 13);
+    h = h * 5 + 0xe6546b64;
+  }
+  
+  k = 0;
+  switch (len & 3) {
+    case 3: k ^= hash_byte (data[i + 2], signed_chars) << 16; /* fallthrough */
+    case 2: k ^= hash_byte (data[i + 1], signed_chars) << 8;  /* fallthrough */
+    case 1:
+      k ^= hash_byte (data[i], signed_chars);
+      k *= c1;
+      k = rotl32 (k, 15);
+      k *= c2;
+      h ^= k;
+  }
+  
+  h ^= (guint32) len;
+  h ^= h >> 16;
+  h *= 0x85ebca6b;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35;
+  h ^= h >> 16;
+  
+  return h;
+}
+
+/**
+ * _ggu_git_commit_graph_bloom_key_new:
+ * @graph: A #GguGitCommitGraph
+ * @path: A path relative to the repository root
+ * 
+ * Prepares a Bloom filter query for @path and all its leading directories,
+ * like Git does.
+ * 
+ * Returns: A new #GguGitBloomKey, or %NULL if @graph has no Bloom filters
+ */
+GguGitBloomKey *
+_ggu_git_commit_graph_bloom_key_new (GguGitCommitGraph *graph,
+                                     const gchar       *path)
+{
+  const Layer    *layer = graph->bloom_layer;
+  GguGitBloomKey *key;
+  gsize           len = strlen (path);
+  guint           i;
+  
+  while (len > 0 && path[len - 1] == '/') {
+    len--;
+  }
+  if (! layer || len == 0) {
+    return NULL;
+  }
+  
+  key = g_slice_alloc (sizeof *key);
+  key->version = layer->bloom_version;
+  key->n_hashes = layer->bloom_n_hashes;
+  key->n_keys = 1;
+  for (i = 0; i < len; i++) {
+    if (path[i] == '/') {
+      key->n_keys++;
+    }
+  }
+  key->hashes = g_new (guint32, key->n_keys * key->n_hashes);
+  for (i = 0; i < key->n_keys; i++) {
+    guint32 *hashes = key->hashes + i * key->n_hashes;
+    guint32  h0 = murmur3 (BLOOM_SEED0, path, len, key->version == 1);
+    guint32  h1 = murmur3 (BLOOM_SEED1, path, len, key->version == 1);
+    guint32  j;
+    
+    for (j = 0; j < key->n_hashes; j++) {
+      hashes[j] = h0 + j * h1;
+    }
+    /* next leading directory */
+    do {
+      len--;
+    } while (len > 0 && path[len] != '/');
+  }
+  
+  return key;
+}
+
+void
+_ggu_git_commit_graph_bloom_key_free (GguGitBloomKey *key)
+{
+  if (key) {
+    g_free (key->hashes);
+    g_slice_free1 (sizeof *key, key);
+  }
+}
+
+/**
+ * _ggu_git_commit_graph_maybe_changed:
+ * @graph: A #GguGitCommitGraph
+ * @pos: The position of a commit in the graph
+ * @key: A #GguGitBloomKey
+ * 
+ * Checks the Bloom filter of a commit to know whether it might have changed
+ * the path of @key compared to its first parent.
+ * 
+ * Returns: %FALSE if the commit surely didn't change the path, %TRUE if it
+ *          may have
+ */
+gboolean
+_ggu_git_commit_graph_maybe_changed (GguGitCommitGraph    *graph,
+                                     guint32               pos,
+                                     const GguGitBloomKey *key)
+{
+  const Layer  *layer = find_layer (graph, pos);
+  const guint8 *filter;
+  guint32       lex_pos;
+  guint32       start;
+  guint32       end;
+  guint64       n_bits;
+  guint         i;
+  
+  if (! layer || ! layer->bloom_data ||
+      layer->bloom_version != key->version ||
+      layer->bloom_n_hashes != key->n_hashes) {
+    return TRUE;
+  }
+  
+  lex_pos = pos - layer->base;
+  start = lex_pos > 0 ? get_be32 (layer->bloom_index + (lex_pos - 1) * 4) : 0;
+  end = get_be32 (layer->bloom_index + lex_pos * 4);
+  if (start >= end || end > layer->bloom_data_len) {
+    /* empty or invalid filter, we don't know anything */
+    return TRUE;
+  }
+  filter = layer->bloom_data + start;
+  n_bits = (guint64) (end - start) * 8;
+  
+  /* all of the path and its leading directories have to be in the filter */
+  for (i = 0; i < key->n_keys; i++) {
+    const guint32  *hashes = key->hashes + i * key->n_hashes;
+    guint32         j;
+    
+    for (j = 0; j < key->n_hashes; j++) {
+      guint64 bit = hashes[j] % n_bits;
+      
+      if (! (filter[bit / 8] & (1 << (bit % 8)))) {
+        return FALSE;
+      }
+    }
+  }
+  
+  return TRUE;
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright 2011 Colomban Wendling <ban@herbesfolles.org>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+#ifndef H_GGU_GIT_COMMIT_GRAPH
+#define H_GGU_GIT_COMMIT_GRAPH
+
+#include <glib.h>
+
+#include "ggu-git-odb.h"
+
+G_BEGIN_DECLS
+
+
+/* position of a commit not in the graph */
+#define GGU_GIT_COMMIT_GRAPH_NO_POS G_MAXUINT32
+
+typedef struct _GguGitCommitGraph GguGitCommitGraph;
+typedef struct _GguGitBloomKey    GguGitBloomKey;
+
+
+GguGitCommitGraph  *_ggu_git_commit_graph_open        (GguGitOdb *odb);
+void                _ggu_git_commit_graph_free        (GguGitCommitGraph *graph);
+gboolean            _ggu_git_commit_graph_find        (GguGitCommitGraph *graph,
+                                                       const guint8      *oid,
+                                                       guint32           *pos);
+const guint8       *_ggu_git_commit_graph_get_oid     (GguGitCommitGraph *graph,
+                                                       guint32            pos);
+gboolean            _ggu_git_commit_graph_get_commit  (GguGitCommitGraph *graph,
+                                                       guint32            pos,
+                                                       guint8             tree[GGU_GIT_ODB_OID_SIZE],
+                                                       GArray            *parents,
+                                                       gint64            *date);
+GguGitBloomKey     *_ggu_git_commit_graph_bloom_key_new
+                                                      (GguGitCommitGraph *graph,
+                                                       const gchar       *path);
+void                _ggu_git_commit_graph_bloom_key_free
+                                                      (GguGitBloomKey *key);
+gboolean            _ggu_git_commit_graph_maybe_changed
+                                                      (GguGitCommitGraph    *graph,
+                                                       guint32               pos,
+                                                       const GguGitBloomKey *key);
+
+
+G_END_DECLS
+
+#endif /* guard */
@@ -33,6 +33,13 @@ G_DEFINE_BOXED_TYPE (GguGitFilesChangedEntry,
                      ggu_git_files_changed_entry_unref)
 
 
+/**
+ * ggu_git_files_changed_entry_new:
+ * 
+ * Creates a new entry owning all its fields.
+ * 
+ * Returns: A new #GguGitFilesChangedEntry
+ */
 GguGitFilesChangedEntry *
 ggu_git_files_changed_entry_new (void)
 {
@@ -40,6 +47,29 @@ ggu_git_files_changed_entry_new (void)
   
   entry = g_slice_alloc0 (sizeof *entry);
   entry->ref_count = 1;
+  entry->owned = GGU_GIT_FILES_CHANGED_ENTRY_OWNS_ALL;
+  
+  return entry;
+}
+
+/**
+ * ggu_git_files_changed_entry_new_with_buffer:
+ * @buffer: A #GguGitBuffer
+ * 
+ * Creates a new entry whose paths may point inside @buffer.  The caller
+ * should set the paths it allocates separately in the entry's @owned flags.
+ * 
+ * Returns: A new #GguGitFilesChangedEntry, holding a reference to @buffer
+ */
+GguGitFilesChangedEntry *
+ggu_git_files_changed_entry_new_with_buffer (GguGitBuffer *buffer)
+{
+  GguGitFilesChangedEntry *entry;
+  
+  entry = g_slice_alloc0 (sizeof *entry);
+  entry->ref_count = 1;
+  entry->buffer = ggu_git_buffer_ref (buffer);
+  entry->owned = 0;
   
   return entry;
 }
@@ -55,8 +85,67 @@ void
 ggu_git_files_changed_entry_unref (GguGitFilesChangedEntry *entry)
 {
   if (g_atomic_int_dec_and_test (&entry->ref_count)) {
-    g_free (entry->hash);
-    g_free (entry->path);
+    if (entry->oid) {
+      ggu_git_oid_unref (entry->oid);
+    }
+    if (entry->display_path != entry->path) {
+      g_free ((gchar *) entry->display_path);
+    }
+    if (entry->owned & GGU_GIT_FILES_CHANGED_ENTRY_OWNS_PATH) {
+      g_free (entry->path);
+    }
+    if (entry->owned & GGU_GIT_FILES_CHANGED_ENTRY_OWNS_OLD_PATH) {
+      g_free (entry->old_path);
+    }
+    if (entry->buffer) {
+      ggu_git_buffer_unref (entry->buffer);
+    }
     g_slice_free1 (sizeof *entry, entry);
   }
 }
+
+/* whether g_strescape() would change @str */
+static gboolean
+needs_escaping (const gchar *str)
+{
+  for (; *str; str++) {
+    guchar c = (guchar) *str;
+    
+    if (c < 0x20 || c >= 0x7f || c == '\\') {
+      return TRUE;
+    }
+  }
+  
+  return FALSE;
+}
+
+/**
+ * ggu_git_files_changed_entry_update_display:
+ * @entry: A #GguGitFilesChangedEntry
+ * 
+ * Computes the display strings of @entry from its other fields, so they
+ * don't need computing each time the entry is shown.  This should be called
+ * after setting the other fields.
+ */
+void
+ggu_git_files_changed_entry_update_display (GguGitFilesChangedEntry *entry)
+{
+  if (entry->display_path != entry->path) {
+    g_free ((gchar *) entry->display_path);
+  }
+  if (entry->old_path) {
+    gchar *path = g_strconcat (entry->old_path, " => ", entry->path, NULL);
+    
+    entry->display_path = g_strescape (path, "\"");
+    g_free (path);
+  } else if (entry->path && needs_escaping (entry->path)) {
+    entry->display_path = g_strescape (entry->path, "\"");
+  } else {
+    /* most paths display as they are, share them */
+    entry->display_path = entry->path;
+  }
+  g_snprintf (entry->added_text, sizeof entry->added_text,
+              "+%u", entry->added);
+  g_snprintf (entry->removed_text, sizeof entry->removed_text,
+              "-%u", entry->removed);
+}
@@ -25,28 +25,53 @@
 #include <glib.h>
 #include <glib-object.h>
 
+#include "ggu-git-buffer.h"
+#include "ggu-git-oid.h"
+
 G_BEGIN_DECLS
 
 
 #define GGU_TYPE_GIT_FILES_CHANGED_ENTRY (ggu_git_files_changed_entry_get_type ())
 
+/* fields an entry allocated itself, the others point inside its buffer */
+typedef enum
+{
+  GGU_GIT_FILES_CHANGED_ENTRY_OWNS_PATH     = 1 << 0,
+  GGU_GIT_FILES_CHANGED_ENTRY_OWNS_OLD_PATH = 1 << 1,
+  GGU_GIT_FILES_CHANGED_ENTRY_OWNS_ALL      = (1 << 2) - 1
+} GguGitFilesChangedEntryOwnership;
+
 
 typedef struct _GguGitFilesChangedEntry GguGitFilesChangedEntry;
 struct _GguGitFilesChangedEntry
 {
-  gint    ref_count;
+  gint        ref_count;
+  
+  GguGitOid    *oid; /* the revision for which these changes applies */
+  gchar        *path;
+  gchar        *old_path; /* the path before a rename, or %NULL */
+  guint         added;
+  guint         removed;
+  
+  /* display strings, see ggu_git_files_changed_entry_update_display() */
+  const gchar  *display_path;
+  gchar         added_text[12];   /* "+" and the count */
+  gchar         removed_text[12]; /* "-" and the count */
   
-  gchar  *hash; /* the revision for which these changes applies */
-  gchar  *path;
-  guint   added;
-  guint   removed;
+  /*< private >*/
+  GguGitBuffer                     *buffer;
+  GguGitFilesChangedEntryOwnership  owned;
 };
 
 
 GType                     ggu_git_files_changed_entry_get_type  (void) G_GNUC_CONST;
 GguGitFilesChangedEntry  *ggu_git_files_changed_entry_new       (void);
+GguGitFilesChangedEntry  *ggu_git_files_changed_entry_new_with_buffer
+                                                                (GguGitBuffer *buffer);
 GguGitFilesChangedEntry  *ggu_git_files_changed_entry_ref       (GguGitFilesChangedEntry *entry);
 void                      ggu_git_files_changed_entry_unref     (GguGitFilesChangedEntry *entry);
+void                      ggu_git_files_changed_entry_update_display
+                                                                (GguGitFilesChangedEntry *entry);
 
 
 G_END_DECLS
@@ -25,6 +25,7 @@
 #include <glib-object.h>
 
 #include "ggu-glib-compat.h"
+#include "ggu-git-utils.h"
 
 
 G_DEFINE_BOXED_TYPE (GguGitLogEntry,
@@ -33,6 +34,13 @@ G_DEFINE_BOXED_TYPE (GguGitLogEntry,
                      ggu_git_log_entry_unref)
 
 
+/**
+ * ggu_git_log_entry_new:
+ * 
+ * Creates a new entry owning all its fields.
+ * 
+ * Returns: A new #GguGitLogEntry
+ */
 GguGitLogEntry *
 ggu_git_log_entry_new (void)
 {
@@ -40,6 +48,29 @@ ggu_git_log_entry_new (void)
   
   entry = g_slice_alloc0 (sizeof *entry);
   entry->ref_count = 1;
+  entry->owned = GGU_GIT_LOG_ENTRY_OWNS_ALL;
+  
+  return entry;
+}
+
+/**
+ * ggu_git_log_entry_new_with_buffer:
+ * @buffer: A #GguGitBuffer
+ * 
+ * Creates a new entry whose fields may point inside @buffer.  The caller
+ * should set the fields it allocates separately in the entry's @owned flags.
+ * 
+ * Returns: A new #GguGitLogEntry, holding a reference to @buffer
+ */
+GguGitLogEntry *
+ggu_git_log_entry_new_with_buffer (GguGitBuffer *buffer)
+{
+  GguGitLogEntry *entry;
+  
+  entry = g_slice_alloc0 (sizeof *entry);
+  entry->ref_count = 1;
+  entry->buffer = ggu_git_buffer_ref (buffer);
+  entry->owned = 0;
   
   return entry;
 }
@@ -55,11 +86,138 @@ void
 ggu_git_log_entry_unref (GguGitLogEntry *entry)
 {
   if (g_atomic_int_dec_and_test (&entry->ref_count)) {
-    g_free (entry->hash);
-    g_free (entry->date);
-    g_free (entry->author);
-    g_free (entry->summary);
+    if (entry->oid) {
+      ggu_git_oid_unref (entry->oid);
+    }
+    if (entry->author) {
+      ggu_git_interned_unref (entry->author);
+    }
+    if (entry->owned & GGU_GIT_LOG_ENTRY_OWNS_SUMMARY) {
+      g_free (entry->summary);
+    }
     g_free (entry->details);
+    if (entry->buffer) {
+      ggu_git_buffer_unref (entry->buffer);
+    }
+    g_free (entry->date);
     g_slice_free1 (sizeof *entry, entry);
   }
 }
+
+/**
+ * ggu_git_log_entry_update_display:
+ * @entry: A #GguGitLogEntry
+ * 
+ * Computes the display strings of @entry from its other fields, so they
+ * don't need computing each time the entry is shown.  This should be called
+ * after setting the other fields; #GguGitLog does it when parsing.
+ */
+void
+ggu_git_log_entry_update_display (GguGitLogEntry *entry)
+{
+  gchar hex[GGU_GIT_OID_HEX_SIZE] = "";
+  
+  if (entry->oid) {
+    ggu_git_oid_to_hex (entry->oid, hex);
+  }
+  g_strlcpy (entry->short_hash, hex, sizeof entry->short_hash);
+}
+
+
+/* the day part of the dates, as most of them share the day of a neighbour */
+#define DAY_CACHE_SIZE 64
+
+typedef struct _DayCacheSlot DayCacheSlot;
+struct _DayCacheSlot
+{
+  gboolean  valid;
+  gint64    day;
+  gchar     text[32];
+};
+
+G_LOCK_DEFINE_STATIC (day_cache);
+static DayCacheSlot day_cache[DAY_CACHE_SIZE];
+
+/* formats "Wdy, D Mon YYYY" for @day days since the Epoch, converted to a
+ * civil date as described at
+ * http://howardhinnant.github.io/date_algorithms.html#civil_from_days */
+static void
+format_day (gint64  day,
+            gchar  *text,
+            gsize   size)
+{
+  static const gchar *const days[] = {
+    "Mon", "Tue", "Wed", "Thu", "Fri", "Sat", "Sun"
+  };
+  static const gchar *const months[] = {
+    "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+    "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+  };
+  gint64  z = day + 719468;
+  gint64  era = (z >= 0 ? z : z - 146096) / 146097;
+  guint   doe = (guint) (z - era * 146097);
+  guint   yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  guint   doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  guint   mp = (5 * doy + 2) / 153;
+  guint   mday = doy - (153 * mp + 2) / 5 + 1;
+  guint   month = mp < 10 ? mp + 3 : mp - 9;
+  gint64  year = yoe + era * 400 + (month <= 2);
+  /* the Epoch was a Thursday */
+  gint    wday = (gint) (((day + 3) % 7 + 7) % 7);
+  
+  g_snprintf (text, size, "%s, %u %s %" G_GINT64_FORMAT,
+              days[wday], mday, months[month - 1], year);
+}
+
+/* like Git's RFC 2822 date format, used by %aD */
+static gchar *
+format_date (gint64 timestamp,
+             gint   tz_offset)
+{
+  gint64        local = timestamp + tz_offset * 60;
+  gint64        day = (local >= 0 ? local : local - 86399) / 86400;
+  gint          seconds = (gint) (local - day * 86400);
+  guint         tz = (guint) ABS (tz_offset);
+  DayCacheSlot *slot = &day_cache[(guint64) day % DAY_CACHE_SIZE];
+  gchar        *str;
+  
+  G_LOCK (day_cache);
+  if (! slot->valid || slot->day != day) {
+    format_day (day, slot->text, sizeof slot->text);
+    slot->day = day;
+    slot->valid = TRUE;
+  }
+  str = g_strdup_printf ("%s %02d:%02d:%02d %c%02u%02u",
+                         slot->text,
+                         seconds / 3600, seconds / 60 % 60, seconds % 60,
+                         tz_offset < 0 ? '-' : '+', tz / 60, tz % 60);
+  G_UNLOCK (day_cache);
+  
+  return str;
+}
+
+/**
+ * ggu_git_log_entry_get_date:
+ * @entry: A #GguGitLogEntry
+ * 
+ * Gets the displayable author date of @entry.  It is only formatted the first
+ * time it is requested, so entries that are never shown don't pay for it.
+ * 
+ * Returns: The date of @entry, owned by @entry
+ */
+const gchar *
+ggu_git_log_entry_get_date (GguGitLogEntry *entry)
+{
+  gchar *date = g_atomic_pointer_get (&entry->date);
+  
+  if (! date) {
+    date = format_date (entry->timestamp, entry->tz_offset);
+    if (! g_atomic_pointer_compare_and_exchange ((gpointer *) &entry->date,
+                                                 NULL, date)) {
+      g_free (date);
+      date = g_atomic_pointer_get (&entry->date);
+    }
+  }
+  
+  return date;
+}
@@ -25,30 +25,56 @@
 #include <glib.h>
 #include <glib-object.h>
 
+#include "ggu-git-buffer.h"
+#include "ggu-git-oid.h"
+
 G_BEGIN_DECLS
 
 
 #define GGU_TYPE_GIT_LOG_ENTRY (ggu_git_log_entry_get_type ())
 
+#define GGU_GIT_LOG_ENTRY_SHORT_HASH_LENGTH 7
+
+/* fields an entry allocated itself, the others point inside its buffer */
+typedef enum
+{
+  GGU_GIT_LOG_ENTRY_OWNS_SUMMARY  = 1 << 0,
+  GGU_GIT_LOG_ENTRY_OWNS_ALL      = (1 << 1) - 1
+} GguGitLogEntryOwnership;
+
 
 typedef struct _GguGitLogEntry GguGitLogEntry;
 struct _GguGitLogEntry
 {
-  gint      ref_count;
+  gint          ref_count;
+  
+  GguGitOid    *oid;
+  gint64        timestamp;  /* author date, in seconds since the Epoch */
+  gint          tz_offset;  /* author timezone, in minutes east of UTC */
+  const gchar  *author; /* interned, see ggu_git_intern_utf8() */
+  gchar        *summary;
+  gchar        *details; /* %NULL until loaded, see
+                          * ggu_git_log_load_details_async() */
+  
+  /* display strings, see ggu_git_log_entry_update_display() */
+  gchar         short_hash[GGU_GIT_LOG_ENTRY_SHORT_HASH_LENGTH + 1];
   
-  /*guint64   hash;*/
-  gchar    *hash;
-  gchar    *date; /* TODO: use a date repsentation? */
-  gchar    *author;
-  gchar    *summary;
-  gchar    *details;
+  /*< private >*/
+  GguGitBuffer             *buffer;
+  GguGitLogEntryOwnership   owned;
+  gchar                    *date; /* see ggu_git_log_entry_get_date() */
 };
 
 
 GType             ggu_git_log_entry_get_type  (void) G_GNUC_CONST;
 GguGitLogEntry   *ggu_git_log_entry_new       (void);
+GguGitLogEntry   *ggu_git_log_entry_new_with_buffer
+                                              (GguGitBuffer *buffer);
 GguGitLogEntry   *ggu_git_log_entry_ref       (GguGitLogEntry *entry);
 void              ggu_git_log_entry_unref     (GguGitLogEntry *entry);
+void              ggu_git_log_entry_update_display
+                                              (GguGitLogEntry *entry);
+const gchar      *ggu_git_log_entry_get_date  (GguGitLogEntry *entry);
 
 
 G_END_DECLS
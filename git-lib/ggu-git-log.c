@@ -22,6 +22,9 @@
 #include "ggu-git-log.h"
 
 #include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/wait.h>
 #include <glib.h>
 #include <glib-object.h>
 #include <gio/gio.h>
@@ -29,7 +32,12 @@
 #include "ggu-glib-compat.h"
 #include "ggu-git.h"
 #include "ggu-git-utils.h"
+#include "ggu-git-cache.h"
 #include "ggu-git-log-entry.h"
+#include "ggu-git-odb.h"
+#include "ggu-git-oid.h"
+#include "ggu-git-rev-walk.h"
+#include "ggu-git-scheduler.h"
 
 
 GQuark
@@ -47,8 +55,20 @@ ggu_git_log_error_quark (void)
 
 struct _GguGitLogPrivate
 {
-  gchar *rev;
-  gchar *file;
+  gchar          *rev;
+  gchar          *file;
+  guint           max_count;
+  
+  /* paging state */
+  guint           serial;         /* incremented for each new log */
+  guint           n_loaded;       /* entries already given to the caller */
+  guint           page_max_count; /* max-count of the running page */
+  gboolean        complete;
+  gboolean        native;         /* whether to walk the history ourselves */
+  GguGitOdb      *odb;
+  GguGitRevWalk  *walk;           /* the walk to resume, if any */
+  
+  GPtrArray      *details_entries; /* entries of the running details load */
 };
 
 enum
@@ -56,7 +76,15 @@ enum
   PROP_0,
   
   PROP_REV,
-  PROP_FILE
+  PROP_FILE,
+  PROP_MAX_COUNT
+};
+
+enum
+{
+  SIGNAL_ENTRIES_ADDED,
+  
+  N_SIGNALS
 };
 
 
@@ -69,6 +97,9 @@ static void         ggu_git_log_set_property        (GObject       *object,
                                                      const GValue  *value,
                                                      GParamSpec    *pspec);
 static void         ggu_git_log_finalize            (GObject *object);
+static void         ggu_git_log_drop_walk           (GguGitLog *self);
+static void         ggu_git_log_drop_details_entries
+                                                    (GguGitLog *self);
 
 
 G_DEFINE_TYPE (GguGitLog,
@@ -76,6 +107,8 @@ G_DEFINE_TYPE (GguGitLog,
                GGU_TYPE_GIT)
 
 
+static guint signals[N_SIGNALS] = { 0 };
+
 static void
 ggu_git_log_class_init (GguGitLogClass *klass)
 {
@@ -99,6 +132,38 @@ ggu_git_log_class_init (GguGitLogClass *klass)
                                                         NULL,
                                                         G_PARAM_READWRITE |
                                                         G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (object_class, PROP_MAX_COUNT,
+                                   g_param_spec_uint ("max-count",
+                                                      "Max count",
+                                                      "The maximum number of entries to get at once, or 0 for no limit",
+                                                      0, G_MAXUINT, 0,
+                                                      G_PARAM_READWRITE |
+                                                      G_PARAM_STATIC_STRINGS));
+  
+  /**
+   * GguGitLog::entries-added:
+   * @self: The object that received the signal
+   * @entries: (element-type GguGitLogEntry) (transfer none): The new entries
+   * 
+   * This signal is emitted in the main thread while a log operation runs,
+   * each time a batch of entries is available, and always before the
+   * operation completes.
+   * 
+   * If an identical operation was already running the two share their
+   * work, and the signal is only emitted on the object that started it.  The
+   * list given by ggu_git_log_log_finish() however always holds all the
+   * entries, starting with the ones already signaled.
+   */
+  signals[SIGNAL_ENTRIES_ADDED] = g_signal_new (
+    "entries-added",
+    GGU_TYPE_GIT_LOG,
+    G_SIGNAL_RUN_LAST,
+    G_STRUCT_OFFSET (GguGitLogClass, entries_added),
+    NULL, NULL,
+    g_cclosure_marshal_VOID__POINTER,
+    G_TYPE_NONE,
+    1,
+    G_TYPE_POINTER);
   
   g_type_class_add_private (klass, sizeof (GguGitLogPrivate));
 }
@@ -112,6 +177,14 @@ ggu_git_log_init (GguGitLog *self)
   
   self->priv->rev = NULL;
   self->priv->file = NULL;
+  self->priv->max_count = 0;
+  self->priv->serial = 0;
+  self->priv->n_loaded = 0;
+  self->priv->page_max_count = 0;
+  self->priv->complete = FALSE;
+  self->priv->native = FALSE;
+  self->priv->odb = NULL;
+  self->priv->walk = NULL;
 }
 
 static void
@@ -131,6 +204,10 @@ ggu_git_log_get_property (GObject    *object,
       g_value_set_string (value, self->priv->file);
       break;
     
+    case PROP_MAX_COUNT:
+      g_value_set_uint (value, self->priv->max_count);
+      break;
+    
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -166,6 +243,15 @@ ggu_git_log_set_property (GObject      *object,
       }
     } break;
     
+    case PROP_MAX_COUNT: {
+      guint max_count = g_value_get_uint (value);
+      
+      if (self->priv->max_count != max_count) {
+        self->priv->max_count = max_count;
+        g_object_notify_by_pspec (object, pspec);
+      }
+    } break;
+    
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -181,6 +267,8 @@ ggu_git_log_finalize (GObject *object)
   self->priv->rev = NULL;
   g_free (self->priv->file);
   self->priv->file = NULL;
+  ggu_git_log_drop_walk (self);
+  ggu_git_log_drop_details_entries (self);
   
   G_OBJECT_CLASS (ggu_git_log_parent_class)->finalize (object);
 }
@@ -193,44 +281,62 @@ ggu_git_log_new (void)
   return g_object_new (GGU_TYPE_GIT_LOG, NULL);
 }
 
-/*
- * parse_message:
- * @msg: a raw commit message
- * 
- * Reformats @msg.
- * 
- * Returns: The reformatted message.
- */
+static void
+ggu_git_log_drop_walk (GguGitLog *self)
+{
+  if (self->priv->walk) {
+    _ggu_git_rev_walk_free (self->priv->walk);
+    self->priv->walk = NULL;
+  }
+  if (self->priv->odb) {
+    _ggu_git_odb_unref (self->priv->odb);
+    self->priv->odb = NULL;
+  }
+}
+
+static void
+ggu_git_log_drop_details_entries (GguGitLog *self)
+{
+  if (self->priv->details_entries) {
+    g_ptr_array_free (self->priv->details_entries, TRUE);
+    self->priv->details_entries = NULL;
+  }
+}
+
+/* returns @str if it is valid UTF-8, or a valid copy the entry owns */
 static gchar *
-parse_message (const gchar *msg)
+entry_take_string (GguGitLogEntry          *entry,
+                   gchar                   *str,
+                   GguGitLogEntryOwnership  field)
 {
-  GString  *builder;
-  gboolean  prev_newline = FALSE;
-  gchar    *formatted;
+  gchar *valid = ggu_git_utf8_normalize (str, strlen (str), FALSE);
   
-  builder = g_string_new (NULL);
-  while (*msg) {
-    gunichar wc = g_utf8_get_char_validated (msg, -1);
-    
-    if (G_UNLIKELY (wc & 0x80000000)) {
-      /* replace invalid UTF-8 characters by U+FFFD */
-      g_string_append_unichar (builder, 0xfffd);
-      prev_newline = FALSE;
-      msg ++;
-    } else {
-      if (! prev_newline && *msg == '\n' && g_unichar_isalnum (msg[1])) {
-        /* transform this newline by a space */
-        g_string_append_c (builder, ' ');
-      } else {
-        g_string_append_unichar (builder, wc);
-      }
-      prev_newline = *msg == '\n';
-      msg = g_utf8_next_char (msg);
-    }
+  if (G_LIKELY (! valid)) {
+    return str;
   }
+  entry->owned |= field;
   
-  formatted = g_string_free (builder, FALSE);
-  return g_strchomp (formatted);
+  return valid;
+}
+
+static GguGitLogEntry *
+log_entry_new (GguGitOid   *oid,
+               gint64       timestamp,
+               gint         tz_offset,
+               const gchar *author,
+               const gchar *summary)
+{
+  GguGitLogEntry *entry;
+  
+  entry = ggu_git_log_entry_new ();
+  entry->oid     = oid;
+  entry->timestamp = timestamp;
+  entry->tz_offset = tz_offset;
+  entry->author  = ggu_git_intern_utf8 (author);
+  entry->summary = ggu_git_utf8_ensure_valid (summary);
+  ggu_git_log_entry_update_display (entry);
+  
+  return entry;
 }
 
 static void
@@ -239,59 +345,278 @@ entry_list_unref (GList *entries)
   g_list_free_full (entries, (GDestroyNotify) ggu_git_log_entry_unref);
 }
 
+/* GguGitLog::entries-added emission from the parsing thread.  The emission
+ * is deferred to the main thread in an idle of the same priority as the
+ * operation completion, so it always happens before it */
+
+typedef struct _EntriesAdded EntriesAdded;
+struct _EntriesAdded
+{
+  GguGitLog  *self;
+  GList      *entries;
+};
+
+static gboolean
+entries_added_idle (gpointer data)
+{
+  EntriesAdded *added = data;
+  
+  g_signal_emit (added->self, signals[SIGNAL_ENTRIES_ADDED], 0,
+                 added->entries);
+  
+  return FALSE;
+}
+
+static void
+entries_added_free (EntriesAdded *added)
+{
+  g_object_unref (added->self);
+  entry_list_unref (added->entries);
+  g_slice_free1 (sizeof *added, added);
+}
+
+/* @entries is a list of references to new entries, in order */
 static void
-ggu_git_log_parse_output (GguGit             *obj,
-                          const gchar        *output,
-                          GSimpleAsyncResult *result,
-                          GCancellable       *cancellable)
+queue_entries_added (GguGitLog *self,
+                     GList     *entries)
 {
-  gchar **chunks;
-  gsize   i = 0;
-  GList  *entries = NULL;
+  EntriesAdded *added;
   
-  chunks = g_strsplit (output, "\xff", -1);
-  for (i = 0; chunks[i] && (chunks[i][0] != '\n' || chunks[i][1]); i += 5) {
-    GError         *error = NULL;
+  added = g_slice_alloc (sizeof *added);
+  added->self     = g_object_ref (self);
+  added->entries  = entries;
+  g_idle_add_full (G_PRIORITY_DEFAULT, entries_added_idle, added,
+                   (GDestroyNotify) entries_added_free);
+}
+
+#define N_FIELDS 4
+
+typedef struct _LogParser LogParser;
+struct _LogParser
+{
+  GguGitParser  parent;
+  GList        *entries;
+  GPtrArray    *fields;   /* N_FIELDS for each complete entry of a chunk */
+};
+
+/* converts a Git timezone (+/-HHMM) to minutes east of UTC */
+static inline gint
+tz_to_minutes (gint tz)
+{
+  gint minutes = ABS (tz) / 100 * 60 + ABS (tz) % 100;
+  
+  return tz < 0 ? -minutes : minutes;
+}
+
+/* parses Git's raw date format, "<timestamp> <+/-HHMM>" */
+static gboolean
+parse_raw_date (const gchar *str,
+                gint64      *timestamp,
+                gint        *tz_offset)
+{
+  gchar *end;
+  
+  if (! g_ascii_isdigit (*str)) {
+    return FALSE;
+  }
+  *timestamp = (gint64) g_ascii_strtoull (str, &end, 10);
+  while (*end == ' ') {
+    end++;
+  }
+  if ((*end != '+' && *end != '-') || ! g_ascii_isdigit (end[1])) {
+    return FALSE;
+  }
+  *tz_offset = tz_to_minutes ((gint) g_ascii_strtoll (end, NULL, 10));
+  
+  return TRUE;
+}
+
+/* creates the entries found in a chunk.  only the summaries are kept as
+ * they are, so they are packed in a single buffer shared by the entries of
+ * the chunk instead of each owning copies, or keeping the whole chunk with
+ * hashes, dates and authors alive */
+static void
+log_parser_add_entries (LogParser   *self,
+                        GguGitLog   *log)
+{
+  GguGitBuffer *buffer;
+  gchar        *copy;
+  gsize         length = 0;
+  GList        *added = NULL;
+  guint         i;
+  
+  if (self->fields->len == 0) {
+    return;
+  }
+  
+  /* the separators were replaced by 0s, so the fields are strings */
+  for (i = 0; i < self->fields->len; i += N_FIELDS) {
+    length += strlen (g_ptr_array_index (self->fields, i + 3)) + 1;
+  }
+  buffer = ggu_git_buffer_sized_new (length);
+  copy = ggu_git_buffer_get_data (buffer, NULL);
+  for (i = 0; i < self->fields->len; i += N_FIELDS) {
+    gchar          *fields[N_FIELDS];
     GguGitLogEntry *entry;
+    gsize           summary_size;
+    guint           j;
+    
+    for (j = 0; j < N_FIELDS; j++) {
+      fields[j] = g_ptr_array_index (self->fields, i + j);
+    }
+    summary_size = strlen (fields[3]) + 1;
+    memcpy (copy, fields[3], summary_size);
+    
+    entry = ggu_git_log_entry_new_with_buffer (buffer);
+    entry->oid     = ggu_git_oid_intern_hex (fields[0], -1);
+    if (! parse_raw_date (fields[1], &entry->timestamp, &entry->tz_offset)) {
+      entry->timestamp = 0;
+      entry->tz_offset = 0;
+    }
+    entry->author  = ggu_git_intern_utf8 (fields[2]);
+    entry->summary = entry_take_string (entry, copy,
+                                        GGU_GIT_LOG_ENTRY_OWNS_SUMMARY);
+    ggu_git_log_entry_update_display (entry);
+    copy += summary_size;
+    
+    self->entries = g_list_prepend (self->entries, entry);
+    added = g_list_prepend (added, ggu_git_log_entry_ref (entry));
+  }
+  g_ptr_array_set_size (self->fields, 0);
+  ggu_git_buffer_unref (buffer);
+  
+  queue_entries_added (log, g_list_reverse (added));
+}
+
+static gboolean
+log_parser_parse (GguGitParser       *parser,
+                  GguGit             *git,
+                  gchar              *data,
+                  gsize               length,
+                  gboolean            eof,
+                  gsize              *consumed,
+                  GSimpleAsyncResult *result,
+                  GCancellable       *cancellable)
+{
+  LogParser    *self = (LogParser *) parser;
+  gchar        *p    = data;
+  gchar *const  end  = data + length;
+  gboolean      success = TRUE;
+  
+  while (success) {
+    GError         *error = NULL;
+    gchar          *fields[N_FIELDS];
+    gchar          *seps[N_FIELDS];
+    gchar          *field;
+    guint           i;
+    
+    /* there is a leading \n after each entry, then before each hash that is
+     * not the first one */
+    while (p < end && g_ascii_isspace (*p)) {
+      p++;
+    }
+    if (p >= end) {
+      break;
+    }
     
     if (g_cancellable_set_error_if_cancelled (cancellable, &error)) {
       g_simple_async_result_take_error (result, error);
+      success = FALSE;
       break;
     }
     
-    if (! chunks[i+1] || ! chunks[i+2] || ! chunks[i+3] || ! chunks[i+4]) {
-      g_simple_async_result_set_error (result, GGU_GIT_LOG_ERROR,
-                                       GGU_GIT_LOG_ERROR_INCOMPLETE_RESULT,
-                                       "Incomplete output");
+    /* find the fields before touching anything, the entry might not be
+     * complete yet */
+    for (i = 0, field = p; i < N_FIELDS; i++) {
+      seps[i] = memchr (field, '\xff', (gsize) (end - field));
+      if (! seps[i]) {
+        break;
+      }
+      fields[i] = field;
+      field = seps[i] + 1;
+    }
+    if (i < N_FIELDS) {
+      if (eof) {
+        g_simple_async_result_set_error (result, GGU_GIT_LOG_ERROR,
+                                         GGU_GIT_LOG_ERROR_INCOMPLETE_RESULT,
+                                         "Incomplete output");
+        success = FALSE;
+      }
       break;
     }
-    /* there is a leading \n after each entry, then before each hash that is
-     * not the first one */
-    g_strchug (chunks[i]);
-    if (! ggu_git_is_hash (chunks[i])) {
+    for (i = 0; i < N_FIELDS; i++) {
+      *seps[i] = 0;
+    }
+    p = field;
+    
+    if (! ggu_git_is_hash (fields[0])) {
       g_simple_async_result_set_error (result, GGU_GIT_LOG_ERROR,
                                        GGU_GIT_LOG_ERROR_INVALID_RESULT,
                                        "Corrupted output: don't start with a hash");
+      success = FALSE;
       break;
     }
     
-    entry = ggu_git_log_entry_new ();
-    entry->hash    = g_strdup (chunks[i+0]);
-    entry->date    = ggu_git_utf8_ensure_valid (chunks[i+1]);
-    entry->author  = ggu_git_utf8_ensure_valid (chunks[i+2]);
-    entry->summary = ggu_git_utf8_ensure_valid (chunks[i+3]);
-    entry->details = parse_message (chunks[i+4]);
-    
-    entries = g_list_prepend (entries, entry);
+    for (i = 0; i < N_FIELDS; i++) {
+      g_ptr_array_add (self->fields, fields[i]);
+    }
+  }
+  log_parser_add_entries (self, GGU_GIT_LOG (git));
+  *consumed = (gsize) (p - data);
+  
+  if (success && eof) {
+    g_simple_async_result_set_op_res_gpointer (result,
+                                               g_list_reverse (self->entries),
+                                               (GDestroyNotify) entry_list_unref);
+    self->entries = NULL;
   }
-  entries = g_list_reverse (entries);
-  g_simple_async_result_set_op_res_gpointer (result, entries,
-                                             (GDestroyNotify) entry_list_unref);
-  g_strfreev (chunks);
+  
+  return success;
+}
+
+static void
+log_parser_free (GguGitParser *parser)
+{
+  LogParser *self = (LogParser *) parser;
+  
+  entry_list_unref (self->entries);
+  g_ptr_array_free (self->fields, TRUE);
+  g_free (self);
 }
 
-static gchar **
-ggu_git_log_get_argv (GguGitLog *self)
+/**
+ * _ggu_git_log_parser_new:
+ * 
+ * Creates the parser of the output of the command _ggu_git_log_get_argv()
+ * returns.  It is used internally, and exposed to measure parsing alone.
+ * 
+ * Returns: A new #GguGitParser
+ */
+GguGitParser *
+_ggu_git_log_parser_new (void)
+{
+  LogParser *self;
+  
+  self = g_malloc (sizeof *self);
+  self->parent.parse  = log_parser_parse;
+  self->parent.free   = log_parser_free;
+  self->entries       = NULL;
+  self->fields        = g_ptr_array_new ();
+  
+  return (GguGitParser *) self;
+}
+
+/**
+ * _ggu_git_log_get_argv:
+ * @self: A #GguGitLog
+ * 
+ * Gets the `git log` command for the next page of the history @self
+ * describes, whose output _ggu_git_log_parser_new() parses.
+ * 
+ * Returns: A %NULL-terminated array of arguments, to free with g_strfreev()
+ */
+gchar **
+_ggu_git_log_get_argv (GguGitLog *self)
 {
   GPtrArray *argv;
   
@@ -300,10 +625,17 @@ ggu_git_log_get_argv (GguGitLog *self)
   g_ptr_array_add (argv, g_strdup ("log"));
   g_ptr_array_add (argv, g_strdup ("--format="
                                    "%H%xff"
-                                   "%aD%xff"
+                                   "%ad%xff"
                                    "%an <%ae>%xff"
-                                   "%s%xff"
-                                   "%B%xff"));
+                                   "%s%xff"));
+  g_ptr_array_add (argv, g_strdup ("--date=raw"));
+  if (self->priv->n_loaded > 0) {
+    g_ptr_array_add (argv, g_strdup_printf ("--skip=%u", self->priv->n_loaded));
+  }
+  if (self->priv->max_count > 0) {
+    g_ptr_array_add (argv, g_strdup_printf ("--max-count=%u",
+                                            self->priv->max_count));
+  }
   /* support to log on no real branch, in which case we long on current state */
   if (self->priv->rev && strcmp (self->priv->rev, "(no branch)") != 0) {
     g_ptr_array_add (argv, g_strdup (self->priv->rev));
@@ -317,6 +649,531 @@ ggu_git_log_get_argv (GguGitLog *self)
   return (gchar **) g_ptr_array_free (argv, FALSE);
 }
 
+/* history of a file without spawning Git, see ggu-git-rev-walk.c.  We need
+ * to format the entries exactly like our `git log` format does */
+
+#define PATH_OP_KEY "ggu-git-log-path-op"
+
+typedef struct _PathOp PathOp;
+struct _PathOp
+{
+  gchar              *git_path;
+  gchar              *dir;
+  gchar              *rev;
+  gchar              *file;
+  gchar             **argv; /* for falling back to `git log` */
+  guint               serial;
+  guint               skip;
+  guint               max_count;
+  GguGitOdb          *odb;
+  GguGitRevWalk      *walk;
+  GCancellable       *cancellable;
+  GAsyncReadyCallback callback;
+  gpointer            user_data;
+};
+
+static void
+path_op_free (PathOp *op)
+{
+  g_free (op->git_path);
+  g_free (op->dir);
+  g_free (op->rev);
+  g_free (op->file);
+  g_strfreev (op->argv);
+  if (op->walk) {
+    _ggu_git_rev_walk_free (op->walk);
+  }
+  if (op->odb) {
+    _ggu_git_odb_unref (op->odb);
+  }
+  if (op->cancellable) {
+    g_object_unref (op->cancellable);
+  }
+  g_free (op);
+}
+
+/* whether Git would take @file literally and as we do, relative to the
+ * repository root */
+static gboolean
+path_is_supported (const gchar *dir,
+                   const gchar *file)
+{
+  gchar    *dot_git;
+  gboolean  is_root;
+  gchar   **components;
+  guint     i;
+  gboolean  supported = TRUE;
+  
+  if (! *file || *file == ':' || *file == '/' || strpbrk (file, "*?[\\\n")) {
+    return FALSE;
+  }
+  components = g_strsplit (file, "/", 0);
+  for (i = 0; supported && components[i]; i++) {
+    supported = (strcmp (components[i], ".") != 0 &&
+                 strcmp (components[i], "..") != 0);
+  }
+  g_strfreev (components);
+  
+  dot_git = g_build_filename (dir, ".git", NULL);
+  is_root = g_file_test (dot_git, G_FILE_TEST_EXISTS);
+  g_free (dot_git);
+  
+  return supported && is_root;
+}
+
+/* asks Git for a boolean configuration variable in @dir: 1 if true, 0 if
+ * false or unset, and -1 if Git failed */
+static gint
+config_get_bool (const gchar *git_path,
+                 const gchar *dir,
+                 const gchar *name)
+{
+  gchar    *argv[] = { (gchar *) git_path, "config", "--bool", "--get",
+                       (gchar *) name, NULL };
+  GString  *output;
+  GPid      pid;
+  gint      out_fd;
+  gint      status = 0;
+  gint      value = -1;
+  gssize    n_read;
+  
+  if (! _ggu_git_spawn (dir, argv, &pid, NULL, &out_fd, NULL, NULL)) {
+    return -1;
+  }
+  output = g_string_new (NULL);
+  do {
+    gchar buf[64];
+    
+    n_read = read (out_fd, buf, sizeof buf);
+    if (n_read > 0) {
+      g_string_append_len (output, buf, n_read);
+    }
+  } while (n_read > 0 || (n_read < 0 && errno == EINTR));
+  close (out_fd);
+  while (waitpid (pid, &status, 0) < 0 && errno == EINTR);
+  g_spawn_close_pid (pid);
+  
+  if (WIFEXITED (status)) {
+    if (WEXITSTATUS (status) == 1) {
+      /* the variable is not set */
+      value = 0;
+    } else if (WEXITSTATUS (status) == 0) {
+      g_strstrip (output->str);
+      if (strcmp (output->str, "true") == 0) {
+        value = 1;
+      } else if (strcmp (output->str, "false") == 0) {
+        value = 0;
+      }
+    }
+  }
+  g_string_free (output, TRUE);
+  
+  return value;
+}
+
+static GMutex       G_follows_lock;
+static GHashTable  *G_follows = NULL; /* directory -> whether Git follows */
+
+/* whether Git would follow renames in @dir, which we don't support.  Git is
+ * asked, as the configuration may come from many places, and the answer is
+ * kept for the next histories of the same directory */
+static gboolean
+follows_renames (const gchar *git_path,
+                 const gchar *dir)
+{
+  gpointer  value;
+  gboolean  follows;
+  
+  g_mutex_lock (&G_follows_lock);
+  if (G_UNLIKELY (! G_follows)) {
+    G_follows = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  }
+  if (g_hash_table_lookup_extended (G_follows, dir, NULL, &value)) {
+    g_mutex_unlock (&G_follows_lock);
+    return GPOINTER_TO_INT (value);
+  }
+  g_mutex_unlock (&G_follows_lock);
+  
+  /* if we can't know, assume it does so we let Git do it */
+  follows = config_get_bool (git_path, dir, "log.follow") != 0;
+  
+  g_mutex_lock (&G_follows_lock);
+  g_hash_table_insert (G_follows, g_strdup (dir), GINT_TO_POINTER (follows));
+  g_mutex_unlock (&G_follows_lock);
+  
+  return follows;
+}
+
+static gboolean
+resolve_commit (GguGitOdb    *odb,
+                const gchar  *rev,
+                guint8        oid[GGU_GIT_ODB_OID_SIZE],
+                GError      **error)
+{
+  GguGitObjectType  type = GGU_GIT_OBJECT_NONE;
+  gchar            *data = NULL;
+  
+  if (_ggu_git_odb_resolve (odb, rev, oid)) {
+    /* peel tags */
+    while ((data = _ggu_git_odb_read (odb, oid, &type, NULL, error)) &&
+           type == GGU_GIT_OBJECT_TAG &&
+           g_str_has_prefix (data, "object ") &&
+           _ggu_git_odb_parse_oid (data + 7, oid)) {
+      g_free (data);
+    }
+    g_free (data);
+  }
+  if (type != GGU_GIT_OBJECT_COMMIT) {
+    if (error && ! *error) {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                   "Cannot resolve \"%s\"", rev);
+    }
+    return FALSE;
+  }
+  
+  return TRUE;
+}
+
+static inline gboolean
+is_git_space (gchar c)
+{
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+/* gets the length of the line at @p without trailing spaces, and the
+ * position of the next line */
+static gsize
+get_line (const gchar  *p,
+          const gchar **next)
+{
+  const gchar *eol = strchr (p, '\n');
+  gsize        len = eol ? (gsize) (eol - p) : strlen (p);
+  
+  *next = eol ? eol + 1 : p + len;
+  while (len > 0 && is_git_space (p[len - 1])) {
+    len--;
+  }
+  
+  return len;
+}
+
+static gboolean
+is_utf8_encoding (const gchar *name,
+                  gsize        len)
+{
+  return ((len == 5 && g_ascii_strncasecmp (name, "utf-8", 5) == 0) ||
+          (len == 4 && g_ascii_strncasecmp (name, "utf8", 4) == 0));
+}
+
+/* like Git's %s: the first paragraph as a single line */
+static gchar *
+format_subject (const gchar *msg)
+{
+  GString     *subject = g_string_new (NULL);
+  const gchar *next;
+  gsize        len;
+  
+  /* skip leading blank lines */
+  while (*msg && get_line (msg, &next) == 0) {
+    msg = next;
+  }
+  while (*msg && (len = get_line (msg, &next)) > 0) {
+    if (subject->len > 0) {
+      g_string_append_c (subject, ' ');
+    }
+    g_string_append_len (subject, msg, (gssize) len);
+    msg = next;
+  }
+  
+  return g_string_free (subject, FALSE);
+}
+
+/* creates an entry from a raw commit, or returns %NULL if Git would do
+ * something we don't */
+static GguGitLogEntry *
+log_entry_new_from_commit (const guint8 *oid,
+                           const gchar  *data)
+{
+  GguGitLogEntry *entry = NULL;
+  const gchar    *line;
+  const gchar    *next;
+  const gchar    *message = "";
+  const gchar    *ident = NULL;
+  const gchar    *ident_end = NULL;
+  const gchar    *lt;
+  const gchar    *gt;
+  const gchar    *name_end;
+  gchar          *author;
+  gchar          *summary;
+  gint64          timestamp;
+  gint            tz_offset;
+  
+  for (line = data; *line && *line != '\n'; line = next) {
+    gsize len = get_line (line, &next);
+    
+    if (! ident && g_str_has_prefix (line, "author ")) {
+      ident = line + 7;
+      ident_end = line + len;
+    } else if (g_str_has_prefix (line, "encoding ") &&
+               ! is_utf8_encoding (line + 9, len - 9)) {
+      /* Git would re-encode the message */
+      return NULL;
+    }
+  }
+  if (*line == '\n') {
+    message = line + 1;
+  }
+  
+  /* "Name <email> timestamp tz" */
+  if (! ident ||
+      ! (lt = memchr (ident, '<', (gsize) (ident_end - ident))) ||
+      ! (gt = memchr (lt, '>', (gsize) (ident_end - lt)))) {
+    return NULL;
+  }
+  name_end = lt;
+  while (name_end > ident && is_git_space (name_end[-1])) {
+    name_end--;
+  }
+  /* the date follows the last '>' */
+  line = g_strrstr_len (gt, ident_end - gt, ">") + 1;
+  while (line < ident_end && is_git_space (*line)) {
+    line++;
+  }
+  if (! parse_raw_date (line, &timestamp, &tz_offset)) {
+    return NULL;
+  }
+  
+  author = g_strdup_printf ("%.*s <%.*s>",
+                            (gint) (name_end - ident), ident,
+                            (gint) (gt - lt - 1), lt + 1);
+  summary = format_subject (message);
+  entry = log_entry_new (ggu_git_oid_intern_raw (oid, GGU_GIT_ODB_OID_SIZE),
+                         timestamp, tz_offset, author, summary);
+  g_free (summary);
+  g_free (author);
+  
+  return entry;
+}
+
+/* starts a new walk, at the position of the previous one if any */
+static GguGitRevWalk *
+log_path_start_walk (PathOp        *op,
+                     GCancellable  *cancellable,
+                     GError       **error)
+{
+  GguGitRevWalk  *walk = NULL;
+  guint8          oid[GGU_GIT_ODB_OID_SIZE];
+  
+  if (follows_renames (op->git_path, op->dir)) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                 "Following renames is not supported");
+  } else if (resolve_commit (op->odb, op->rev ? op->rev : "HEAD", oid,
+                             error)) {
+    walk = _ggu_git_rev_walk_new (op->odb, oid, op->file, error);
+  }
+  if (walk && op->skip > 0) {
+    GPtrArray *skipped = g_ptr_array_new_with_free_func (g_free);
+    
+    if (! _ggu_git_rev_walk_next (walk, skipped, op->skip, cancellable,
+                                  error)) {
+      _ggu_git_rev_walk_free (walk);
+      walk = NULL;
+    }
+    g_ptr_array_free (skipped, TRUE);
+  }
+  
+  return walk;
+}
+
+static void
+log_path_thread (GSimpleAsyncResult *result,
+                 GObject            *object,
+                 GCancellable       *cancellable)
+{
+  PathOp     *op;
+  GPtrArray  *commits;
+  GList      *entries = NULL;
+  GError     *error = NULL;
+  
+  op = g_object_get_data (G_OBJECT (result), PATH_OP_KEY);
+  if (! op->odb) {
+    op->odb = _ggu_git_odb_open (op->dir, &error);
+    if (! op->odb) {
+      g_simple_async_result_take_error (result, error);
+      return;
+    }
+  }
+  if (! op->walk) {
+    op->walk = log_path_start_walk (op, cancellable, &error);
+    if (! op->walk) {
+      g_simple_async_result_take_error (result, error);
+      return;
+    }
+  }
+  
+  commits = g_ptr_array_new_with_free_func (g_free);
+  if (_ggu_git_rev_walk_next (op->walk, commits, op->max_count, cancellable,
+                              &error)) {
+    guint i;
+    
+    /* read the commits changing the file, oldest first as we prepend */
+    for (i = commits->len; ! error && i > 0; i--) {
+      const guint8     *commit = g_ptr_array_index (commits, i - 1);
+      GguGitObjectType  type;
+      gchar            *data;
+      GguGitLogEntry   *entry = NULL;
+      
+      data = _ggu_git_odb_read (op->odb, commit, &type, NULL, &error);
+      if (data && type == GGU_GIT_OBJECT_COMMIT) {
+        entry = log_entry_new_from_commit (commit, data);
+      }
+      g_free (data);
+      if (entry) {
+        entries = g_list_prepend (entries, entry);
+      } else if (! error) {
+        g_set_error (&error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                     "Unsupported commit");
+      }
+    }
+  }
+  g_ptr_array_free (commits, TRUE);
+  
+  if (error) {
+    entry_list_unref (entries);
+    g_simple_async_result_take_error (result, error);
+  } else {
+    g_simple_async_result_set_op_res_gpointer (result, entries,
+                                               (GDestroyNotify) entry_list_unref);
+  }
+}
+
+static void
+log_path_ready (GObject      *object,
+                GAsyncResult *result,
+                gpointer      data)
+{
+  GguGitLog          *self = GGU_GIT_LOG (object);
+  GSimpleAsyncResult *simple = G_SIMPLE_ASYNC_RESULT (result);
+  PathOp             *op = data;
+  GError             *error = NULL;
+  gboolean            current = op->serial == self->priv->serial;
+  
+  if (! g_simple_async_result_propagate_error (simple, &error) ||
+      g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+    GSimpleAsyncResult *user_result;
+    
+    if (! error) {
+      if (current) {
+        /* keep the walk for the next page */
+        ggu_git_log_drop_walk (self);
+        self->priv->odb = op->odb;
+        self->priv->walk = op->walk;
+        op->odb = NULL;
+        op->walk = NULL;
+      }
+      /* the page is only signaled once complete so that falling back to
+       * `git log` never signals the same entries twice */
+      g_signal_emit (self, signals[SIGNAL_ENTRIES_ADDED], 0,
+                     g_simple_async_result_get_op_res_gpointer (simple));
+    }
+    user_result = g_simple_async_result_new (object, op->callback,
+                                             op->user_data,
+                                             ggu_git_log_log_async);
+    if (error) {
+      g_simple_async_result_take_error (user_result, error);
+    } else {
+      /* the entries are owned by the internal result */
+      g_simple_async_result_set_op_res_gpointer (user_result,
+                                                 g_object_ref (simple),
+                                                 g_object_unref);
+    }
+    g_simple_async_result_complete (user_result);
+    g_object_unref (user_result);
+  } else {
+    /* no commit-graph or something we don't support, let `git log` do it,
+     * and don't try again for the next pages */
+    if (current) {
+      self->priv->native = FALSE;
+    }
+    g_error_free (error);
+    _ggu_git_run_streaming_async (GGU_GIT (self), op->argv,
+                                  _ggu_git_log_parser_new (),
+                                  ggu_git_get_priority (GGU_GIT (self)),
+                                  op->cancellable, op->callback,
+                                  op->user_data);
+  }
+}
+
+/* runs the next page of the log described by @self */
+static void
+ggu_git_log_run (GguGitLog           *self,
+                 GCancellable        *cancellable,
+                 GAsyncReadyCallback  callback,
+                 gpointer             user_data)
+{
+  gchar **argv;
+  
+  self->priv->page_max_count = self->priv->max_count;
+  argv = _ggu_git_log_get_argv (self);
+  if (self->priv->native) {
+    GSimpleAsyncResult *result;
+    PathOp             *op;
+    
+    op = g_malloc (sizeof *op);
+    op->git_path    = g_strdup (ggu_git_get_git_path (GGU_GIT (self)));
+    op->dir         = g_strdup (ggu_git_get_dir (GGU_GIT (self)));
+    op->rev         = NULL;
+    op->file        = g_strdup (self->priv->file);
+    op->argv        = argv;
+    op->serial      = self->priv->serial;
+    op->skip        = self->priv->n_loaded;
+    op->max_count   = self->priv->max_count;
+    /* the running page owns the walk so it's never used by two threads */
+    op->odb         = self->priv->odb;
+    op->walk        = self->priv->walk;
+    op->cancellable = cancellable ? g_object_ref (cancellable) : NULL;
+    op->callback    = callback;
+    op->user_data   = user_data;
+    self->priv->odb = NULL;
+    self->priv->walk = NULL;
+    /* same as in _ggu_git_log_get_argv() */
+    if (self->priv->rev && *self->priv->rev &&
+        strcmp (self->priv->rev, "(no branch)") != 0) {
+      op->rev = g_strdup (self->priv->rev);
+    }
+    
+    result = g_simple_async_result_new (G_OBJECT (self), log_path_ready, op,
+                                        log_path_thread);
+    g_object_set_data_full (G_OBJECT (result), PATH_OP_KEY, op,
+                            (GDestroyNotify) path_op_free);
+    _ggu_git_scheduler_run_in_thread (result, log_path_thread, op->dir,
+                                      ggu_git_get_priority (GGU_GIT (self)),
+                                      cancellable);
+    g_object_unref (result);
+  } else {
+    _ggu_git_run_streaming_async (GGU_GIT (self), argv,
+                                  _ggu_git_log_parser_new (),
+                                  ggu_git_get_priority (GGU_GIT (self)),
+                                  cancellable, callback, user_data);
+    g_strfreev (argv);
+  }
+}
+
+/**
+ * ggu_git_log_log_async:
+ * @self: A #GguGitLog
+ * @dir: The repository root
+ * @rev: The revision to log, or %NULL for the current one
+ * @file: The file to log, or %NULL for the whole repository
+ * @cancellable: A #GCancellable, or %NULL
+ * @callback: Callback to call when the operation is done
+ * @user_data: Data to pass to @callback
+ * 
+ * Gets the history of @file starting at @rev.  If #GguGitLog:max-count is
+ * not 0, only the first page of up to this many entries is fetched, and the
+ * next ones can be fetched with ggu_git_log_log_more_async().  The entries
+ * are also signaled with #GguGitLog::entries-added as they are found.
+ */
 void
 ggu_git_log_log_async (GguGitLog           *self,
                        const gchar         *dir,
@@ -326,18 +1183,57 @@ ggu_git_log_log_async (GguGitLog           *self,
                        GAsyncReadyCallback  callback,
                        gpointer             user_data)
 {
-  gchar **argv;
-  
   g_object_set (self,
                 "dir", dir,
                 "rev", rev,
                 "file", file,
                 NULL);
   
-  argv = ggu_git_log_get_argv (self);
-  _ggu_git_run_async (GGU_GIT (self), argv, ggu_git_log_parse_output,
-                      G_PRIORITY_DEFAULT, cancellable, callback, user_data);
-  g_strfreev (argv);
+  ggu_git_log_drop_walk (self);
+  self->priv->serial++;
+  self->priv->n_loaded = 0;
+  self->priv->complete = FALSE;
+  self->priv->native = (file && path_is_supported (dir, file) &&
+                        (! rev || ! strchr (rev, '\n')));
+  
+  ggu_git_log_run (self, cancellable, callback, user_data);
+}
+
+/**
+ * ggu_git_log_log_more_async:
+ * @self: A #GguGitLog
+ * @cancellable: A #GCancellable, or %NULL
+ * @callback: Callback to call when the operation is done
+ * @user_data: Data to pass to @callback
+ * 
+ * Gets the next page of the history started with ggu_git_log_log_async(),
+ * of up to #GguGitLog:max-count entries.  The walk is resumed where the
+ * previous page stopped when possible, so pages don't get slower the further
+ * they are in the history.  Only one page can be fetched at a time, and the
+ * operation is finished with ggu_git_log_log_finish().
+ */
+void
+ggu_git_log_log_more_async (GguGitLog           *self,
+                            GCancellable        *cancellable,
+                            GAsyncReadyCallback  callback,
+                            gpointer             user_data)
+{
+  ggu_git_log_run (self, cancellable, callback, user_data);
+}
+
+/**
+ * ggu_git_log_is_complete:
+ * @self: A #GguGitLog
+ * 
+ * Checks whether all the history was fetched, e.g. whether there is no need
+ * to call ggu_git_log_log_more_async().
+ * 
+ * Returns: %TRUE if the history was fetched entirely, %FALSE otherwise
+ */
+gboolean
+ggu_git_log_is_complete (GguGitLog *self)
+{
+  return self->priv->complete;
 }
 
 /**
@@ -355,5 +1251,210 @@ ggu_git_log_log_finish (GguGitLog    *self,
                         GAsyncResult *result,
                         GError      **error)
 {
-  return _ggu_git_run_finish (GGU_GIT (self), result, error);
+  GList  *entries;
+  GError *err = NULL;
+  
+  if (g_simple_async_result_is_valid (result, G_OBJECT (self),
+                                      ggu_git_log_log_async)) {
+    GSimpleAsyncResult *simple = G_SIMPLE_ASYNC_RESULT (result);
+    
+    entries = NULL;
+    if (! g_simple_async_result_propagate_error (simple, &err)) {
+      /* the entries are held by the history walk's result */
+      simple = g_simple_async_result_get_op_res_gpointer (simple);
+      entries = g_simple_async_result_get_op_res_gpointer (simple);
+    }
+  } else {
+    entries = _ggu_git_run_finish (GGU_GIT (self), result, &err);
+  }
+  
+  if (err) {
+    g_propagate_error (error, err);
+  } else {
+    guint n_entries = g_list_length (entries);
+    
+    /* a short page means we reached the end */
+    self->priv->n_loaded += n_entries;
+    self->priv->complete = (self->priv->page_max_count == 0 ||
+                            n_entries < self->priv->page_max_count);
+  }
+  
+  return entries;
+}
+
+
+/* builds a table mapping the commit IDs to their formatted messages */
+static void
+ggu_git_log_details_parse_output (GguGit             *obj,
+                                  const gchar        *output,
+                                  GSimpleAsyncResult *result,
+                                  GCancellable       *cancellable)
+{
+  /* Format:
+   * 
+   * <hash> <\xff> <raw message> <\xff> <\n>
+   */
+  
+  GHashTable   *details;
+  const gchar  *p = output;
+  
+  details = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                   (GDestroyNotify) ggu_git_oid_unref, g_free);
+  while (*p) {
+    GError       *error = NULL;
+    const gchar  *hash_end;
+    const gchar  *message_end;
+    GguGitOid    *oid;
+    gchar        *message;
+    gsize         length;
+    
+    while (g_ascii_isspace (*p)) {
+      p++;
+    }
+    if (! *p) {
+      break;
+    }
+    if (g_cancellable_set_error_if_cancelled (cancellable, &error)) {
+      g_simple_async_result_take_error (result, error);
+      break;
+    }
+    
+    if (! (hash_end = strchr (p, '\xff')) ||
+        ! (message_end = strchr (hash_end + 1, '\xff'))) {
+      g_simple_async_result_set_error (result, GGU_GIT_LOG_ERROR,
+                                       GGU_GIT_LOG_ERROR_INCOMPLETE_RESULT,
+                                       "Incomplete output");
+      break;
+    }
+    oid = ggu_git_oid_intern_hex (p, hash_end - p);
+    if (! oid) {
+      g_simple_async_result_set_error (result, GGU_GIT_LOG_ERROR,
+                                       GGU_GIT_LOG_ERROR_INVALID_RESULT,
+                                       "Corrupted output: don't start with a hash");
+      break;
+    }
+    length = (gsize) (message_end - hash_end - 1);
+    message = ggu_git_utf8_normalize (hash_end + 1, length, TRUE);
+    if (! message) {
+      message = g_strndup (hash_end + 1, length);
+    }
+    _ggu_git_cache_insert (GGU_GIT_CACHE_MESSAGE, oid, NULL,
+                           g_strdup (message), strlen (message) + 1,
+                           (GBoxedCopyFunc) g_strdup, g_free);
+    g_hash_table_replace (details, oid, message);
+    p = message_end + 1;
+  }
+  
+  g_simple_async_result_set_op_res_gpointer (result, details,
+                                             (GDestroyNotify) g_hash_table_destroy);
+}
+
+/**
+ * ggu_git_log_load_details_async:
+ * @self: A #GguGitLog
+ * @dir: The repository directory
+ * @entries: (array length=n_entries): Entries to load the details of
+ * @n_entries: The number of entries in @entries
+ * @cancellable: A #GCancellable, or %NULL
+ * @callback: Callback to call when the operation is done
+ * @user_data: Data to pass to @callback
+ * 
+ * Loads the message of each of @entries, which the history doesn't include
+ * not to fetch and keep the message of commits that are never shown.  Loading
+ * the details of several entries at once is a lot cheaper than loading them
+ * separately, and messages loaded before are taken from the cache.
+ * 
+ * Only one details load may run at a time on a given #GguGitLog.
+ */
+void
+ggu_git_log_load_details_async (GguGitLog            *self,
+                                const gchar          *dir,
+                                GguGitLogEntry      **entries,
+                                guint                 n_entries,
+                                GCancellable         *cancellable,
+                                GAsyncReadyCallback   callback,
+                                gpointer              user_data)
+{
+  GPtrArray  *argv;
+  gchar     **argv_strv;
+  guint       i;
+  
+  g_return_if_fail (n_entries > 0);
+  
+  ggu_git_log_drop_details_entries (self);
+  self->priv->details_entries = g_ptr_array_new_with_free_func ((GDestroyNotify) ggu_git_log_entry_unref);
+  
+  argv = g_ptr_array_new ();
+  g_ptr_array_add (argv, g_strdup ("git"));
+  g_ptr_array_add (argv, g_strdup ("show"));
+  g_ptr_array_add (argv, g_strdup ("-s"));
+  g_ptr_array_add (argv, g_strdup ("--format=%H%xff%B%xff"));
+  for (i = 0; i < n_entries; i++) {
+    /* entries are only modified from the main thread, like in _finish() */
+    if (! entries[i]->details &&
+        ! _ggu_git_cache_lookup (GGU_GIT_CACHE_MESSAGE, entries[i]->oid, NULL,
+                                 (gpointer *) &entries[i]->details)) {
+      gchar hex[GGU_GIT_OID_HEX_SIZE];
+      
+      g_ptr_array_add (self->priv->details_entries,
+                       ggu_git_log_entry_ref (entries[i]));
+      g_ptr_array_add (argv, g_strdup (ggu_git_oid_to_hex (entries[i]->oid,
+                                                           hex)));
+    }
+  }
+  g_ptr_array_add (argv, NULL);
+  argv_strv = (gchar **) g_ptr_array_free (argv, FALSE);
+  
+  g_object_set (self, "dir", dir, NULL);
+  if (self->priv->details_entries->len == 0) {
+    _ggu_git_complete_cached (GGU_GIT (self),
+                              g_hash_table_new (g_direct_hash, g_direct_equal),
+                              (GDestroyNotify) g_hash_table_destroy,
+                              cancellable, callback, user_data);
+  } else {
+    _ggu_git_run_async (GGU_GIT (self), argv_strv,
+                        ggu_git_log_details_parse_output,
+                        ggu_git_get_priority (GGU_GIT (self)),
+                        cancellable, callback, user_data);
+  }
+  g_strfreev (argv_strv);
+}
+
+/**
+ * ggu_git_log_load_details_finish:
+ * @self: A #GguGitLog
+ * @result: The #GAsyncResult
+ * @error: Return location for errors, or %NULL
+ * 
+ * Finishes an operation started with ggu_git_log_load_details_async(),
+ * setting the details of the entries it was given.
+ * 
+ * Returns: Whether the details could be loaded
+ */
+gboolean
+ggu_git_log_load_details_finish (GguGitLog     *self,
+                                 GAsyncResult  *result,
+                                 GError       **error)
+{
+  GHashTable *details;
+  guint       i;
+  
+  details = _ggu_git_run_finish (GGU_GIT (self), result, error);
+  if (! details) {
+    return FALSE;
+  }
+  
+  for (i = 0; i < self->priv->details_entries->len; i++) {
+    GguGitLogEntry *entry = g_ptr_array_index (self->priv->details_entries, i);
+    
+    if (! entry->details) {
+      const gchar *message = g_hash_table_lookup (details, entry->oid);
+      
+      /* don't let an entry Git didn't report be loaded again and again */
+      entry->details = g_strdup (message ? message : "");
+    }
+  }
+  ggu_git_log_drop_details_entries (self);
+  
+  return TRUE;
 }
@@ -27,6 +27,7 @@
 #include <gio/gio.h>
 
 #include "ggu-git.h"
+#include "ggu-git-log-entry.h"
 
 G_BEGIN_DECLS
 
@@ -61,6 +62,9 @@ struct _GguGitLog
 struct _GguGitLogClass
 {
   GguGitClass parent_class;
+  
+  void  (*entries_added)  (GguGitLog *self,
+                           GList     *entries);
 };
 
 
@@ -74,9 +78,29 @@ void              ggu_git_log_log_async       (GguGitLog           *self,
                                                GCancellable        *cancellable,
                                                GAsyncReadyCallback  callback,
                                                gpointer             user_data);
+void              ggu_git_log_log_more_async  (GguGitLog           *self,
+                                               GCancellable        *cancellable,
+                                               GAsyncReadyCallback  callback,
+                                               gpointer             user_data);
 GList            *ggu_git_log_log_finish      (GguGitLog           *self,
                                                GAsyncResult        *result,
                                                GError             **error);
+gboolean          ggu_git_log_is_complete     (GguGitLog           *self);
+void              ggu_git_log_load_details_async
+                                              (GguGitLog           *self,
+                                               const gchar         *dir,
+                                               GguGitLogEntry     **entries,
+                                               guint                n_entries,
+                                               GCancellable        *cancellable,
+                                               GAsyncReadyCallback  callback,
+                                               gpointer             user_data);
+gboolean          ggu_git_log_load_details_finish
+                                              (GguGitLog           *self,
+                                               GAsyncResult        *result,
+                                               GError             **error);
+
+gchar           **_ggu_git_log_get_argv       (GguGitLog *self);
+GguGitParser     *_ggu_git_log_parser_new     (void);
 
 
 G_END_DECLS
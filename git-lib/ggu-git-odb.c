@@ -0,0 +1,1753 @@
+/*
+ * Copyright 2011 Colomban Wendling <ban@herbesfolles.org>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+/*
+ * Read-only access to a repository's object database, without Git.
+ * 
+ * This reads loose objects, packs (through their version 2 indexes or a
+ * multi-pack-index) and references.  It doesn't try to know everything Git
+ * does: when something is not supported or not found, callers are expected
+ * to fall back to asking Git.
+ * 
+ * A GguGitOdb may be used from several threads at once.
+ */
+
+#include "ggu-git-odb.h"
+
+#include <string.h>
+#include <glib.h>
+#include <gio/gio.h>
+
+#include "ggu-glib-compat.h"
+#include "ggu-git.h"
+#include "ggu-git-utils.h"
+#include "ggu-git-oid.h"
+
+
+/* memory budget of the delta base cache of each database */
+#define DELTA_CACHE_SIZE      (16 * 1024 * 1024)
+/* maximum length of a delta chain we accept, to avoid looping on broken
+ * packs */
+#define MAX_DELTA_CHAIN       10000
+/* maximum number of symbolic references we follow */
+#define MAX_SYMREF_DEPTH      5
+
+enum
+{
+  PACK_OBJ_COMMIT     = 1,
+  PACK_OBJ_TREE       = 2,
+  PACK_OBJ_BLOB       = 3,
+  PACK_OBJ_TAG        = 4,
+  PACK_OBJ_OFS_DELTA  = 6,
+  PACK_OBJ_REF_DELTA  = 7
+};
+
+
+typedef struct _Pack      Pack;
+typedef struct _Midx      Midx;
+typedef struct _CacheKey  CacheKey;
+typedef struct _CacheItem CacheItem;
+
+/* a pack and its index.  the index is not loaded for packs covered by a
+ * multi-pack-index */
+struct _Pack
+{
+  gchar        *name;     /* path without extension */
+  
+  GMappedFile  *idx_map;
+  const guint8 *idx;
+  gsize         idx_len;
+  guint32       n_objects;
+  
+  GMappedFile  *pack_map; /* lazily opened */
+  const guint8 *pack;
+  gsize         pack_len;
+};
+
+struct _Midx
+{
+  GMappedFile  *map;
+  const guint8 *data;
+  gsize         len;
+  guint32       n_objects;
+  const guint8 *fanout;
+  const guint8 *oids;
+  const guint8 *offsets;
+  const guint8 *large_offsets;
+  guint32       n_large_offsets;
+  GPtrArray    *packs;    /* of Pack, indexed by pack-int-id */
+};
+
+struct _CacheKey
+{
+  const Pack *pack;
+  guint64     offset;
+};
+
+struct _CacheItem
+{
+  CacheKey          key;
+  GguGitObjectType  type;
+  guint8           *data;
+  gsize             length;
+  GList            *link;   /* in the LRU queue */
+};
+
+struct _GguGitOdb
+{
+  gint        ref_count;
+  gchar      *git_dir;    /* the repository's (possibly per-worktree) dir */
+  gchar      *common_dir; /* where shared data (refs, objects) live */
+  GPtrArray  *object_dirs;
+  
+  /* protects everything below */
+  GMutex      lock;
+  GPtrArray  *midxs;
+  GPtrArray  *packs;      /* all packs, including the ones from midxs */
+  GHashTable *pack_names; /* name -> Pack */
+  GHashTable *cache;      /* CacheKey -> CacheItem */
+  GQueue      cache_lru;  /* most recently used first */
+  gsize       cache_size;
+};
+
+
+static inline guint32
+get_be32 (const guint8 *p)
+{
+  return ((guint32) p[0] << 24) | ((guint32) p[1] << 16) |
+         ((guint32) p[2] << 8)  |  (guint32) p[3];
+}
+
+static inline guint64
+get_be64 (const guint8 *p)
+{
+  return ((guint64) get_be32 (p) << 32) | get_be32 (p + 4);
+}
+
+/**
+ * _ggu_git_odb_parse_oid:
+ * @hex: A string starting with 40 hexadecimal digits
+ * @oid: Return location for the raw object ID
+ * 
+ * Returns: Whether @hex started with a valid object ID
+ */
+gboolean
+_ggu_git_odb_parse_oid (const gchar *hex,
+                        guint8       oid[GGU_GIT_ODB_OID_SIZE])
+{
+  guint i;
+  
+  /* @hex may be shorter, so don't let the decoder read past its end */
+  for (i = 0; i < GGU_GIT_ODB_OID_SIZE * 2; i++) {
+    if (! hex[i]) {
+      return FALSE;
+    }
+  }
+  
+  return _ggu_git_hex_decode (hex, GGU_GIT_ODB_OID_SIZE * 2, oid);
+}
+
+/* whether @hex is exactly an object ID we can read: unlike
+ * ggu_git_is_hash(), this rejects SHA-256 ones */
+static gboolean
+is_odb_oid (const gchar *hex)
+{
+  return (strlen (hex) == GGU_GIT_ODB_OID_SIZE * 2 &&
+          _ggu_git_hex_span (hex, GGU_GIT_ODB_OID_SIZE * 2) ==
+          GGU_GIT_ODB_OID_SIZE * 2);
+}
+
+/**
+ * _ggu_git_odb_format_oid:
+ * @oid: A raw object ID
+ * @hex: Return location for the 0-terminated hexadecimal representation
+ */
+void
+_ggu_git_odb_format_oid (const guint8 *oid,
+                         gchar         hex[GGU_GIT_ODB_OID_SIZE * 2 + 1])
+{
+  _ggu_git_hex_encode (oid, GGU_GIT_ODB_OID_SIZE, hex);
+}
+
+static GguGitObjectType
+object_type_from_name (const gchar *name,
+                       gsize        len)
+{
+  if (len == 4 && strncmp (name, "blob", 4) == 0) {
+    return GGU_GIT_OBJECT_BLOB;
+  } else if (len == 4 && strncmp (name, "tree", 4) == 0) {
+    return GGU_GIT_OBJECT_TREE;
+  } else if (len == 6 && strncmp (name, "commit", 6) == 0) {
+    return GGU_GIT_OBJECT_COMMIT;
+  } else if (len == 3 && strncmp (name, "tag", 3) == 0) {
+    return GGU_GIT_OBJECT_TAG;
+  }
+  
+  return GGU_GIT_OBJECT_NONE;
+}
+
+static void
+set_corrupt_error (GError     **error,
+                   const gchar *what)
+{
+  g_set_error (error, GGU_GIT_ERROR, GGU_GIT_ERROR_INVALID_RESULT,
+               "Corrupt object database: %s", what);
+}
+
+
+/* inflating */
+
+/* inflates a zlib stream from @in into @out, which must be @out_len bytes
+ * long.  the stream must inflate to exactly @out_len bytes */
+static gboolean
+inflate_exact (const guint8  *in,
+               gsize          in_len,
+               guint8        *out,
+               gsize          out_len,
+               GError       **error)
+{
+  GConverter       *converter;
+  GConverterResult  res;
+  gsize             in_pos = 0;
+  gsize             out_pos = 0;
+  guint8            extra;
+  
+  converter = G_CONVERTER (g_zlib_decompressor_new (G_ZLIB_COMPRESSOR_FORMAT_ZLIB));
+  do {
+    gsize   bytes_read = 0;
+    gsize   bytes_written = 0;
+    guint8 *buf = out + out_pos;
+    gsize   buf_len = out_len - out_pos;
+    
+    /* use a spare byte so that we always have some room, and would see
+     * if the data is bigger than expected */
+    if (buf_len == 0) {
+      buf = &extra;
+      buf_len = 1;
+    }
+    res = g_converter_convert (converter, in + in_pos, in_len - in_pos,
+                               buf, buf_len, G_CONVERTER_INPUT_AT_END,
+                               &bytes_read, &bytes_written, error);
+    if (res == G_CONVERTER_ERROR) {
+      break;
+    }
+    in_pos += bytes_read;
+    if (buf == &extra && bytes_written > 0) {
+      set_corrupt_error (error, "object bigger than expected");
+      res = G_CONVERTER_ERROR;
+      break;
+    }
+    out_pos += bytes_written;
+  } while (res != G_CONVERTER_FINISHED);
+  g_object_unref (converter);
+  
+  if (res == G_CONVERTER_FINISHED && out_pos != out_len) {
+    set_corrupt_error (error, "object smaller than expected");
+    res = G_CONVERTER_ERROR;
+  }
+  
+  return res == G_CONVERTER_FINISHED;
+}
+
+/* inflates a whole zlib stream of unknown size */
+static guint8 *
+inflate_all (const guint8  *in,
+             gsize          in_len,
+             gsize         *out_len,
+             GError       **error)
+{
+  GConverter       *converter;
+  GConverterResult  res;
+  GByteArray       *out;
+  gsize             in_pos = 0;
+  
+  converter = G_CONVERTER (g_zlib_decompressor_new (G_ZLIB_COMPRESSOR_FORMAT_ZLIB));
+  out = g_byte_array_sized_new ((guint) MIN (in_len * 4, G_MAXUINT / 2));
+  do {
+    gsize bytes_read = 0;
+    gsize bytes_written = 0;
+    guint len = out->len;
+    
+    g_byte_array_set_size (out, MAX (len * 2, 4096));
+    res = g_converter_convert (converter, in + in_pos, in_len - in_pos,
+                               out->data + len, out->len - len,
+                               G_CONVERTER_INPUT_AT_END,
+                               &bytes_read, &bytes_written, error);
+    in_pos += bytes_read;
+    g_byte_array_set_size (out, len + (guint) bytes_written);
+  } while (res != G_CONVERTER_FINISHED && res != G_CONVERTER_ERROR);
+  g_object_unref (converter);
+  
+  if (res == G_CONVERTER_ERROR) {
+    g_byte_array_free (out, TRUE);
+    return NULL;
+  }
+  *out_len = out->len;
+  
+  return g_byte_array_free (out, FALSE);
+}
+
+
+/* loose objects */
+
+static gchar *
+read_loose (GguGitOdb         *odb,
+            const guint8      *oid,
+            GguGitObjectType  *type,
+            gsize             *length,
+            GError           **error)
+{
+  gchar   hex[GGU_GIT_ODB_OID_SIZE * 2 + 1];
+  gchar   dir_name[3];
+  guint   i;
+  
+  _ggu_git_odb_format_oid (oid, hex);
+  memcpy (dir_name, hex, 2);
+  dir_name[2] = 0;
+  
+  for (i = 0; i < odb->object_dirs->len; i++) {
+    gchar    *path;
+    gchar    *contents;
+    gsize     contents_len;
+    guint8   *data;
+    gsize     data_len;
+    guint8   *nul;
+    gchar    *end;
+    guint64   size;
+    gchar    *result;
+    
+    path = g_build_filename (g_ptr_array_index (odb->object_dirs, i),
+                             dir_name, hex + 2, NULL);
+    if (! g_file_get_contents (path, &contents, &contents_len, NULL)) {
+      g_free (path);
+      continue;
+    }
+    g_free (path);
+    
+    data = inflate_all ((const guint8 *) contents, contents_len, &data_len,
+                        error);
+    g_free (contents);
+    if (! data) {
+      return NULL;
+    }
+    
+    /* "<type> <size>\0<data>" */
+    nul = memchr (data, 0, data_len);
+    end = nul ? memchr (data, ' ', (gsize) (nul - data)) : NULL;
+    if (! end) {
+      g_free (data);
+      set_corrupt_error (error, "invalid loose object header");
+      return NULL;
+    }
+    *type = object_type_from_name ((const gchar *) data,
+                                   (gsize) ((guint8 *) end - data));
+    size = g_ascii_strtoull (end + 1, &end, 10);
+    if (*type == GGU_GIT_OBJECT_NONE || (guint8 *) end != nul ||
+        size != data_len - (gsize) (nul + 1 - data)) {
+      g_free (data);
+      set_corrupt_error (error, "invalid loose object header");
+      return NULL;
+    }
+    
+    result = g_malloc ((gsize) size + 1);
+    memcpy (result, nul + 1, (gsize) size);
+    result[size] = 0;
+    g_free (data);
+    if (length) {
+      *length = (gsize) size;
+    }
+    
+    return result;
+  }
+  
+  return NULL;
+}
+
+
+/* packs and indexes */
+
+static void
+pack_free (Pack *pack)
+{
+  if (pack->idx_map) {
+    g_mapped_file_unref (pack->idx_map);
+  }
+  if (pack->pack_map) {
+    g_mapped_file_unref (pack->pack_map);
+  }
+  g_free (pack->name);
+  g_slice_free1 (sizeof *pack, pack);
+}
+
+static Pack *
+pack_new (const gchar *name)
+{
+  Pack *pack = g_slice_alloc0 (sizeof *pack);
+  
+  pack->name = g_strdup (name);
+  
+  return pack;
+}
+
+/* loads a version 2 pack index */
+static gboolean
+pack_load_index (Pack *pack)
+{
+  gchar        *path;
+  const guint8 *idx;
+  gsize         len;
+  guint32       n;
+  
+  path = g_strconcat (pack->name, ".idx", NULL);
+  pack->idx_map = g_mapped_file_new (path, FALSE, NULL);
+  g_free (path);
+  if (! pack->idx_map) {
+    return FALSE;
+  }
+  
+  idx = (const guint8 *) g_mapped_file_get_contents (pack->idx_map);
+  len = g_mapped_file_get_length (pack->idx_map);
+  /* header, fanout, then at least the trailing checksums */
+  if (len < 8 + 256 * 4 + 2 * 20 ||
+      memcmp (idx, "\377tOc", 4) != 0 || get_be32 (idx + 4) != 2) {
+    goto invalid;
+  }
+  n = get_be32 (idx + 8 + 255 * 4);
+  /* OIDs, CRCs and offsets */
+  if ((len - 8 - 256 * 4 - 2 * 20) / (20 + 4 + 4) < n) {
+    goto invalid;
+  }
+  
+  pack->idx = idx;
+  pack->idx_len = len;
+  pack->n_objects = n;
+  
+  return TRUE;
+  
+invalid:
+  g_mapped_file_unref (pack->idx_map);
+  pack->idx_map = NULL;
+  return FALSE;
+}
+
+/* binary search of @oid in a sorted OID table, within the range given by a
+ * fanout table */
+static gboolean
+find_in_fanout (const guint8 *fanout,
+                const guint8 *oids,
+                const guint8 *oid,
+                guint32      *pos)
+{
+  guint32 lo = oid[0] ? get_be32 (fanout + (oid[0] - 1) * 4) : 0;
+  guint32 hi = get_be32 (fanout + oid[0] * 4);
+  
+  while (lo < hi) {
+    guint32 mid = lo + (hi - lo) / 2;
+    gint    cmp = memcmp (oids + (gsize) mid * 20, oid, 20);
+    
+    if (cmp == 0) {
+      *pos = mid;
+      return TRUE;
+    } else if (cmp < 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  
+  return FALSE;
+}
+
+static gboolean
+pack_find (const Pack   *pack,
+           const guint8 *oid,
+           guint64      *offset)
+{
+  const guint8 *fanout = pack->idx + 8;
+  const guint8 *oids = fanout + 256 * 4;
+  const guint8 *offsets = oids + (gsize) pack->n_objects * (20 + 4);
+  guint32       pos;
+  guint32       off;
+  
+  if (! find_in_fanout (fanout, oids, oid, &pos)) {
+    return FALSE;
+  }
+  
+  off = get_be32 (offsets + (gsize) pos * 4);
+  if (off & 0x80000000) {
+    const guint8 *large = offsets + (gsize) pack->n_objects * 4;
+    gsize         index = off & 0x7fffffff;
+    
+    if (large + (index + 1) * 8 > pack->idx + pack->idx_len - 2 * 20) {
+      return FALSE;
+    }
+    *offset = get_be64 (large + index * 8);
+  } else {
+    *offset = off;
+  }
+  
+  return TRUE;
+}
+
+/* maps @pack's data if not already done.  must be called with the lock */
+static gboolean
+pack_open (Pack    *pack,
+           GError **error)
+{
+  if (! pack->pack_map) {
+    gchar *path = g_strconcat (pack->name, ".pack", NULL);
+    
+    pack->pack_map = g_mapped_file_new (path, FALSE, error);
+    g_free (path);
+    if (! pack->pack_map) {
+      return FALSE;
+    }
+    pack->pack = (const guint8 *) g_mapped_file_get_contents (pack->pack_map);
+    pack->pack_len = g_mapped_file_get_length (pack->pack_map);
+    if (pack->pack_len < 12 + 20 || memcmp (pack->pack, "PACK", 4) != 0) {
+      g_mapped_file_unref (pack->pack_map);
+      pack->pack_map = NULL;
+      set_corrupt_error (error, "invalid pack");
+      return FALSE;
+    }
+  }
+  
+  return TRUE;
+}
+
+
+/* multi-pack-index */
+
+static void
+midx_free (Midx *midx)
+{
+  g_mapped_file_unref (midx->map);
+  g_ptr_array_free (midx->packs, TRUE);
+  g_slice_free1 (sizeof *midx, midx);
+}
+
+/* loads @dir's multi-pack-index, if any.  the packs it covers are added to
+ * the database.  must be called with the lock */
+static Midx *
+midx_load (GguGitOdb   *odb,
+           const gchar *pack_dir)
+{
+  Midx         *midx;
+  gchar        *path;
+  GMappedFile  *map;
+  const guint8 *data;
+  gsize         len;
+  guint         n_chunks;
+  guint32       n_packs;
+  const guint8 *names = NULL;
+  const guint8 *names_end = NULL;
+  guint         i;
+  
+  path = g_build_filename (pack_dir, "multi-pack-index", NULL);
+  map = g_mapped_file_new (path, FALSE, NULL);
+  g_free (path);
+  if (! map) {
+    return NULL;
+  }
+  
+  midx = g_slice_alloc0 (sizeof *midx);
+  midx->map = map;
+  midx->packs = g_ptr_array_new ();
+  data = (const guint8 *) g_mapped_file_get_contents (map);
+  len = g_mapped_file_get_length (map);
+  midx->data = data;
+  midx->len = len;
+  
+  /* "MIDX", version 1, SHA-1, chunk count, base count (must be 0), packs */
+  if (len < 12 || memcmp (data, "MIDX", 4) != 0 || data[4] != 1 ||
+      data[5] != 1 || data[7] != 0) {
+    goto invalid;
+  }
+  n_chunks = data[6];
+  n_packs = get_be32 (data + 8);
+  if (len < 12 + (n_chunks + 1) * 12 + 20) {
+    goto invalid;
+  }
+  
+  for (i = 0; i < n_chunks; i++) {
+    const guint8 *chunk = data + 12 + i * 12;
+    guint64       start = get_be64 (chunk + 4);
+    guint64       end = get_be64 (chunk + 12 + 4);
+    
+    if (start > end || end > len) {
+      goto invalid;
+    }
+    if (memcmp (chunk, "PNAM", 4) == 0) {
+      names = data + start;
+      names_end = data + end;
+    } else if (memcmp (chunk, "OIDF", 4) == 0) {
+      if (end - start != 256 * 4) {
+        goto invalid;
+      }
+      midx->fanout = data + start;
+    } else if (memcmp (chunk, "OIDL", 4) == 0) {
+      midx->oids = data + start;
+      midx->n_objects = (guint32) ((end - start) / 20);
+    } else if (memcmp (chunk, "OOFF", 4) == 0) {
+      midx->offsets = data + start;
+    } else if (memcmp (chunk, "LOFF", 4) == 0) {
+      midx->large_offsets = data + start;
+      midx->n_large_offsets = (guint32) ((end - start) / 8);
+    }
+  }
+  if (! names || ! midx->fanout || ! midx->oids || ! midx->offsets ||
+      get_be32 (midx->fanout + 255 * 4) != midx->n_objects ||
+      midx->offsets + (gsize) midx->n_objects * 8 > data + len) {
+    goto invalid;
+  }
+  
+  /* pack names are the .idx names, sorted and NUL-separated */
+  for (i = 0; i < n_packs; i++) {
+    const guint8 *nul;
+    gchar        *name;
+    gchar        *base;
+    Pack         *pack;
+    
+    nul = memchr (names, 0, (gsize) (names_end - names));
+    if (! nul || ! g_str_has_suffix ((const gchar *) names, ".idx")) {
+      goto invalid;
+    }
+    name = g_strndup ((const gchar *) names, (gsize) (nul - names) - 4);
+    base = g_build_filename (pack_dir, name, NULL);
+    g_free (name);
+    pack = g_hash_table_lookup (odb->pack_names, base);
+    if (! pack) {
+      pack = pack_new (base);
+      g_hash_table_insert (odb->pack_names, pack->name, pack);
+      g_ptr_array_add (odb->packs, pack);
+    }
+    g_free (base);
+    g_ptr_array_add (midx->packs, pack);
+    names = nul + 1;
+  }
+  
+  return midx;
+  
+invalid:
+  midx_free (midx);
+  return NULL;
+}
+
+static gboolean
+midx_find (const Midx    *midx,
+           const guint8  *oid,
+           Pack         **pack,
+           guint64       *offset)
+{
+  const guint8 *entry;
+  guint32       pos;
+  guint32       pack_id;
+  guint32       off;
+  
+  if (! find_in_fanout (midx->fanout, midx->oids, oid, &pos)) {
+    return FALSE;
+  }
+  
+  entry = midx->offsets + (gsize) pos * 8;
+  pack_id = get_be32 (entry);
+  off = get_be32 (entry + 4);
+  if (pack_id >= midx->packs->len) {
+    return FALSE;
+  }
+  if (off & 0x80000000) {
+    off &= 0x7fffffff;
+    if (! midx->large_offsets || off >= midx->n_large_offsets) {
+      return FALSE;
+    }
+    *offset = get_be64 (midx->large_offsets + (gsize) off * 8);
+  } else {
+    *offset = off;
+  }
+  *pack = g_ptr_array_index (midx->packs, pack_id);
+  
+  return TRUE;
+}
+
+
+/* pack discovery */
+
+/* adds the packs in the object directories we don't know yet, and on the
+ * first scan their multi-pack-indexes.  must be called with the lock.  returns
+ * whether new packs were found */
+static gboolean
+scan_packs (GguGitOdb *odb,
+            gboolean   first)
+{
+  gboolean found = FALSE;
+  guint    i;
+  
+  for (i = 0; i < odb->object_dirs->len; i++) {
+    gchar        *pack_dir;
+    GDir         *dir;
+    const gchar  *entry;
+    
+    pack_dir = g_build_filename (g_ptr_array_index (odb->object_dirs, i),
+                                 "pack", NULL);
+    if (first) {
+      Midx *midx = midx_load (odb, pack_dir);
+      
+      if (midx) {
+        g_ptr_array_add (odb->midxs, midx);
+        found = TRUE;
+      }
+    }
+    dir = g_dir_open (pack_dir, 0, NULL);
+    while (dir && (entry = g_dir_read_name (dir))) {
+      gchar *base;
+      
+      if (! g_str_has_prefix (entry, "pack-") ||
+          ! g_str_has_suffix (entry, ".idx")) {
+        continue;
+      }
+      base = g_build_filename (pack_dir, entry, NULL);
+      base[strlen (base) - 4] = 0;
+      if (! g_hash_table_lookup (odb->pack_names, base)) {
+        Pack *pack = pack_new (base);
+        
+        if (pack_load_index (pack)) {
+          g_hash_table_insert (odb->pack_names, pack->name, pack);
+          g_ptr_array_add (odb->packs, pack);
+          found = TRUE;
+        } else {
+          pack_free (pack);
+        }
+      }
+      g_free (base);
+    }
+    if (dir) {
+      g_dir_close (dir);
+    }
+    g_free (pack_dir);
+  }
+  
+  return found;
+}
+
+/* finds the pack containing @oid.  must be called with the lock */
+static gboolean
+find_packed (GguGitOdb     *odb,
+             const guint8  *oid,
+             Pack         **pack_,
+             guint64       *offset)
+{
+  guint i;
+  
+  for (i = 0; i < odb->midxs->len; i++) {
+    if (midx_find (g_ptr_array_index (odb->midxs, i), oid, pack_, offset)) {
+      return TRUE;
+    }
+  }
+  for (i = 0; i < odb->packs->len; i++) {
+    Pack *pack = g_ptr_array_index (odb->packs, i);
+    
+    if (pack->idx && pack_find (pack, oid, offset)) {
+      *pack_ = pack;
+      return TRUE;
+    }
+  }
+  
+  return FALSE;
+}
+
+
+/* delta base cache */
+
+static guint
+cache_key_hash (gconstpointer key)
+{
+  const CacheKey *k = key;
+  
+  return g_direct_hash (k->pack) ^ (guint) (k->offset ^ (k->offset >> 32));
+}
+
+static gboolean
+cache_key_equal (gconstpointer a,
+                 gconstpointer b)
+{
+  const CacheKey *ka = a;
+  const CacheKey *kb = b;
+  
+  return ka->pack == kb->pack && ka->offset == kb->offset;
+}
+
+static void
+cache_item_free (CacheItem *item)
+{
+  g_free (item->data);
+  g_slice_free1 (sizeof *item, item);
+}
+
+/* looks up a resolved object in the cache, and returns a copy of it.  must be
+ * called with the lock */
+static guint8 *
+cache_lookup (GguGitOdb         *odb,
+              const Pack        *pack,
+              guint64            offset,
+              GguGitObjectType  *type,
+              gsize             *length)
+{
+  CacheKey   key = { pack, offset };
+  CacheItem *item;
+  
+  item = g_hash_table_lookup (odb->cache, &key);
+  if (! item) {
+    return NULL;
+  }
+  
+  /* move to front */
+  g_queue_unlink (&odb->cache_lru, item->link);
+  g_queue_push_head_link (&odb->cache_lru, item->link);
+  
+  *type = item->type;
+  *length = item->length;
+  
+  return g_memdup2 (item->data, item->length + 1);
+}
+
+/* must be called with the lock */
+static void
+cache_insert (GguGitOdb        *odb,
+              const Pack       *pack,
+              guint64           offset,
+              GguGitObjectType  type,
+              const guint8     *data,
+              gsize             length)
+{
+  CacheItem *item;
+  CacheKey   key = { pack, offset };
+  
+  if (length > DELTA_CACHE_SIZE / 4 ||
+      g_hash_table_lookup (odb->cache, &key)) {
+    return;
+  }
+  
+  while (odb->cache_size + length > DELTA_CACHE_SIZE) {
+    CacheItem *old = g_queue_pop_tail (&odb->cache_lru);
+    
+    odb->cache_size -= old->length;
+    g_hash_table_remove (odb->cache, &old->key);
+  }
+  
+  item = g_slice_alloc (sizeof *item);
+  item->key = key;
+  item->type = type;
+  item->data = g_memdup2 (data, length + 1);
+  item->length = length;
+  g_queue_push_head (&odb->cache_lru, item);
+  item->link = odb->cache_lru.head;
+  g_hash_table_insert (odb->cache, &item->key, item);
+  odb->cache_size += length;
+}
+
+
+/* packed objects */
+
+typedef struct _PackEntry PackEntry;
+struct _PackEntry
+{
+  const Pack   *pack;
+  guint64       offset;
+  guint         type;
+  guint64       size;       /* inflated size */
+  const guint8 *data;       /* compressed data */
+  gsize         data_len;   /* max length of the compressed data */
+  const guint8 *base_oid;   /* for REF_DELTA */
+  /* location of the delta base */
+  const Pack   *base_pack;
+  guint64       base_offset;
+};
+
+static gboolean
+parse_pack_entry (const Pack  *pack,
+                  guint64      offset,
+                  PackEntry   *entry,
+                  GError     **error)
+{
+  const guint8 *p = pack->pack + offset;
+  const guint8 *end = pack->pack + pack->pack_len - 20;
+  guint8        c;
+  guint         shift;
+  
+  if (offset < 12 || p >= end) {
+    set_corrupt_error (error, "invalid pack offset");
+    return FALSE;
+  }
+  
+  entry->pack = pack;
+  entry->offset = offset;
+  c = *p++;
+  entry->type = (c >> 4) & 7;
+  entry->size = c & 15;
+  for (shift = 4; c & 0x80; shift += 7) {
+    if (p >= end || shift > 57) {
+      goto invalid;
+    }
+    c = *p++;
+    entry->size |= (guint64) (c & 0x7f) << shift;
+  }
+  
+  if (entry->type == PACK_OBJ_OFS_DELTA) {
+    guint64 off;
+    
+    if (p >= end) {
+      goto invalid;
+    }
+    c = *p++;
+    off = c & 0x7f;
+    while (c & 0x80) {
+      if (p >= end || off >= G_MAXUINT64 >> 8) {
+        goto invalid;
+      }
+      c = *p++;
+      off = ((off + 1) << 7) | (c & 0x7f);
+    }
+    if (off == 0 || off > offset) {
+      goto invalid;
+    }
+    entry->base_pack = pack;
+    entry->base_offset = offset - off;
+  } else if (entry->type == PACK_OBJ_REF_DELTA) {
+    if (end - p < 20) {
+      goto invalid;
+    }
+    entry->base_oid = p;
+    p += 20;
+  } else if (entry->type < PACK_OBJ_COMMIT || entry->type > PACK_OBJ_TAG) {
+    goto invalid;
+  }
+  
+  entry->data = p;
+  entry->data_len = (gsize) (end - p);
+  
+  return TRUE;
+  
+invalid:
+  set_corrupt_error (error, "invalid pack entry");
+  return FALSE;
+}
+
+static guint8 *
+inflate_pack_entry (const PackEntry  *entry,
+                    GError          **error)
+{
+  guint8 *data;
+  
+  if (entry->size >= G_MAXSIZE) {
+    set_corrupt_error (error, "object too big");
+    return NULL;
+  }
+  
+  data = g_malloc ((gsize) entry->size + 1);
+  if (! inflate_exact (entry->data, entry->data_len, data,
+                       (gsize) entry->size, error)) {
+    g_free (data);
+    return NULL;
+  }
+  data[entry->size] = 0;
+  
+  return data;
+}
+
+static gboolean
+read_delta_size (const guint8 **p,
+                 const guint8  *end,
+                 gsize         *size)
+{
+  guint shift = 0;
+  guint8 c;
+  
+  *size = 0;
+  do {
+    if (*p >= end || shift > sizeof (gsize) * 8 - 7) {
+      return FALSE;
+    }
+    c = *(*p)++;
+    *size |= (gsize) (c & 0x7f) << shift;
+    shift += 7;
+  } while (c & 0x80);
+  
+  return TRUE;
+}
+
+/* applies @delta to @base, returns the result */
+static guint8 *
+apply_delta (const guint8  *base,
+             gsize          base_len,
+             const guint8  *delta,
+             gsize          delta_len,
+             gsize         *length,
+             GError       **error)
+{
+  const guint8 *p = delta;
+  const guint8 *end = delta + delta_len;
+  gsize         src_size;
+  gsize         dst_size;
+  guint8       *out;
+  gsize         out_pos = 0;
+  
+  if (! read_delta_size (&p, end, &src_size) ||
+      ! read_delta_size (&p, end, &dst_size) ||
+      src_size != base_len || dst_size == G_MAXSIZE) {
+    goto invalid;
+  }
+  
+  out = g_malloc (dst_size + 1);
+  while (p < end) {
+    guint8 cmd = *p++;
+    
+    if (cmd & 0x80) {
+      gsize off = 0;
+      gsize size = 0;
+      guint i;
+      
+      for (i = 0; i < 4; i++) {
+        if (cmd & (1 << i)) {
+          if (p >= end) {
+            goto invalid_free;
+          }
+          off |= (gsize) *p++ << (i * 8);
+        }
+      }
+      for (i = 0; i < 3; i++) {
+        if (cmd & (0x10 << i)) {
+          if (p >= end) {
+            goto invalid_free;
+          }
+          size |= (gsize) *p++ << (i * 8);
+        }
+      }
+      if (size == 0) {
+        size = 0x10000;
+      }
+      if (off > base_len || size > base_len - off ||
+          size > dst_size - out_pos) {
+        goto invalid_free;
+      }
+      memcpy (out + out_pos, base + off, size);
+      out_pos += size;
+    } else if (cmd != 0) {
+      if (cmd > (gsize) (end - p) || cmd > dst_size - out_pos) {
+        goto invalid_free;
+      }
+      memcpy (out + out_pos, p, cmd);
+      out_pos += cmd;
+      p += cmd;
+    } else {
+      goto invalid_free;
+    }
+  }
+  if (out_pos != dst_size) {
+    goto invalid_free;
+  }
+  out[dst_size] = 0;
+  *length = dst_size;
+  
+  return out;
+  
+invalid_free:
+  g_free (out);
+invalid:
+  set_corrupt_error (error, "invalid delta");
+  return NULL;
+}
+
+static GguGitObjectType
+pack_type_to_object_type (guint type)
+{
+  switch (type) {
+    case PACK_OBJ_COMMIT: return GGU_GIT_OBJECT_COMMIT;
+    case PACK_OBJ_TREE:   return GGU_GIT_OBJECT_TREE;
+    case PACK_OBJ_BLOB:   return GGU_GIT_OBJECT_BLOB;
+    case PACK_OBJ_TAG:    return GGU_GIT_OBJECT_TAG;
+  }
+  
+  return GGU_GIT_OBJECT_NONE;
+}
+
+/* reads the object at @offset in @pack, resolving deltas.  the delta chain
+ * is first walked down to a base (or a cached object), and the deltas are
+ * then applied back up, caching the intermediate objects as they are likely
+ * to be the base of other objects we'll be asked for. */
+static gchar *
+read_packed (GguGitOdb         *odb,
+             Pack              *pack,
+             guint64            offset,
+             GguGitObjectType  *type,
+             gsize             *length,
+             GError           **error)
+{
+  GArray   *chain;
+  guint8   *data = NULL;
+  gsize     data_len = 0;
+  
+  chain = g_array_new (FALSE, FALSE, sizeof (PackEntry));
+  
+  g_mutex_lock (&odb->lock);
+  for (;;) {
+    PackEntry entry;
+    
+    data = cache_lookup (odb, pack, offset, type, &data_len);
+    if (data) {
+      break;
+    }
+    if (chain->len >= MAX_DELTA_CHAIN) {
+      set_corrupt_error (error, "delta chain too long");
+      break;
+    }
+    if (! pack_open (pack, error) ||
+        ! parse_pack_entry (pack, offset, &entry, error)) {
+      break;
+    }
+    
+    if (entry.type == PACK_OBJ_OFS_DELTA) {
+      g_array_append_val (chain, entry);
+      offset = entry.base_offset;
+    } else if (entry.type == PACK_OBJ_REF_DELTA) {
+      /* the base is usually in the same pack */
+      if (! (pack->idx && pack_find (pack, entry.base_oid, &offset)) &&
+          ! find_packed (odb, entry.base_oid, &pack, &offset)) {
+        set_corrupt_error (error, "missing delta base");
+        break;
+      }
+      entry.base_pack = pack;
+      entry.base_offset = offset;
+      g_array_append_val (chain, entry);
+    } else {
+      g_mutex_unlock (&odb->lock);
+      data = inflate_pack_entry (&entry, error);
+      data_len = (gsize) entry.size;
+      *type = pack_type_to_object_type (entry.type);
+      g_mutex_lock (&odb->lock);
+      break;
+    }
+  }
+  g_mutex_unlock (&odb->lock);
+  
+  while (data && chain->len > 0) {
+    PackEntry *entry = &g_array_index (chain, PackEntry, chain->len - 1);
+    guint8    *delta;
+    guint8    *result = NULL;
+    gsize      result_len = 0;
+    
+    delta = inflate_pack_entry (entry, error);
+    if (delta) {
+      result = apply_delta (data, data_len, delta, (gsize) entry->size,
+                            &result_len, error);
+      g_free (delta);
+    }
+    
+    /* the object we just used is a delta base, keep it around */
+    g_mutex_lock (&odb->lock);
+    if (result) {
+      cache_insert (odb, entry->base_pack, entry->base_offset, *type,
+                    data, data_len);
+    }
+    g_mutex_unlock (&odb->lock);
+    
+    g_free (data);
+    data = result;
+    data_len = result_len;
+    g_array_set_size (chain, chain->len - 1);
+  }
+  g_array_free (chain, TRUE);
+  
+  if (data && length) {
+    *length = data_len;
+  }
+  
+  return (gchar *) data;
+}
+
+
+/* database */
+
+/* finds the Git directory of the repository containing @dir */
+static gchar *
+find_git_dir (const gchar *dir)
+{
+  gchar *root = g_strdup (dir);
+  
+  while (root) {
+    gchar *guess;
+    gchar *contents;
+    gchar *tmp;
+    
+    guess = g_build_filename (root, ".git", NULL);
+    if (g_file_test (guess, G_FILE_TEST_IS_DIR)) {
+      g_free (root);
+      return guess;
+    }
+    /* worktrees and submodules have a file pointing to the actual dir */
+    if (g_file_get_contents (guess, &contents, NULL, NULL)) {
+      if (g_str_has_prefix (contents, "gitdir: ")) {
+        gchar *git_dir = g_strstrip (contents + 8);
+        
+        if (! g_path_is_absolute (git_dir)) {
+          git_dir = g_build_filename (root, git_dir, NULL);
+        } else {
+          git_dir = g_strdup (git_dir);
+        }
+        g_free (contents);
+        g_free (guess);
+        g_free (root);
+        return git_dir;
+      }
+      g_free (contents);
+    }
+    g_free (guess);
+    
+    tmp = g_path_get_dirname (root);
+    if (g_strcmp0 (tmp, root) == 0) {
+      g_free (tmp);
+      tmp = NULL;
+    }
+    g_free (root);
+    root = tmp;
+  }
+  
+  return NULL;
+}
+
+/* reads a file containing a path, relative to @base if not absolute */
+static gchar *
+read_path_file (const gchar *base,
+                const gchar *file)
+{
+  gchar *path = g_build_filename (base, file, NULL);
+  gchar *contents;
+  gchar *result = NULL;
+  
+  if (g_file_get_contents (path, &contents, NULL, NULL)) {
+    g_strstrip (contents);
+    if (g_path_is_absolute (contents)) {
+      result = g_strdup (contents);
+    } else {
+      result = g_build_filename (base, contents, NULL);
+    }
+    g_free (contents);
+  }
+  g_free (path);
+  
+  return result;
+}
+
+static void
+odb_free (GguGitOdb *odb)
+{
+  g_mutex_clear (&odb->lock);
+  g_hash_table_destroy (odb->cache);
+  g_queue_clear (&odb->cache_lru);
+  g_ptr_array_free (odb->midxs, TRUE);
+  g_ptr_array_free (odb->packs, TRUE);
+  g_hash_table_destroy (odb->pack_names);
+  g_ptr_array_free (odb->object_dirs, TRUE);
+  g_free (odb->git_dir);
+  g_free (odb->common_dir);
+  g_slice_free1 (sizeof *odb, odb);
+}
+
+static GguGitOdb *
+odb_new (gchar *git_dir)
+{
+  GguGitOdb  *odb;
+  gchar      *objects;
+  gchar      *alternates;
+  gchar      *contents;
+  
+  odb = g_slice_alloc0 (sizeof *odb);
+  odb->ref_count = 1;
+  odb->git_dir = git_dir;
+  odb->common_dir = read_path_file (git_dir, "commondir");
+  if (! odb->common_dir) {
+    odb->common_dir = g_strdup (git_dir);
+  }
+  
+  odb->object_dirs = g_ptr_array_new_with_free_func (g_free);
+  objects = g_build_filename (odb->common_dir, "objects", NULL);
+  g_ptr_array_add (odb->object_dirs, objects);
+  /* alternates, one level */
+  alternates = g_build_filename (objects, "info", "alternates", NULL);
+  if (g_file_get_contents (alternates, &contents, NULL, NULL)) {
+    gchar **lines = g_strsplit (contents, "\n", 0);
+    guint   i;
+    
+    for (i = 0; lines[i]; i++) {
+      if (*lines[i] && *lines[i] != '#') {
+        g_ptr_array_add (odb->object_dirs,
+                         g_path_is_absolute (lines[i])
+                         ? g_strdup (lines[i])
+                         : g_build_filename (objects, lines[i], NULL));
+      }
+    }
+    g_strfreev (lines);
+    g_free (contents);
+  }
+  g_free (alternates);
+  
+  g_mutex_init (&odb->lock);
+  odb->midxs = g_ptr_array_new_with_free_func ((GDestroyNotify) midx_free);
+  odb->packs = g_ptr_array_new_with_free_func ((GDestroyNotify) pack_free);
+  odb->pack_names = g_hash_table_new (g_str_hash, g_str_equal);
+  odb->cache = g_hash_table_new_full (cache_key_hash, cache_key_equal,
+                                      NULL, (GDestroyNotify) cache_item_free);
+  g_queue_init (&odb->cache_lru);
+  odb->cache_size = 0;
+  scan_packs (odb, TRUE);
+  
+  return odb;
+}
+
+static GMutex       G_odbs_lock;
+static GHashTable  *G_odbs = NULL; /* Git dir -> GguGitOdb */
+
+/**
+ * _ggu_git_odb_open:
+ * @dir: A directory inside a repository
+ * @error: Return location for errors, or %NULL to ignore them
+ * 
+ * Gets the object database of the repository containing @dir.  Databases are
+ * cached, so opening the same repository again is cheap.
+ * 
+ * Returns: A new reference to the object database, or %NULL if @dir isn't in
+ *          a repository
+ */
+GguGitOdb *
+_ggu_git_odb_open (const gchar *dir,
+                   GError     **error)
+{
+  GguGitOdb  *odb;
+  gchar      *git_dir;
+  
+  g_return_val_if_fail (dir != NULL, NULL);
+  
+  git_dir = find_git_dir (dir);
+  if (! git_dir) {
+    g_set_error (error, GGU_GIT_ERROR, GGU_GIT_ERROR_FAILED,
+                 "\"%s\" is not in a Git repository", dir);
+    return NULL;
+  }
+  
+  g_mutex_lock (&G_odbs_lock);
+  if (G_UNLIKELY (! G_odbs)) {
+    G_odbs = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+                                    (GDestroyNotify) _ggu_git_odb_unref);
+  }
+  odb = g_hash_table_lookup (G_odbs, git_dir);
+  if (odb) {
+    g_free (git_dir);
+  } else {
+    odb = odb_new (git_dir);
+    g_hash_table_insert (G_odbs, odb->git_dir, odb);
+  }
+  _ggu_git_odb_ref (odb);
+  g_mutex_unlock (&G_odbs_lock);
+  
+  return odb;
+}
+
+GguGitOdb *
+_ggu_git_odb_ref (GguGitOdb *odb)
+{
+  g_atomic_int_inc (&odb->ref_count);
+  return odb;
+}
+
+void
+_ggu_git_odb_unref (GguGitOdb *odb)
+{
+  if (g_atomic_int_dec_and_test (&odb->ref_count)) {
+    odb_free (odb);
+  }
+}
+
+/**
+ * _ggu_git_odb_get_common_dir:
+ * @odb: A #GguGitOdb
+ * 
+ * Gets the directory holding the data shared by all worktrees of the
+ * repository, like the refs and the objects.
+ * 
+ * Returns: The path of the common Git directory
+ */
+const gchar *
+_ggu_git_odb_get_common_dir (GguGitOdb *odb)
+{
+  return odb->common_dir;
+}
+
+/**
+ * _ggu_git_odb_read:
+ * @odb: A #GguGitOdb
+ * @oid: The raw ID of the object to read
+ * @type: Return location for the type of the object
+ * @length: Return location for the length of the object, or %NULL
+ * @error: Return location for errors, or %NULL to ignore them
+ * 
+ * Reads an object.  If the object is not found, %NULL is returned without
+ * setting @error.
+ * 
+ * Returns: The content of the object, followed by a terminating 0 not part of
+ *          @length, or %NULL
+ */
+gchar *
+_ggu_git_odb_read (GguGitOdb         *odb,
+                   const guint8      *oid,
+                   GguGitObjectType  *type,
+                   gsize             *length,
+                   GError           **error)
+{
+  Pack     *pack;
+  guint64   offset;
+  gboolean  found;
+  gchar    *data;
+  GError   *err = NULL;
+  
+  g_mutex_lock (&odb->lock);
+  found = find_packed (odb, oid, &pack, &offset);
+  g_mutex_unlock (&odb->lock);
+  if (found) {
+    return read_packed (odb, pack, offset, type, length, error);
+  }
+  
+  data = read_loose (odb, oid, type, length, &err);
+  if (! data && ! err) {
+    /* maybe it got packed since we looked at the packs */
+    g_mutex_lock (&odb->lock);
+    found = scan_packs (odb, FALSE) && find_packed (odb, oid, &pack, &offset);
+    g_mutex_unlock (&odb->lock);
+    if (found) {
+      return read_packed (odb, pack, offset, type, length, error);
+    }
+  }
+  if (err) {
+    g_propagate_error (error, err);
+  }
+  
+  return data;
+}
+
+
+/* references */
+
+/* reads a reference from its loose file or from packed-refs, without
+ * following it if it's symbolic.  returns the target */
+static gchar *
+read_ref (GguGitOdb   *odb,
+          const gchar *name)
+{
+  gchar *path;
+  gchar *contents = NULL;
+  
+  /* HEAD and the like are per worktree, the rest is shared */
+  if (g_str_has_prefix (name, "refs/")) {
+    path = g_build_filename (odb->common_dir, name, NULL);
+  } else {
+    path = g_build_filename (odb->git_dir, name, NULL);
+  }
+  if (g_file_get_contents (path, &contents, NULL, NULL)) {
+    g_strstrip (contents);
+  }
+  g_free (path);
+  
+  if (! contents && g_str_has_prefix (name, "refs/")) {
+    gchar *packed;
+    
+    path = g_build_filename (odb->common_dir, "packed-refs", NULL);
+    if (g_file_get_contents (path, &packed, NULL, NULL)) {
+      gsize  name_len = strlen (name);
+      gchar *line = packed;
+      
+      /* "<hash> <name>" lines, plus comments and peeled tags */
+      while (line && *line) {
+        gchar *eol = strchr (line, '\n');
+        
+        if (eol) {
+          *eol = 0;
+        }
+        if (*line != '#' && *line != '^' &&
+            strlen (line) == GGU_GIT_ODB_OID_SIZE * 2 + 1 + name_len &&
+            strcmp (line + GGU_GIT_ODB_OID_SIZE * 2 + 1, name) == 0) {
+          contents = g_strndup (line, GGU_GIT_ODB_OID_SIZE * 2);
+          break;
+        }
+        line = eol ? eol + 1 : NULL;
+      }
+      g_free (packed);
+    }
+    g_free (path);
+  }
+  
+  return contents;
+}
+
+/* resolves a reference, following symbolic references */
+static gboolean
+resolve_ref (GguGitOdb   *odb,
+             const gchar *name,
+             guint8       oid[GGU_GIT_ODB_OID_SIZE])
+{
+  gchar    *target = read_ref (odb, name);
+  gboolean  found = FALSE;
+  guint     depth;
+  
+  for (depth = 0; target && depth < MAX_SYMREF_DEPTH; depth++) {
+    gchar *next;
+    
+    if (! g_str_has_prefix (target, "ref: ")) {
+      found = (is_odb_oid (target) &&
+               _ggu_git_odb_parse_oid (target, oid));
+      break;
+    }
+    next = read_ref (odb, target + 5);
+    g_free (target);
+    target = next;
+  }
+  g_free (target);
+  
+  return found;
+}
+
+/**
+ * _ggu_git_odb_resolve:
+ * @odb: A #GguGitOdb
+ * @rev: A revision
+ * @oid: Return location for the raw object ID
+ * 
+ * Resolves a simple revision: either a full hash or a reference name, looked
+ * up like Git does.  Revision expressions are not supported.
+ * 
+ * Returns: Whether the revision could be resolved
+ */
+gboolean
+_ggu_git_odb_resolve (GguGitOdb   *odb,
+                      const gchar *rev,
+                      guint8       oid[GGU_GIT_ODB_OID_SIZE])
+{
+  static const gchar *const rules[] = {
+    "%s",
+    "refs/%s",
+    "refs/tags/%s",
+    "refs/heads/%s",
+    "refs/remotes/%s",
+    "refs/remotes/%s/HEAD"
+  };
+  guint i;
+  
+  if (is_odb_oid (rev)) {
+    return _ggu_git_odb_parse_oid (rev, oid);
+  }
+  /* reject what may escape the Git directory or be an expression */
+  if (! *rev || strstr (rev, "..") || strpbrk (rev, "~^:@{}[]?*\\ ") ||
+      g_path_is_absolute (rev)) {
+    return FALSE;
+  }
+  
+  for (i = 0; i < G_N_ELEMENTS (rules); i++) {
+    gchar    *name = g_strdup_printf (rules[i], rev);
+    gboolean  found = resolve_ref (odb, name, oid);
+    
+    g_free (name);
+    if (found) {
+      return TRUE;
+    }
+  }
+  
+  return FALSE;
+}
+
+/* finds @name in a tree, returns the entry's mode or 0 */
+static guint
+tree_find (const gchar  *tree,
+           gsize         length,
+           const gchar  *name,
+           gsize         name_len,
+           guint8        oid[GGU_GIT_ODB_OID_SIZE])
+{
+  const gchar *p = tree;
+  const gchar *end = tree + length;
+  
+  /* "<octal mode> <name>\0<raw oid>" entries */
+  while (p < end) {
+    const gchar *space = memchr (p, ' ', (gsize) (end - p));
+    const gchar *nul;
+    guint        mode = 0;
+    
+    if (! space) {
+      break;
+    }
+    nul = memchr (space, 0, (gsize) (end - space));
+    if (! nul || end - nul - 1 < GGU_GIT_ODB_OID_SIZE) {
+      break;
+    }
+    for (; p < space; p++) {
+      mode = mode * 8 + (guint) (*p - '0');
+    }
+    if ((gsize) (nul - space - 1) == name_len &&
+        memcmp (space + 1, name, name_len) == 0) {
+      memcpy (oid, nul + 1, GGU_GIT_ODB_OID_SIZE);
+      return mode;
+    }
+    p = nul + 1 + GGU_GIT_ODB_OID_SIZE;
+  }
+  
+  return 0;
+}
+
+/**
+ * _ggu_git_odb_find_path:
+ * @odb: A #GguGitOdb
+ * @tree: The raw ID of the tree to look into
+ * @path: Path of an entry relative to @tree
+ * @mode: Return location for the mode of the entry, or 0 if it doesn't exist
+ * @oid: Return location for the raw ID of the entry
+ * @error: Return location for errors, or %NULL to ignore them
+ * 
+ * Finds the entry at @path in @tree, like `git ls-tree tree path` does.
+ * 
+ * Returns: %FALSE if a tree couldn't be read, %TRUE otherwise
+ */
+gboolean
+_ggu_git_odb_find_path (GguGitOdb    *odb,
+                        const guint8 *tree,
+                        const gchar  *path,
+                        guint        *mode,
+                        guint8        oid[GGU_GIT_ODB_OID_SIZE],
+                        GError      **error)
+{
+  const gchar *p = path;
+  
+  memmove (oid, tree, GGU_GIT_ODB_OID_SIZE);
+  *mode = 0040000;
+  while (*p) {
+    const gchar      *slash = strchr (p, '/');
+    gsize             len = slash ? (gsize) (slash - p) : strlen (p);
+    GguGitObjectType  type;
+    gchar            *data;
+    gsize             data_len;
+    
+    if ((*mode & 0170000) != 0040000) {
+      /* not a tree on the way */
+      *mode = 0;
+      break;
+    }
+    data = _ggu_git_odb_read (odb, oid, &type, &data_len, error);
+    if (! data || type != GGU_GIT_OBJECT_TREE) {
+      if (data) {
+        set_corrupt_error (error, "tree entry is not a tree");
+      }
+      g_free (data);
+      return FALSE;
+    }
+    *mode = tree_find (data, data_len, p, len, oid);
+    g_free (data);
+    if (*mode == 0) {
+      break;
+    }
+    p += len;
+    while (*p == '/') {
+      p++;
+    }
+  }
+  
+  return TRUE;
+}
+
+/**
+ * _ggu_git_odb_read_path:
+ * @odb: A #GguGitOdb
+ * @rev: A revision, see _ggu_git_odb_resolve()
+ * @path: Path of a file relative to the repository root
+ * @length: Return location for the length of the content, or %NULL
+ * @error: Return location for errors, or %NULL to ignore them
+ * 
+ * Reads the content of a file at a given revision, like `git show rev:path`
+ * does.  If something is not found or not supported, %NULL is returned
+ * without setting @error.
+ * 
+ * Returns: The content of the file, followed by a terminating 0 not part of
+ *          @length, or %NULL
+ */
+gchar *
+_ggu_git_odb_read_path (GguGitOdb    *odb,
+                        const gchar  *rev,
+                        const gchar  *path,
+                        gsize        *length,
+                        GError      **error)
+{
+  guint8            oid[GGU_GIT_ODB_OID_SIZE];
+  GguGitObjectType  type;
+  gchar            *data;
+  gsize             data_len;
+  guint             mode;
+  
+  if (! _ggu_git_odb_resolve (odb, rev, oid)) {
+    return NULL;
+  }
+  
+  /* peel tags and commits down to a tree */
+  for (;;) {
+    data = _ggu_git_odb_read (odb, oid, &type, &data_len, error);
+    if (! data) {
+      return NULL;
+    }
+    if (type == GGU_GIT_OBJECT_TREE) {
+      break;
+    } else if ((type == GGU_GIT_OBJECT_COMMIT &&
+                g_str_has_prefix (data, "tree ")) ||
+               (type == GGU_GIT_OBJECT_TAG &&
+                g_str_has_prefix (data, "object "))) {
+      gboolean valid = _ggu_git_odb_parse_oid (strchr (data, ' ') + 1, oid);
+      
+      g_free (data);
+      if (! valid) {
+        return NULL;
+      }
+    } else {
+      g_free (data);
+      return NULL;
+    }
+  }
+  g_free (data);
+  
+  /* we only want blobs */
+  if (! _ggu_git_odb_find_path (odb, oid, path, &mode, oid, error) ||
+      ((mode & 0170000) != 0100000 && (mode & 0170000) != 0120000)) {
+    return NULL;
+  }
+  data = _ggu_git_odb_read (odb, oid, &type, &data_len, error);
+  if (! data) {
+    return NULL;
+  }
+  if (type != GGU_GIT_OBJECT_BLOB) {
+    g_free (data);
+    return NULL;
+  }
+  if (length) {
+    *length = data_len;
+  }
+  
+  return data;
+}
@@ -0,0 +1,77 @@
+/*
+ * Copyright 2011 Colomban Wendling <ban@herbesfolles.org>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+#ifndef H_GGU_GIT_ODB
+#define H_GGU_GIT_ODB
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+
+/* size of a raw object ID */
+#define GGU_GIT_ODB_OID_SIZE 20
+
+typedef enum
+{
+  GGU_GIT_OBJECT_NONE   = 0,
+  GGU_GIT_OBJECT_COMMIT = 1,
+  GGU_GIT_OBJECT_TREE   = 2,
+  GGU_GIT_OBJECT_BLOB   = 3,
+  GGU_GIT_OBJECT_TAG    = 4
+} GguGitObjectType;
+
+typedef struct _GguGitOdb GguGitOdb;
+
+
+gboolean      _ggu_git_odb_parse_oid      (const gchar *hex,
+                                           guint8       oid[GGU_GIT_ODB_OID_SIZE]);
+void          _ggu_git_odb_format_oid     (const guint8 *oid,
+                                           gchar         hex[GGU_GIT_ODB_OID_SIZE * 2 + 1]);
+
+GguGitOdb    *_ggu_git_odb_open           (const gchar *dir,
+                                           GError     **error);
+GguGitOdb    *_ggu_git_odb_ref            (GguGitOdb *odb);
+void          _ggu_git_odb_unref          (GguGitOdb *odb);
+const gchar  *_ggu_git_odb_get_common_dir (GguGitOdb *odb);
+gboolean      _ggu_git_odb_resolve        (GguGitOdb   *odb,
+                                           const gchar *rev,
+                                           guint8       oid[GGU_GIT_ODB_OID_SIZE]);
+gchar        *_ggu_git_odb_read           (GguGitOdb         *odb,
+                                           const guint8      *oid,
+                                           GguGitObjectType  *type,
+                                           gsize             *length,
+                                           GError           **error);
+gboolean      _ggu_git_odb_find_path      (GguGitOdb    *odb,
+                                           const guint8 *tree,
+                                           const gchar  *path,
+                                           guint        *mode,
+                                           guint8        oid[GGU_GIT_ODB_OID_SIZE],
+                                           GError      **error);
+gchar        *_ggu_git_odb_read_path      (GguGitOdb    *odb,
+                                           const gchar  *rev,
+                                           const gchar  *path,
+                                           gsize        *length,
+                                           GError      **error);
+
+G_END_DECLS
+
+#endif /* guard */
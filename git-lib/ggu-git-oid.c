@@ -0,0 +1,341 @@
+/*
+ * Copyright 2011 Colomban Wendling <ban@herbesfolles.org>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+#include "ggu-git-oid.h"
+
+#include <string.h>
+#include <glib.h>
+#include <glib-object.h>
+
+#if defined (__SSE2__)
+# include <emmintrin.h>
+#endif
+
+#include "ggu-glib-compat.h"
+
+
+G_DEFINE_BOXED_TYPE (GguGitOid,
+                     ggu_git_oid,
+                     ggu_git_oid_ref,
+                     ggu_git_oid_unref)
+
+
+#if defined (__SSE2__)
+
+/* values of the hexadecimal digits of @v and a mask of which bytes were
+ * hexadecimal digits */
+static inline __m128i
+hex_digits_decode_16 (__m128i   v,
+                      __m128i  *valid)
+{
+  const __m128i lower = _mm_or_si128 (v, _mm_set1_epi8 (0x20));
+  const __m128i digit = _mm_and_si128 (_mm_cmpgt_epi8 (v, _mm_set1_epi8 ('0' - 1)),
+                                       _mm_cmplt_epi8 (v, _mm_set1_epi8 ('9' + 1)));
+  const __m128i alpha = _mm_and_si128 (_mm_cmpgt_epi8 (lower, _mm_set1_epi8 ('a' - 1)),
+                                       _mm_cmplt_epi8 (lower, _mm_set1_epi8 ('f' + 1)));
+  
+  *valid = _mm_or_si128 (digit, alpha);
+  
+  return _mm_or_si128 (_mm_and_si128 (digit,
+                                      _mm_sub_epi8 (v, _mm_set1_epi8 ('0'))),
+                       _mm_andnot_si128 (digit,
+                                         _mm_sub_epi8 (lower, _mm_set1_epi8 ('a' - 10))));
+}
+
+#endif /* __SSE2__ */
+
+/**
+ * _ggu_git_hex_span:
+ * @str: A string
+ * @length: The length of @str
+ * 
+ * Returns: The number of hexadecimal digits at the start of @str
+ */
+gsize
+_ggu_git_hex_span (const gchar *str,
+                   gsize        length)
+{
+  gsize i = 0;
+  
+#if defined (__SSE2__)
+  for (; i + 16 <= length; i += 16) {
+    __m128i valid;
+    guint   mask;
+    
+    hex_digits_decode_16 (_mm_loadu_si128 ((const __m128i *) &str[i]), &valid);
+    mask = (guint) _mm_movemask_epi8 (valid);
+    if (mask != 0xffff) {
+      return i + (gsize) g_bit_nth_lsf (~mask, -1);
+    }
+  }
+#endif
+  for (; i < length && g_ascii_isxdigit (str[i]); i++);
+  
+  return i;
+}
+
+/**
+ * _ggu_git_hex_decode:
+ * @hex: A string of at least @length bytes
+ * @length: The number of hexadecimal digits to decode, must be even
+ * @raw: Return location for the @length / 2 decoded bytes
+ * 
+ * Returns: Whether the @length first bytes of @hex were hexadecimal digits.
+ *          If not, the content of @raw is undefined.
+ */
+gboolean
+_ggu_git_hex_decode (const gchar *hex,
+                     gsize        length,
+                     guint8      *raw)
+{
+  gsize i = 0;
+  
+  g_return_val_if_fail (length % 2 == 0, FALSE);
+  
+#if defined (__SSE2__)
+  for (; i + 16 <= length; i += 16) {
+    __m128i valid;
+    __m128i values;
+    __m128i bytes;
+    
+    values = hex_digits_decode_16 (_mm_loadu_si128 ((const __m128i *) &hex[i]),
+                                   &valid);
+    if (_mm_movemask_epi8 (valid) != 0xffff) {
+      return FALSE;
+    }
+    /* each 16 bits word holds a high nibble in its low byte and the
+     * corresponding low nibble in its high byte */
+    bytes = _mm_or_si128 (_mm_slli_epi16 (_mm_and_si128 (values,
+                                                         _mm_set1_epi16 (0x00ff)),
+                                          4),
+                          _mm_srli_epi16 (values, 8));
+    _mm_storel_epi64 ((__m128i *) &raw[i / 2], _mm_packus_epi16 (bytes, bytes));
+  }
+#endif
+  for (; i < length; i += 2) {
+    gint hi = g_ascii_xdigit_value (hex[i]);
+    gint lo = hi < 0 ? -1 : g_ascii_xdigit_value (hex[i + 1]);
+    
+    if (lo < 0) {
+      return FALSE;
+    }
+    raw[i / 2] = (guint8) (hi << 4 | lo);
+  }
+  
+  return TRUE;
+}
+
+/**
+ * _ggu_git_hex_encode:
+ * @raw: Bytes to encode
+ * @size: The number of bytes in @raw
+ * @hex: Return location for the 0-terminated hexadecimal representation of
+ *       @raw, at least @size * 2 + 1 bytes
+ */
+void
+_ggu_git_hex_encode (const guint8 *raw,
+                     gsize         size,
+                     gchar        *hex)
+{
+  static const gchar digits[] = "0123456789abcdef";
+  gsize i;
+  
+  for (i = 0; i < size; i++) {
+    hex[i * 2]      = digits[raw[i] >> 4];
+    hex[i * 2 + 1]  = digits[raw[i] & 0xf];
+  }
+  hex[i * 2] = 0;
+}
+
+
+/* an ID only takes the bytes it needs, 25 for a SHA-1 one */
+#define OID_ALLOC_SIZE(size) (G_STRUCT_OFFSET (GguGitOid, raw) + (size))
+
+G_LOCK_DEFINE_STATIC (oids);
+static GHashTable *oids = NULL;
+
+static guint
+oid_hash (gconstpointer key)
+{
+  const GguGitOid  *oid = key;
+  guint32           hash;
+  
+  /* object IDs are already well distributed */
+  memcpy (&hash, oid->raw, sizeof hash);
+  
+  return hash;
+}
+
+static gboolean
+oid_equal (gconstpointer a,
+           gconstpointer b)
+{
+  const GguGitOid *oid_a = a;
+  const GguGitOid *oid_b = b;
+  
+  return (oid_a->size == oid_b->size &&
+          memcmp (oid_a->raw, oid_b->raw, oid_a->size) == 0);
+}
+
+static GguGitOid *
+oid_intern (const GguGitOid *key)
+{
+  GguGitOid *oid;
+  
+  G_LOCK (oids);
+  if (G_UNLIKELY (! oids)) {
+    oids = g_hash_table_new (oid_hash, oid_equal);
+  }
+  oid = g_hash_table_lookup (oids, key);
+  if (oid) {
+    g_atomic_int_inc (&oid->ref_count);
+  } else {
+    oid = g_slice_alloc (OID_ALLOC_SIZE (key->size));
+    oid->ref_count = 1;
+    oid->size = key->size;
+    memcpy (oid->raw, key->raw, key->size);
+    g_hash_table_insert (oids, oid, oid);
+  }
+  G_UNLOCK (oids);
+  
+  return oid;
+}
+
+/**
+ * ggu_git_oid_intern_raw:
+ * @raw: A raw object ID
+ * @size: The size of @raw, either %GGU_GIT_OID_SHA1_SIZE or
+ *        %GGU_GIT_OID_MAX_SIZE
+ * 
+ * Gets the #GguGitOid for @raw.
+ * 
+ * Returns: A reference to the #GguGitOid for @raw
+ */
+GguGitOid *
+ggu_git_oid_intern_raw (const guint8 *raw,
+                        gsize         size)
+{
+  GguGitOid *key;
+  
+  g_return_val_if_fail (size == GGU_GIT_OID_SHA1_SIZE ||
+                        size == GGU_GIT_OID_MAX_SIZE, NULL);
+  
+  key = g_alloca (OID_ALLOC_SIZE (size));
+  key->size = (guint8) size;
+  memcpy (key->raw, raw, size);
+  
+  return oid_intern (key);
+}
+
+/**
+ * ggu_git_oid_intern_hex:
+ * @hex: A full hexadecimal object ID
+ * @length: The length of @hex, or -1 if it is 0-terminated
+ * 
+ * Gets the #GguGitOid for @hex.
+ * 
+ * Returns: A reference to the #GguGitOid for @hex, or %NULL if @hex isn't a
+ *          valid object ID
+ */
+GguGitOid *
+ggu_git_oid_intern_hex (const gchar *hex,
+                        gssize       length)
+{
+  GguGitOid *key;
+  
+  if (length < 0) {
+    length = (gssize) strlen (hex);
+  }
+  if (length != GGU_GIT_OID_SHA1_SIZE * 2 &&
+      length != GGU_GIT_OID_MAX_SIZE * 2) {
+    return NULL;
+  }
+  key = g_alloca (OID_ALLOC_SIZE (length / 2));
+  if (! _ggu_git_hex_decode (hex, (gsize) length, key->raw)) {
+    return NULL;
+  }
+  key->size = (guint8) (length / 2);
+  
+  return oid_intern (key);
+}
+
+/**
+ * ggu_git_oid_ref:
+ * @oid: A #GguGitOid
+ * 
+ * Adds a reference to a #GguGitOid.
+ * 
+ * Returns: @oid
+ */
+GguGitOid *
+ggu_git_oid_ref (GguGitOid *oid)
+{
+  g_atomic_int_inc (&oid->ref_count);
+  return oid;
+}
+
+/**
+ * ggu_git_oid_unref:
+ * @oid: A #GguGitOid
+ * 
+ * Drops a reference from a #GguGitOid.  If the reference count drops to 0,
+ * the object ID is removed from the interning table and destroyed.
+ */
+void
+ggu_git_oid_unref (GguGitOid *oid)
+{
+  gint count;
+  
+  /* only the last reference needs the lock, so that the ID can't be looked up
+   * again while it is being removed */
+  do {
+    count = g_atomic_int_get (&oid->ref_count);
+  } while (count > 1 &&
+           ! g_atomic_int_compare_and_exchange (&oid->ref_count,
+                                                count, count - 1));
+  if (count <= 1) {
+    G_LOCK (oids);
+    if (g_atomic_int_dec_and_test (&oid->ref_count)) {
+      g_hash_table_remove (oids, oid);
+      g_slice_free1 (OID_ALLOC_SIZE (oid->size), oid);
+    }
+    G_UNLOCK (oids);
+  }
+}
+
+/**
+ * ggu_git_oid_to_hex:
+ * @oid: A #GguGitOid
+ * @hex: Return location for the hexadecimal form of @oid, at least
+ *       %GGU_GIT_OID_HEX_SIZE bytes
+ * 
+ * Formats @oid as a 0-terminated lowercase hexadecimal string.
+ * 
+ * Returns: @hex
+ */
+const gchar *
+ggu_git_oid_to_hex (const GguGitOid *oid,
+                    gchar           *hex)
+{
+  _ggu_git_hex_encode (oid->raw, oid->size, hex);
+  
+  return hex;
+}
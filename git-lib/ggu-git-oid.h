@@ -0,0 +1,85 @@
+/*
+ * Copyright 2011 Colomban Wendling <ban@herbesfolles.org>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+#ifndef H_GGU_GIT_OID
+#define H_GGU_GIT_OID
+
+#include <glib.h>
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+
+#define GGU_TYPE_GIT_OID (ggu_git_oid_get_type ())
+
+/* size of a raw SHA-1 object ID */
+#define GGU_GIT_OID_SHA1_SIZE 20
+/* size of the largest raw object ID, a SHA-256 one */
+#define GGU_GIT_OID_MAX_SIZE  32
+/* size of a buffer large enough for any hexadecimal object ID */
+#define GGU_GIT_OID_HEX_SIZE  (GGU_GIT_OID_MAX_SIZE * 2 + 1)
+
+
+typedef struct _GguGitOid GguGitOid;
+/**
+ * GguGitOid:
+ * @size: The size of @raw, in bytes
+ * @raw: The raw object ID, @size bytes
+ * 
+ * An interned Git object ID.  There is only one #GguGitOid for a given ID
+ * at a time, so two of them can be compared by their addresses.  Only the
+ * raw bytes are stored, use ggu_git_oid_to_hex() to get the hexadecimal
+ * form.
+ */
+struct _GguGitOid
+{
+  /*< private >*/
+  gint    ref_count;
+  
+  /*< public >*/
+  guint8  size;
+  guint8  raw[];
+};
+
+
+GType         ggu_git_oid_get_type    (void) G_GNUC_CONST;
+GguGitOid    *ggu_git_oid_intern_raw  (const guint8 *raw,
+                                       gsize         size);
+GguGitOid    *ggu_git_oid_intern_hex  (const gchar *hex,
+                                       gssize       length);
+GguGitOid    *ggu_git_oid_ref         (GguGitOid *oid);
+void          ggu_git_oid_unref       (GguGitOid *oid);
+const gchar  *ggu_git_oid_to_hex      (const GguGitOid *oid,
+                                       gchar           *hex);
+
+gsize         _ggu_git_hex_span       (const gchar *str,
+                                       gsize        length);
+gboolean      _ggu_git_hex_decode     (const gchar *hex,
+                                       gsize        length,
+                                       guint8      *raw);
+void          _ggu_git_hex_encode     (const guint8 *raw,
+                                       gsize         size,
+                                       gchar        *hex);
+
+
+G_END_DECLS
+
+#endif /* guard */
@@ -0,0 +1,190 @@
+/*
+ * Copyright 2011 Colomban Wendling <ban@herbesfolles.org>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+/*
+ * Parsing of large record-oriented outputs on several threads: the output is
+ * split at record boundaries in as many pieces as there are processors, each
+ * piece is parsed in its own thread and the resulting lists are concatenated
+ * in order.
+ */
+
+#include "ggu-git-parallel.h"
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#include "ggu-glib-compat.h"
+
+
+/* below this size per piece, spawning threads costs more than it saves */
+#define PIECE_MIN_SIZE  (1024 * 1024)
+#define MAX_PIECES      16
+
+
+/* maximum number of threads of a parse, 0 for as many as processors */
+static gint G_max_threads = 0;
+
+
+typedef struct _Piece Piece;
+struct _Piece
+{
+  const gchar            *start;
+  const gchar            *end;
+  GguGitRecordParseFunc   parse;
+  gpointer                user_data;
+  GCancellable           *cancellable;
+  
+  GThread                *thread;
+  gboolean                success;
+  GList                  *items;
+  GError                 *error;
+};
+
+static gpointer
+piece_parse (gpointer data)
+{
+  Piece *piece = data;
+  
+  piece->success = piece->parse (piece->start, piece->end, &piece->items,
+                                 piece->user_data, piece->cancellable,
+                                 &piece->error);
+  
+  return NULL;
+}
+
+/**
+ * _ggu_git_parse_records:
+ * @data: The output to parse, starting with a record
+ * @length: The length of @data
+ * @find: Function finding record boundaries
+ * @parse: Function parsing a range of records
+ * @free_item: Function to free the items @parse returns
+ * @user_data: Data to pass to @parse
+ * @cancellable: A #GCancellable, or %NULL
+ * @error: Return location for errors, or %NULL
+ * 
+ * Parses the records of @data with @parse, in parallel if @data is large
+ * enough.  @parse may then be called concurrently from several threads.
+ * 
+ * Returns: The parsed items, in the order of @data, or %NULL on error
+ */
+GList *
+_ggu_git_parse_records (const gchar            *data,
+                        gsize                   length,
+                        GguGitRecordFindFunc    find,
+                        GguGitRecordParseFunc   parse,
+                        GDestroyNotify          free_item,
+                        gpointer                user_data,
+                        GCancellable           *cancellable,
+                        GError                **error)
+{
+  const gchar  *end = data + length;
+  Piece         pieces[MAX_PIECES];
+  guint         n_pieces;
+  guint         i;
+  guint         max_threads;
+  GList        *items = NULL;
+  GError       *err = NULL;
+  
+  max_threads = (guint) g_atomic_int_get (&G_max_threads);
+  if (max_threads == 0) {
+    max_threads = (guint) g_get_num_processors ();
+  }
+  n_pieces = (guint) MIN (length / PIECE_MIN_SIZE,
+                          MIN (max_threads, MAX_PIECES));
+  n_pieces = MAX (n_pieces, 1);
+  
+  for (i = 0; i < n_pieces; i++) {
+    pieces[i].start       = i == 0 ? data : pieces[i - 1].end;
+    pieces[i].end         = (i + 1 == n_pieces
+                             ? end
+                             : find (MAX (data + length / n_pieces * (i + 1),
+                                          pieces[i].start),
+                                     end));
+    pieces[i].parse       = parse;
+    pieces[i].user_data   = user_data;
+    pieces[i].cancellable = cancellable;
+    pieces[i].thread      = NULL;
+    pieces[i].success     = FALSE;
+    pieces[i].items       = NULL;
+    pieces[i].error       = NULL;
+    /* the first piece is parsed in this thread */
+    if (i > 0 && pieces[i].start < pieces[i].end) {
+      pieces[i].thread = g_thread_try_new ("ggu-git-parser", piece_parse,
+                                           &pieces[i], NULL);
+    }
+  }
+  
+  for (i = 0; i < n_pieces; i++) {
+    if (pieces[i].thread) {
+      g_thread_join (pieces[i].thread);
+    } else {
+      piece_parse (&pieces[i]);
+    }
+  }
+  
+  /* stitch the pieces back, backwards not to walk the lists again */
+  for (i = n_pieces; i-- > 0; ) {
+    if (! pieces[i].success && ! err) {
+      /* only report the first error in the output */
+      guint j;
+      
+      for (j = 0; j <= i; j++) {
+        if (! pieces[j].success) {
+          err = pieces[j].error;
+          pieces[j].error = NULL;
+          break;
+        }
+      }
+    }
+    if (pieces[i].error) {
+      g_error_free (pieces[i].error);
+    }
+    if (err) {
+      g_list_free_full (pieces[i].items, free_item);
+    } else {
+      items = g_list_concat (pieces[i].items, items);
+    }
+  }
+  
+  if (err) {
+    g_list_free_full (items, free_item);
+    g_propagate_error (error, err);
+    items = NULL;
+  }
+  
+  return items;
+}
+
+/**
+ * _ggu_git_parse_records_set_max_threads:
+ * @max_threads: The maximum number of threads, or 0 for as many as there are
+ *               processors
+ * 
+ * Limits the number of threads _ggu_git_parse_records() uses, which is the
+ * number of processors by default.  This is mostly useful to measure how
+ * parsing scales.
+ */
+void
+_ggu_git_parse_records_set_max_threads (guint max_threads)
+{
+  g_atomic_int_set (&G_max_threads, (gint) max_threads);
+}
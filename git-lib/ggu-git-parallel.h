@@ -0,0 +1,74 @@
+/*
+ * Copyright 2011 Colomban Wendling <ban@herbesfolles.org>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+#ifndef H_GGU_GIT_PARALLEL
+#define H_GGU_GIT_PARALLEL
+
+#include <glib.h>
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+
+/**
+ * GguGitRecordFindFunc:
+ * @p: A position in the output
+ * @end: The end of the output
+ * 
+ * Returns: The start of the first record at or after @p, or @end
+ */
+typedef const gchar  *(*GguGitRecordFindFunc)   (const gchar *p,
+                                                 const gchar *end);
+/**
+ * GguGitRecordParseFunc:
+ * @start: The start of the first record to parse
+ * @end: The end of the last record to parse
+ * @items: Return location for the parsed items, in order
+ * @user_data: The data given to _ggu_git_parse_records()
+ * @cancellable: A #GCancellable, or %NULL
+ * @error: Return location for errors
+ * 
+ * Returns: Whether the records could be parsed.  On error, @items is
+ *          released by the caller.
+ */
+typedef gboolean      (*GguGitRecordParseFunc)  (const gchar   *start,
+                                                 const gchar   *end,
+                                                 GList        **items,
+                                                 gpointer       user_data,
+                                                 GCancellable  *cancellable,
+                                                 GError       **error);
+
+
+GList    *_ggu_git_parse_records  (const gchar            *data,
+                                   gsize                   length,
+                                   GguGitRecordFindFunc    find,
+                                   GguGitRecordParseFunc   parse,
+                                   GDestroyNotify          free_item,
+                                   gpointer                user_data,
+                                   GCancellable           *cancellable,
+                                   GError                **error);
+void      _ggu_git_parse_records_set_max_threads
+                                  (guint                   max_threads);
+
+
+G_END_DECLS
+
+#endif /* guard */
@@ -0,0 +1,479 @@
+/*
+ * Copyright 2011 Colomban Wendling <ban@herbesfolles.org>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+/*
+ * History of a path, without Git.
+ * 
+ * This walks the commits like `git log rev -- path` does with its default
+ * history simplification: commits are visited newest first, a commit that
+ * doesn't change the path compared to one of its parents only leads to that
+ * parent, and only commits changing the path are kept.
+ * 
+ * The walk needs a commit-graph: it gives the parents and dates without
+ * reading the commits, and its Bloom filters avoid most tree comparisons.
+ * Commits newer than the graph are read from the object database.
+ * 
+ * The walk can be stopped after a given number of commits and resumed later,
+ * so the history can be listed a page at a time.
+ */
+
+#include "ggu-git-rev-walk.h"
+
+#include <string.h>
+#include <glib.h>
+#include <gio/gio.h>
+
+#include "ggu-glib-compat.h"
+#include "ggu-git.h"
+#include "ggu-git-odb.h"
+#include "ggu-git-commit-graph.h"
+
+
+typedef struct _Commit Commit;
+struct _Commit
+{
+  guint8    oid[GGU_GIT_ODB_OID_SIZE];
+  guint8    tree[GGU_GIT_ODB_OID_SIZE];
+  guint32   pos;        /* in the graph, or GGU_GIT_COMMIT_GRAPH_NO_POS */
+  gint64    date;
+  guint64   serial;     /* queuing order, for commits with the same date */
+  Commit  **parents;
+  guint     n_parents;
+  guint     parsed : 1;
+  guint     queued : 1;
+  guint     has_entry : 1;
+  
+  /* the path's entry in the tree, if has_entry */
+  guint     entry_mode;
+  guint8    entry_oid[GGU_GIT_ODB_OID_SIZE];
+};
+
+typedef struct _GguGitRevWalk Walk;
+struct _GguGitRevWalk
+{
+  GguGitOdb          *odb;
+  GguGitCommitGraph  *graph;
+  GguGitBloomKey     *key;
+  gchar              *path;
+  GHashTable         *commits;    /* oid -> Commit */
+  GQueue              queue;      /* commits left to visit */
+  GArray             *positions;  /* scratch array for parents */
+  guint64             serial;
+  gboolean            failed;
+};
+
+
+static guint
+oid_hash (gconstpointer key)
+{
+  const guint8 *oid = key;
+  
+  /* object IDs are already well distributed */
+  return (guint) oid[0] << 24 | (guint) oid[1] << 16 |
+         (guint) oid[2] << 8  | (guint) oid[3];
+}
+
+static gboolean
+oid_equal (gconstpointer a,
+           gconstpointer b)
+{
+  return memcmp (a, b, GGU_GIT_ODB_OID_SIZE) == 0;
+}
+
+static void
+commit_free (Commit *commit)
+{
+  g_free (commit->parents);
+  g_slice_free1 (sizeof *commit, commit);
+}
+
+static Commit *
+walk_get_commit (Walk         *walk,
+                 const guint8 *oid,
+                 guint32       pos)
+{
+  Commit *commit = g_hash_table_lookup (walk->commits, oid);
+  
+  if (! commit) {
+    commit = g_slice_alloc0 (sizeof *commit);
+    memcpy (commit->oid, oid, GGU_GIT_ODB_OID_SIZE);
+    commit->pos = pos;
+    g_hash_table_insert (walk->commits, commit->oid, commit);
+  }
+  
+  return commit;
+}
+
+static void
+set_corrupt_error (GError     **error,
+                   const gchar *what)
+{
+  g_set_error (error, GGU_GIT_ERROR, GGU_GIT_ERROR_INVALID_RESULT,
+               "Corrupt commit: %s", what);
+}
+
+/* parses a commit object, for the ones that aren't in the graph */
+static gboolean
+commit_parse_object (Walk    *walk,
+                     Commit  *commit,
+                     GError **error)
+{
+  GguGitObjectType  type;
+  gchar            *data;
+  const gchar      *line;
+  GPtrArray        *parents;
+  gboolean          has_tree = FALSE;
+  gboolean          has_date = FALSE;
+  
+  data = _ggu_git_odb_read (walk->odb, commit->oid, &type, NULL, error);
+  if (! data || type != GGU_GIT_OBJECT_COMMIT) {
+    if (data || (error && ! *error)) {
+      set_corrupt_error (error, "not found");
+    }
+    g_free (data);
+    return FALSE;
+  }
+  
+  parents = g_ptr_array_new ();
+  for (line = data; *line && *line != '\n'; line = strchr (line, '\n') + 1) {
+    guint8 oid[GGU_GIT_ODB_OID_SIZE];
+    
+    if (g_str_has_prefix (line, "tree ")) {
+      has_tree = _ggu_git_odb_parse_oid (line + 5, commit->tree);
+    } else if (g_str_has_prefix (line, "parent ") &&
+               _ggu_git_odb_parse_oid (line + 7, oid)) {
+      g_ptr_array_add (parents,
+                       walk_get_commit (walk, oid,
+                                        GGU_GIT_COMMIT_GRAPH_NO_POS));
+    } else if (g_str_has_prefix (line, "committer ")) {
+      const gchar *eol = strchr (line, '\n');
+      const gchar *gt = eol ? g_strrstr_len (line, eol - line, ">") : NULL;
+      
+      if (gt && g_ascii_isdigit (gt[1 + strspn (gt + 1, " ")])) {
+        commit->date = g_ascii_strtoll (gt + 1, NULL, 10);
+        has_date = TRUE;
+      }
+    }
+    if (! strchr (line, '\n')) {
+      break;
+    }
+  }
+  g_free (data);
+  
+  commit->n_parents = parents->len;
+  commit->parents = (Commit **) g_ptr_array_free (parents, FALSE);
+  if (! has_tree || ! has_date) {
+    set_corrupt_error (error, "missing tree or committer");
+    return FALSE;
+  }
+  
+  return TRUE;
+}
+
+static gboolean
+commit_parse (Walk    *walk,
+              Commit  *commit,
+              GError **error)
+{
+  if (commit->parsed) {
+    return TRUE;
+  }
+  
+  if (commit->pos == GGU_GIT_COMMIT_GRAPH_NO_POS) {
+    _ggu_git_commit_graph_find (walk->graph, commit->oid, &commit->pos);
+  }
+  if (commit->pos == GGU_GIT_COMMIT_GRAPH_NO_POS) {
+    if (! commit_parse_object (walk, commit, error)) {
+      return FALSE;
+    }
+  } else {
+    guint i;
+    
+    if (! _ggu_git_commit_graph_get_commit (walk->graph, commit->pos,
+                                            commit->tree, walk->positions,
+                                            &commit->date)) {
+      g_set_error (error, GGU_GIT_ERROR, GGU_GIT_ERROR_INVALID_RESULT,
+                   "Corrupt commit-graph");
+      return FALSE;
+    }
+    commit->n_parents = walk->positions->len;
+    commit->parents = g_new (Commit *, commit->n_parents);
+    for (i = 0; i < commit->n_parents; i++) {
+      guint32 pos = g_array_index (walk->positions, guint32, i);
+      
+      commit->parents[i] = walk_get_commit (walk,
+                                            _ggu_git_commit_graph_get_oid (walk->graph,
+                                                                           pos),
+                                            pos);
+    }
+  }
+  commit->parsed = TRUE;
+  
+  return TRUE;
+}
+
+/* finds the path in the commit's tree */
+static gboolean
+commit_get_entry (Walk    *walk,
+                  Commit  *commit,
+                  GError **error)
+{
+  if (! commit->has_entry) {
+    if (! commit_parse (walk, commit, error) ||
+        ! _ggu_git_odb_find_path (walk->odb, commit->tree, walk->path,
+                                  &commit->entry_mode, commit->entry_oid,
+                                  error)) {
+      if (error && ! *error) {
+        set_corrupt_error (error, "tree not found");
+      }
+      return FALSE;
+    }
+    commit->has_entry = TRUE;
+  }
+  
+  return TRUE;
+}
+
+/* whether @commit's path is the same as in its @n-th parent */
+static gboolean
+commit_is_treesame (Walk      *walk,
+                    Commit    *commit,
+                    guint      n,
+                    gboolean  *same,
+                    GError   **error)
+{
+  Commit *parent = commit->parents[n];
+  
+  /* the filters are computed against the first parent */
+  if (n == 0 && walk->key && commit->pos != GGU_GIT_COMMIT_GRAPH_NO_POS &&
+      ! _ggu_git_commit_graph_maybe_changed (walk->graph, commit->pos,
+                                             walk->key)) {
+    *same = TRUE;
+    return TRUE;
+  }
+  if (! commit_get_entry (walk, commit, error) ||
+      ! commit_get_entry (walk, parent, error)) {
+    return FALSE;
+  }
+  *same = (commit->entry_mode == parent->entry_mode &&
+           (commit->entry_mode == 0 ||
+            memcmp (commit->entry_oid, parent->entry_oid,
+                    GGU_GIT_ODB_OID_SIZE) == 0));
+  
+  return TRUE;
+}
+
+/* newest first, then in queuing order, like Git */
+static gint
+commit_compare (gconstpointer a,
+                gconstpointer b,
+                gpointer      data)
+{
+  const Commit *ca = a;
+  const Commit *cb = b;
+  
+  if (ca->date != cb->date) {
+    return ca->date > cb->date ? -1 : 1;
+  }
+  
+  return ca->serial < cb->serial ? -1 : 1;
+}
+
+static gboolean
+walk_queue (Walk    *walk,
+            GQueue  *queue,
+            Commit  *commit,
+            GError **error)
+{
+  if (! commit->queued) {
+    if (! commit_parse (walk, commit, error)) {
+      return FALSE;
+    }
+    commit->queued = TRUE;
+    commit->serial = walk->serial++;
+    g_queue_insert_sorted (queue, commit, commit_compare, NULL);
+  }
+  
+  return TRUE;
+}
+
+/**
+ * _ggu_git_rev_walk_new:
+ * @odb: A #GguGitOdb
+ * @start: The raw ID of the commit to start from
+ * @path: A path relative to the repository root
+ * @error: Return location for errors, or %NULL to ignore them
+ * 
+ * Prepares listing the commits changing @path like `git log start -- path`
+ * does.  This requires the repository to have a commit-graph, and fails with
+ * %G_IO_ERROR_NOT_SUPPORTED otherwise.
+ * 
+ * Returns: A new #GguGitRevWalk to free with _ggu_git_rev_walk_free(), or
+ *          %NULL on error
+ */
+GguGitRevWalk *
+_ggu_git_rev_walk_new (GguGitOdb     *odb,
+                       const guint8  *start,
+                       const gchar   *path,
+                       GError       **error)
+{
+  GguGitCommitGraph  *graph;
+  Walk               *walk;
+  
+  graph = _ggu_git_commit_graph_open (odb);
+  if (! graph) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                 "No commit-graph");
+    return NULL;
+  }
+  
+  walk = g_slice_alloc (sizeof *walk);
+  walk->odb = _ggu_git_odb_ref (odb);
+  walk->graph = graph;
+  walk->key = _ggu_git_commit_graph_bloom_key_new (graph, path);
+  walk->path = g_strdup (path);
+  walk->commits = g_hash_table_new_full (oid_hash, oid_equal, NULL,
+                                         (GDestroyNotify) commit_free);
+  g_queue_init (&walk->queue);
+  walk->positions = g_array_new (FALSE, FALSE, sizeof (guint32));
+  walk->serial = 0;
+  walk->failed = FALSE;
+  
+  if (! walk_queue (walk, &walk->queue,
+                    walk_get_commit (walk, start, GGU_GIT_COMMIT_GRAPH_NO_POS),
+                    error)) {
+    _ggu_git_rev_walk_free (walk);
+    walk = NULL;
+  }
+  
+  return walk;
+}
+
+/**
+ * _ggu_git_rev_walk_free:
+ * @walk: A #GguGitRevWalk
+ * 
+ * Frees a #GguGitRevWalk
+ */
+void
+_ggu_git_rev_walk_free (GguGitRevWalk *walk)
+{
+  g_queue_clear (&walk->queue);
+  g_array_free (walk->positions, TRUE);
+  g_hash_table_destroy (walk->commits);
+  g_free (walk->path);
+  _ggu_git_commit_graph_bloom_key_free (walk->key);
+  _ggu_git_commit_graph_free (walk->graph);
+  _ggu_git_odb_unref (walk->odb);
+  g_slice_free1 (sizeof *walk, walk);
+}
+
+/**
+ * _ggu_git_rev_walk_next:
+ * @walk: A #GguGitRevWalk
+ * @result: Array to which add the raw IDs of the commits found
+ * @max_count: The maximum number of commits to add, or 0 for no limit
+ * @cancellable: A #GCancellable, or %NULL
+ * @error: Return location for errors, or %NULL to ignore them
+ * 
+ * Continues the walk until @max_count commits changing the path have been
+ * added to @result, newest first.  The next call continues where this one
+ * stopped, even if it was cancelled.  A walk that failed for another reason
+ * can't be continued.
+ * 
+ * Returns: Whether the walk succeeded
+ */
+gboolean
+_ggu_git_rev_walk_next (GguGitRevWalk *walk,
+                        GPtrArray     *result,
+                        guint          max_count,
+                        GCancellable  *cancellable,
+                        GError       **error)
+{
+  Commit   *commit;
+  gboolean  success = TRUE;
+  guint     n_found = 0;
+  
+  if (walk->failed) {
+    g_set_error (error, GGU_GIT_ERROR, GGU_GIT_ERROR_FAILED,
+                 "History walk already failed");
+    return FALSE;
+  }
+  
+  while (success && (max_count == 0 || n_found < max_count) &&
+         (commit = g_queue_peek_head (&walk->queue))) {
+    gboolean  shown = TRUE;
+    guint     first = 0;
+    guint     last = commit->n_parents;
+    guint     i;
+    
+    /* check before popping so a cancelled walk can be resumed */
+    if (g_cancellable_set_error_if_cancelled (cancellable, error)) {
+      return FALSE;
+    }
+    g_queue_pop_head (&walk->queue);
+    
+    if (commit->n_parents == 0) {
+      /* a root commit shows the path if it has it */
+      success = commit_get_entry (walk, commit, error);
+      shown = commit->entry_mode != 0;
+    } else {
+      for (i = 0; success && i < commit->n_parents; i++) {
+        gboolean same;
+        
+        success = commit_is_treesame (walk, commit, i, &same, error);
+        if (success && same) {
+          /* only follow the first parent with the same content */
+          shown = FALSE;
+          first = i;
+          last = i + 1;
+          break;
+        }
+      }
+    }
+    if (success && shown) {
+      g_ptr_array_add (result, g_memdup2 (commit->oid, GGU_GIT_ODB_OID_SIZE));
+      n_found++;
+    }
+    for (i = first; success && i < last; i++) {
+      success = walk_queue (walk, &walk->queue, commit->parents[i], error);
+    }
+  }
+  if (! success) {
+    walk->failed = TRUE;
+  }
+  
+  return success;
+}
+
+/**
+ * _ggu_git_rev_walk_is_done:
+ * @walk: A #GguGitRevWalk
+ * 
+ * Checks whether all the commits changing the path have been found
+ * 
+ * Returns: %TRUE if there is nothing more to walk
+ */
+gboolean
+_ggu_git_rev_walk_is_done (GguGitRevWalk *walk)
+{
+  return ! walk->failed && g_queue_is_empty (&walk->queue);
+}
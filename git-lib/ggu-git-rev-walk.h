@@ -0,0 +1,51 @@
+/*
+ * Copyright 2011 Colomban Wendling <ban@herbesfolles.org>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+#ifndef H_GGU_GIT_REV_WALK
+#define H_GGU_GIT_REV_WALK
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#include "ggu-git-odb.h"
+
+G_BEGIN_DECLS
+
+
+typedef struct _GguGitRevWalk GguGitRevWalk;
+
+
+GguGitRevWalk  *_ggu_git_rev_walk_new     (GguGitOdb     *odb,
+                                           const guint8  *start,
+                                           const gchar   *path,
+                                           GError       **error);
+void            _ggu_git_rev_walk_free    (GguGitRevWalk *walk);
+gboolean        _ggu_git_rev_walk_next    (GguGitRevWalk *walk,
+                                           GPtrArray     *result,
+                                           guint          max_count,
+                                           GCancellable  *cancellable,
+                                           GError       **error);
+gboolean        _ggu_git_rev_walk_is_done (GguGitRevWalk *walk);
+
+
+G_END_DECLS
+
+#endif /* guard */
@@ -0,0 +1,414 @@
+/*
+ * Copyright 2011 Colomban Wendling <ban@herbesfolles.org>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+/*
+ * Job scheduler for Git operations.
+ * 
+ * Jobs are run by our own worker threads rather than in GIO's shared pool,
+ * so they never wait behind unrelated I/O.  They are dispatched in two lanes:
+ * interactive jobs (priority up to G_PRIORITY_DEFAULT) and background ones,
+ * each lane having its own threads so that background work never delays
+ * interactive one.  Inside a lane, jobs are run by priority, then in
+ * submission order, and at most a few jobs run at once for the same
+ * repository.  A job still queued can have its priority raised, which may
+ * move it to the interactive lane.
+ * 
+ * A job cancelled before it started is dropped right away, even if its
+ * cancellable gets reset afterwards, as the caller superseded it.
+ */
+
+#include "ggu-git-scheduler.h"
+
+#include <signal.h>
+#include <pthread.h>
+#include <glib.h>
+#include <gio/gio.h>
+
+
+/* how long an idle worker thread waits for jobs before exiting */
+#define WORKER_IDLE_TIMEOUT   30 /* s */
+
+enum
+{
+  LANE_INTERACTIVE,
+  LANE_BACKGROUND,
+  
+  N_LANES
+};
+
+typedef struct _Lane Lane;
+struct _Lane
+{
+  GCond       cond;
+  GQueue      jobs;       /* sorted by priority, then serial */
+  GHashTable *running;    /* repo -> number of running jobs */
+  guint       n_threads;
+  guint       n_idle;
+  guint       max_threads;
+  guint       max_per_repo;
+};
+
+typedef struct _Job Job;
+struct _Job
+{
+  gint                    ref_count;
+  
+  GSimpleAsyncResult     *result;
+  GSimpleAsyncThreadFunc  func;
+  GCancellable           *cancellable;
+  gulong                  cancelled_id;
+  gchar                  *repo;
+  gint                    priority;
+  guint64                 serial;
+  Lane                   *lane;
+  gboolean                queued;
+};
+
+
+static GMutex   G_lock;
+static Lane     G_lanes[N_LANES] = {
+  { { 0 }, G_QUEUE_INIT, NULL, 0, 0, 4, 2 }, /* interactive */
+  { { 0 }, G_QUEUE_INIT, NULL, 0, 0, 2, 1 }  /* background */
+};
+static guint64  G_serial = 0;
+
+
+static Job *
+job_ref (Job *job)
+{
+  g_atomic_int_inc (&job->ref_count);
+  return job;
+}
+
+static void
+job_unref (Job *job)
+{
+  if (g_atomic_int_dec_and_test (&job->ref_count)) {
+    g_object_unref (job->result);
+    if (job->cancellable) {
+      g_object_unref (job->cancellable);
+    }
+    g_free (job->repo);
+    g_slice_free1 (sizeof *job, job);
+  }
+}
+
+static gint
+job_compare (gconstpointer a,
+             gconstpointer b,
+             gpointer      data)
+{
+  const Job *job_a = a;
+  const Job *job_b = b;
+  
+  if (job_a->priority != job_b->priority) {
+    return job_a->priority < job_b->priority ? -1 : 1;
+  }
+  
+  return job_a->serial < job_b->serial ? -1 : 1;
+}
+
+/* reports @job as cancelled without running it */
+static void
+job_drop (Job *job)
+{
+  g_simple_async_result_set_error (job->result,
+                                   G_IO_ERROR, G_IO_ERROR_CANCELLED,
+                                   "Operation was cancelled");
+  g_simple_async_result_complete_in_idle (job->result);
+}
+
+/* disconnects the cancellation handler of a job dropped by the handler
+ * itself, as it can't do it from inside the emission */
+static gboolean
+job_disconnect_idle (gpointer data)
+{
+  Job *job = data;
+  
+  g_cancellable_disconnect (job->cancellable, job->cancelled_id);
+  
+  return FALSE;
+}
+
+/* called when a job's cancellable fires, possibly from any thread */
+static void
+job_cancelled_handler (GCancellable *cancellable,
+                       Job          *job)
+{
+  g_mutex_lock (&G_lock);
+  if (job->queued) {
+    job->queued = FALSE;
+    g_queue_remove (&job->lane->jobs, job);
+    job_drop (job);
+    g_idle_add_full (G_PRIORITY_DEFAULT_IDLE, job_disconnect_idle,
+                     job, (GDestroyNotify) job_unref); /* the queue's reference */
+  }
+  g_mutex_unlock (&G_lock);
+}
+
+/* pops the first job that can run from @lane's queue.  must be called with
+ * the lock held */
+static Job *
+lane_pop_job (Lane *lane)
+{
+  GList *link;
+  
+  for (link = lane->jobs.head; link; link = link->next) {
+    Job  *job = link->data;
+    guint n_running;
+    
+    n_running = GPOINTER_TO_UINT (g_hash_table_lookup (lane->running,
+                                                       job->repo));
+    if (n_running < lane->max_per_repo) {
+      g_queue_delete_link (&lane->jobs, link);
+      job->queued = FALSE;
+      g_hash_table_insert (lane->running, g_strdup (job->repo),
+                           GUINT_TO_POINTER (n_running + 1));
+      return job;
+    }
+  }
+  
+  return NULL;
+}
+
+static gpointer
+worker_thread (gpointer data)
+{
+  Lane     *lane = data;
+  sigset_t  sigs;
+  
+  /* jobs write to pipes to Git, get EPIPE rather than being killed if it
+   * dies */
+  sigemptyset (&sigs);
+  sigaddset (&sigs, SIGPIPE);
+  pthread_sigmask (SIG_BLOCK, &sigs, NULL);
+  
+  g_mutex_lock (&G_lock);
+  for (;;) {
+    Job     *job;
+    GObject *object;
+    guint    n_running;
+    
+    job = lane_pop_job (lane);
+    if (! job) {
+      gint64 end_time;
+      
+      end_time = g_get_monotonic_time () + WORKER_IDLE_TIMEOUT * G_TIME_SPAN_SECOND;
+      lane->n_idle++;
+      if (! g_cond_wait_until (&lane->cond, &G_lock, end_time) &&
+          ! lane->jobs.head) {
+        lane->n_idle--;
+        break;
+      }
+      lane->n_idle--;
+      continue;
+    }
+    g_mutex_unlock (&G_lock);
+    
+    /* the job isn't queued anymore, so the handler would be a no-op */
+    if (job->cancellable) {
+      g_cancellable_disconnect (job->cancellable, job->cancelled_id);
+    }
+    
+    object = g_async_result_get_source_object (G_ASYNC_RESULT (job->result));
+    job->func (job->result, object, job->cancellable);
+    g_simple_async_result_complete_in_idle (job->result);
+    if (object) {
+      g_object_unref (object);
+    }
+    
+    g_mutex_lock (&G_lock);
+    n_running = GPOINTER_TO_UINT (g_hash_table_lookup (lane->running,
+                                                       job->repo));
+    if (n_running > 1) {
+      g_hash_table_insert (lane->running, g_strdup (job->repo),
+                           GUINT_TO_POINTER (n_running - 1));
+    } else {
+      g_hash_table_remove (lane->running, job->repo);
+    }
+    /* a job for this repository might have been waiting for a free slot */
+    g_cond_broadcast (&lane->cond);
+    job_unref (job);
+  }
+  lane->n_threads--;
+  g_mutex_unlock (&G_lock);
+  
+  return NULL;
+}
+
+static Lane *
+lane_for_priority (gint priority)
+{
+  return &G_lanes[priority > G_PRIORITY_DEFAULT ? LANE_BACKGROUND
+                                                : LANE_INTERACTIVE];
+}
+
+/* makes sure a thread of @lane will look at its queue.  returns whether one
+ * will, which can only fail if the lane has no thread and none can be
+ * created.  must be called with the lock held */
+static gboolean
+lane_wake (Lane *lane)
+{
+  if (! lane->running) {
+    lane->running = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                           g_free, NULL);
+  }
+  if (lane->n_idle > 0) {
+    g_cond_broadcast (&lane->cond);
+  } else if (lane->n_threads < lane->max_threads) {
+    GThread *thread;
+    
+    thread = g_thread_try_new ("ggu-git-worker", worker_thread, lane, NULL);
+    if (thread) {
+      lane->n_threads++;
+      g_thread_unref (thread);
+    } else if (lane->n_threads < 1) {
+      return FALSE;
+    }
+  }
+  
+  return TRUE;
+}
+
+/**
+ * _ggu_git_scheduler_run_in_thread:
+ * @result: A #GSimpleAsyncResult
+ * @func: The function to run in a thread
+ * @repo: The repository @func works on
+ * @priority: The job's priority
+ * @cancellable: A #GCancellable, or %NULL
+ * 
+ * Like g_simple_async_result_run_in_thread(), but schedules @func in our own
+ * thread pool.  @priority chooses the lane the job goes in:
+ * G_PRIORITY_DEFAULT and higher priorities are considered interactive, lower
+ * ones background work.
+ * 
+ * If @cancellable is cancelled before the job starts, @result is completed
+ * with %G_IO_ERROR_CANCELLED without running @func.
+ */
+void
+_ggu_git_scheduler_run_in_thread (GSimpleAsyncResult     *result,
+                                  GSimpleAsyncThreadFunc  func,
+                                  const gchar            *repo,
+                                  gint                    priority,
+                                  GCancellable           *cancellable)
+{
+  Job  *job;
+  Lane *lane;
+  
+  lane = lane_for_priority (priority);
+  
+  job = g_slice_alloc (sizeof *job);
+  job->ref_count    = 1;
+  job->result       = g_object_ref (result);
+  job->func         = func;
+  job->cancellable  = cancellable ? g_object_ref (cancellable) : NULL;
+  job->cancelled_id = 0;
+  job->repo         = g_strdup (repo ? repo : "");
+  job->priority     = priority;
+  job->lane         = lane;
+  job->queued       = FALSE;
+  
+  /* connect before queuing: if the cancellable is already cancelled the
+   * handler runs now and won't find the job queued, we check below */
+  if (cancellable) {
+    job->cancelled_id = g_cancellable_connect (cancellable,
+                                               G_CALLBACK (job_cancelled_handler),
+                                               job_ref (job),
+                                               (GDestroyNotify) job_unref);
+  }
+  
+  g_mutex_lock (&G_lock);
+  if (g_cancellable_is_cancelled (cancellable)) {
+    g_mutex_unlock (&G_lock);
+    if (cancellable) {
+      g_cancellable_disconnect (cancellable, job->cancelled_id);
+    }
+    job_drop (job);
+    job_unref (job);
+    return;
+  }
+  
+  job->serial = G_serial++;
+  job->queued = TRUE;
+  g_queue_insert_sorted (&lane->jobs, job, job_compare, NULL);
+  if (! lane_wake (lane)) {
+    /* we have no thread to run it, give up */
+    g_queue_remove (&lane->jobs, job);
+    job->queued = FALSE;
+    g_mutex_unlock (&G_lock);
+    if (cancellable) {
+      g_cancellable_disconnect (cancellable, job->cancelled_id);
+    }
+    g_simple_async_result_set_error (result, G_IO_ERROR, G_IO_ERROR_FAILED,
+                                     "Failed to create a worker thread");
+    g_simple_async_result_complete_in_idle (result);
+    job_unref (job);
+    return;
+  }
+  g_mutex_unlock (&G_lock);
+}
+
+/**
+ * _ggu_git_scheduler_raise_priority:
+ * @result: The #GSimpleAsyncResult of a job scheduled with
+ *          _ggu_git_scheduler_run_in_thread()
+ * @priority: The new priority
+ * 
+ * Raises the priority of a job still waiting in the queue, moving it to the
+ * interactive lane if @priority calls for it.  Does nothing if the job
+ * already started or if @priority isn't higher than its current one.
+ */
+void
+_ggu_git_scheduler_raise_priority (GSimpleAsyncResult *result,
+                                   gint                priority)
+{
+  guint i;
+  
+  g_mutex_lock (&G_lock);
+  for (i = 0; i < N_LANES; i++) {
+    GList *link;
+    
+    for (link = G_lanes[i].jobs.head; link; link = link->next) {
+      Job  *job = link->data;
+      Lane *lane;
+      
+      if (job->result != result) {
+        continue;
+      }
+      if (priority < job->priority) {
+        lane = lane_for_priority (priority);
+        g_queue_delete_link (&job->lane->jobs, link);
+        if (lane != job->lane && ! lane_wake (lane)) {
+          /* no thread for it in the new lane, better leave it where it is */
+          lane = job->lane;
+        } else {
+          job->priority = priority;
+        }
+        job->lane = lane;
+        g_queue_insert_sorted (&lane->jobs, job, job_compare, NULL);
+      }
+      g_mutex_unlock (&G_lock);
+      return;
+    }
+  }
+  g_mutex_unlock (&G_lock);
+}
@@ -29,6 +29,13 @@
 #include "ggu-glib-compat.h"
 #include "ggu-git.h"
 #include "ggu-git-utils.h"
+#include "ggu-git-buffer.h"
+#include "ggu-git-cache.h"
+#include "ggu-git-cat-file.h"
+#include "ggu-git-odb.h"
+#include "ggu-git-oid.h"
+#include "ggu-git-parallel.h"
+#include "ggu-git-scheduler.h"
 #include "ggu-git-files-changed-entry.h"
 #include "ggu-git-blame-entry.h"
 
@@ -205,13 +212,90 @@ ggu_git_show_new (void)
 }
 
 
+typedef struct _ShowParser ShowParser;
+struct _ShowParser
+{
+  GguGitParser  parent;
+  GString      *content;
+  GguGitOid    *cache_oid; /* the commit to cache the content for, or NULL */
+  gchar        *cache_path;
+};
+
+static gboolean
+show_parser_parse (GguGitParser       *parser,
+                   GguGit             *git,
+                   gchar              *data,
+                   gsize               length,
+                   gboolean            eof,
+                   gsize              *consumed,
+                   GSimpleAsyncResult *result,
+                   GCancellable       *cancellable)
+{
+  ShowParser *self = (ShowParser *) parser;
+  
+  g_string_append_len (self->content, data, (gssize) length);
+  *consumed = length;
+  
+  if (eof) {
+    if (self->cache_oid) {
+      _ggu_git_cache_insert (GGU_GIT_CACHE_DIFF, self->cache_oid,
+                             self->cache_path,
+                             g_strndup (self->content->str,
+                                        self->content->len),
+                             self->content->len + 1,
+                             (GBoxedCopyFunc) g_strdup, g_free);
+    }
+    g_simple_async_result_set_op_res_gpointer (result,
+                                               g_string_free (self->content,
+                                                              FALSE),
+                                               g_free);
+    self->content = NULL;
+  }
+  
+  return TRUE;
+}
+
 static void
-ggu_git_show_parse_output (GguGit             *obj,
-                           const gchar        *output,
-                           GSimpleAsyncResult *result,
-                           GCancellable       *cancellable)
+show_parser_free (GguGitParser *parser)
 {
-  g_simple_async_result_set_op_res_gpointer (result, g_strdup (output), g_free);
+  ShowParser *self = (ShowParser *) parser;
+  
+  if (self->content) {
+    g_string_free (self->content, TRUE);
+  }
+  if (self->cache_oid) {
+    ggu_git_oid_unref (self->cache_oid);
+  }
+  g_free (self->cache_path);
+  g_free (self);
+}
+
+/* @cache_oid and @cache_path are what to cache the content for, if any */
+static GguGitParser *
+show_parser_new (GguGitOid   *cache_oid,
+                 const gchar *cache_path)
+{
+  ShowParser *self;
+  
+  self = g_malloc (sizeof *self);
+  self->parent.parse  = show_parser_parse;
+  self->parent.free   = show_parser_free;
+  self->content       = g_string_new (NULL);
+  self->cache_oid     = cache_oid ? ggu_git_oid_ref (cache_oid) : NULL;
+  self->cache_path    = g_strdup (cache_path);
+  
+  return (GguGitParser *) self;
+}
+
+/* the cache is keyed by commit, so only full IDs can be looked up */
+static GguGitOid *
+rev_get_cache_oid (const gchar *rev)
+{
+  if (rev && ggu_git_is_hash (rev)) {
+    return ggu_git_oid_intern_hex (rev, -1);
+  }
+  
+  return NULL;
 }
 
 static gchar **
@@ -241,6 +325,109 @@ ggu_git_show_get_argv (GguGitShow *self)
   return (gchar **) g_ptr_array_free (argv, FALSE);
 }
 
+/* getting content without spawning Git: we first try to read it ourselves,
+ * then through `git cat-file --batch` */
+
+#define CONTENT_OP_KEY "ggu-git-show-content-op"
+
+typedef struct _ContentOp ContentOp;
+struct _ContentOp
+{
+  gchar              *git_path;
+  gchar              *dir;
+  gchar              *rev;
+  gchar              *file;
+  gchar              *object;
+  gchar             **argv; /* for falling back to `git show` */
+  GCancellable       *cancellable;
+  GAsyncReadyCallback callback;
+  gpointer            user_data;
+};
+
+static void
+content_op_free (ContentOp *op)
+{
+  g_free (op->git_path);
+  g_free (op->dir);
+  g_free (op->rev);
+  g_free (op->file);
+  g_free (op->object);
+  g_strfreev (op->argv);
+  if (op->cancellable) {
+    g_object_unref (op->cancellable);
+  }
+  g_free (op);
+}
+
+static void
+show_content_thread (GSimpleAsyncResult *result,
+                     GObject            *object,
+                     GCancellable       *cancellable)
+{
+  ContentOp  *op;
+  GError     *error = NULL;
+  gchar      *content = NULL;
+  
+  op = g_object_get_data (G_OBJECT (result), CONTENT_OP_KEY);
+  /* we can't read the index */
+  if (op->rev) {
+    GguGitOdb *odb = _ggu_git_odb_open (op->dir, NULL);
+    
+    if (odb) {
+      /* on failure, let Git try */
+      content = _ggu_git_odb_read_path (odb, op->rev, op->file, NULL, NULL);
+      _ggu_git_odb_unref (odb);
+    }
+  }
+  if (! content) {
+    content = _ggu_git_cat_file_get (op->git_path, op->dir, op->object, NULL,
+                                     cancellable, &error);
+  }
+  if (content) {
+    g_simple_async_result_set_op_res_gpointer (result, content, g_free);
+  } else {
+    g_simple_async_result_take_error (result, error);
+  }
+}
+
+static void
+show_content_ready (GObject      *object,
+                    GAsyncResult *result,
+                    gpointer      data)
+{
+  GguGitShow         *self = GGU_GIT_SHOW (object);
+  GSimpleAsyncResult *simple = G_SIMPLE_ASYNC_RESULT (result);
+  ContentOp          *op = data;
+  GError             *error = NULL;
+  
+  if (! g_simple_async_result_propagate_error (simple, &error) ||
+      g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+    GSimpleAsyncResult *user_result;
+    
+    user_result = g_simple_async_result_new (object, op->callback,
+                                             op->user_data,
+                                             ggu_git_show_show_async);
+    if (error) {
+      g_simple_async_result_take_error (user_result, error);
+    } else {
+      /* the content is owned by the internal result */
+      g_simple_async_result_set_op_res_gpointer (user_result,
+                                                 g_object_ref (simple),
+                                                 g_object_unref);
+    }
+    g_simple_async_result_complete (user_result);
+    g_object_unref (user_result);
+  } else {
+    /* whatever went wrong, let `git show` handle it and report errors */
+    g_error_free (error);
+    _ggu_git_run_streaming_async (GGU_GIT (self), op->argv,
+                                  show_parser_new (NULL, NULL),
+                                  ggu_git_get_priority (GGU_GIT (self)),
+                                  op->cancellable, op->callback,
+                                  op->user_data);
+  }
+}
+
 void
 ggu_git_show_show_async (GguGitShow          *self,
                          const gchar         *dir,
@@ -263,9 +450,48 @@ ggu_git_show_show_async (GguGitShow          *self,
                 NULL);
   
   argv = ggu_git_show_get_argv (self);
-  _ggu_git_run_async (GGU_GIT (self), argv, ggu_git_show_parse_output,
-                      G_PRIORITY_DEFAULT, cancellable, callback, user_data);
-  g_strfreev (argv);
+  if (! diff && ! strchr (file, '\n') && (! rev || ! strchr (rev, '\n'))) {
+    GSimpleAsyncResult *result;
+    ContentOp          *op;
+    
+    op = g_malloc (sizeof *op);
+    op->git_path    = g_strdup (ggu_git_get_git_path (GGU_GIT (self)));
+    op->dir         = g_strdup (dir);
+    op->rev         = (rev && *rev) ? g_strdup (rev) : NULL;
+    op->file        = g_strdup (file);
+    op->object      = g_strconcat (rev ? rev : "", ":", file, NULL);
+    op->argv        = argv;
+    op->cancellable = cancellable ? g_object_ref (cancellable) : NULL;
+    op->callback    = callback;
+    op->user_data   = user_data;
+    
+    result = g_simple_async_result_new (G_OBJECT (self), show_content_ready, op,
+                                        show_content_thread);
+    g_object_set_data_full (G_OBJECT (result), CONTENT_OP_KEY, op,
+                            (GDestroyNotify) content_op_free);
+    _ggu_git_scheduler_run_in_thread (result, show_content_thread, dir,
+                                      ggu_git_get_priority (GGU_GIT (self)),
+                                      cancellable);
+    g_object_unref (result);
+  } else {
+    GguGitOid *oid = diff ? rev_get_cache_oid (rev) : NULL;
+    gchar     *content;
+    
+    if (oid && _ggu_git_cache_lookup (GGU_GIT_CACHE_DIFF, oid, file,
+                                      (gpointer *) &content)) {
+      _ggu_git_complete_cached (GGU_GIT (self), content, g_free,
+                                cancellable, callback, user_data);
+    } else {
+      _ggu_git_run_streaming_async (GGU_GIT (self), argv,
+                                    show_parser_new (oid, file),
+                                    ggu_git_get_priority (GGU_GIT (self)),
+                                    cancellable, callback, user_data);
+    }
+    if (oid) {
+      ggu_git_oid_unref (oid);
+    }
+    g_strfreev (argv);
+  }
 }
 
 const gchar *
@@ -273,12 +499,40 @@ ggu_git_show_show_finish (GguGitShow   *self,
                           GAsyncResult *result,
                           GError      **error)
 {
+  if (g_simple_async_result_is_valid (result, G_OBJECT (self),
+                                      ggu_git_show_show_async)) {
+    GSimpleAsyncResult *simple = G_SIMPLE_ASYNC_RESULT (result);
+    
+    if (g_simple_async_result_propagate_error (simple, error)) {
+      return NULL;
+    }
+    /* the content is held by the `git cat-file` operation's result */
+    simple = g_simple_async_result_get_op_res_gpointer (simple);
+    
+    return g_simple_async_result_get_op_res_gpointer (simple);
+  }
+  
   return _ggu_git_run_finish (GGU_GIT (self), result, error);
 }
 
 
 /* list files changed */
 
+static const gchar *
+skip_hash (const gchar *line,
+           gsize        length)
+{
+  gsize span;
+  
+  span = _ggu_git_hex_span (line, MIN (length, GGU_GIT_OID_MAX_SIZE * 2));
+  if ((span == GGU_GIT_OID_SHA1_SIZE * 2 || span == GGU_GIT_OID_MAX_SIZE * 2) &&
+      (span == length || g_ascii_isspace (line[span]))) {
+    return line + span;
+  } else {
+    return NULL;
+  }
+}
+
 static void
 files_changed_entry_list_unref (GList *entries)
 {
@@ -286,62 +540,36 @@ files_changed_entry_list_unref (GList *entries)
                     (GDestroyNotify) ggu_git_files_changed_entry_unref);
 }
 
-static inline gboolean
-unescape_filename (gchar              *filename,
-                   GSimpleAsyncResult *result)
+static GList *
+files_changed_entry_list_copy (GList *entries)
 {
-  if (*filename == '"') {
-    guint i, j;
-    
-    for (i = 1, j = 0;
-         filename[i] != 0 && (filename[i] != '"' || filename[i+1] != 0);
-         i++) {
-      if (filename[i] == '\\') {
-        i++; /* skip backslash */
-        switch (filename[i]) {
-          case 'n':   filename[j++] = '\n'; break;
-          case 't':   filename[j++] = '\t'; break;
-          case '"':
-          case '\\':  filename[j++] = filename[i]; break;
-          
-          default:
-            /* should not happen */
-            g_warning ("unexpected escaping");
-            i--;
-            filename[j++] = filename[i];
-        }
-      } else {
-        filename[j++] = filename[i];
-      }
-    }
-    if (filename[i] != '"') {
-      g_simple_async_result_set_error (result, GGU_GIT_ERROR,
-                                       GGU_GIT_ERROR_INVALID_RESULT,
-                                       "Unexpected end of line");
-      return FALSE;
-    }
-    filename[j] = 0;
+  GList *copy = g_list_copy (entries);
+  GList *item;
+  
+  for (item = copy; item; item = item->next) {
+    ggu_git_files_changed_entry_ref (item->data);
   }
   
-  return TRUE;
+  return copy;
 }
 
 static inline gboolean
-parse_changes_count (const gchar        *changes,
-                     guint              *n_,
-                     GSimpleAsyncResult *result)
+parse_changes_count (const gchar  *changes,
+                     const gchar  *changes_end,
+                     guint        *n_,
+                     GError      **error)
 {
-  if (changes[0] == '-' && changes[1] == 0) {
+  if (changes[0] == '-' && changes + 1 == changes_end) {
     *n_ = 0u;
   } else {
     gulong  n;
     gchar  *end;
     
     n = strtoul (changes, &end, 10);
-    if (*end != 0) {
-      g_simple_async_result_set_error (result, GGU_GIT_ERROR,
-                                       GGU_GIT_ERROR_INVALID_RESULT,
-                                       "Invalid change count \"%s\"", changes);
+    if (end == changes || end != changes_end) {
+      g_set_error (error, GGU_GIT_ERROR, GGU_GIT_ERROR_INVALID_RESULT,
+                   "Invalid change count \"%.*s\"",
+                   (gint) (changes_end - changes), changes);
       return FALSE;
     } else if (n > G_MAXUINT) {
       g_warning ("value too big, truncating");
@@ -352,72 +580,236 @@ parse_changes_count (const gchar        *changes,
   return TRUE;
 }
 
-static void
-ggu_git_list_files_changed_parse_output (GguGit             *obj,
-                                         const gchar        *output,
-                                         GSimpleAsyncResult *result,
-                                         GCancellable       *cancellable)
+typedef struct _NumstatRecord NumstatRecord;
+struct _NumstatRecord
 {
-  /* Formats:
-   * 
-   * n_added <\t> n_removed <\t> file-name
-   * n_added <\t> n_removed <\t> "file-name-with-special-chars"
-   * -       <\t> -         <\t> binary-file-name
-   * -       <\t> -         <\t> "binary-file-name-with-special-chars"
-   */
-  /* FIXME: would be cool to have the output length, so we sould use
-   * 0-terminated lines, thus no weird filename convention */
-  
-  GguGitShow *self = GGU_GIT_SHOW (obj);
-  gchar     **lines;
-  guint       i;
-  GList      *entries = NULL;
-  
-  lines = g_strsplit (output, "\n", -1);
-  for (i = 0; lines[i] != NULL; i++) {
-    gchar **line;
-    guint   n_added;
-    guint   n_removed;
-    GError *error = NULL;
+  guint   added;
+  guint   removed;
+  gchar  *path;
+  gchar  *old_path; /* for renames, or NULL */
+};
+
+/* parses the `--numstat -z` record at @p, see files_changed_parser_parse().
+ * Returns the start of the next record, or %NULL if the record is incomplete
+ * or @error is set */
+static gchar *
+numstat_parse_record (gchar          *p,
+                      gchar          *end,
+                      NumstatRecord  *record,
+                      GError        **error)
+{
+  gchar *nul;
+  gchar *removed;
+  gchar *removed_end;
+  gchar *next;
+  
+  /* find the whole record before touching anything, it might not be
+   * complete yet */
+  nul = memchr (p, 0, (gsize) (end - p));
+  if (! nul) {
+    return NULL;
+  }
+  removed = memchr (p, '\t', (gsize) (nul - p));
+  removed_end = removed ? memchr (removed + 1, '\t',
+                                  (gsize) (nul - removed - 1)) : NULL;
+  if (! removed_end) {
+    g_set_error (error, GGU_GIT_ERROR, GGU_GIT_ERROR_INVALID_RESULT,
+                 "Invalid output");
+    return NULL;
+  }
+  record->path = removed_end + 1;
+  record->old_path = NULL;
+  next = nul + 1;
+  if (record->path == nul) {
+    /* a rename: the old then new paths follow, each 0-terminated */
+    record->old_path = next;
+    nul = memchr (record->old_path, 0, (gsize) (end - record->old_path));
+    if (! nul) {
+      return NULL;
+    }
+    record->path = nul + 1;
+    nul = memchr (record->path, 0, (gsize) (end - record->path));
+    if (! nul) {
+      return NULL;
+    }
+    next = nul + 1;
+  }
+  
+  if (! parse_changes_count (p, removed, &record->added, error) ||
+      ! parse_changes_count (removed + 1, removed_end, &record->removed,
+                             error)) {
+    return NULL;
+  }
+  
+  return next;
+}
+
+static GguGitFilesChangedEntry *
+numstat_record_to_entry (const NumstatRecord *record,
+                         GguGitBuffer        *buffer,
+                         GguGitOid           *oid)
+{
+  GguGitFilesChangedEntry *entry;
+  
+  entry = ggu_git_files_changed_entry_new_with_buffer (buffer);
+  entry->oid      = ggu_git_oid_ref (oid);
+  entry->added    = record->added;
+  entry->removed  = record->removed;
+  entry->path     = record->path;
+  entry->old_path = record->old_path;
+  ggu_git_files_changed_entry_update_display (entry);
+  
+  return entry;
+}
+
+typedef struct _FilesChangedParser FilesChangedParser;
+struct _FilesChangedParser
+{
+  GguGitParser  parent;
+  GguGitOid    *oid; /* shared by all entries */
+  GList        *entries;
+  gsize         size; /* approximate memory used by the entries */
+};
+
+/* creates the entries of the complete records in @data, pointing inside a
+ * single copy of it.  Returns the number of bytes used */
+static gsize
+files_changed_parser_add_entries (FilesChangedParser  *self,
+                                  const gchar         *data,
+                                  gsize                length,
+                                  GCancellable        *cancellable,
+                                  GError             **error)
+{
+  GguGitBuffer *buffer;
+  gchar        *p;
+  gchar        *end;
+  
+  buffer = ggu_git_buffer_new (data, length);
+  p = ggu_git_buffer_get_data (buffer, NULL);
+  end = p + length;
+  while (TRUE) {
+    NumstatRecord  record;
+    gchar         *next;
     
-    if (g_cancellable_set_error_if_cancelled (cancellable, &error)) {
-      g_simple_async_result_take_error (result, error);
+    while (p < end && *p == '\n') {
+      p++;
+    }
+    if (! (next = numstat_parse_record (p, end, &record, error)) ||
+        g_cancellable_set_error_if_cancelled (cancellable, error)) {
       break;
     }
     
-    /* empty line, skip it */
-    if (lines[i][0] == 0) {
-      continue;
-    }
+    self->entries = g_list_prepend (self->entries,
+                                    numstat_record_to_entry (&record, buffer,
+                                                             self->oid));
+    self->size += sizeof (GguGitFilesChangedEntry) + sizeof (GList) +
+                  (gsize) (next - p);
     
-    line = g_strsplit (lines[i], "\t", 3);
-    if (! line[0] || ! line[1] || ! line[2]) {
-      g_simple_async_result_set_error (result, GGU_GIT_ERROR,
-                                       GGU_GIT_ERROR_INVALID_RESULT,
-                                       "Invalid output");
-    } else if (parse_changes_count (line[0], &n_added, result) &&
-               parse_changes_count (line[1], &n_removed, result) &&
-               unescape_filename (line[2], result)) {
-      GguGitFilesChangedEntry *entry = NULL;
-      
-      entry = ggu_git_files_changed_entry_new ();
-      entry->hash     = g_strdup (self->priv->rev);
-      entry->added    = n_added;
-      entry->removed  = n_removed;
-      entry->path     = line[2];
-      
-      entries = g_list_prepend (entries, entry);
-      
-      /* avoid freeing the filename. It's not a problem to set it to null
-       * since it is the last strv entry */
-      line[2] = NULL;
+    p = next;
+  }
+  length = (gsize) (p - ggu_git_buffer_get_data (buffer, NULL));
+  ggu_git_buffer_unref (buffer);
+  
+  return length;
+}
+
+static gboolean
+files_changed_parser_parse (GguGitParser       *parser,
+                            GguGit             *git,
+                            gchar              *data,
+                            gsize               length,
+                            gboolean            eof,
+                            gsize              *consumed,
+                            GSimpleAsyncResult *result,
+                            GCancellable       *cancellable)
+{
+  /* Formats, with -z:
+   * 
+   * <hash> \0
+   * 
+   * n_added <\t> n_removed <\t> file-name \0
+   * n_added <\t> n_removed <\t> \0 old-file-name \0 new-file-name \0
+   * -       <\t> -         <\t> binary-file-name \0
+   * 
+   * file names are verbatim, there is no quoting to undo
+   */
+  
+  FilesChangedParser *self = (FilesChangedParser *) parser;
+  GError             *error = NULL;
+  
+  *consumed = 0;
+  if (! self->oid) {
+    const gchar *nul = memchr (data, 0, length);
+    
+    /* all entries share the commit's ID */
+    if (nul) {
+      self->oid = ggu_git_oid_intern_hex (data, nul - data);
+    }
+    if (! self->oid) {
+      if (nul || eof) {
+        g_simple_async_result_set_error (result, GGU_GIT_ERROR,
+                                         GGU_GIT_ERROR_INVALID_RESULT,
+                                         "Corrupted output: don't start with a hash");
+        return FALSE;
+      }
+      return TRUE;
     }
-    g_strfreev (line);
+    *consumed = (gsize) (nul + 1 - data);
   }
-  g_strfreev (lines);
-  entries = g_list_reverse (entries);
-  g_simple_async_result_set_op_res_gpointer (result, entries,
-                                             (GDestroyNotify) files_changed_entry_list_unref);
+  
+  *consumed += files_changed_parser_add_entries (self, data + *consumed,
+                                                 length - *consumed,
+                                                 cancellable, &error);
+  if (! error && eof && *consumed < length &&
+      strspn (data + *consumed, "\n") < length - *consumed) {
+    g_set_error (&error, GGU_GIT_ERROR, GGU_GIT_ERROR_INVALID_RESULT,
+                 "Incomplete output");
+  }
+  if (error) {
+    g_simple_async_result_take_error (result, error);
+    return FALSE;
+  }
+  
+  if (eof) {
+    self->entries = g_list_reverse (self->entries);
+    _ggu_git_cache_insert (GGU_GIT_CACHE_FILES_CHANGED, self->oid, NULL,
+                           files_changed_entry_list_copy (self->entries),
+                           self->size,
+                           (GBoxedCopyFunc) files_changed_entry_list_copy,
+                           (GDestroyNotify) files_changed_entry_list_unref);
+    g_simple_async_result_set_op_res_gpointer (result, self->entries,
+                                               (GDestroyNotify) files_changed_entry_list_unref);
+    self->entries = NULL;
+  }
+  
+  return TRUE;
+}
+
+static void
+files_changed_parser_free (GguGitParser *parser)
+{
+  FilesChangedParser *self = (FilesChangedParser *) parser;
+  
+  files_changed_entry_list_unref (self->entries);
+  if (self->oid) {
+    ggu_git_oid_unref (self->oid);
+  }
+  g_free (self);
+}
+
+static GguGitParser *
+files_changed_parser_new (void)
+{
+  FilesChangedParser *self;
+  
+  self = g_malloc (sizeof *self);
+  self->parent.parse  = files_changed_parser_parse;
+  self->parent.free   = files_changed_parser_free;
+  self->oid           = NULL;
+  self->entries       = NULL;
+  self->size          = 0;
+  
+  return (GguGitParser *) self;
 }
 
 void
@@ -432,10 +824,13 @@ ggu_git_list_files_changed_async (GguGitShow          *self,
     "git",
     "show",
     "--numstat",
-    "--format=%N",
+    "-z",
+    "--format=%H",
     NULL, /* placeholder for rev */
     NULL
   };
+  GguGitOid  *oid;
+  GList      *entries;
   
   argv[G_N_ELEMENTS (argv) - 2] = rev;
   
@@ -446,9 +841,21 @@ ggu_git_list_files_changed_async (GguGitShow          *self,
                 "diff", FALSE,
                 NULL);
   
-  _ggu_git_run_async (GGU_GIT (self), (gchar **) argv,
-                      ggu_git_list_files_changed_parse_output,
-                      G_PRIORITY_DEFAULT, cancellable, callback, user_data);
+  oid = rev_get_cache_oid (rev);
+  if (oid && _ggu_git_cache_lookup (GGU_GIT_CACHE_FILES_CHANGED, oid, NULL,
+                                    (gpointer *) &entries)) {
+    _ggu_git_complete_cached (GGU_GIT (self), entries,
+                              (GDestroyNotify) files_changed_entry_list_unref,
+                              cancellable, callback, user_data);
+  } else {
+    _ggu_git_run_streaming_async (GGU_GIT (self), (gchar **) argv,
+                                  files_changed_parser_new (),
+                                  ggu_git_get_priority (GGU_GIT (self)),
+                                  cancellable, callback, user_data);
+  }
+  if (oid) {
+    ggu_git_oid_unref (oid);
+  }
 }
 
 GList *
@@ -460,125 +867,507 @@ ggu_git_list_files_changed_finish (GguGitShow    *self,
 }
 
 
+/* batch stats */
 
-static const gchar *
-skip_hash (const gchar *line)
+typedef struct _StatsParser StatsParser;
+struct _StatsParser
+{
+  GguGitParser        parent;
+  GHashTable         *stats;
+  /* the commit being parsed */
+  GguGitOid          *oid;
+  GguGitCommitStats  *current;
+  gboolean            is_merge;
+  GList              *entries;
+  gsize               size;
+};
+
+/* caches the files changed by the commit being parsed, like
+ * ggu_git_list_files_changed_async() would list them */
+static void
+stats_parser_finish_commit (StatsParser *self)
+{
+  if (self->oid) {
+    if (! self->is_merge) {
+      _ggu_git_cache_insert (GGU_GIT_CACHE_FILES_CHANGED, self->oid, NULL,
+                             g_list_reverse (self->entries), self->size,
+                             (GBoxedCopyFunc) files_changed_entry_list_copy,
+                             (GDestroyNotify) files_changed_entry_list_unref);
+      self->entries = NULL;
+    }
+    ggu_git_oid_unref (self->oid);
+  }
+  self->oid = NULL;
+  self->current = NULL;
+  self->is_merge = FALSE;
+  self->size = 0;
+}
+
+/* parses the complete records in @data.  Returns the number of bytes used */
+static gsize
+stats_parser_add_records (StatsParser   *self,
+                          const gchar   *data,
+                          gsize          length,
+                          GCancellable  *cancellable,
+                          GError       **error)
 {
-  register const gchar *p = line;
+  GguGitBuffer *buffer;
+  gchar        *p;
+  gchar        *end;
   
-  while (g_ascii_isxdigit (*p)) {
-    p++;
+  buffer = ggu_git_buffer_new (data, length);
+  p = ggu_git_buffer_get_data (buffer, NULL);
+  end = p + length;
+  while (TRUE) {
+    NumstatRecord  record;
+    const gchar   *hash_end;
+    gchar         *nul;
+    gchar         *next;
+    
+    while (p < end && *p == '\n') {
+      p++;
+    }
+    if (! (nul = memchr (p, 0, (gsize) (end - p)))) {
+      break;
+    }
+    
+    /* counts are followed by a tab, so only headers can start with a hash
+     * and a space */
+    hash_end = skip_hash (p, (gsize) (nul - p));
+    if (hash_end && *hash_end == ' ') {
+      if (g_cancellable_set_error_if_cancelled (cancellable, error)) {
+        break;
+      }
+      stats_parser_finish_commit (self);
+      self->oid = ggu_git_oid_intern_hex (p, hash_end - p);
+      self->current = g_malloc0 (sizeof *self->current);
+      g_hash_table_replace (self->stats, ggu_git_oid_ref (self->oid),
+                            self->current);
+      /* merges have several parents and aren't listed the same */
+      self->is_merge = memchr (hash_end + 1, ' ',
+                               (gsize) (nul - hash_end - 1)) != NULL;
+      p = nul + 1;
+      continue;
+    }
+    
+    if (! self->oid) {
+      g_set_error (error, GGU_GIT_ERROR, GGU_GIT_ERROR_INVALID_RESULT,
+                   "Corrupted output: don't start with a hash");
+      break;
+    }
+    if (! (next = numstat_parse_record (p, end, &record, error))) {
+      break;
+    }
+    self->current->added += record.added;
+    self->current->removed += record.removed;
+    self->current->n_files++;
+    if (! self->is_merge) {
+      self->entries = g_list_prepend (self->entries,
+                                      numstat_record_to_entry (&record, buffer,
+                                                               self->oid));
+      self->size += sizeof (GguGitFilesChangedEntry) + sizeof (GList) +
+                    (gsize) (next - p);
+    }
+    
+    p = next;
   }
+  length = (gsize) (p - ggu_git_buffer_get_data (buffer, NULL));
+  ggu_git_buffer_unref (buffer);
   
-  if (p - line == 40 && (! *p || g_ascii_isspace (*p))) {
-    return p;
-  } else {
-    return NULL;
+  return length;
+}
+
+static gboolean
+stats_parser_parse (GguGitParser       *parser,
+                    GguGit             *git,
+                    gchar              *data,
+                    gsize               length,
+                    gboolean            eof,
+                    gsize              *consumed,
+                    GSimpleAsyncResult *result,
+                    GCancellable       *cancellable)
+{
+  /* Format, with -z:
+   * 
+   * <hash> <space> <parent-hashes> \0
+   * <\n> <numstat records, as for files_changed_parser_parse()>
+   * 
+   * the newline and records are missing for commits without changes, and
+   * the next header follows the last record directly
+   */
+  
+  StatsParser  *self = (StatsParser *) parser;
+  GError       *error = NULL;
+  
+  *consumed = stats_parser_add_records (self, data, length, cancellable,
+                                        &error);
+  if (! error && eof && *consumed < length &&
+      strspn (data + *consumed, "\n") < length - *consumed) {
+    g_set_error (&error, GGU_GIT_ERROR, GGU_GIT_ERROR_INVALID_RESULT,
+                 "Incomplete output");
+  }
+  if (error) {
+    g_simple_async_result_take_error (result, error);
+    return FALSE;
   }
+  
+  if (eof) {
+    stats_parser_finish_commit (self);
+    g_simple_async_result_set_op_res_gpointer (result, self->stats,
+                                               (GDestroyNotify) g_hash_table_unref);
+    self->stats = NULL;
+  }
+  
+  return TRUE;
 }
 
+static void
+stats_parser_free (GguGitParser *parser)
+{
+  StatsParser *self = (StatsParser *) parser;
+  
+  if (self->oid) {
+    ggu_git_oid_unref (self->oid);
+  }
+  files_changed_entry_list_unref (self->entries);
+  if (self->stats) {
+    g_hash_table_unref (self->stats);
+  }
+  g_free (self);
+}
+
+static GguGitParser *
+stats_parser_new (void)
+{
+  StatsParser *self;
+  
+  self = g_malloc (sizeof *self);
+  self->parent.parse  = stats_parser_parse;
+  self->parent.free   = stats_parser_free;
+  /* IDs are interned, so they can be compared directly */
+  self->stats         = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                               (GDestroyNotify) ggu_git_oid_unref,
+                                               g_free);
+  self->oid           = NULL;
+  self->current       = NULL;
+  self->is_merge      = FALSE;
+  self->entries       = NULL;
+  self->size          = 0;
+  
+  return (GguGitParser *) self;
+}
+
+/**
+ * ggu_git_show_load_stats_async:
+ * @self: A #GguGitShow object
+ * @dir: Directory to run in
+ * @rev: Revision to start the history at, or %NULL for HEAD
+ * @file: Path to restrict the history to, or %NULL
+ * @skip: Number of commits to skip at the start of the history
+ * @max_count: Maximum number of commits to get the stats of, or 0 for no limit
+ * @cancellable: A #GCancellable object, or %NULL
+ * @callback: The callback to be called when the operation result is ready
+ * @user_data: User data for @callback
+ * 
+ * Gets how many lines each commit of the history adds and removes, in a
+ * single `git log` run rather than one ggu_git_list_files_changed_async() per
+ * commit.  @rev, @file, @skip and @max_count select the commits like they do
+ * for #GguGitLog, so the stats of a history page can be loaded along with it.
+ * The counts are the ones of the whole commits even if @file is given.
+ * 
+ * As the changes of each commit are parsed anyway, their lists are put in the
+ * cache so that ggu_git_list_files_changed_async() can find them.
+ * 
+ * @callback can obtain the operation result using
+ * ggu_git_show_load_stats_finish().
+ */
+void
+ggu_git_show_load_stats_async (GguGitShow          *self,
+                               const gchar         *dir,
+                               const gchar         *rev,
+                               const gchar         *file,
+                               guint                skip,
+                               guint                max_count,
+                               GCancellable        *cancellable,
+                               GAsyncReadyCallback  callback,
+                               gpointer             user_data)
+{
+  GPtrArray  *argv;
+  gchar     **argv_strv;
+  
+  argv = g_ptr_array_new ();
+  g_ptr_array_add (argv, g_strdup ("git"));
+  g_ptr_array_add (argv, g_strdup ("log"));
+  g_ptr_array_add (argv, g_strdup ("--numstat"));
+  g_ptr_array_add (argv, g_strdup ("-z"));
+  g_ptr_array_add (argv, g_strdup ("--format=%H %P"));
+  if (skip > 0) {
+    g_ptr_array_add (argv, g_strdup_printf ("--skip=%u", skip));
+  }
+  if (max_count > 0) {
+    g_ptr_array_add (argv, g_strdup_printf ("--max-count=%u", max_count));
+  }
+  if (rev) {
+    g_ptr_array_add (argv, g_strdup (rev));
+  }
+  if (file) {
+    /* list all the changes, not only the ones to @file */
+    g_ptr_array_add (argv, g_strdup ("--full-diff"));
+    g_ptr_array_add (argv, g_strdup ("--"));
+    g_ptr_array_add (argv, g_strdup (file));
+  }
+  g_ptr_array_add (argv, NULL);
+  argv_strv = (gchar **) g_ptr_array_free (argv, FALSE);
+  
+  g_object_set (self,
+                "dir", dir,
+                "rev", rev,
+                "file", file,
+                "diff", FALSE,
+                NULL);
+  
+  _ggu_git_run_streaming_async (GGU_GIT (self), argv_strv, stats_parser_new (),
+                                ggu_git_get_priority (GGU_GIT (self)),
+                                cancellable, callback, user_data);
+  g_strfreev (argv_strv);
+}
+
+/**
+ * ggu_git_show_load_stats_finish:
+ * @self: The #GguGitShow object that launched the operation
+ * @result: The #GAsyncResult of the operation
+ * @error: Return location for errors or %NULL to ignore
+ * 
+ * Gets the result of an operation started with
+ * ggu_git_show_load_stats_async().
+ * 
+ * Returns: (transfer none) (element-type GguGitOid GguGitCommitStats): A
+ *          table mapping the interned ID of each commit to its
+ *          #GguGitCommitStats, or %NULL on error.
+ */
+GHashTable *
+ggu_git_show_load_stats_finish (GguGitShow    *self,
+                                GAsyncResult  *result,
+                                GError       **error)
+{
+  return _ggu_git_run_finish (GGU_GIT (self), result, error);
+}
+
+
+
 static void
 entry_list_unref (GList *entries)
 {
   g_list_free_full (entries, (GDestroyNotify) ggu_git_blame_entry_unref);
 }
 
-static void
-ggu_git_blame_parse_output (GguGit             *obj,
-                            const gchar        *output,
-                            GSimpleAsyncResult *result,
-                            GCancellable       *cancellable)
+/* whether the line starts a group, e.g. has a hash and 3 numbers */
+static gboolean
+blame_is_group_start (const gchar *line,
+                      const gchar *eol)
 {
-  /* Format:
-   * 
-   * <hash> <rigline> <line> <n_following>
-   * author <name>
-   * author-mail <email>
-   * ... <many headers>
-   * \t<line content>
-   * 
-   * the headers may be omitted if they are the same as the previous ones
-   */
+  const gchar  *p = skip_hash (line, (gsize) (eol - line));
+  guint         n_fields = 1;
   
-  gchar **lines = g_strsplit (output, "\n", 0);
-  gchar **p;
-  glong   count = 0;
-  GList  *entries = NULL;
+  if (! p) {
+    return FALSE;
+  }
+  for (; p < eol; p++) {
+    if (*p == ' ') {
+      n_fields++;
+    }
+  }
   
-  for (p = lines; *p; p++) {
-    const gchar      *line = skip_hash (*p);
-    gchar            *end;
-    GguGitBlameEntry *entry;
+  return n_fields == 4;
+}
+
+static const gchar *
+blame_find_record (const gchar *p,
+                   const gchar *end)
+{
+  if (p[-1] != '\n') {
+    p = memchr (p, '\n', (gsize) (end - p));
+    p = p ? p + 1 : end;
+  }
+  while (p < end) {
+    const gchar *eol = memchr (p, '\n', (gsize) (end - p));
     
+    if (! eol) {
+      eol = end;
+    }
+    /* content lines start with a tab and headers with a name, so only
+     * commit lines can start with a hash */
+    if (blame_is_group_start (p, eol)) {
+      break;
+    }
+    p = eol + 1;
+  }
+  
+  return MIN (p, end);
+}
+
+static const gchar *
+blame_intern_author (const gchar            *name,
+                     gsize                   length,
+                     const GguGitBlameEntry *previous)
+{
+  gchar         buf[256];
+  gchar        *str = buf;
+  const gchar  *author;
+  
+  /* consecutive lines often have the same author, avoid the locked lookup */
+  if (previous && strncmp (previous->author, name, length) == 0 &&
+      previous->author[length] == 0) {
+    return ggu_git_interned_ref (previous->author);
+  }
+  
+  if (length >= sizeof buf) {
+    str = g_malloc (length + 1);
+  }
+  memcpy (str, name, length);
+  str[length] = 0;
+  author = ggu_git_intern_utf8 (str);
+  if (str != buf) {
+    g_free (str);
+  }
+  
+  return author;
+}
+
+static gboolean
+blame_parse_records (const gchar   *start,
+                     const gchar   *end,
+                     GList        **entries_,
+                     gpointer       data,
+                     GCancellable  *cancellable,
+                     GError       **error)
+{
+  GList        *entries = NULL;
+  const gchar  *eol;
+  glong         count = 0;
+  gboolean      success = TRUE;
+  
+  for (; success && start < end; start = eol + 1) {
+    const gchar            *line;
+    gchar                  *num_end;
+    GguGitBlameEntry       *entry;
+    const GguGitBlameEntry *previous;
+    
+    eol = memchr (start, '\n', (gsize) (end - start));
+    if (! eol) {
+      eol = end;
+    }
+    
+    line = skip_hash (start, (gsize) (eol - start));
     if (! line) {
       continue;
     }
     
     entry = ggu_git_blame_entry_new ();
     entries = g_list_prepend (entries, entry);
-    entry->hash = g_strndup (*p, (gsize) (line - *p));
+    entry->oid = ggu_git_oid_intern_hex (start, line - start);
     
     if (--count > 0) {
       const GguGitBlameEntry *old = entries->next->data;
       
-      if (strcmp (entry->hash, old->hash) != 0) {
-        g_simple_async_result_set_error (result, GGU_GIT_ERROR,
-                                         GGU_GIT_ERROR_INVALID_RESULT,
-                                         "Corrupted output: grouped commits with different hashes");
-        break;
+      /* interned, so the same commit has the same ID */
+      if (entry->oid != old->oid) {
+        g_set_error (error, GGU_GIT_ERROR, GGU_GIT_ERROR_INVALID_RESULT,
+                     "Corrupted output: grouped commits with different hashes");
+        success = FALSE;
+        continue;
       }
       
       entry->line = old->line + 1;
-      entry->author = g_strdup (old->author);
+      entry->author = ggu_git_interned_ref (old->author);
       continue;
     }
     
+    if (g_cancellable_set_error_if_cancelled (cancellable, error)) {
+      success = FALSE;
+      continue;
+    }
     
-    while (*(++line) != ' '); /* oldline */
-    entry->line = strtoul (line, &end, 0); /* line*/
-    if (line == end) {
-      g_simple_async_result_set_error (result, GGU_GIT_ERROR,
-                                       GGU_GIT_ERROR_INVALID_RESULT,
-                                       "Corrupted output: missing line number");
-      break;
+    while (line < eol && *(++line) != ' '); /* oldline */
+    entry->line = strtoul (line, &num_end, 0); /* line*/
+    if (line >= eol || line == num_end) {
+      g_set_error (error, GGU_GIT_ERROR, GGU_GIT_ERROR_INVALID_RESULT,
+                   "Corrupted output: missing line number");
+      success = FALSE;
+      continue;
     }
-    line = end;
+    line = num_end;
     
-    count = strtol (line, &end, 10);
-    if (line == end || *end != 0) {
-      g_simple_async_result_set_error (result, GGU_GIT_ERROR,
-                                       GGU_GIT_ERROR_INVALID_RESULT,
-                                       "Corrupted output: missing commit count");
-      break;
+    count = strtol (line, &num_end, 10);
+    if (line == num_end || num_end != eol) {
+      g_set_error (error, GGU_GIT_ERROR, GGU_GIT_ERROR_INVALID_RESULT,
+                   "Corrupted output: missing commit count");
+      success = FALSE;
+      continue;
     }
     
     /* now get the author name */
-    line = *(++p);
-    if (! line) {
-      g_simple_async_result_set_error (result, GGU_GIT_ERROR,
-                                       GGU_GIT_ERROR_INVALID_RESULT,
-                                       "Corrupted output: truncated data");
-      break;
+    if (eol >= end) {
+      g_set_error (error, GGU_GIT_ERROR, GGU_GIT_ERROR_INVALID_RESULT,
+                   "Corrupted output: truncated data");
+      success = FALSE;
+      continue;
+    }
+    line = eol + 1;
+    eol = memchr (line, '\n', (gsize) (end - line));
+    if (! eol) {
+      eol = end;
     }
     
-    if (g_str_has_prefix (line, "author ")) {
-      entry->author = ggu_git_utf8_ensure_valid (line + 7);  /* skip "author " */
-    } else if (entries) {
-      const GguGitBlameEntry *old = entries->next->data;
-      
-      entry->author = g_strdup (old->author);
+    previous = entries->next ? entries->next->data : NULL;
+    if (eol - line >= 7 && strncmp (line, "author ", 7) == 0) {
+      entry->author = blame_intern_author (line + 7, (gsize) (eol - line - 7),
+                                           previous);
+    } else if (previous) {
+      entry->author = ggu_git_interned_ref (previous->author);
     } else {
-      g_simple_async_result_set_error (result, GGU_GIT_ERROR,
-                                       GGU_GIT_ERROR_INVALID_RESULT,
-                                       "Corrupted output: missing author info");
-      break;
+      g_set_error (error, GGU_GIT_ERROR, GGU_GIT_ERROR_INVALID_RESULT,
+                   "Corrupted output: missing author info");
+      success = FALSE;
     }
   }
   
-  entries = g_list_reverse (entries);
-  g_simple_async_result_set_op_res_gpointer (result, entries,
-                                             (GDestroyNotify) entry_list_unref);
-  g_strfreev (lines);
+  *entries_ = g_list_reverse (entries);
+  
+  return success;
+}
+
+static void
+ggu_git_blame_parse_output (GguGit             *obj,
+                            const gchar        *output,
+                            GSimpleAsyncResult *result,
+                            GCancellable       *cancellable)
+{
+  /* Format:
+   * 
+   * <hash> <rigline> <line> <n_following>
+   * author <name>
+   * author-mail <email>
+   * ... <many headers>
+   * \t<line content>
+   * 
+   * the headers may be omitted if they are the same as the previous ones
+   */
+  
+  GList  *entries;
+  GError *error = NULL;
+  
+  /* blames of large files are split at the groups and parsed in parallel */
+  entries = _ggu_git_parse_records (output, strlen (output),
+                                    blame_find_record, blame_parse_records,
+                                    (GDestroyNotify) ggu_git_blame_entry_unref,
+                                    NULL, cancellable, &error);
+  if (error) {
+    g_simple_async_result_take_error (result, error);
+  } else {
+    g_simple_async_result_set_op_res_gpointer (result, entries,
+                                               (GDestroyNotify) entry_list_unref);
+  }
 }
 
 /**
@@ -635,7 +1424,8 @@ ggu_git_blame_async (GguGitShow          *self,
   
   _ggu_git_run_async (GGU_GIT (self), (gchar **) argv,
                       ggu_git_blame_parse_output,
-                      G_PRIORITY_DEFAULT, cancellable, callback, user_data);
+                      ggu_git_get_priority (GGU_GIT (self)),
+                      cancellable, callback, user_data);
 }
 
 /**
@@ -42,6 +42,7 @@ G_BEGIN_DECLS
 typedef struct _GguGitShow        GguGitShow;
 typedef struct _GguGitShowClass   GguGitShowClass;
 typedef struct _GguGitShowPrivate GguGitShowPrivate;
+typedef struct _GguGitCommitStats GguGitCommitStats;
 
 struct _GguGitShow
 {
@@ -54,6 +55,22 @@ struct _GguGitShowClass
   GguGitClass parent_class;
 };
 
+/**
+ * GguGitCommitStats:
+ * @added: Number of lines added by the commit
+ * @removed: Number of lines removed by the commit
+ * @n_files: Number of files the commit changes
+ * 
+ * Summary of the changes of a commit.  Binary files count as changed files
+ * without adding or removing any line.
+ */
+struct _GguGitCommitStats
+{
+  guint added;
+  guint removed;
+  guint n_files;
+};
+
 
 GType             ggu_git_show_get_type             (void) G_GNUC_CONST;
 GguGitShow       *ggu_git_show_new                  (void);
@@ -77,6 +94,18 @@ void              ggu_git_list_files_changed_async  (GguGitShow          *self,
 GList            *ggu_git_list_files_changed_finish (GguGitShow          *self,
                                                      GAsyncResult        *result,
                                                      GError             **error);
+void              ggu_git_show_load_stats_async     (GguGitShow          *self,
+                                                     const gchar         *dir,
+                                                     const gchar         *rev,
+                                                     const gchar         *file,
+                                                     guint                skip,
+                                                     guint                max_count,
+                                                     GCancellable        *cancellable,
+                                                     GAsyncReadyCallback  callback,
+                                                     gpointer             user_data);
+GHashTable       *ggu_git_show_load_stats_finish    (GguGitShow          *self,
+                                                     GAsyncResult        *result,
+                                                     GError             **error);
 void              ggu_git_blame_async               (GguGitShow          *self,
                                                      const gchar         *dir,
                                                      const gchar         *rev,
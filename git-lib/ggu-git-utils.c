@@ -26,6 +26,8 @@
 #include <sys/wait.h>
 #include <glib.h>
 
+#include "ggu-git-oid.h"
+
 
 /* FIXME: also check whether the path is known of Git, so don't return Git path
  *        for a file Git don't know but that is in the tree? Or we want to have
@@ -86,41 +88,254 @@ ggu_git_parse_path (const gchar *path,
 gchar *
 ggu_git_utf8_ensure_valid (const gchar *str)
 {
-  const gchar  *end;
-  gboolean      valid;
-  GString      *valid_str;
+  gchar *valid = ggu_git_utf8_normalize (str, strlen (str), FALSE);
   
-  valid_str = g_string_new (NULL);
-  do {
-    valid = g_utf8_validate (str, -1, &end);
-    g_string_append_len (valid_str, str, end - str);
-    if (! valid) {
-      g_string_append_unichar (valid_str, 0xfffd);
-      str = end + 1;
+  return valid ? valid : g_strdup (str);
+}
+
+#define WORD_HIGH_BITS  ((guint64) 0x8080808080808080ULL)
+#define WORD_LOW_BITS   ((guint64) 0x0101010101010101ULL)
+/* whether one of the bytes of @w is 0 */
+#define WORD_HAS_ZERO(w) ((((w) - WORD_LOW_BITS) & ~(w) & WORD_HIGH_BITS) != 0)
+
+/* whether the character at @p, that ends before @end, is alphanumeric */
+static gboolean
+is_alnum_at (const gchar *p,
+             const gchar *end)
+{
+  if ((guchar) *p < 0x80) {
+    return g_ascii_isalnum (*p);
+  } else {
+    gunichar wc = g_utf8_get_char_validated (p, end - p);
+    
+    return ! (wc & 0x80000000) && g_unichar_isalnum (wc);
+  }
+}
+
+/**
+ * ggu_git_utf8_normalize:
+ * @str: A string
+ * @length: The length of @str, in bytes
+ * @reflow: Whether to reflow @str as a commit message
+ * 
+ * Makes @str valid UTF-8 like ggu_git_utf8_ensure_valid() does and, if
+ * @reflow is %TRUE, joins the lines of its paragraphs and removes trailing
+ * spaces.  A single newline is joined when the next line starts with a
+ * letter or a digit, in any script.
+ * 
+ * ASCII text is scanned a word at a time, and only the parts that need
+ * changing are copied, so the common case of a valid string that doesn't
+ * need reflowing is cheap.
+ * 
+ * Returns: A newly allocated normalized copy of @str, or %NULL if @str is
+ *          already normalized.
+ */
+gchar *
+ggu_git_utf8_normalize (const gchar *str,
+                        gsize        length,
+                        gboolean     reflow)
+{
+  const guint64   newlines = WORD_LOW_BITS * '\n';
+  const gchar    *p = str;
+  const gchar    *end = str + length;
+  const gchar    *copied = str; /* start of what still has to be copied */
+  const gchar    *tail;
+  GString        *builder = NULL;
+  gboolean        prev_newline = FALSE;
+  
+  while (p < end) {
+    guchar c;
+    
+    /* skip ASCII words, and for reflowing those without a newline */
+    while (end - p >= 8) {
+      guint64 w;
+      
+      memcpy (&w, p, sizeof w);
+      if ((w & WORD_HIGH_BITS) || (reflow && WORD_HAS_ZERO (w ^ newlines))) {
+        break;
+      }
+      p += 8;
+      prev_newline = FALSE;
+    }
+    if (p >= end) {
+      break;
+    }
+    
+    c = (guchar) *p;
+    if (c < 0x80) {
+      if (reflow && c == '\n') {
+        if (! prev_newline && p + 1 < end && is_alnum_at (p + 1, end)) {
+          /* transform this newline by a space */
+          if (! builder) {
+            builder = g_string_sized_new (length);
+          }
+          g_string_append_len (builder, copied, p - copied);
+          g_string_append_c (builder, ' ');
+          copied = p + 1;
+        }
+        prev_newline = TRUE;
+      } else {
+        prev_newline = FALSE;
+      }
+      p++;
+    } else {
+      gsize len = MIN ((gsize) g_utf8_skip[c], (gsize) (end - p));
+      
+      if (G_LIKELY (g_utf8_validate (p, (gssize) len, NULL))) {
+        p += len;
+      } else {
+        /* replace invalid bytes by U+FFFD */
+        if (! builder) {
+          builder = g_string_sized_new (length + 2);
+        }
+        g_string_append_len (builder, copied, p - copied);
+        g_string_append (builder, "\357\277\275");
+        copied = ++p;
+      }
+      prev_newline = FALSE;
+    }
+  }
+  
+  tail = end;
+  if (reflow) {
+    /* neither a replacement character nor an added space are spaces to
+     * strip, so the trailing spaces are all in the part not copied yet */
+    while (tail > copied && g_ascii_isspace (tail[-1])) {
+      tail--;
+    }
+  }
+  if (builder) {
+    g_string_append_len (builder, copied, tail - copied);
+    return g_string_free (builder, FALSE);
+  } else if (tail != end) {
+    return g_strndup (str, (gsize) (tail - str));
+  } else {
+    return NULL;
+  }
+}
+
+
+/* an interned string, @str is what callers get */
+typedef struct _InternedString InternedString;
+struct _InternedString
+{
+  gint    ref_count;
+  gchar  *key;    /* the string as it was given, or @str if it was valid */
+  gchar   str[1];
+};
+
+#define INTERNED_STRING(s) \
+  ((InternedString *) ((s) - G_STRUCT_OFFSET (InternedString, str)))
+
+G_LOCK_DEFINE_STATIC (interned_strings);
+static GHashTable *interned_strings = NULL;
+
+/**
+ * ggu_git_intern_utf8:
+ * @str: A string
+ * 
+ * Gets a shared valid UTF-8 version of @str, like
+ * ggu_git_utf8_ensure_valid() would return.  Equal strings share the same
+ * memory and are only validated the first time, which is well suited to
+ * values that repeat a lot, like author names.
+ * 
+ * Returns: A reference to an interned valid UTF-8 version of @str.  It must
+ *          not be modified, and should be released with
+ *          ggu_git_interned_unref().
+ */
+const gchar *
+ggu_git_intern_utf8 (const gchar *str)
+{
+  InternedString *interned;
+  
+  G_LOCK (interned_strings);
+  if (G_UNLIKELY (! interned_strings)) {
+    interned_strings = g_hash_table_new (g_str_hash, g_str_equal);
+  }
+  interned = g_hash_table_lookup (interned_strings, str);
+  if (interned) {
+    g_atomic_int_inc (&interned->ref_count);
+  } else {
+    gsize   length = strlen (str);
+    gchar  *valid = ggu_git_utf8_normalize (str, length, FALSE);
+    
+    if (G_UNLIKELY (valid)) {
+      length = strlen (valid);
     }
-  } while (! valid);
+    interned = g_malloc (sizeof *interned + length);
+    interned->ref_count = 1;
+    memcpy (interned->str, valid ? valid : str, length + 1);
+    interned->key = valid ? g_strdup (str) : interned->str;
+    g_hash_table_insert (interned_strings, interned->key, interned);
+    g_free (valid);
+  }
+  G_UNLOCK (interned_strings);
+  
+  return interned->str;
+}
+
+/**
+ * ggu_git_interned_ref:
+ * @str: A string returned by ggu_git_intern_utf8()
+ * 
+ * Adds a reference to an interned string.
+ * 
+ * Returns: @str
+ */
+const gchar *
+ggu_git_interned_ref (const gchar *str)
+{
+  g_atomic_int_inc (&INTERNED_STRING (str)->ref_count);
+  return str;
+}
+
+/**
+ * ggu_git_interned_unref:
+ * @str: A string returned by ggu_git_intern_utf8()
+ * 
+ * Drops a reference from an interned string, releasing it when it was the
+ * last one.
+ */
+void
+ggu_git_interned_unref (const gchar *str)
+{
+  InternedString *interned = INTERNED_STRING (str);
+  gint            count;
   
-  return g_string_free (valid_str, FALSE);
+  /* the last reference is dropped under the lock not to race a lookup */
+  do {
+    count = g_atomic_int_get (&interned->ref_count);
+  } while (count > 1 &&
+           ! g_atomic_int_compare_and_exchange (&interned->ref_count,
+                                                count, count - 1));
+  if (count <= 1) {
+    G_LOCK (interned_strings);
+    if (g_atomic_int_dec_and_test (&interned->ref_count)) {
+      g_hash_table_remove (interned_strings, interned->key);
+      if (interned->key != interned->str) {
+        g_free (interned->key);
+      }
+      g_free (interned);
+    }
+    G_UNLOCK (interned_strings);
+  }
 }
 
 /**
  * ggu_git_is_hash:
  * @hash: a string
  * 
- * Checks if a string is a possibly valid Git hash
+ * Checks if a string is a possibly valid full Git hash, either a SHA-1 or a
+ * SHA-256 one
  * 
  * Returns: whether @str looks OK
  */
 gboolean
 ggu_git_is_hash (const gchar *hash)
 {
-  guint i;
-  
-  for (i = 0; hash[i]; i++) {
-    if (! g_ascii_isxdigit (hash[i])) {
-      return FALSE;
-    }
-  }
+  gsize length = strlen (hash);
   
-  return i == 40;
+  return ((length == GGU_GIT_OID_SHA1_SIZE * 2 ||
+           length == GGU_GIT_OID_MAX_SIZE * 2) &&
+          _ggu_git_hex_span (hash, length) == length);
 }
@@ -31,8 +31,15 @@ gboolean  ggu_git_parse_path        (const gchar *path,
                                      gchar      **root_,
                                      gchar      **inner_path_);
 gchar    *ggu_git_utf8_ensure_valid (const gchar *str);
+gchar    *ggu_git_utf8_normalize    (const gchar *str,
+                                     gsize        length,
+                                     gboolean     reflow);
 gboolean  ggu_git_is_hash           (const gchar *hash);
 
+const gchar  *ggu_git_intern_utf8     (const gchar *str);
+const gchar  *ggu_git_interned_ref    (const gchar *str);
+void          ggu_git_interned_unref  (const gchar *str);
+
 
 G_END_DECLS
 
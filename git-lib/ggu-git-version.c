@@ -92,7 +92,8 @@ ggu_git_get_version_async (GguGit              *self,
   };
   
   _ggu_git_run_async (GGU_GIT (self), (gchar **) argv,
-                      ggu_git_get_version_parse_output, G_PRIORITY_DEFAULT,
+                      ggu_git_get_version_parse_output,
+                      ggu_git_get_priority (GGU_GIT (self)),
                       cancellable, callback, user_data);
 }
 
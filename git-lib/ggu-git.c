@@ -19,15 +19,33 @@
  * 
  */
 
+/* first, so that the system extensions it enables apply to all headers */
+#include "config.h"
+
 #include "ggu-git.h"
 
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/types.h>
 #include <sys/wait.h>
+#if defined (HAVE_POSIX_SPAWN) && \
+    defined (HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCHDIR_NP) && \
+    defined (HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCLOSEFROM_NP) && \
+    defined (HAVE_PIPE2)
+# define USE_POSIX_SPAWN 1
+# include <spawn.h>
+extern char **environ;
+#endif
 #include <glib.h>
 #include <glib-object.h>
 #include <gio/gio.h>
 
 #include "ggu-glib-compat.h"
+#include "ggu-git-scheduler.h"
 
 
 GQuark
@@ -47,6 +65,7 @@ struct _GguGitPrivate
 {
   gchar *git_path;
   gchar *dir;
+  gint   priority;
 };
 
 enum
@@ -54,7 +73,8 @@ enum
   PROP_0,
   
   PROP_GIT_PATH,
-  PROP_DIR
+  PROP_DIR,
+  PROP_PRIORITY
 };
 
 
@@ -80,6 +100,10 @@ ggu_git_get_property (GObject    *object,
       g_value_set_string (value, self->priv->dir);
       break;
     
+    case PROP_PRIORITY:
+      g_value_set_int (value, self->priv->priority);
+      break;
+    
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -103,6 +127,10 @@ ggu_git_set_property (GObject      *object,
       ggu_git_set_dir (self, g_value_get_string (value));
       break;
     
+    case PROP_PRIORITY:
+      ggu_git_set_priority (self, g_value_get_int (value));
+      break;
+    
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -145,6 +173,14 @@ ggu_git_class_init (GguGitClass *klass)
                                                         NULL,
                                                         G_PARAM_READWRITE |
                                                         G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (object_class, PROP_PRIORITY,
+                                   g_param_spec_int ("priority",
+                                                     "Priority",
+                                                     "Priority of the operations",
+                                                     G_MININT, G_MAXINT,
+                                                     G_PRIORITY_DEFAULT,
+                                                     G_PARAM_READWRITE |
+                                                     G_PARAM_STATIC_STRINGS));
   
   g_type_class_add_private (klass, sizeof (GguGitPrivate));
 }
@@ -158,16 +194,67 @@ ggu_git_init (GguGit *self)
   
   self->priv->git_path = g_strdup ("git");
   self->priv->dir = NULL;
+  self->priv->priority = G_PRIORITY_DEFAULT;
+}
+
+
+/* size of the chunks in which the output of Git is read */
+#define READ_SIZE 65536
+
+/* GguGitParser wrapping a GguGitParseOutputFunc: waits for the whole output
+ * and gives it to the function */
+typedef struct _OutputParser OutputParser;
+struct _OutputParser
+{
+  GguGitParser          parent;
+  GguGitParseOutputFunc parse_output;
+};
+
+static gboolean
+output_parser_parse (GguGitParser        *parser,
+                     GguGit              *git,
+                     gchar               *data,
+                     gsize                length,
+                     gboolean             eof,
+                     gsize               *consumed,
+                     GSimpleAsyncResult  *result,
+                     GCancellable        *cancellable)
+{
+  OutputParser *self = (OutputParser *) parser;
+  
+  if (! eof) {
+    *consumed = 0;
+  } else {
+    self->parse_output (git, data, result, cancellable);
+    *consumed = length;
+  }
+  
+  return TRUE;
 }
 
+static GguGitParser *
+output_parser_new (GguGitParseOutputFunc parse_output)
+{
+  OutputParser *self;
+  
+  self = g_malloc (sizeof *self);
+  self->parent.parse  = output_parser_parse;
+  self->parent.free   = (void (*) (GguGitParser *)) g_free;
+  self->parse_output  = parse_output;
+  
+  return (GguGitParser *) self;
+}
+
+
+#define GIT_OP_KEY "ggu-git-op"
 
 typedef struct _GitOp GitOp;
 struct _GitOp
 {
-  gchar                *git_path;
-  gchar                *dir;
-  gchar               **argv;
-  GguGitParseOutputFunc parse_output;
+  gchar        *git_path;
+  gchar        *dir;
+  gchar       **argv;
+  GguGitParser *parser;
 };
 
 static void
@@ -176,20 +263,378 @@ git_op_free (GitOp *op)
   g_free (op->git_path);
   g_free (op->dir);
   g_strfreev (op->argv);
+  op->parser->free (op->parser);
   g_free (op);
 }
 
+/* reads what is available on @fd and appends it to @buf.  @buf is kept
+ * 0-terminated. */
+static gboolean
+read_chunk (gint      fd,
+            GString  *buf,
+            gboolean *eof,
+            GError  **error)
+{
+  gsize   len = buf->len;
+  gssize  n;
+  
+  g_string_set_size (buf, len + READ_SIZE);
+  do {
+    n = read (fd, buf->str + len, READ_SIZE);
+  } while (n < 0 && errno == EINTR);
+  if (n < 0) {
+    gint errsv = errno;
+    
+    g_string_truncate (buf, len);
+    g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+                 "Failed to read Git output: %s", g_strerror (errsv));
+    return FALSE;
+  }
+  g_string_truncate (buf, len + (gsize) n);
+  *eof = (n == 0);
+  
+  return TRUE;
+}
+
+/* how long Git is given to terminate after SIGTERM before being killed */
+#define TERMINATE_GRACE_TIME  500 /* ms */
+
+/* a running Git process */
+typedef struct _GitChild GitChild;
+struct _GitChild
+{
+  GPid          pid;
+  gint          out_fd;
+  gint          err_fd;
+  /* readable when the operation gets cancelled, or -1 */
+  gint          cancel_fd;
+  /* whether the process was asked to terminate because the operation got
+   * cancelled.  the cancellable can't be trusted for this since it may have
+   * been reset in the meantime */
+  volatile gint terminated;
+};
+
+#ifdef USE_POSIX_SPAWN
+
+/* creates a pipe which won't leak in children */
+static gboolean
+make_pipe (gint     fds[2],
+           GError **error)
+{
+  if (pipe2 (fds, O_CLOEXEC) < 0) {
+    gint errsv = errno;
+    
+    g_set_error (error, G_SPAWN_ERROR, G_SPAWN_ERROR_FAILED,
+                 "Failed to create pipe for communicating with Git: %s",
+                 g_strerror (errsv));
+    return FALSE;
+  }
+  
+  return TRUE;
+}
+
+static void
+close_fd (gint fd)
+{
+  if (fd >= 0) {
+    close (fd);
+  }
+}
+
+/* spawns Git using posix_spawn().  unlike fork(), it doesn't need to
+ * duplicate our address space (the C library uses vfork() or an equivalent),
+ * and the file descriptors are closed with a single closefrom() rather than
+ * one by one up to the limit.  both get slow in a big Geany process. */
+static gboolean
+spawn_git (const gchar  *dir,
+           gchar       **argv,
+           GPid         *child_pid,
+           gint         *in_fd,
+           gint         *out_fd,
+           gint         *err_fd,
+           GError      **error)
+{
+  posix_spawn_file_actions_t  actions;
+  posix_spawnattr_t           attr;
+  sigset_t                    sigs;
+  gint                        in_fds[2]  = { -1, -1 };
+  gint                        out_fds[2] = { -1, -1 };
+  gint                        err_fds[2] = { -1, -1 };
+  pid_t                       pid;
+  gint                        err;
+  
+  if ((in_fd && ! make_pipe (in_fds, error)) ||
+      ! make_pipe (out_fds, error) ||
+      (err_fd && ! make_pipe (err_fds, error))) {
+    close_fd (in_fds[0]);
+    close_fd (in_fds[1]);
+    close_fd (out_fds[0]);
+    close_fd (out_fds[1]);
+    return FALSE;
+  }
+  
+  posix_spawn_file_actions_init (&actions);
+  if (in_fd) {
+    posix_spawn_file_actions_adddup2 (&actions, in_fds[0], 0);
+  } else {
+    posix_spawn_file_actions_addopen (&actions, 0, "/dev/null", O_RDONLY, 0);
+  }
+  posix_spawn_file_actions_adddup2 (&actions, out_fds[1], 1);
+  if (err_fd) {
+    posix_spawn_file_actions_adddup2 (&actions, err_fds[1], 2);
+  } else {
+    posix_spawn_file_actions_addopen (&actions, 2, "/dev/null", O_WRONLY, 0);
+  }
+  posix_spawn_file_actions_addclosefrom_np (&actions, 3);
+  if (dir) {
+    posix_spawn_file_actions_addchdir_np (&actions, dir);
+  }
+  
+  posix_spawnattr_init (&attr);
+  /* put Git in its own process group, so it can be killed with whatever it
+   * may spawn */
+  posix_spawnattr_setpgroup (&attr, 0);
+  sigemptyset (&sigs);
+  posix_spawnattr_setsigmask (&attr, &sigs);
+  sigaddset (&sigs, SIGPIPE);
+  posix_spawnattr_setsigdefault (&attr, &sigs);
+  posix_spawnattr_setflags (&attr, POSIX_SPAWN_SETPGROUP |
+                                   POSIX_SPAWN_SETSIGMASK |
+                                   POSIX_SPAWN_SETSIGDEF);
+  
+  err = posix_spawnp (&pid, argv[0], &actions, &attr, argv, environ);
+  
+  posix_spawnattr_destroy (&attr);
+  posix_spawn_file_actions_destroy (&actions);
+  /* close the child's ends */
+  close_fd (in_fds[0]);
+  close_fd (out_fds[1]);
+  close_fd (err_fds[1]);
+  
+  if (err != 0) {
+    close_fd (in_fds[1]);
+    close_fd (out_fds[0]);
+    close_fd (err_fds[0]);
+    g_set_error (error, G_SPAWN_ERROR, G_SPAWN_ERROR_FAILED,
+                 "Failed to execute Git (%s): %s", argv[0], g_strerror (err));
+    return FALSE;
+  }
+  
+  *child_pid = pid;
+  if (in_fd) {
+    *in_fd = in_fds[1];
+  }
+  *out_fd = out_fds[0];
+  if (err_fd) {
+    *err_fd = err_fds[0];
+  }
+  
+  return TRUE;
+}
+
+#else /* ! USE_POSIX_SPAWN */
+
+/* GSpawnChildSetupFunc putting Git in its own process group, so it can be
+ * killed with whatever it may spawn.  it also undoes the SIGPIPE blocking of
+ * our worker threads, which the child would inherit, like the posix_spawn()
+ * path does */
+static void
+child_setup (gpointer data)
+{
+  sigset_t sigs;
+  
+  setpgid (0, 0);
+  sigemptyset (&sigs);
+  sigprocmask (SIG_SETMASK, &sigs, NULL);
+  signal (SIGPIPE, SIG_DFL);
+}
+
+static gboolean
+spawn_git (const gchar  *dir,
+           gchar       **argv,
+           GPid         *child_pid,
+           gint         *in_fd,
+           gint         *out_fd,
+           gint         *err_fd,
+           GError      **error)
+{
+  GSpawnFlags flags = G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD;
+  
+  if (! err_fd) {
+    flags |= G_SPAWN_STDERR_TO_DEV_NULL;
+  }
+  if (! g_spawn_async_with_pipes (dir, argv, NULL, flags,
+                                  child_setup, NULL, child_pid,
+                                  in_fd, out_fd, err_fd, error)) {
+    return FALSE;
+  }
+  /* also set the process group from here so we don't race with the child */
+  setpgid (*child_pid, *child_pid);
+  
+  return TRUE;
+}
+
+#endif /* ! USE_POSIX_SPAWN */
+
+/**
+ * _ggu_git_spawn:
+ * @dir: The directory in which run Git, or %NULL for the current one
+ * @argv: The arguments, the first being the path to Git
+ * @pid: Return location for the process ID
+ * @in_fd: Return location for a pipe to Git's standard input, or %NULL to
+ *         give it /dev/null
+ * @out_fd: Return location for a pipe from Git's standard output
+ * @err_fd: Return location for a pipe from Git's error output, or %NULL to
+ *          discard it
+ * @error: Return location for errors, or %NULL to ignore them
+ * 
+ * Spawns Git in its own process group.  The process is not reaped
+ * automatically, the caller has to waitpid() for it and then call
+ * g_spawn_close_pid().
+ * 
+ * Returns: Whether Git could be spawned
+ */
+gboolean
+_ggu_git_spawn (const gchar  *dir,
+                gchar       **argv,
+                GPid         *pid,
+                gint         *in_fd,
+                gint         *out_fd,
+                gint         *err_fd,
+                GError      **error)
+{
+  g_return_val_if_fail (argv != NULL && argv[0] != NULL, FALSE);
+  g_return_val_if_fail (pid != NULL && out_fd != NULL, FALSE);
+  
+  return spawn_git (dir, argv, pid, in_fd, out_fd, err_fd, error);
+}
+
+static void
+child_cancelled_handler (GCancellable *cancellable,
+                         GitChild     *child)
+{
+  g_atomic_int_set (&child->terminated, TRUE);
+  kill (-child->pid, SIGTERM);
+}
+
+/* terminates @child, first gently then with SIGKILL if it didn't terminate
+ * after TERMINATE_GRACE_TIME, and reaps it */
+static void
+child_terminate (GitChild *child,
+                 gint     *status)
+{
+  guint elapsed;
+  
+  kill (-child->pid, SIGTERM);
+  for (elapsed = 0; elapsed < TERMINATE_GRACE_TIME; elapsed += 10) {
+    pid_t pid = waitpid (child->pid, status, WNOHANG);
+    
+    if (pid == child->pid || (pid < 0 && errno != EINTR)) {
+      return;
+    }
+    g_usleep (10 * 1000);
+  }
+  kill (-child->pid, SIGKILL);
+  while (waitpid (child->pid, status, 0) < 0 && errno == EINTR);
+}
+
+/* reads both Git's standard and error outputs until they are closed, feeding
+ * the parser with the standard output as it arrives.  Returns %FALSE on
+ * error, in which case either @error or @result's error is set (the latter
+ * being done by the parser) */
+static gboolean
+read_output (GguGit              *self,
+             GguGitParser        *parser,
+             GitChild            *child,
+             GString             *output,
+             GString             *errors,
+             GSimpleAsyncResult  *result,
+             GCancellable        *cancellable,
+             GError             **error)
+{
+  gboolean out_eof = FALSE;
+  gboolean err_eof = FALSE;
+  
+  while (! out_eof || ! err_eof) {
+    struct pollfd fds[3];
+    nfds_t        n_fds = 0;
+    nfds_t        i;
+    
+    if (! out_eof) {
+      fds[n_fds].fd = child->out_fd;
+      fds[n_fds].events = POLLIN;
+      n_fds++;
+    }
+    if (! err_eof) {
+      fds[n_fds].fd = child->err_fd;
+      fds[n_fds].events = POLLIN;
+      n_fds++;
+    }
+    if (child->cancel_fd >= 0) {
+      fds[n_fds].fd = child->cancel_fd;
+      fds[n_fds].events = POLLIN;
+      n_fds++;
+    }
+    if (poll (fds, n_fds, -1) < 0) {
+      gint errsv = errno;
+      
+      if (errsv == EINTR) {
+        continue;
+      }
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+                   "Failed to wait for Git output: %s", g_strerror (errsv));
+      return FALSE;
+    }
+    
+    for (i = 0; i < n_fds; i++) {
+      if (! fds[i].revents) {
+        continue;
+      }
+      
+      if (fds[i].fd == child->out_fd) {
+        if (! read_chunk (child->out_fd, output, &out_eof, error)) {
+          return FALSE;
+        }
+        if (! out_eof) {
+          gsize consumed = 0;
+          
+          if (! parser->parse (parser, self, output->str, output->len, FALSE,
+                               &consumed, result, cancellable)) {
+            return FALSE;
+          }
+          g_string_erase (output, 0, (gssize) consumed);
+        }
+      } else if (fds[i].fd == child->err_fd) {
+        if (! read_chunk (child->err_fd, errors, &err_eof, error)) {
+          return FALSE;
+        }
+      }
+    }
+    
+    if (g_atomic_int_get (&child->terminated) ||
+        g_cancellable_is_cancelled (cancellable)) {
+      g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_CANCELLED,
+                           "Operation was cancelled");
+      return FALSE;
+    }
+  }
+  
+  return TRUE;
+}
+
 static void
 run_thread (GSimpleAsyncResult *result,
             GObject            *object,
             GCancellable       *cancellable)
 {
   GguGit       *self  = GGU_GIT (object);
-  GguGitClass  *klass = GGU_GIT_GET_CLASS (self);
   GError       *error = NULL;
-  gchar        *output_str;
-  gchar        *errors_str;
-  gint          status;
+  GitChild      child;
+  gulong        cancelled_id = 0;
+  GString      *output;
+  GString      *errors;
+  gboolean      success;
+  gint          status = 0;
   GitOp        *op;
   
   if (g_cancellable_set_error_if_cancelled (cancellable, &error)) {
@@ -197,15 +642,54 @@ run_thread (GSimpleAsyncResult *result,
     return;
   }
   
-  op = g_simple_async_result_get_op_res_gpointer (result);
+  op = g_object_get_data (G_OBJECT (result), GIT_OP_KEY);
   /* FIXME: would be better not to need the argv to contain the command? */
   g_free (op->argv[0]);
   op->argv[0] = op->git_path;
   op->git_path = NULL;
   
-  if (! g_spawn_sync (op->dir, op->argv, NULL, G_SPAWN_SEARCH_PATH,
-                      NULL, NULL, &output_str, &errors_str, &status, &error)) {
+  if (! spawn_git (op->dir, op->argv, &child.pid, NULL,
+                   &child.out_fd, &child.err_fd, &error)) {
     g_simple_async_result_take_error (result, error);
+    return;
+  }
+  child.terminated = FALSE;
+  child.cancel_fd = -1;
+  if (cancellable) {
+    child.cancel_fd = g_cancellable_get_fd (cancellable);
+    cancelled_id = g_cancellable_connect (cancellable,
+                                          G_CALLBACK (child_cancelled_handler),
+                                          &child, NULL);
+  }
+  
+  output = g_string_sized_new (READ_SIZE);
+  errors = g_string_new (NULL);
+  
+  success = read_output (self, op->parser, &child, output, errors,
+                         result, cancellable, &error);
+  
+  if (cancellable) {
+    /* this waits for a possibly running handler to return, so after it we
+     * know nobody will try to kill the process we are about to reap */
+    g_cancellable_disconnect (cancellable, cancelled_id);
+    if (child.cancel_fd >= 0) {
+      g_cancellable_release_fd (cancellable);
+    }
+  }
+  close (child.out_fd);
+  close (child.err_fd);
+  if (! success) {
+    /* we won't read anything more, don't let Git run for nothing */
+    child_terminate (&child, &status);
+  } else {
+    while (waitpid (child.pid, &status, 0) < 0 && errno == EINTR);
+  }
+  g_spawn_close_pid (child.pid);
+  
+  if (! success) {
+    if (error) {
+      g_simple_async_result_take_error (result, error);
+    }
   } else if (! WIFEXITED (status)) {
     g_simple_async_result_set_error (result,
                                      GGU_GIT_ERROR, GGU_GIT_ERROR_CRASHED,
@@ -214,17 +698,272 @@ run_thread (GSimpleAsyncResult *result,
     g_simple_async_result_set_error (result,
                                      GGU_GIT_ERROR, GGU_GIT_ERROR_FAILED,
                                      "Git terminated with error code %d: %s",
-                                     WEXITSTATUS (status), errors_str);
+                                     WEXITSTATUS (status), errors->str);
   } else {
     if (g_cancellable_set_error_if_cancelled (cancellable, &error)) {
       g_simple_async_result_take_error (result, error);
     } else {
-      op->parse_output (self, output_str, result, cancellable);
+      gsize consumed = 0;
+      
+      op->parser->parse (op->parser, self, output->str, output->len, TRUE,
+                         &consumed, result, cancellable);
+    }
+  }
+  
+  g_string_free (output, TRUE);
+  g_string_free (errors, TRUE);
+}
+
+/* In-flight operations
+ * 
+ * Identical operations (same directory, Git, arguments and parser) started
+ * while one is already running share it instead of spawning Git again.  Each
+ * caller gets its own result, holding a reference to the shared one, and can
+ * cancel its own request without affecting the others: the shared operation
+ * is only cancelled when nobody waits for it anymore. */
+
+typedef struct _InFlight  InFlight;
+typedef struct _Waiter    Waiter;
+
+struct _InFlight
+{
+  gchar              *key;
+  GSimpleAsyncResult *result;
+  GCancellable       *cancellable;
+  gint                priority; /* highest priority of the waiters */
+  GList              *waiters;
+};
+
+struct _Waiter
+{
+  gint                ref_count;
+  GSimpleAsyncResult *result;
+  GCancellable       *cancellable;
+  gulong              cancelled_id;
+  volatile gint       cancelled;
+  InFlight           *in_flight; /* NULL when completed */
+};
+
+/* key -> InFlight, only accessed from the main thread */
+static GHashTable *G_in_flight = NULL;
+
+
+static gchar *
+in_flight_key (const gchar   *git_path,
+               const gchar   *dir,
+               gchar        **argv,
+               gconstpointer  parser_id)
+{
+  GString *key = g_string_new (NULL);
+  guint    i;
+  
+  /* prefix each part with its length so the key is not ambiguous */
+  g_string_append_printf (key, "%p", parser_id);
+  g_string_append_printf (key, ":%lu:%s", (gulong) strlen (git_path), git_path);
+  if (dir) {
+    g_string_append_printf (key, ":%lu:%s", (gulong) strlen (dir), dir);
+  } else {
+    g_string_append (key, ":-");
+  }
+  /* argv[0] is replaced by the Git path anyway */
+  for (i = 1; argv[i]; i++) {
+    g_string_append_printf (key, ":%lu:%s", (gulong) strlen (argv[i]), argv[i]);
+  }
+  
+  return g_string_free (key, FALSE);
+}
+
+static Waiter *
+waiter_ref (Waiter *waiter)
+{
+  g_atomic_int_inc (&waiter->ref_count);
+  return waiter;
+}
+
+static void
+waiter_unref (Waiter *waiter)
+{
+  if (g_atomic_int_dec_and_test (&waiter->ref_count)) {
+    g_object_unref (waiter->result);
+    if (waiter->cancellable) {
+      g_object_unref (waiter->cancellable);
+    }
+    g_slice_free1 (sizeof *waiter, waiter);
+  }
+}
+
+/* detaches @waiter from its operation.  if it was the last one waiting, the
+ * operation is cancelled and forgotten so that a new request starts afresh */
+static void
+waiter_detach (Waiter *waiter)
+{
+  InFlight *in_flight = waiter->in_flight;
+  
+  in_flight->waiters = g_list_remove (in_flight->waiters, waiter);
+  waiter->in_flight = NULL;
+  if (waiter->cancellable) {
+    g_cancellable_disconnect (waiter->cancellable, waiter->cancelled_id);
+  }
+  
+  if (! in_flight->waiters) {
+    if (g_hash_table_lookup (G_in_flight, in_flight->key) == in_flight) {
+      g_hash_table_remove (G_in_flight, in_flight->key);
+    }
+    g_cancellable_cancel (in_flight->cancellable);
+  }
+  waiter_unref (waiter);
+}
+
+static gboolean
+waiter_cancelled_idle (gpointer data)
+{
+  Waiter *waiter = data;
+  
+  /* the operation might have completed in the meantime */
+  if (waiter->in_flight) {
+    g_simple_async_result_set_error (waiter->result,
+                                     G_IO_ERROR, G_IO_ERROR_CANCELLED,
+                                     "Operation was cancelled");
+    g_simple_async_result_complete (waiter->result);
+    waiter_detach (waiter);
+  }
+  
+  return FALSE;
+}
+
+/* may be called from any thread, defer the work to the main one.  the flag
+ * is needed because the cancellable may be reset before the idle runs */
+static void
+waiter_cancelled_handler (GCancellable *cancellable,
+                          Waiter       *waiter)
+{
+  g_atomic_int_set (&waiter->cancelled, TRUE);
+  g_idle_add_full (G_PRIORITY_DEFAULT, waiter_cancelled_idle,
+                   waiter_ref (waiter), (GDestroyNotify) waiter_unref);
+}
+
+static void
+in_flight_free (InFlight *in_flight)
+{
+  g_free (in_flight->key);
+  g_object_unref (in_flight->cancellable);
+  g_slice_free1 (sizeof *in_flight, in_flight);
+}
+
+/* completes all the waiters of a finished operation */
+static void
+in_flight_ready (GObject      *object,
+                 GAsyncResult *result,
+                 gpointer      data)
+{
+  InFlight *in_flight = data;
+  GError   *error = NULL;
+  
+  if (g_hash_table_lookup (G_in_flight, in_flight->key) == in_flight) {
+    g_hash_table_remove (G_in_flight, in_flight->key);
+  }
+  
+  g_simple_async_result_propagate_error (in_flight->result, &error);
+  while (in_flight->waiters) {
+    Waiter *waiter = in_flight->waiters->data;
+    
+    if (g_atomic_int_get (&waiter->cancelled)) {
+      g_simple_async_result_set_error (waiter->result,
+                                       G_IO_ERROR, G_IO_ERROR_CANCELLED,
+                                       "Operation was cancelled");
+    } else if (error) {
+      g_simple_async_result_set_from_error (waiter->result, error);
+    } else {
+      g_simple_async_result_set_op_res_gpointer (waiter->result,
+                                                 g_object_ref (result),
+                                                 g_object_unref);
+    }
+    g_simple_async_result_complete (waiter->result);
+    /* the last waiter would cancel the operation, not a problem since it's
+     * already done */
+    waiter_detach (waiter);
+  }
+  if (error) {
+    g_error_free (error);
+  }
+  
+  g_object_unref (in_flight->result);
+  in_flight_free (in_flight);
+}
+
+static void
+run_async (GguGit              *self,
+           gchar              **argv,
+           GguGitParser        *parser,
+           gconstpointer        parser_id,
+           gint                 priority,
+           GCancellable        *cancellable,
+           GAsyncReadyCallback  callback,
+           gpointer             user_data)
+{
+  InFlight *in_flight;
+  Waiter   *waiter;
+  gchar    *key;
+  
+  if (G_UNLIKELY (! G_in_flight)) {
+    G_in_flight = g_hash_table_new (g_str_hash, g_str_equal);
+  }
+  
+  key = in_flight_key (self->priv->git_path, self->priv->dir, argv, parser_id);
+  in_flight = g_hash_table_lookup (G_in_flight, key);
+  if (in_flight) {
+    /* we'll use the parser of the running operation */
+    parser->free (parser);
+    g_free (key);
+    /* don't let an interactive caller wait behind background work it
+     * happened to join */
+    if (priority < in_flight->priority) {
+      in_flight->priority = priority;
+      _ggu_git_scheduler_raise_priority (in_flight->result, priority);
     }
+  } else {
+    GitOp *op;
+    
+    op = g_malloc (sizeof *op);
+    op->git_path      = g_strdup (self->priv->git_path);
+    op->dir           = g_strdup (self->priv->dir);
+    op->argv          = g_strdupv (argv);
+    op->parser        = parser;
+    
+    in_flight = g_slice_alloc (sizeof *in_flight);
+    in_flight->key          = key;
+    in_flight->cancellable  = g_cancellable_new ();
+    in_flight->priority     = priority;
+    in_flight->waiters      = NULL;
+    in_flight->result       = g_simple_async_result_new (G_OBJECT (self),
+                                                         in_flight_ready,
+                                                         in_flight,
+                                                         (gpointer) run_async);
+    /* the operation data is attached to the result rather than set as its
+     * operation result since the parser will set the latter */
+    g_object_set_data_full (G_OBJECT (in_flight->result), GIT_OP_KEY, op,
+                            (GDestroyNotify) git_op_free);
+    g_hash_table_insert (G_in_flight, in_flight->key, in_flight);
+    _ggu_git_scheduler_run_in_thread (in_flight->result, run_thread, op->dir,
+                                      priority, in_flight->cancellable);
   }
   
-  g_free (output_str);
-  g_free (errors_str);
+  waiter = g_slice_alloc (sizeof *waiter);
+  waiter->ref_count     = 1;
+  waiter->result        = g_simple_async_result_new (G_OBJECT (self),
+                                                     callback, user_data,
+                                                     (gpointer) _ggu_git_run_async);
+  waiter->cancellable   = cancellable ? g_object_ref (cancellable) : NULL;
+  waiter->cancelled_id  = 0;
+  waiter->cancelled     = FALSE;
+  waiter->in_flight     = in_flight;
+  in_flight->waiters = g_list_append (in_flight->waiters, waiter);
+  if (cancellable) {
+    /* if already cancelled, this calls the handler right away */
+    waiter->cancelled_id = g_cancellable_connect (cancellable,
+                                                  G_CALLBACK (waiter_cancelled_handler),
+                                                  waiter, NULL);
+  }
 }
 
 /**
@@ -233,7 +972,7 @@ run_thread (GSimpleAsyncResult *result,
  * @argv: A NULL-terminated array of the arguments of the command to spawn
  *       (including the program name)
  * @parse_output: Function to call after the subprocess terminated
- * @priority: The thread priority
+ * @priority: The operation priority, see _ggu_git_scheduler_run_in_thread()
  * @cancellable: The user's #GCancellable, or %NULL
  * @callback: The user's #GAsyncReadyCallback
  * @user_data: The user's #GAsyncReadyCallback user data
@@ -244,6 +983,10 @@ run_thread (GSimpleAsyncResult *result,
  * 
  * @parse_output must set the #GSimpleAsyncResult's operation result using
  * g_simple_async_result_set_op_res_gpointer().
+ * 
+ * If an identical operation is already running, this doesn't spawn Git again
+ * but waits for that operation's result, which is then shared.  Cancelling
+ * @cancellable only cancels this request.
  */
 void
 _ggu_git_run_async (GguGit               *self,
@@ -253,26 +996,110 @@ _ggu_git_run_async (GguGit               *self,
                     GCancellable         *cancellable,
                     GAsyncReadyCallback   callback,
                     gpointer              user_data)
+{
+  run_async (self, argv, output_parser_new (parse_output), parse_output,
+             priority, cancellable, callback, user_data);
+}
+
+/**
+ * _ggu_git_run_streaming_async:
+ * @self: A #GguGit object
+ * @argv: A NULL-terminated array of the arguments of the command to spawn
+ *       (including the program name)
+ * @parser: (transfer full): The parser to feed with the output
+ * @priority: The operation priority, see _ggu_git_scheduler_run_in_thread()
+ * @cancellable: The user's #GCancellable, or %NULL
+ * @callback: The user's #GAsyncReadyCallback
+ * @user_data: The user's #GAsyncReadyCallback user data
+ * 
+ * Like _ggu_git_run_async(), but feeds @parser with the output while the
+ * subprocess runs rather than waiting for it to terminate.  This way the
+ * memory used to hold the output only depends on what @parser leaves
+ * unconsumed.
+ */
+void
+_ggu_git_run_streaming_async (GguGit               *self,
+                              gchar               **argv,
+                              GguGitParser         *parser,
+                              gint                  priority,
+                              GCancellable         *cancellable,
+                              GAsyncReadyCallback   callback,
+                              gpointer              user_data)
+{
+  run_async (self, argv, parser, parser->parse, priority, cancellable,
+             callback, user_data);
+}
+
+typedef struct _CachedOp CachedOp;
+struct _CachedOp
 {
   GSimpleAsyncResult *result;
-  GitOp              *op;
-  
-  op = g_malloc (sizeof *op);
-  op->git_path      = g_strdup (self->priv->git_path);
-  op->dir           = g_strdup (self->priv->dir);
-  op->argv          = g_strdupv (argv);
-  op->parse_output  = parse_output;
-  
-  result = g_simple_async_result_new (G_OBJECT (self), callback, user_data,
-                                      (gpointer) _ggu_git_run_async);
-  /* we use result to transfer the operation data to the thread, but it will
-   * be overwritten later by the operation. not a problem, we won't need it
-   * anymore */
-  g_simple_async_result_set_op_res_gpointer (result, op,
-                                             (GDestroyNotify) git_op_free);
-  g_simple_async_result_run_in_thread (result, run_thread, priority,
-                                       cancellable);
-  g_object_unref (result);
+  GCancellable       *cancellable;
+};
+
+static void
+cached_op_free (CachedOp *op)
+{
+  g_object_unref (op->result);
+  if (op->cancellable) {
+    g_object_unref (op->cancellable);
+  }
+  g_slice_free1 (sizeof *op, op);
+}
+
+static gboolean
+cached_op_complete_idle (gpointer data)
+{
+  CachedOp *op = data;
+  GError   *error = NULL;
+  
+  if (g_cancellable_set_error_if_cancelled (op->cancellable, &error)) {
+    g_simple_async_result_take_error (op->result, error);
+  }
+  g_simple_async_result_complete (op->result);
+  
+  return FALSE;
+}
+
+/**
+ * _ggu_git_complete_cached:
+ * @self: A #GguGit object
+ * @res: (transfer full): The operation result
+ * @destroy: Function to free @res
+ * @cancellable: The user's #GCancellable, or %NULL
+ * @callback: The user's #GAsyncReadyCallback
+ * @user_data: The user's #GAsyncReadyCallback user data
+ * 
+ * Completes an operation with an already known result, without spawning
+ * anything.  The result is retrieved with _ggu_git_run_finish() just like
+ * the result of _ggu_git_run_async(), so callers don't need to care where it
+ * came from.
+ */
+void
+_ggu_git_complete_cached (GguGit              *self,
+                          gpointer             res,
+                          GDestroyNotify       destroy,
+                          GCancellable        *cancellable,
+                          GAsyncReadyCallback  callback,
+                          gpointer             user_data)
+{
+  GSimpleAsyncResult *shared;
+  CachedOp           *op;
+  
+  /* mimic the shared operation result run_async() gives its waiters */
+  shared = g_simple_async_result_new (G_OBJECT (self), NULL, NULL,
+                                      (gpointer) run_async);
+  g_simple_async_result_set_op_res_gpointer (shared, res, destroy);
+  
+  op = g_slice_alloc (sizeof *op);
+  op->result      = g_simple_async_result_new (G_OBJECT (self),
+                                               callback, user_data,
+                                               (gpointer) _ggu_git_run_async);
+  op->cancellable = cancellable ? g_object_ref (cancellable) : NULL;
+  g_simple_async_result_set_op_res_gpointer (op->result, shared,
+                                             g_object_unref);
+  g_idle_add_full (G_PRIORITY_DEFAULT, cached_op_complete_idle, op,
+                   (GDestroyNotify) cached_op_free);
 }
 
 /**
@@ -305,6 +1132,9 @@ _ggu_git_run_finish (GguGit        *self,
     return NULL;
   }
   
+  /* the actual result is the one of the possibly shared operation */
+  simple = g_simple_async_result_get_op_res_gpointer (simple);
+  
   return g_simple_async_result_get_op_res_gpointer (simple);
 }
 
@@ -349,3 +1179,40 @@ ggu_git_set_git_path (GguGit      *self,
     g_object_notify (G_OBJECT (self), "git-path");
   }
 }
+
+/**
+ * ggu_git_get_priority:
+ * @self: A #GguGit object
+ * 
+ * Gets the priority with which @self's operations are scheduled.
+ * 
+ * Returns: The priority of @self's operations
+ */
+gint
+ggu_git_get_priority (GguGit *self)
+{
+  g_return_val_if_fail (GGU_IS_GIT (self), G_PRIORITY_DEFAULT);
+  
+  return self->priv->priority;
+}
+
+/**
+ * ggu_git_set_priority:
+ * @self: A #GguGit object
+ * @priority: The new priority
+ * 
+ * Sets the priority with which @self's operations are scheduled.  Operations
+ * with a priority lower than %G_PRIORITY_DEFAULT are considered background
+ * work and never delay interactive ones.
+ */
+void
+ggu_git_set_priority (GguGit *self,
+                      gint    priority)
+{
+  g_return_if_fail (GGU_IS_GIT (self));
+  
+  if (self->priv->priority != priority) {
+    self->priv->priority = priority;
+    g_object_notify (G_OBJECT (self), "priority");
+  }
+}
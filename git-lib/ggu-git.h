@@ -51,11 +51,41 @@ typedef struct _GguGit        GguGit;
 typedef struct _GguGitClass   GguGitClass;
 typedef struct _GguGitPrivate GguGitPrivate;
 
+typedef struct _GguGitParser  GguGitParser;
+
 typedef void    (*GguGitParseOutputFunc)    (GguGit              *self,
                                              const gchar         *output,
                                              GSimpleAsyncResult  *result,
                                              GCancellable        *cancellable);
 
+/**
+ * GguGitParser:
+ * @parse: Called each time new output is available.  @data is the output
+ *         that was not consumed yet, followed by a terminating 0 that is not
+ *         part of @length.  The function should set @consumed to the number
+ *         of bytes it is done with; the remaining ones will be passed again
+ *         together with the next chunk.  It may modify the bytes it consumes.
+ *         When @eof is %TRUE, the whole output is available and the function
+ *         should set the operation result as #GguGitParseOutputFunc would.
+ *         On error, it should set the error on @result and return %FALSE.
+ * @free: Frees the parser
+ * 
+ * A resumable output parser, fed with the output of Git while it runs.
+ * Implementations generally embed this structure as their first member.
+ */
+struct _GguGitParser
+{
+  gboolean  (*parse)  (GguGitParser       *parser,
+                       GguGit             *git,
+                       gchar              *data,
+                       gsize               length,
+                       gboolean            eof,
+                       gsize              *consumed,
+                       GSimpleAsyncResult *result,
+                       GCancellable       *cancellable);
+  void      (*free)   (GguGitParser       *parser);
+};
+
 struct _GguGit
 {
   GObject parent_instance;
@@ -76,6 +106,26 @@ void              _ggu_git_run_async            (GguGit                *self,
                                                  GCancellable          *cancellable,
                                                  GAsyncReadyCallback    callback,
                                                  gpointer               user_data);
+void              _ggu_git_run_streaming_async  (GguGit                *self,
+                                                 gchar                **argv,
+                                                 GguGitParser          *parser,
+                                                 gint                   priority,
+                                                 GCancellable          *cancellable,
+                                                 GAsyncReadyCallback    callback,
+                                                 gpointer               user_data);
+void              _ggu_git_complete_cached      (GguGit                *self,
+                                                 gpointer               res,
+                                                 GDestroyNotify         destroy,
+                                                 GCancellable          *cancellable,
+                                                 GAsyncReadyCallback    callback,
+                                                 gpointer               user_data);
+gboolean          _ggu_git_spawn                (const gchar  *dir,
+                                                 gchar       **argv,
+                                                 GPid         *pid,
+                                                 gint         *in_fd,
+                                                 gint         *out_fd,
+                                                 gint         *err_fd,
+                                                 GError      **error);
 gpointer          _ggu_git_run_finish           (GguGit        *self,
                                                  GAsyncResult  *result,
                                                  GError       **error);
@@ -85,6 +135,9 @@ void              ggu_git_set_dir               (GguGit      *self,
 const gchar *     ggu_git_get_git_path          (GguGit *self);
 void              ggu_git_set_git_path          (GguGit      *self,
                                                  const gchar *path);
+gint              ggu_git_get_priority          (GguGit *self);
+void              ggu_git_set_priority          (GguGit *self,
+                                                 gint    priority);
 
 
 G_END_DECLS
@@ -19,40 +19,683 @@
  * 
  */
 
-/* TODO: would be better to implement this with a simpler data structure than
- *       GtkTreeModel (e.g. GPtrArray or whatever) since our data is known.
- *       But this would need to implement the whole GtkTreeModel iface... */
+/* The store keeps the entries sorted by path, which makes it a prefix index:
+ * the entries matching the filter are a single range found by bisection.
+ * 
+ * In tree mode, the entries of that range are grouped in directory nodes in
+ * a single pass, and the rows are directly the nodes' children.  Views only
+ * ask for the children of the rows they expand, so showing a commit costs as
+ * much as its top-level directories whatever its number of files. */
 
 #include "ggu-files-changed-store.h"
 
 #include "config.h"
 
+#include <string.h>
 #include <glib.h>
 #include <gtk/gtk.h>
 
 #include "ggu-git-files-changed-entry.h"
 
 
-G_DEFINE_TYPE (GguFilesChangedStore,
-               ggu_files_changed_store,
-               GTK_TYPE_LIST_STORE)
+typedef struct _DirNode DirNode;
+struct _DirNode
+{
+  DirNode      *parent;
+  guint         index;  /* in the parent's dirs */
+  gchar        *path;   /* with a trailing slash */
+  const gchar  *name;   /* last component of @path */
+  GPtrArray    *dirs;   /* of DirNode, or NULL */
+  GPtrArray    *files;  /* of GguGitFilesChangedEntry, or NULL */
+  guint         added;
+  guint         removed;
+  gchar         added_text[12];
+  gchar         removed_text[12];
+};
+
+enum
+{
+  PROP_0,
+  
+  PROP_TREE_MODE,
+  PROP_FILTER
+};
+
+struct _GguFilesChangedStorePrivate
+{
+  GPtrArray  *entries;  /* sorted by path */
+  gboolean    tree_mode;
+  gchar      *filter;
+  DirNode    *root;
+  guint       n_roots;  /* top-level rows the views know about */
+  gint        stamp;
+};
+
+
+static void               ggu_files_changed_store_finalize        (GObject *object);
+static void               ggu_files_changed_store_get_property    (GObject    *object,
+                                                                   guint       prop_id,
+                                                                   GValue     *value,
+                                                                   GParamSpec *pspec);
+static void               ggu_files_changed_store_set_property    (GObject      *object,
+                                                                   guint         prop_id,
+                                                                   const GValue *value,
+                                                                   GParamSpec   *pspec);
+static void               ggu_files_changed_store_tree_model_init (GtkTreeModelIface *iface);
+static GtkTreeModelFlags  ggu_files_changed_store_get_flags       (GtkTreeModel *model);
+static gint               ggu_files_changed_store_get_n_columns   (GtkTreeModel *model);
+static GType              ggu_files_changed_store_get_column_type (GtkTreeModel *model,
+                                                                   gint          index_);
+static gboolean           ggu_files_changed_store_get_iter        (GtkTreeModel *model,
+                                                                   GtkTreeIter  *iter,
+                                                                   GtkTreePath  *path);
+static GtkTreePath       *ggu_files_changed_store_get_tree_path   (GtkTreeModel *model,
+                                                                   GtkTreeIter  *iter);
+static void               ggu_files_changed_store_get_value       (GtkTreeModel *model,
+                                                                   GtkTreeIter  *iter,
+                                                                   gint          column,
+                                                                   GValue       *value);
+static gboolean           ggu_files_changed_store_iter_next       (GtkTreeModel *model,
+                                                                   GtkTreeIter  *iter);
+static gboolean           ggu_files_changed_store_iter_children   (GtkTreeModel *model,
+                                                                   GtkTreeIter  *iter,
+                                                                   GtkTreeIter  *parent);
+static gboolean           ggu_files_changed_store_iter_has_child  (GtkTreeModel *model,
+                                                                   GtkTreeIter  *iter);
+static gint               ggu_files_changed_store_iter_n_children (GtkTreeModel *model,
+                                                                   GtkTreeIter  *iter);
+static gboolean           ggu_files_changed_store_iter_nth_child  (GtkTreeModel *model,
+                                                                   GtkTreeIter  *iter,
+                                                                   GtkTreeIter  *parent,
+                                                                   gint          n);
+static gboolean           ggu_files_changed_store_iter_parent     (GtkTreeModel *model,
+                                                                   GtkTreeIter  *iter,
+                                                                   GtkTreeIter  *child);
+
+
+G_DEFINE_TYPE_WITH_CODE (GguFilesChangedStore,
+                         ggu_files_changed_store,
+                         G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (GTK_TYPE_TREE_MODEL,
+                                                ggu_files_changed_store_tree_model_init))
+
+
+static DirNode *
+dir_node_new (DirNode     *parent,
+              const gchar *path,
+              gsize        length)
+{
+  DirNode *node;
+  
+  node = g_slice_alloc (sizeof *node);
+  node->parent  = parent;
+  node->index   = 0;
+  node->path    = g_strndup (path, length);
+  node->name    = node->path + (parent ? strlen (parent->path) : 0);
+  node->dirs    = NULL;
+  node->files   = NULL;
+  node->added   = 0;
+  node->removed = 0;
+  node->added_text[0] = 0;
+  node->removed_text[0] = 0;
+  
+  if (parent) {
+    if (! parent->dirs) {
+      parent->dirs = g_ptr_array_new ();
+    }
+    node->index = parent->dirs->len;
+    g_ptr_array_add (parent->dirs, node);
+  }
+  
+  return node;
+}
+
+static void
+dir_node_free (DirNode *node)
+{
+  if (node->dirs) {
+    g_ptr_array_foreach (node->dirs, (GFunc) dir_node_free, NULL);
+    g_ptr_array_free (node->dirs, TRUE);
+  }
+  if (node->files) {
+    g_ptr_array_free (node->files, TRUE);
+  }
+  g_free (node->path);
+  g_slice_free1 (sizeof *node, node);
+}
+
+static inline guint
+dir_node_n_dirs (const DirNode *node)
+{
+  return node->dirs ? node->dirs->len : 0;
+}
+
+static inline guint
+dir_node_n_children (const DirNode *node)
+{
+  return dir_node_n_dirs (node) + (node->files ? node->files->len : 0);
+}
+
+static void
+dir_node_add_file (DirNode                 *node,
+                   GguGitFilesChangedEntry *entry)
+{
+  if (! node->files) {
+    node->files = g_ptr_array_new ();
+  }
+  g_ptr_array_add (node->files, entry);
+  node->added += entry->added;
+  node->removed += entry->removed;
+}
+
+/* the totals of @node are complete, add them to its parent's */
+static DirNode *
+dir_node_close (DirNode *node)
+{
+  g_snprintf (node->added_text, sizeof node->added_text, "+%u", node->added);
+  g_snprintf (node->removed_text, sizeof node->removed_text,
+              "-%u", node->removed);
+  if (node->parent) {
+    node->parent->added += node->added;
+    node->parent->removed += node->removed;
+  }
+  
+  return node->parent;
+}
+
+/* groups the sorted @entries in directories in a single pass: the entries of
+ * a directory are contiguous, so once an entry isn't in the current directory
+ * no more will be and its totals are known */
+static DirNode *
+dir_node_build_tree (GguGitFilesChangedEntry **entries,
+                     guint                     n_entries)
+{
+  DirNode  *root = dir_node_new (NULL, "", 0);
+  DirNode  *node = root;
+  guint     i;
+  
+  for (i = 0; i < n_entries; i++) {
+    const gchar  *path = entries[i]->path;
+    const gchar  *slash;
+    
+    while (node != root &&
+           strncmp (path, node->path, strlen (node->path)) != 0) {
+      node = dir_node_close (node);
+    }
+    while ((slash = strchr (path + strlen (node->path), '/'))) {
+      node = dir_node_new (node, path, (gsize) (slash + 1 - path));
+    }
+    dir_node_add_file (node, entries[i]);
+  }
+  while (node) {
+    node = dir_node_close (node);
+  }
+  
+  return root;
+}
+
+
+/* iterators point to the @n-th child of a node, directories first */
+
+#define ITER_NODE(iter)   ((DirNode *) (iter)->user_data)
+#define ITER_INDEX(iter)  (GPOINTER_TO_UINT ((iter)->user_data2))
+
+static inline guint
+store_n_children (GguFilesChangedStore *self,
+                  const DirNode        *node)
+{
+  /* the views may not know all top-level rows yet, or anymore */
+  return node == self->priv->root ? self->priv->n_roots
+                                  : dir_node_n_children (node);
+}
+
+static inline void
+iter_set (GguFilesChangedStore *self,
+          GtkTreeIter          *iter,
+          DirNode              *node,
+          guint                 index_)
+{
+  iter->stamp = self->priv->stamp;
+  iter->user_data = node;
+  iter->user_data2 = GUINT_TO_POINTER (index_);
+  iter->user_data3 = NULL;
+}
+
+static inline gboolean
+iter_is_valid (GguFilesChangedStore *self,
+               GtkTreeIter          *iter)
+{
+  return (iter->stamp == self->priv->stamp &&
+          ITER_INDEX (iter) < store_n_children (self, ITER_NODE (iter)));
+}
+
+/* the directory at @iter, or %NULL if it's a file */
+static inline DirNode *
+iter_get_dir (GtkTreeIter *iter)
+{
+  DirNode *node = ITER_NODE (iter);
+  
+  if (ITER_INDEX (iter) < dir_node_n_dirs (node)) {
+    return g_ptr_array_index (node->dirs, ITER_INDEX (iter));
+  }
+  
+  return NULL;
+}
+
+static inline GguGitFilesChangedEntry *
+iter_get_file (GtkTreeIter *iter)
+{
+  DirNode *node = ITER_NODE (iter);
+  guint    n_dirs = dir_node_n_dirs (node);
+  
+  if (ITER_INDEX (iter) >= n_dirs) {
+    return g_ptr_array_index (node->files, ITER_INDEX (iter) - n_dirs);
+  }
+  
+  return NULL;
+}
 
 
 static void
 ggu_files_changed_store_class_init (GguFilesChangedStoreClass *klass)
 {
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  
+  object_class->finalize      = ggu_files_changed_store_finalize;
+  object_class->get_property  = ggu_files_changed_store_get_property;
+  object_class->set_property  = ggu_files_changed_store_set_property;
+  
+  g_object_class_install_property (object_class,
+                                   PROP_TREE_MODE,
+                                   g_param_spec_boolean ("tree-mode",
+                                                         "Tree mode",
+                                                         "Whether the files are grouped by directory",
+                                                         FALSE,
+                                                         G_PARAM_READWRITE |
+                                                         G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (object_class,
+                                   PROP_FILTER,
+                                   g_param_spec_string ("filter",
+                                                        "Filter",
+                                                        "The prefix of the paths to show, or NULL to show all",
+                                                        NULL,
+                                                        G_PARAM_READWRITE |
+                                                        G_PARAM_STATIC_STRINGS));
   
+  g_type_class_add_private (klass, sizeof (GguFilesChangedStorePrivate));
+}
+
+static void
+ggu_files_changed_store_tree_model_init (GtkTreeModelIface *iface)
+{
+  iface->get_flags        = ggu_files_changed_store_get_flags;
+  iface->get_n_columns    = ggu_files_changed_store_get_n_columns;
+  iface->get_column_type  = ggu_files_changed_store_get_column_type;
+  iface->get_iter         = ggu_files_changed_store_get_iter;
+  iface->get_path         = ggu_files_changed_store_get_tree_path;
+  iface->get_value        = ggu_files_changed_store_get_value;
+  iface->iter_next        = ggu_files_changed_store_iter_next;
+  iface->iter_children    = ggu_files_changed_store_iter_children;
+  iface->iter_has_child   = ggu_files_changed_store_iter_has_child;
+  iface->iter_n_children  = ggu_files_changed_store_iter_n_children;
+  iface->iter_nth_child   = ggu_files_changed_store_iter_nth_child;
+  iface->iter_parent      = ggu_files_changed_store_iter_parent;
 }
 
 static void
 ggu_files_changed_store_init (GguFilesChangedStore *self)
 {
-  GType column_types[GGU_FILES_CHANGED_STORE_N_COLUMNS] = { 0 };
+  self->priv = G_TYPE_INSTANCE_GET_PRIVATE (self, GGU_TYPE_FILES_CHANGED_STORE,
+                                            GguFilesChangedStorePrivate);
+  
+  self->priv->entries = g_ptr_array_new_with_free_func ((GDestroyNotify) ggu_git_files_changed_entry_unref);
+  self->priv->tree_mode = FALSE;
+  self->priv->filter = NULL;
+  self->priv->root = dir_node_new (NULL, "", 0);
+  self->priv->n_roots = 0;
+  self->priv->stamp = g_random_int ();
+}
+
+static void
+ggu_files_changed_store_finalize (GObject *object)
+{
+  GguFilesChangedStore *self = GGU_FILES_CHANGED_STORE (object);
+  
+  if (self->priv->root) {
+    dir_node_free (self->priv->root);
+    self->priv->root = NULL;
+  }
+  g_ptr_array_free (self->priv->entries, TRUE);
+  self->priv->entries = NULL;
+  g_free (self->priv->filter);
+  self->priv->filter = NULL;
+  
+  G_OBJECT_CLASS (ggu_files_changed_store_parent_class)->finalize (object);
+}
+
+static void
+ggu_files_changed_store_get_property (GObject    *object,
+                                      guint       prop_id,
+                                      GValue     *value,
+                                      GParamSpec *pspec)
+{
+  GguFilesChangedStore *self = GGU_FILES_CHANGED_STORE (object);
+  
+  switch (prop_id) {
+    case PROP_TREE_MODE:
+      g_value_set_boolean (value, self->priv->tree_mode);
+      break;
+    
+    case PROP_FILTER:
+      g_value_set_string (value, self->priv->filter);
+      break;
+    
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+ggu_files_changed_store_set_property (GObject      *object,
+                                      guint         prop_id,
+                                      const GValue *value,
+                                      GParamSpec   *pspec)
+{
+  GguFilesChangedStore *self = GGU_FILES_CHANGED_STORE (object);
+  
+  switch (prop_id) {
+    case PROP_TREE_MODE:
+      ggu_files_changed_store_set_tree_mode (self, g_value_get_boolean (value));
+      break;
+    
+    case PROP_FILTER:
+      ggu_files_changed_store_set_filter (self, g_value_get_string (value));
+      break;
+    
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static GtkTreeModelFlags
+ggu_files_changed_store_get_flags (GtkTreeModel *model)
+{
+  return GTK_TREE_MODEL_ITERS_PERSIST;
+}
+
+static gint
+ggu_files_changed_store_get_n_columns (GtkTreeModel *model)
+{
+  return GGU_FILES_CHANGED_STORE_N_COLUMNS;
+}
+
+static GType
+ggu_files_changed_store_get_column_type (GtkTreeModel *model,
+                                         gint          index_)
+{
+  g_return_val_if_fail (index_ == GGU_FILES_CHANGED_STORE_COLUMN_ENTRY,
+                        G_TYPE_INVALID);
+  
+  return GGU_TYPE_GIT_FILES_CHANGED_ENTRY;
+}
+
+static gboolean
+ggu_files_changed_store_get_iter (GtkTreeModel *model,
+                                  GtkTreeIter  *iter,
+                                  GtkTreePath  *path)
+{
+  GguFilesChangedStore *self = GGU_FILES_CHANGED_STORE (model);
+  const gint           *indices = gtk_tree_path_get_indices (path);
+  gint                  depth = gtk_tree_path_get_depth (path);
+  DirNode              *node = self->priv->root;
+  gint                  i;
+  
+  g_return_val_if_fail (depth > 0, FALSE);
+  
+  for (i = 0; i < depth; i++) {
+    if (! node || indices[i] < 0 ||
+        (guint) indices[i] >= store_n_children (self, node)) {
+      iter->stamp = 0;
+      return FALSE;
+    }
+    iter_set (self, iter, node, (guint) indices[i]);
+    node = iter_get_dir (iter);
+  }
+  
+  return TRUE;
+}
+
+static GtkTreePath *
+ggu_files_changed_store_get_tree_path (GtkTreeModel *model,
+                                       GtkTreeIter  *iter)
+{
+  GguFilesChangedStore *self = GGU_FILES_CHANGED_STORE (model);
+  GtkTreePath          *path;
+  DirNode              *node;
+  
+  g_return_val_if_fail (iter_is_valid (self, iter), NULL);
+  
+  path = gtk_tree_path_new ();
+  gtk_tree_path_prepend_index (path, (gint) ITER_INDEX (iter));
+  for (node = ITER_NODE (iter); node->parent; node = node->parent) {
+    gtk_tree_path_prepend_index (path, (gint) node->index);
+  }
+  
+  return path;
+}
+
+static void
+ggu_files_changed_store_get_value (GtkTreeModel *model,
+                                   GtkTreeIter  *iter,
+                                   gint          column,
+                                   GValue       *value)
+{
+  GguFilesChangedStore *self = GGU_FILES_CHANGED_STORE (model);
   
-  column_types[GGU_FILES_CHANGED_STORE_COLUMN_ENTRY] = GGU_TYPE_GIT_FILES_CHANGED_ENTRY;
+  g_return_if_fail (column == GGU_FILES_CHANGED_STORE_COLUMN_ENTRY);
+  g_return_if_fail (iter_is_valid (self, iter));
   
-  gtk_list_store_set_column_types (GTK_LIST_STORE (self),
-                                   G_N_ELEMENTS (column_types), column_types);
+  g_value_init (value, GGU_TYPE_GIT_FILES_CHANGED_ENTRY);
+  g_value_set_boxed (value, iter_get_file (iter));
+}
+
+static gboolean
+ggu_files_changed_store_iter_next (GtkTreeModel *model,
+                                   GtkTreeIter  *iter)
+{
+  GguFilesChangedStore *self = GGU_FILES_CHANGED_STORE (model);
+  
+  g_return_val_if_fail (iter_is_valid (self, iter), FALSE);
+  
+  if (ITER_INDEX (iter) + 1 >= store_n_children (self, ITER_NODE (iter))) {
+    iter->stamp = 0;
+    return FALSE;
+  }
+  iter_set (self, iter, ITER_NODE (iter), ITER_INDEX (iter) + 1);
+  
+  return TRUE;
+}
+
+static gboolean
+ggu_files_changed_store_iter_children (GtkTreeModel *model,
+                                       GtkTreeIter  *iter,
+                                       GtkTreeIter  *parent)
+{
+  return ggu_files_changed_store_iter_nth_child (model, iter, parent, 0);
+}
+
+static gboolean
+ggu_files_changed_store_iter_has_child (GtkTreeModel *model,
+                                        GtkTreeIter  *iter)
+{
+  return ggu_files_changed_store_iter_n_children (model, iter) > 0;
+}
+
+static gint
+ggu_files_changed_store_iter_n_children (GtkTreeModel *model,
+                                         GtkTreeIter  *iter)
+{
+  GguFilesChangedStore *self = GGU_FILES_CHANGED_STORE (model);
+  DirNode              *node = self->priv->root;
+  
+  if (iter) {
+    g_return_val_if_fail (iter_is_valid (self, iter), 0);
+    
+    node = iter_get_dir (iter);
+  }
+  
+  return node ? (gint) store_n_children (self, node) : 0;
+}
+
+static gboolean
+ggu_files_changed_store_iter_nth_child (GtkTreeModel *model,
+                                        GtkTreeIter  *iter,
+                                        GtkTreeIter  *parent,
+                                        gint          n)
+{
+  GguFilesChangedStore *self = GGU_FILES_CHANGED_STORE (model);
+  DirNode              *node = self->priv->root;
+  
+  if (parent) {
+    g_return_val_if_fail (iter_is_valid (self, parent), FALSE);
+    
+    node = iter_get_dir (parent);
+  }
+  if (! node || n < 0 || (guint) n >= store_n_children (self, node)) {
+    iter->stamp = 0;
+    return FALSE;
+  }
+  iter_set (self, iter, node, (guint) n);
+  
+  return TRUE;
+}
+
+static gboolean
+ggu_files_changed_store_iter_parent (GtkTreeModel *model,
+                                     GtkTreeIter  *iter,
+                                     GtkTreeIter  *child)
+{
+  GguFilesChangedStore *self = GGU_FILES_CHANGED_STORE (model);
+  DirNode              *node;
+  
+  g_return_val_if_fail (iter_is_valid (self, child), FALSE);
+  
+  node = ITER_NODE (child);
+  if (! node->parent) {
+    iter->stamp = 0;
+    return FALSE;
+  }
+  iter_set (self, iter, node->parent, node->index);
+  
+  return TRUE;
+}
+
+
+static gint
+compare_entries_path (gconstpointer a,
+                      gconstpointer b)
+{
+  const GguGitFilesChangedEntry *entry_a = *(GguGitFilesChangedEntry **) a;
+  const GguGitFilesChangedEntry *entry_b = *(GguGitFilesChangedEntry **) b;
+  
+  return strcmp (entry_a->path, entry_b->path);
+}
+
+/* finds the first entry whose path's first @length bytes compare greater
+ * than @prefix, or greater or equal if @or_equal is TRUE */
+static guint
+entries_bisect (GPtrArray    *entries,
+                const gchar  *prefix,
+                gsize         length,
+                gboolean      or_equal)
+{
+  guint lo = 0;
+  guint hi = entries->len;
+  
+  while (lo < hi) {
+    guint                           mid = lo + (hi - lo) / 2;
+    const GguGitFilesChangedEntry  *entry = g_ptr_array_index (entries, mid);
+    gint                            cmp = strncmp (entry->path, prefix, length);
+    
+    if (cmp > 0 || (or_equal && cmp == 0)) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
+    }
+  }
+  
+  return lo;
+}
+
+static void
+ggu_files_changed_store_remove_rows (GguFilesChangedStore *self)
+{
+  GtkTreeModel *model = GTK_TREE_MODEL (self);
+  GtkTreePath  *path;
+  
+  /* remove the rows from the end so nothing needs to move */
+  path = gtk_tree_path_new_from_indices ((gint) self->priv->n_roots, -1);
+  while (self->priv->n_roots > 0) {
+    self->priv->n_roots--;
+    gtk_tree_path_prev (path);
+    gtk_tree_model_row_deleted (model, path);
+  }
+  gtk_tree_path_free (path);
+  dir_node_free (self->priv->root);
+  self->priv->root = NULL;
+  /* invalidate all iterators */
+  self->priv->stamp++;
+}
+
+/* creates the rows of the entries matching the filter, in the current mode */
+static void
+ggu_files_changed_store_insert_rows (GguFilesChangedStore *self)
+{
+  GtkTreeModel             *model = GTK_TREE_MODEL (self);
+  GtkTreePath              *path;
+  GtkTreeIter               iter;
+  GguGitFilesChangedEntry **entries;
+  guint                     start = 0;
+  guint                     end = self->priv->entries->len;
+  guint                     n_roots;
+  
+  if (self->priv->filter && *self->priv->filter) {
+    gsize length = strlen (self->priv->filter);
+    
+    start = entries_bisect (self->priv->entries, self->priv->filter, length,
+                            TRUE);
+    end = entries_bisect (self->priv->entries, self->priv->filter, length,
+                          FALSE);
+  }
+  entries = (GguGitFilesChangedEntry **) self->priv->entries->pdata + start;
+  if (self->priv->tree_mode) {
+    self->priv->root = dir_node_build_tree (entries, end - start);
+  } else {
+    guint i;
+    
+    /* a list is a tree with a single directory */
+    self->priv->root = dir_node_new (NULL, "", 0);
+    self->priv->root->files = g_ptr_array_sized_new (end - start);
+    for (i = 0; i < end - start; i++) {
+      g_ptr_array_add (self->priv->root->files, entries[i]);
+    }
+  }
+  
+  /* only the top-level rows are announced, the views will ask for the
+   * children of the ones they expand */
+  n_roots = dir_node_n_children (self->priv->root);
+  path = gtk_tree_path_new_first ();
+  while (self->priv->n_roots < n_roots) {
+    iter_set (self, &iter, self->priv->root, self->priv->n_roots++);
+    gtk_tree_model_row_inserted (model, path, &iter);
+    if (iter_get_dir (&iter)) {
+      gtk_tree_model_row_has_child_toggled (model, path, &iter);
+    }
+    gtk_tree_path_next (path);
+  }
+  gtk_tree_path_free (path);
 }
 
 
@@ -63,21 +706,139 @@ ggu_files_changed_store_new (void)
 }
 
 /**
- * ggu_files_changed_store_append:
+ * ggu_files_changed_store_set_entries:
+ * @self: A #GguFilesChangedStore
+ * @entries: (element-type GguGitFilesChangedEntry) (transfer none): The
+ *           entries to show
+ * 
+ * Replaces the entries of the store with @entries.  The rows are sorted by
+ * path whatever the order of @entries.
+ */
+void
+ggu_files_changed_store_set_entries (GguFilesChangedStore *self,
+                                     GList                *entries)
+{
+  GPtrArray  *array;
+  gboolean    sorted = TRUE;
+  
+  g_return_if_fail (GGU_IS_FILES_CHANGED_STORE (self));
+  
+  array = g_ptr_array_new_with_free_func ((GDestroyNotify) ggu_git_files_changed_entry_unref);
+  for (; entries; entries = entries->next) {
+    GguGitFilesChangedEntry *entry = entries->data;
+    
+    if (sorted && array->len > 0 &&
+        strcmp (((GguGitFilesChangedEntry *) array->pdata[array->len - 1])->path,
+                entry->path) > 0) {
+      sorted = FALSE;
+    }
+    g_ptr_array_add (array, ggu_git_files_changed_entry_ref (entry));
+  }
+  /* Git mostly lists them sorted already */
+  if (! sorted) {
+    g_ptr_array_sort (array, compare_entries_path);
+  }
+  
+  ggu_files_changed_store_remove_rows (self);
+  g_ptr_array_free (self->priv->entries, TRUE);
+  self->priv->entries = array;
+  ggu_files_changed_store_insert_rows (self);
+}
+
+/**
+ * ggu_files_changed_store_clear:
+ * @self: A #GguFilesChangedStore
+ * 
+ * Removes all the entries.
+ */
+void
+ggu_files_changed_store_clear (GguFilesChangedStore *self)
+{
+  g_return_if_fail (GGU_IS_FILES_CHANGED_STORE (self));
+  
+  ggu_files_changed_store_set_entries (self, NULL);
+}
+
+/**
+ * ggu_files_changed_store_get_n_entries:
  * @self: A #GguFilesChangedStore
- * @entry: (transfer none): The #GguGitFilesChangedEntry to append
  * 
- * Appends a new row and fills it with @entry.
+ * Gets the number of entries in the store, whether they match the filter or
+ * not.
+ * 
+ * Returns: The number of entries
+ */
+guint
+ggu_files_changed_store_get_n_entries (GguFilesChangedStore *self)
+{
+  g_return_val_if_fail (GGU_IS_FILES_CHANGED_STORE (self), 0);
+  
+  return self->priv->entries->len;
+}
+
+gboolean
+ggu_files_changed_store_get_tree_mode (GguFilesChangedStore *self)
+{
+  g_return_val_if_fail (GGU_IS_FILES_CHANGED_STORE (self), FALSE);
+  
+  return self->priv->tree_mode;
+}
+
+/**
+ * ggu_files_changed_store_set_tree_mode:
+ * @self: A #GguFilesChangedStore
+ * @tree_mode: Whether to group the files by directory
+ * 
+ * Sets whether the rows are the files or a tree of the directories
+ * containing them.  Directory rows have no entry, but sum the changes of the
+ * files they contain.
+ */
+void
+ggu_files_changed_store_set_tree_mode (GguFilesChangedStore *self,
+                                       gboolean              tree_mode)
+{
+  g_return_if_fail (GGU_IS_FILES_CHANGED_STORE (self));
+  
+  if (self->priv->tree_mode != tree_mode) {
+    ggu_files_changed_store_remove_rows (self);
+    self->priv->tree_mode = tree_mode;
+    ggu_files_changed_store_insert_rows (self);
+    g_object_notify (G_OBJECT (self), "tree-mode");
+  }
+}
+
+const gchar *
+ggu_files_changed_store_get_filter (GguFilesChangedStore *self)
+{
+  g_return_val_if_fail (GGU_IS_FILES_CHANGED_STORE (self), NULL);
+  
+  return self->priv->filter;
+}
+
+/**
+ * ggu_files_changed_store_set_filter:
+ * @self: A #GguFilesChangedStore
+ * @prefix: (allow-none): The prefix of the paths to show, or %NULL
+ * 
+ * Only shows the files whose path starts with @prefix.  The filter is kept
+ * when the entries change.
  */
 void
-ggu_files_changed_store_append (GguFilesChangedStore    *self,
-                                GguGitFilesChangedEntry *entry)
+ggu_files_changed_store_set_filter (GguFilesChangedStore *self,
+                                    const gchar          *prefix)
 {
-  GtkTreeIter iter;
+  g_return_if_fail (GGU_IS_FILES_CHANGED_STORE (self));
   
-  gtk_list_store_append (GTK_LIST_STORE (self), &iter);
-  gtk_list_store_set (GTK_LIST_STORE (self), &iter,
-                      GGU_FILES_CHANGED_STORE_COLUMN_ENTRY, entry, -1);
+  if (prefix && ! *prefix) {
+    prefix = NULL;
+  }
+  if (g_strcmp0 (self->priv->filter, prefix) != 0) {
+    ggu_files_changed_store_remove_rows (self);
+    g_free (self->priv->filter);
+    self->priv->filter = g_strdup (prefix);
+    ggu_files_changed_store_insert_rows (self);
+    g_object_notify (G_OBJECT (self), "filter");
+  }
 }
 
 /**
@@ -87,17 +848,105 @@ ggu_files_changed_store_append (GguFilesChangedStore    *self,
  * 
  * Gets the #GguGitFilesChangedEntry at a given row.
  * 
- * Returns: (transfer none): The entry at the given row.
+ * Returns: (transfer none): The entry at the given row, or %NULL if it is a
+ *          directory.
  */
 GguGitFilesChangedEntry *
 ggu_files_changed_store_get_entry (GguFilesChangedStore *self,
                                    GtkTreeIter          *iter)
 {
-  GguGitFilesChangedEntry *entry;
+  g_return_val_if_fail (GGU_IS_FILES_CHANGED_STORE (self), NULL);
+  g_return_val_if_fail (iter_is_valid (self, iter), NULL);
+  
+  return iter_get_file (iter);
+}
+
+/**
+ * ggu_files_changed_store_get_name:
+ * @self: A #GguFilesChangedStore
+ * @iter: The #GtkTreeIter pointing to the row to get
+ * 
+ * Gets the text to show for a row: the path of the file in list mode, and
+ * the name of the file or directory in tree mode.
+ * 
+ * Returns: The name of the row
+ */
+const gchar *
+ggu_files_changed_store_get_name (GguFilesChangedStore *self,
+                                  GtkTreeIter          *iter)
+{
+  DirNode                  *dir;
+  GguGitFilesChangedEntry  *entry;
+  
+  g_return_val_if_fail (GGU_IS_FILES_CHANGED_STORE (self), NULL);
+  g_return_val_if_fail (iter_is_valid (self, iter), NULL);
+  
+  if ((dir = iter_get_dir (iter))) {
+    return dir->name;
+  }
+  entry = iter_get_file (iter);
+  /* renames show where the file comes from */
+  if (self->priv->tree_mode && ! entry->old_path &&
+      entry->display_path == entry->path) {
+    return entry->path + strlen (ITER_NODE (iter)->path);
+  }
+  
+  return entry->display_path;
+}
+
+/**
+ * ggu_files_changed_store_get_path:
+ * @self: A #GguFilesChangedStore
+ * @iter: The #GtkTreeIter pointing to the row to get
+ * 
+ * Gets the full path of a row.  Directories' have a trailing slash.
+ * 
+ * Returns: The path of the row
+ */
+const gchar *
+ggu_files_changed_store_get_path (GguFilesChangedStore *self,
+                                  GtkTreeIter          *iter)
+{
+  DirNode *dir;
+  
+  g_return_val_if_fail (GGU_IS_FILES_CHANGED_STORE (self), NULL);
+  g_return_val_if_fail (iter_is_valid (self, iter), NULL);
+  
+  if ((dir = iter_get_dir (iter))) {
+    return dir->path;
+  }
+  
+  return iter_get_file (iter)->path;
+}
+
+/**
+ * ggu_files_changed_store_get_changes_text:
+ * @self: A #GguFilesChangedStore
+ * @iter: The #GtkTreeIter pointing to the row to get
+ * @added: (out): Return location for the lines added
+ * @removed: (out): Return location for the lines removed
+ * 
+ * Gets the display strings of the lines added and removed in a row, which
+ * for directories are the ones of all the files they contain.
+ */
+void
+ggu_files_changed_store_get_changes_text (GguFilesChangedStore  *self,
+                                          GtkTreeIter           *iter,
+                                          const gchar          **added,
+                                          const gchar          **removed)
+{
+  DirNode *dir;
   
-  gtk_tree_model_get (GTK_TREE_MODEL (self), iter,
-                      GGU_FILES_CHANGED_STORE_COLUMN_ENTRY, &entry, -1);
-  ggu_git_files_changed_entry_unref (entry);
+  g_return_if_fail (GGU_IS_FILES_CHANGED_STORE (self));
+  g_return_if_fail (iter_is_valid (self, iter));
   
-  return entry;
+  if ((dir = iter_get_dir (iter))) {
+    *added = dir->added_text;
+    *removed = dir->removed_text;
+  } else {
+    GguGitFilesChangedEntry *entry = iter_get_file (iter);
+    
+    *added = entry->added_text;
+    *removed = entry->removed_text;
+  }
 }
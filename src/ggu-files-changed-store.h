@@ -45,26 +45,44 @@ enum
   GGU_FILES_CHANGED_STORE_N_COLUMNS
 };
 
-typedef struct _GguFilesChangedStore       GguFilesChangedStore;
-typedef struct _GguFilesChangedStoreClass  GguFilesChangedStoreClass;
+typedef struct _GguFilesChangedStore         GguFilesChangedStore;
+typedef struct _GguFilesChangedStoreClass    GguFilesChangedStoreClass;
+typedef struct _GguFilesChangedStorePrivate  GguFilesChangedStorePrivate;
 
 struct _GguFilesChangedStore
 {
-  GtkListStore parent_instance;
+  GObject parent_instance;
+  GguFilesChangedStorePrivate *priv;
 };
 
 struct _GguFilesChangedStoreClass
 {
-  GtkListStoreClass parent_class;
+  GObjectClass parent_class;
 };
 
 
-GType                     ggu_files_changed_store_get_type  (void) G_GNUC_CONST;
-GguFilesChangedStore     *ggu_files_changed_store_new       (void);
-void                      ggu_files_changed_store_append    (GguFilesChangedStore    *self,
-                                                             GguGitFilesChangedEntry *entry);
-GguGitFilesChangedEntry  *ggu_files_changed_store_get_entry (GguFilesChangedStore *self,
-                                                             GtkTreeIter     *iter);
+GType                     ggu_files_changed_store_get_type         (void) G_GNUC_CONST;
+GguFilesChangedStore     *ggu_files_changed_store_new              (void);
+void                      ggu_files_changed_store_set_entries      (GguFilesChangedStore *self,
+                                                                    GList                *entries);
+void                      ggu_files_changed_store_clear            (GguFilesChangedStore *self);
+guint                     ggu_files_changed_store_get_n_entries    (GguFilesChangedStore *self);
+gboolean                  ggu_files_changed_store_get_tree_mode    (GguFilesChangedStore *self);
+void                      ggu_files_changed_store_set_tree_mode    (GguFilesChangedStore *self,
+                                                                    gboolean              tree_mode);
+const gchar              *ggu_files_changed_store_get_filter       (GguFilesChangedStore *self);
+void                      ggu_files_changed_store_set_filter       (GguFilesChangedStore *self,
+                                                                    const gchar          *prefix);
+GguGitFilesChangedEntry  *ggu_files_changed_store_get_entry        (GguFilesChangedStore *self,
+                                                                    GtkTreeIter          *iter);
+const gchar              *ggu_files_changed_store_get_name         (GguFilesChangedStore *self,
+                                                                    GtkTreeIter          *iter);
+const gchar              *ggu_files_changed_store_get_path         (GguFilesChangedStore *self,
+                                                                    GtkTreeIter          *iter);
+void                      ggu_files_changed_store_get_changes_text (GguFilesChangedStore *self,
+                                                                    GtkTreeIter          *iter,
+                                                                    const gchar         **added,
+                                                                    const gchar         **removed);
 
 
 G_END_DECLS
@@ -50,9 +50,11 @@ struct _GguFilesChangedViewPrivate
   GtkCellRenderer    *removed_cell;
   GtkTreeViewColumn  *removed_column;
   gboolean            colorize_changes;
+  GguFilesChangedStore *store; /* the model whose mode we follow */
 };
 
 
+static void       ggu_files_changed_view_dispose                    (GObject *object);
 static void       ggu_files_changed_view_get_propery                (GObject    *object,
                                                                      guint       prop_id,
                                                                      GValue     *value,
@@ -88,12 +90,55 @@ G_DEFINE_TYPE (GguFilesChangedView,
                GGU_TYPE_TREE_VIEW)
 
 
+/* lists don't need room for expanders */
+static void
+store_tree_mode_notify_handler (GguFilesChangedStore *store,
+                                GParamSpec           *pspec,
+                                GguFilesChangedView  *self)
+{
+  gtk_tree_view_set_show_expanders (GTK_TREE_VIEW (self),
+                                    ggu_files_changed_store_get_tree_mode (store));
+}
+
+static void
+ggu_files_changed_view_set_store (GguFilesChangedView  *self,
+                                  GguFilesChangedStore *store)
+{
+  if (self->priv->store) {
+    g_signal_handlers_disconnect_by_func (self->priv->store,
+                                          store_tree_mode_notify_handler,
+                                          self);
+    g_object_unref (self->priv->store);
+  }
+  self->priv->store = store ? g_object_ref (store) : NULL;
+  if (store) {
+    g_signal_connect (store, "notify::tree-mode",
+                      G_CALLBACK (store_tree_mode_notify_handler), self);
+    store_tree_mode_notify_handler (store, NULL, self);
+  }
+}
+
+static void
+model_notify_handler (GguFilesChangedView *self,
+                      GParamSpec          *pspec,
+                      gpointer             data)
+{
+  GtkTreeModel *model = gtk_tree_view_get_model (GTK_TREE_VIEW (self));
+  
+  ggu_files_changed_view_set_store (self,
+                                    GGU_IS_FILES_CHANGED_STORE (model)
+                                    ? GGU_FILES_CHANGED_STORE (model)
+                                    : NULL);
+}
+
+
 static void
 ggu_files_changed_view_class_init (GguFilesChangedViewClass *klass)
 {
   GObjectClass   *object_class = G_OBJECT_CLASS (klass);
   GtkWidgetClass *widget_class = GTK_WIDGET_CLASS (klass);
   
+  object_class->dispose       = ggu_files_changed_view_dispose;
   object_class->get_property  = ggu_files_changed_view_get_propery;
   object_class->set_property  = ggu_files_changed_view_set_propery;
   
@@ -120,6 +165,7 @@ ggu_files_changed_view_init (GguFilesChangedView *self)
                                             GguFilesChangedViewPrivate);
   
   self->priv->colorize_changes = TRUE;
+  self->priv->store = NULL;
   
   gtk_tree_view_set_headers_visible (GTK_TREE_VIEW (self), FALSE);
   gtk_widget_set_has_tooltip (GTK_WIDGET (self), TRUE);
@@ -127,6 +173,7 @@ ggu_files_changed_view_init (GguFilesChangedView *self)
   /* path column */
   self->priv->path_column = g_object_new (GTK_TYPE_TREE_VIEW_COLUMN,
                                           "title", _("Path"),
+                                          "sizing", GTK_TREE_VIEW_COLUMN_FIXED,
                                           "expand", TRUE,
                                           NULL);
   cell = g_object_new (GTK_TYPE_CELL_RENDERER_TEXT,
@@ -152,6 +199,9 @@ ggu_files_changed_view_init (GguFilesChangedView *self)
                                       self->priv->added_cell,
                                       ggu_files_changed_view_added_cell_set_data_func,
                                       NULL, NULL);
+  ggu_tree_view_set_column_fixed_text (GGU_TREE_VIEW (self),
+                                       self->priv->added_column,
+                                       self->priv->added_cell, "+000000");
   gtk_tree_view_append_column (GTK_TREE_VIEW (self), self->priv->added_column);
   
   /* removed column */
@@ -166,8 +216,27 @@ ggu_files_changed_view_init (GguFilesChangedView *self)
                                       self->priv->removed_cell,
                                       ggu_files_changed_view_removed_cell_set_data_func,
                                       NULL, NULL);
+  ggu_tree_view_set_column_fixed_text (GGU_TREE_VIEW (self),
+                                       self->priv->removed_column,
+                                       self->priv->removed_cell, "-000000");
   gtk_tree_view_append_column (GTK_TREE_VIEW (self),
                                self->priv->removed_column);
+  
+  /* don't measure every row, the counts' columns have fixed widths */
+  gtk_tree_view_set_fixed_height_mode (GTK_TREE_VIEW (self), TRUE);
+  
+  g_signal_connect (self, "notify::model",
+                    G_CALLBACK (model_notify_handler), NULL);
+}
+
+static void
+ggu_files_changed_view_dispose (GObject *object)
+{
+  GguFilesChangedView *self = GGU_FILES_CHANGED_VIEW (object);
+  
+  ggu_files_changed_view_set_store (self, NULL);
+  
+  G_OBJECT_CLASS (ggu_files_changed_view_parent_class)->dispose (object);
 }
 
 static void
@@ -216,10 +285,9 @@ ggu_files_changed_view_query_tooltip (GtkWidget  *widget,
                                       gboolean    keyboard_mode,
                                       GtkTooltip *tooltip)
 {
-  GtkTreeModel             *model;
-  GtkTreePath              *path;
-  GtkTreeIter               iter;
-  GguGitFilesChangedEntry  *entry;
+  GtkTreeModel *model;
+  GtkTreePath  *path;
+  GtkTreeIter   iter;
   
   if (! gtk_tree_view_get_tooltip_context (GTK_TREE_VIEW (widget),
                                            &x, &y, keyboard_mode,
@@ -227,10 +295,9 @@ ggu_files_changed_view_query_tooltip (GtkWidget  *widget,
     return FALSE;
   }
   
-  entry = ggu_files_changed_store_get_entry (GGU_FILES_CHANGED_STORE (model),
-                                             &iter);
-  
-  gtk_tooltip_set_text (tooltip, entry->path);
+  gtk_tooltip_set_text (tooltip,
+                        ggu_files_changed_store_get_path (GGU_FILES_CHANGED_STORE (model),
+                                                          &iter));
   gtk_tree_view_set_tooltip_row (GTK_TREE_VIEW (widget), tooltip, path);
   gtk_tree_path_free (path);
   
@@ -245,15 +312,11 @@ ggu_files_changed_view_path_cell_set_data_func (GtkCellLayout   *cell_layout,
                                                 GtkTreeIter     *iter,
                                                 gpointer         data)
 {
-  GguGitFilesChangedEntry  *entry;
-  GValue                    value = { 0 };
+  const gchar *name;
   
-  entry = ggu_files_changed_store_get_entry (GGU_FILES_CHANGED_STORE (model),
-                                             iter);
-  g_value_init (&value, G_TYPE_STRING);
-  g_value_take_string (&value, g_strescape (entry->path, "\""));
-  g_object_set_property (G_OBJECT (cell), "text", &value);
-  g_value_unset (&value);
+  name = ggu_files_changed_store_get_name (GGU_FILES_CHANGED_STORE (model),
+                                           iter);
+  g_object_set (G_OBJECT (cell), "text", name, NULL);
 }
 
 static void
@@ -263,15 +326,12 @@ ggu_files_changed_view_added_cell_set_data_func (GtkCellLayout   *cell_layout,
                                                  GtkTreeIter     *iter,
                                                  gpointer         data)
 {
-  GguGitFilesChangedEntry  *entry;
-  GValue                    value = { 0 };
+  const gchar *added;
+  const gchar *removed;
   
-  entry = ggu_files_changed_store_get_entry (GGU_FILES_CHANGED_STORE (model),
-                                             iter);
-  g_value_init (&value, G_TYPE_STRING);
-  g_value_take_string (&value, g_strdup_printf ("+%u", entry->added));
-  g_object_set_property (G_OBJECT (cell), "text", &value);
-  g_value_unset (&value);
+  ggu_files_changed_store_get_changes_text (GGU_FILES_CHANGED_STORE (model),
+                                            iter, &added, &removed);
+  g_object_set (G_OBJECT (cell), "text", added, NULL);
 }
 
 static void
@@ -281,15 +341,12 @@ ggu_files_changed_view_removed_cell_set_data_func (GtkCellLayout   *cell_layout,
                                                    GtkTreeIter     *iter,
                                                    gpointer         data)
 {
-  GguGitFilesChangedEntry  *entry;
-  GValue                    value = { 0 };
+  const gchar *added;
+  const gchar *removed;
   
-  entry = ggu_files_changed_store_get_entry (GGU_FILES_CHANGED_STORE (model),
-                                             iter);
-  g_value_init (&value, G_TYPE_STRING);
-  g_value_take_string (&value, g_strdup_printf ("-%u", entry->removed));
-  g_object_set_property (G_OBJECT (cell), "text", &value);
-  g_value_unset (&value);
+  ggu_files_changed_store_get_changes_text (GGU_FILES_CHANGED_STORE (model),
+                                            iter, &added, &removed);
+  g_object_set (G_OBJECT (cell), "text", removed, NULL);
 }
 
 
@@ -19,9 +19,9 @@
  * 
  */
 
-/* TODO: would be better to implement this with a simpler data structure than
- *       GtkTreeModel (e.g. GPtrArray or whatever) since our data is known.
- *       But this would need to implement the whole GtkTreeModel iface... */
+/* A GtkTreeModel listing log entries, stored in a GPtrArray.  Iterators
+ * simply hold the row index, and rows can only be appended or all
+ * removed, so iterators stay valid until the store is cleared. */
 
 #include "ggu-history-store.h"
 
@@ -33,26 +33,258 @@
 #include "ggu-git-log-entry.h"
 
 
-G_DEFINE_TYPE (GguHistoryStore,
-               ggu_history_store,
-               GTK_TYPE_LIST_STORE)
+struct _GguHistoryStorePrivate
+{
+  GPtrArray  *entries;
+  gint        stamp;
+};
+
+
+static void               ggu_history_store_finalize        (GObject *object);
+static void               ggu_history_store_tree_model_init (GtkTreeModelIface *iface);
+static GtkTreeModelFlags  ggu_history_store_get_flags       (GtkTreeModel *model);
+static gint               ggu_history_store_get_n_columns   (GtkTreeModel *model);
+static GType              ggu_history_store_get_column_type (GtkTreeModel *model,
+                                                             gint          index_);
+static gboolean           ggu_history_store_get_iter        (GtkTreeModel *model,
+                                                             GtkTreeIter  *iter,
+                                                             GtkTreePath  *path);
+static GtkTreePath       *ggu_history_store_get_path        (GtkTreeModel *model,
+                                                             GtkTreeIter  *iter);
+static void               ggu_history_store_get_value       (GtkTreeModel *model,
+                                                             GtkTreeIter  *iter,
+                                                             gint          column,
+                                                             GValue       *value);
+static gboolean           ggu_history_store_iter_next       (GtkTreeModel *model,
+                                                             GtkTreeIter  *iter);
+static gboolean           ggu_history_store_iter_children   (GtkTreeModel *model,
+                                                             GtkTreeIter  *iter,
+                                                             GtkTreeIter  *parent);
+static gboolean           ggu_history_store_iter_has_child  (GtkTreeModel *model,
+                                                             GtkTreeIter  *iter);
+static gint               ggu_history_store_iter_n_children (GtkTreeModel *model,
+                                                             GtkTreeIter  *iter);
+static gboolean           ggu_history_store_iter_nth_child  (GtkTreeModel *model,
+                                                             GtkTreeIter  *iter,
+                                                             GtkTreeIter  *parent,
+                                                             gint          n);
+static gboolean           ggu_history_store_iter_parent     (GtkTreeModel *model,
+                                                             GtkTreeIter  *iter,
+                                                             GtkTreeIter  *child);
+
+
+G_DEFINE_TYPE_WITH_CODE (GguHistoryStore,
+                         ggu_history_store,
+                         G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (GTK_TYPE_TREE_MODEL,
+                                                ggu_history_store_tree_model_init))
+
+
+#define ITER_INDEX(iter) (GPOINTER_TO_UINT ((iter)->user_data))
+
+static inline void
+iter_set_index (GguHistoryStore *self,
+                GtkTreeIter     *iter,
+                guint            index_)
+{
+  iter->stamp = self->priv->stamp;
+  iter->user_data = GUINT_TO_POINTER (index_);
+  iter->user_data2 = NULL;
+  iter->user_data3 = NULL;
+}
+
+static inline gboolean
+iter_is_valid (GguHistoryStore *self,
+               GtkTreeIter     *iter)
+{
+  return (iter->stamp == self->priv->stamp &&
+          ITER_INDEX (iter) < self->priv->entries->len);
+}
 
 
 static void
 ggu_history_store_class_init (GguHistoryStoreClass *klass)
 {
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
   
+  object_class->finalize = ggu_history_store_finalize;
+  
+  g_type_class_add_private (klass, sizeof (GguHistoryStorePrivate));
+}
+
+static void
+ggu_history_store_tree_model_init (GtkTreeModelIface *iface)
+{
+  iface->get_flags        = ggu_history_store_get_flags;
+  iface->get_n_columns    = ggu_history_store_get_n_columns;
+  iface->get_column_type  = ggu_history_store_get_column_type;
+  iface->get_iter         = ggu_history_store_get_iter;
+  iface->get_path         = ggu_history_store_get_path;
+  iface->get_value        = ggu_history_store_get_value;
+  iface->iter_next        = ggu_history_store_iter_next;
+  iface->iter_children    = ggu_history_store_iter_children;
+  iface->iter_has_child   = ggu_history_store_iter_has_child;
+  iface->iter_n_children  = ggu_history_store_iter_n_children;
+  iface->iter_nth_child   = ggu_history_store_iter_nth_child;
+  iface->iter_parent      = ggu_history_store_iter_parent;
 }
 
 static void
 ggu_history_store_init (GguHistoryStore *self)
 {
-  GType column_types[GGU_HISTORY_STORE_N_COLUMNS] = { 0 };
+  self->priv = G_TYPE_INSTANCE_GET_PRIVATE (self, GGU_TYPE_HISTORY_STORE,
+                                            GguHistoryStorePrivate);
+  
+  self->priv->entries = g_ptr_array_new_with_free_func ((GDestroyNotify) ggu_git_log_entry_unref);
+  self->priv->stamp = g_random_int ();
+}
+
+static void
+ggu_history_store_finalize (GObject *object)
+{
+  GguHistoryStore *self = GGU_HISTORY_STORE (object);
   
-  column_types[GGU_HISTORY_STORE_COLUMN_ENTRY] = GGU_TYPE_GIT_LOG_ENTRY;
+  g_ptr_array_free (self->priv->entries, TRUE);
+  self->priv->entries = NULL;
   
-  gtk_list_store_set_column_types (GTK_LIST_STORE (self),
-                                   G_N_ELEMENTS (column_types), column_types);
+  G_OBJECT_CLASS (ggu_history_store_parent_class)->finalize (object);
+}
+
+static GtkTreeModelFlags
+ggu_history_store_get_flags (GtkTreeModel *model)
+{
+  return GTK_TREE_MODEL_ITERS_PERSIST | GTK_TREE_MODEL_LIST_ONLY;
+}
+
+static gint
+ggu_history_store_get_n_columns (GtkTreeModel *model)
+{
+  return GGU_HISTORY_STORE_N_COLUMNS;
+}
+
+static GType
+ggu_history_store_get_column_type (GtkTreeModel *model,
+                                   gint          index_)
+{
+  g_return_val_if_fail (index_ == GGU_HISTORY_STORE_COLUMN_ENTRY,
+                        G_TYPE_INVALID);
+  
+  return GGU_TYPE_GIT_LOG_ENTRY;
+}
+
+static gboolean
+ggu_history_store_get_iter (GtkTreeModel *model,
+                            GtkTreeIter  *iter,
+                            GtkTreePath  *path)
+{
+  GguHistoryStore  *self = GGU_HISTORY_STORE (model);
+  gint              index_;
+  
+  g_return_val_if_fail (gtk_tree_path_get_depth (path) > 0, FALSE);
+  
+  index_ = gtk_tree_path_get_indices (path)[0];
+  if (gtk_tree_path_get_depth (path) > 1 ||
+      index_ < 0 || (guint) index_ >= self->priv->entries->len) {
+    return FALSE;
+  }
+  iter_set_index (self, iter, (guint) index_);
+  
+  return TRUE;
+}
+
+static GtkTreePath *
+ggu_history_store_get_path (GtkTreeModel *model,
+                            GtkTreeIter  *iter)
+{
+  GguHistoryStore *self = GGU_HISTORY_STORE (model);
+  
+  g_return_val_if_fail (iter_is_valid (self, iter), NULL);
+  
+  return gtk_tree_path_new_from_indices ((gint) ITER_INDEX (iter), -1);
+}
+
+static void
+ggu_history_store_get_value (GtkTreeModel *model,
+                             GtkTreeIter  *iter,
+                             gint          column,
+                             GValue       *value)
+{
+  GguHistoryStore *self = GGU_HISTORY_STORE (model);
+  
+  g_return_if_fail (column == GGU_HISTORY_STORE_COLUMN_ENTRY);
+  g_return_if_fail (iter_is_valid (self, iter));
+  
+  g_value_init (value, GGU_TYPE_GIT_LOG_ENTRY);
+  g_value_set_boxed (value, g_ptr_array_index (self->priv->entries,
+                                               ITER_INDEX (iter)));
+}
+
+static gboolean
+ggu_history_store_iter_next (GtkTreeModel *model,
+                             GtkTreeIter  *iter)
+{
+  GguHistoryStore *self = GGU_HISTORY_STORE (model);
+  
+  g_return_val_if_fail (iter_is_valid (self, iter), FALSE);
+  
+  if (ITER_INDEX (iter) + 1 >= self->priv->entries->len) {
+    iter->stamp = 0;
+    return FALSE;
+  }
+  iter_set_index (self, iter, ITER_INDEX (iter) + 1);
+  
+  return TRUE;
+}
+
+static gboolean
+ggu_history_store_iter_children (GtkTreeModel *model,
+                                 GtkTreeIter  *iter,
+                                 GtkTreeIter  *parent)
+{
+  return ggu_history_store_iter_nth_child (model, iter, parent, 0);
+}
+
+static gboolean
+ggu_history_store_iter_has_child (GtkTreeModel *model,
+                                  GtkTreeIter  *iter)
+{
+  return FALSE;
+}
+
+static gint
+ggu_history_store_iter_n_children (GtkTreeModel *model,
+                                   GtkTreeIter  *iter)
+{
+  GguHistoryStore *self = GGU_HISTORY_STORE (model);
+  
+  return iter ? 0 : (gint) self->priv->entries->len;
+}
+
+static gboolean
+ggu_history_store_iter_nth_child (GtkTreeModel *model,
+                                  GtkTreeIter  *iter,
+                                  GtkTreeIter  *parent,
+                                  gint          n)
+{
+  GguHistoryStore *self = GGU_HISTORY_STORE (model);
+  
+  if (parent || n < 0 || (guint) n >= self->priv->entries->len) {
+    iter->stamp = 0;
+    return FALSE;
+  }
+  iter_set_index (self, iter, (guint) n);
+  
+  return TRUE;
+}
+
+static gboolean
+ggu_history_store_iter_parent (GtkTreeModel *model,
+                               GtkTreeIter  *iter,
+                               GtkTreeIter  *child)
+{
+  iter->stamp = 0;
+  
+  return FALSE;
 }
 
 
@@ -62,6 +294,50 @@ ggu_history_store_new (void)
   return g_object_new (GGU_TYPE_HISTORY_STORE, NULL);
 }
 
+/**
+ * ggu_history_store_append_entries:
+ * @self: A #GguHistoryStore
+ * @entries: (array length=n_entries) (transfer none): The #GguGitLogEntry to
+ *           append
+ * @n_entries: The number of entries in @entries
+ * 
+ * Appends a new row for each entry of @entries.  This is faster than
+ * appending them one by one as the store only grows once.
+ */
+void
+ggu_history_store_append_entries (GguHistoryStore  *self,
+                                  GguGitLogEntry  **entries,
+                                  guint             n_entries)
+{
+  GtkTreeModel *model;
+  GtkTreePath  *path;
+  GtkTreeIter   iter;
+  guint         first;
+  guint         i;
+  
+  g_return_if_fail (GGU_IS_HISTORY_STORE (self));
+  
+  if (n_entries == 0) {
+    return;
+  }
+  
+  first = self->priv->entries->len;
+  g_ptr_array_set_size (self->priv->entries, (gint) (first + n_entries));
+  for (i = 0; i < n_entries; i++) {
+    self->priv->entries->pdata[first + i] = ggu_git_log_entry_ref (entries[i]);
+  }
+  
+  /* views need to know about each row, but we can at least reuse the path */
+  model = GTK_TREE_MODEL (self);
+  path = gtk_tree_path_new_from_indices ((gint) first, -1);
+  for (i = first; i < first + n_entries; i++) {
+    iter_set_index (self, &iter, i);
+    gtk_tree_model_row_inserted (model, path, &iter);
+    gtk_tree_path_next (path);
+  }
+  gtk_tree_path_free (path);
+}
+
 /**
  * ggu_history_store_append:
  * @self: A #GguHistoryStore
@@ -73,11 +349,35 @@ void
 ggu_history_store_append (GguHistoryStore *self,
                           GguGitLogEntry  *entry)
 {
-  GtkTreeIter iter;
+  ggu_history_store_append_entries (self, &entry, 1);
+}
+
+/**
+ * ggu_history_store_clear:
+ * @self: A #GguHistoryStore
+ * 
+ * Removes all the rows.
+ */
+void
+ggu_history_store_clear (GguHistoryStore *self)
+{
+  GtkTreeModel *model;
+  GtkTreePath  *path;
+  
+  g_return_if_fail (GGU_IS_HISTORY_STORE (self));
   
-  gtk_list_store_append (GTK_LIST_STORE (self), &iter);
-  gtk_list_store_set (GTK_LIST_STORE (self), &iter,
-                      GGU_HISTORY_STORE_COLUMN_ENTRY, entry, -1);
+  /* remove the rows from the end so nothing needs to move */
+  model = GTK_TREE_MODEL (self);
+  path = gtk_tree_path_new_from_indices ((gint) self->priv->entries->len, -1);
+  while (self->priv->entries->len > 0) {
+    g_ptr_array_remove_index (self->priv->entries,
+                              self->priv->entries->len - 1);
+    gtk_tree_path_prev (path);
+    gtk_tree_model_row_deleted (model, path);
+  }
+  gtk_tree_path_free (path);
+  /* invalidate all iterators */
+  self->priv->stamp++;
 }
 
 /**
@@ -93,11 +393,8 @@ GguGitLogEntry *
 ggu_history_store_get_entry (GguHistoryStore *self,
                              GtkTreeIter     *iter)
 {
-  GguGitLogEntry *entry;
-  
-  gtk_tree_model_get (GTK_TREE_MODEL (self), iter,
-                      GGU_HISTORY_STORE_COLUMN_ENTRY, &entry, -1);
-  ggu_git_log_entry_unref (entry);
+  g_return_val_if_fail (GGU_IS_HISTORY_STORE (self), NULL);
+  g_return_val_if_fail (iter_is_valid (self, iter), NULL);
   
-  return entry;
+  return g_ptr_array_index (self->priv->entries, ITER_INDEX (iter));
 }
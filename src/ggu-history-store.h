@@ -45,17 +45,19 @@ enum
   GGU_HISTORY_STORE_N_COLUMNS
 };
 
-typedef struct _GguHistoryStore       GguHistoryStore;
-typedef struct _GguHistoryStoreClass  GguHistoryStoreClass;
+typedef struct _GguHistoryStore        GguHistoryStore;
+typedef struct _GguHistoryStoreClass   GguHistoryStoreClass;
+typedef struct _GguHistoryStorePrivate GguHistoryStorePrivate;
 
 struct _GguHistoryStore
 {
-  GtkListStore parent_instance;
+  GObject parent_instance;
+  GguHistoryStorePrivate *priv;
 };
 
 struct _GguHistoryStoreClass
 {
-  GtkListStoreClass parent_class;
+  GObjectClass parent_class;
 };
 
 
@@ -63,6 +65,10 @@ GType             ggu_history_store_get_type          (void) G_GNUC_CONST;
 GguHistoryStore  *ggu_history_store_new               (void);
 void              ggu_history_store_append            (GguHistoryStore *self,
                                                        GguGitLogEntry  *entry);
+void              ggu_history_store_append_entries    (GguHistoryStore  *self,
+                                                       GguGitLogEntry  **entries,
+                                                       guint             n_entries);
+void              ggu_history_store_clear             (GguHistoryStore *self);
 GguGitLogEntry   *ggu_history_store_get_entry         (GguHistoryStore *self,
                                                        GtkTreeIter     *iter);
 
@@ -35,16 +35,24 @@ enum
 {
   PROP_0,
   
-  PROP_HASH_COLUMN_VISIBLE
+  PROP_HASH_COLUMN_VISIBLE,
+  PROP_STATS_COLUMN_VISIBLE
 };
 
 struct _GguHistoryViewPrivate
 {
   GtkTreeViewColumn  *hash_column;
   GtkTreeViewColumn  *summary_column;
+  GtkTreeViewColumn  *stats_column;
+  GHashTable         *stats; /* GguGitOid -> displayed changes */
+  
+  /* the tooltip is queried on each motion, keep the last one */
+  GguGitLogEntry     *tooltip_entry;
+  gchar              *tooltip_markup;
 };
 
 
+static void       ggu_history_view_finalize                   (GObject    *object);
 static void       ggu_history_view_get_property               (GObject    *object,
                                                                guint       prop_id,
                                                                GValue     *value,
@@ -72,6 +80,11 @@ static void       ggu_history_view_summary_cell_set_data_func (GtkCellLayout   *
                                                                GtkTreeModel    *model,
                                                                GtkTreeIter     *iter,
                                                                gpointer         data);
+static void       ggu_history_view_stats_cell_set_data_func   (GtkCellLayout   *cell_layout,
+                                                               GtkCellRenderer *cell,
+                                                               GtkTreeModel    *model,
+                                                               GtkTreeIter     *iter,
+                                                               gpointer         data);
 static gboolean   ggu_history_view_search_equal_func          (GtkTreeModel *model,
                                                                gint          column,
                                                                const gchar  *key,
@@ -91,6 +104,7 @@ ggu_history_view_class_init (GguHistoryViewClass *klass)
   GtkWidgetClass   *widget_class    = GTK_WIDGET_CLASS (klass);
   GguTreeViewClass *tree_view_class = GGU_TREE_VIEW_CLASS (klass);
   
+  object_class->finalize      = ggu_history_view_finalize;
   object_class->get_property  = ggu_history_view_get_property;
   object_class->set_property  = ggu_history_view_set_property;
   
@@ -106,6 +120,14 @@ ggu_history_view_class_init (GguHistoryViewClass *klass)
                                                          TRUE,
                                                          G_PARAM_READWRITE |
                                                          G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (object_class,
+                                   PROP_STATS_COLUMN_VISIBLE,
+                                   g_param_spec_boolean ("stats-column-visible",
+                                                         "Stats column visible",
+                                                         "Whether the column of the lines added and removed is visible",
+                                                         TRUE,
+                                                         G_PARAM_READWRITE |
+                                                         G_PARAM_STATIC_STRINGS));
   
   g_type_class_add_private (klass, sizeof (GguHistoryViewPrivate));
 }
@@ -118,6 +140,10 @@ ggu_history_view_init (GguHistoryView *self)
   self->priv = G_TYPE_INSTANCE_GET_PRIVATE (self, GGU_TYPE_HISTORY_VIEW,
                                             GguHistoryViewPrivate);
   
+  self->priv->stats = NULL;
+  self->priv->tooltip_entry = NULL;
+  self->priv->tooltip_markup = NULL;
+  
   gtk_tree_view_set_headers_visible (GTK_TREE_VIEW (self), FALSE);
   gtk_widget_set_has_tooltip (GTK_WIDGET (self), TRUE);
   
@@ -137,11 +163,17 @@ ggu_history_view_init (GguHistoryView *self)
                                       cell,
                                       ggu_history_view_hash_cell_set_data_func,
                                       NULL, NULL);
+  ggu_tree_view_set_column_fixed_text (GGU_TREE_VIEW (self),
+                                       self->priv->hash_column, cell,
+                                       "0000000");
   gtk_tree_view_append_column (GTK_TREE_VIEW (self), self->priv->hash_column);
   
   /* summary column */
-  self->priv->summary_column = gtk_tree_view_column_new ();
-  gtk_tree_view_column_set_title (self->priv->summary_column, _("Summary"));
+  self->priv->summary_column = g_object_new (GTK_TYPE_TREE_VIEW_COLUMN,
+                                             "title", _("Summary"),
+                                             "sizing", GTK_TREE_VIEW_COLUMN_FIXED,
+                                             "expand", TRUE,
+                                             NULL);
   cell = g_object_new (GTK_TYPE_CELL_RENDERER_TEXT,
                        "ellipsize", PANGO_ELLIPSIZE_END,
                        NULL);
@@ -153,6 +185,46 @@ ggu_history_view_init (GguHistoryView *self)
                                       NULL, NULL);
   gtk_tree_view_append_column (GTK_TREE_VIEW (self),
                                self->priv->summary_column);
+  
+  /* stats column */
+  self->priv->stats_column = gtk_tree_view_column_new ();
+  gtk_tree_view_column_set_title (self->priv->stats_column, _("Changes"));
+  cell = g_object_new (GTK_TYPE_CELL_RENDERER_TEXT,
+                       "xalign", 1.0,
+                       "scale", PANGO_SCALE_SMALL,
+                       NULL);
+  gtk_cell_layout_pack_start (GTK_CELL_LAYOUT (self->priv->stats_column),
+                              cell, TRUE);
+  gtk_cell_layout_set_cell_data_func (GTK_CELL_LAYOUT (self->priv->stats_column),
+                                      cell,
+                                      ggu_history_view_stats_cell_set_data_func,
+                                      self, NULL);
+  ggu_tree_view_set_column_fixed_text (GGU_TREE_VIEW (self),
+                                       self->priv->stats_column, cell,
+                                       "+00000 -00000");
+  gtk_tree_view_append_column (GTK_TREE_VIEW (self), self->priv->stats_column);
+  
+  /* all rows have the same height, so only the visible ones are measured */
+  gtk_tree_view_set_fixed_height_mode (GTK_TREE_VIEW (self), TRUE);
+}
+
+static void
+ggu_history_view_finalize (GObject *object)
+{
+  GguHistoryView *self = GGU_HISTORY_VIEW (object);
+  
+  if (self->priv->stats) {
+    g_hash_table_unref (self->priv->stats);
+    self->priv->stats = NULL;
+  }
+  if (self->priv->tooltip_entry) {
+    ggu_git_log_entry_unref (self->priv->tooltip_entry);
+    self->priv->tooltip_entry = NULL;
+  }
+  g_free (self->priv->tooltip_markup);
+  self->priv->tooltip_markup = NULL;
+  
+  G_OBJECT_CLASS (ggu_history_view_parent_class)->finalize (object);
 }
 
 static void
@@ -168,6 +240,10 @@ ggu_history_view_get_property (GObject    *object,
       g_value_set_boolean (value, ggu_history_view_get_hash_column_visible (self));
       break;
     
+    case PROP_STATS_COLUMN_VISIBLE:
+      g_value_set_boolean (value, ggu_history_view_get_stats_column_visible (self));
+      break;
+    
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -187,6 +263,10 @@ ggu_history_view_set_property (GObject      *object,
       ggu_history_view_set_hash_column_visible (self, g_value_get_boolean (value));
       break;
     
+    case PROP_STATS_COLUMN_VISIBLE:
+      ggu_history_view_set_stats_column_visible (self, g_value_get_boolean (value));
+      break;
+    
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -201,6 +281,14 @@ hash_column_visible_activate_handler (GtkMenuItem    *item,
                                             gtk_check_menu_item_get_active (GTK_CHECK_MENU_ITEM (item)));
 }
 
+static void
+stats_column_visible_activate_handler (GtkMenuItem    *item,
+                                       GguHistoryView *self)
+{
+  ggu_history_view_set_stats_column_visible (self,
+                                             gtk_check_menu_item_get_active (GTK_CHECK_MENU_ITEM (item)));
+}
+
 static void
 ggu_history_view_populate_popup (GguTreeView *self,
                                  GtkTreePath *path,
@@ -217,6 +305,14 @@ ggu_history_view_populate_popup (GguTreeView *self,
                     G_CALLBACK (hash_column_visible_activate_handler), self);
   gtk_menu_shell_append (GTK_MENU_SHELL (menu), item);
   gtk_widget_show (item);
+  /* show stats column */
+  item = gtk_check_menu_item_new_with_mnemonic (_("Show _changes column"));
+  gtk_check_menu_item_set_active (GTK_CHECK_MENU_ITEM (item),
+                                  ggu_history_view_get_stats_column_visible (GGU_HISTORY_VIEW (self)));
+  g_signal_connect (item, "activate",
+                    G_CALLBACK (stats_column_visible_activate_handler), self);
+  gtk_menu_shell_append (GTK_MENU_SHELL (menu), item);
+  gtk_widget_show (item);
 }
 
 static gboolean
@@ -226,11 +322,12 @@ ggu_history_view_query_tooltip (GtkWidget  *widget,
                                 gboolean    keyboard_mode,
                                 GtkTooltip *tooltip)
 {
+  GguHistoryView *self = GGU_HISTORY_VIEW (widget);
   GtkTreeModel   *model;
   GtkTreePath    *path;
   GtkTreeIter     iter;
   GguGitLogEntry *entry;
-  gchar          *markup;
+  gchar           hex[GGU_GIT_OID_HEX_SIZE];
   
   if (! gtk_tree_view_get_tooltip_context (GTK_TREE_VIEW (widget),
                                            &x, &y, keyboard_mode,
@@ -239,23 +336,31 @@ ggu_history_view_query_tooltip (GtkWidget  *widget,
   }
   
   entry = ggu_history_store_get_entry (GGU_HISTORY_STORE (model), &iter);
+  if (entry != self->priv->tooltip_entry) {
+    if (self->priv->tooltip_entry) {
+      ggu_git_log_entry_unref (self->priv->tooltip_entry);
+    }
+    self->priv->tooltip_entry = ggu_git_log_entry_ref (entry);
+    g_free (self->priv->tooltip_markup);
 #if 1
-  markup = g_markup_printf_escaped ("%s\n"
-                                    "<small>"
-                                    "<b>hash:</b>\t%s\n"
-                                    "<b>date:</b>\t%s\n"
-                                    "<b>author:</b>\t%s"
-                                    "</small>",
-                                    entry->summary, entry->hash, entry->date,
-                                    entry->author);
+    self->priv->tooltip_markup = g_markup_printf_escaped ("%s\n"
+                                                          "<small>"
+                                                          "<b>hash:</b>\t%s\n"
+                                                          "<b>date:</b>\t%s\n"
+                                                          "<b>author:</b>\t%s"
+                                                          "</small>",
+                                                          entry->summary,
+                                                          ggu_git_oid_to_hex (entry->oid, hex),
+                                                          ggu_git_log_entry_get_date (entry),
+                                                          entry->author);
 #else
-  markup = g_markup_escape_text (entry->summary, -1);
+    self->priv->tooltip_markup = g_markup_escape_text (entry->summary, -1);
 #endif
+  }
   
-  gtk_tooltip_set_markup (tooltip, markup);
+  gtk_tooltip_set_markup (tooltip, self->priv->tooltip_markup);
   gtk_tree_view_set_tooltip_row (GTK_TREE_VIEW (widget), tooltip, path);
   
-  g_free (markup);
   gtk_tree_path_free (path);
   
   return TRUE;
@@ -270,13 +375,9 @@ ggu_history_view_hash_cell_set_data_func (GtkCellLayout   *cell_layout,
                                           gpointer         data)
 {
   GguGitLogEntry *entry;
-  GValue          value = { 0 };
   
   entry = ggu_history_store_get_entry (GGU_HISTORY_STORE (model), iter);
-  g_value_init (&value, G_TYPE_STRING);
-  g_value_take_string (&value, g_strndup (entry->hash, 7));
-  g_object_set_property (G_OBJECT (cell), "text", &value);
-  g_value_unset (&value);
+  g_object_set (G_OBJECT (cell), "text", entry->short_hash, NULL);
 }
 
 static void
@@ -292,6 +393,25 @@ ggu_history_view_summary_cell_set_data_func (GtkCellLayout   *cell_layout,
   g_object_set (G_OBJECT (cell), "text", entry->summary, NULL);
 }
 
+/* renders the lines added and removed, if they are known yet */
+static void
+ggu_history_view_stats_cell_set_data_func (GtkCellLayout   *cell_layout,
+                                           GtkCellRenderer *cell,
+                                           GtkTreeModel    *model,
+                                           GtkTreeIter     *iter,
+                                           gpointer         data)
+{
+  GguHistoryView *self = data;
+  GguGitLogEntry *entry;
+  const gchar    *text = NULL;
+  
+  entry = ggu_history_store_get_entry (GGU_HISTORY_STORE (model), iter);
+  if (self->priv->stats) {
+    text = g_hash_table_lookup (self->priv->stats, entry->oid);
+  }
+  g_object_set (G_OBJECT (cell), "text", text ? text : "", NULL);
+}
+
 static gboolean
 ggu_history_view_search_equal_func (GtkTreeModel *model,
                                     gint          column,
@@ -300,10 +420,11 @@ ggu_history_view_search_equal_func (GtkTreeModel *model,
                                     gpointer      data)
 {
   GguGitLogEntry *entry;
+  gchar           hex[GGU_GIT_OID_HEX_SIZE];
   
   /* no need to bother about the column, GguHistoryStore has only one anyway */
   entry = ggu_history_store_get_entry (GGU_HISTORY_STORE (model), iter);
-  return g_str_has_prefix (entry->hash, key) == FALSE;
+  return g_str_has_prefix (ggu_git_oid_to_hex (entry->oid, hex), key) == FALSE;
 }
 
 
@@ -334,3 +455,82 @@ ggu_history_view_set_hash_column_visible (GguHistoryView *self,
     g_object_notify (G_OBJECT (self), "hash-column-visible");
   }
 }
+
+gboolean
+ggu_history_view_get_stats_column_visible (GguHistoryView *self)
+{
+  g_return_val_if_fail (GGU_IS_HISTORY_VIEW (self), FALSE);
+  
+  return gtk_tree_view_column_get_visible (self->priv->stats_column);
+}
+
+void
+ggu_history_view_set_stats_column_visible (GguHistoryView *self,
+                                           gboolean        visible)
+{
+  g_return_if_fail (GGU_IS_HISTORY_VIEW (self));
+  
+  if (gtk_tree_view_column_get_visible (self->priv->stats_column) != visible) {
+    gtk_tree_view_column_set_visible (self->priv->stats_column, visible);
+    g_object_notify (G_OBJECT (self), "stats-column-visible");
+  }
+}
+
+/**
+ * ggu_history_view_set_stats:
+ * @self: A #GguHistoryView
+ * @stats: (element-type GguGitOid utf8) (allow-none): A table mapping
+ *         interned commit IDs to the text to show in the changes column, or
+ *         %NULL
+ * 
+ * Sets where the view finds the lines added and removed by the commits it
+ * shows, already formatted for display.  Commits missing from @stats show no
+ * changes, and the view has to be redrawn when @stats gets new ones.
+ */
+void
+ggu_history_view_set_stats (GguHistoryView *self,
+                            GHashTable     *stats)
+{
+  g_return_if_fail (GGU_IS_HISTORY_VIEW (self));
+  
+  if (stats != self->priv->stats) {
+    if (self->priv->stats) {
+      g_hash_table_unref (self->priv->stats);
+    }
+    self->priv->stats = stats ? g_hash_table_ref (stats) : NULL;
+    gtk_widget_queue_draw (GTK_WIDGET (self));
+  }
+}
+
+/**
+ * ggu_history_view_get_n_visible_rows:
+ * @self: A #GguHistoryView
+ * 
+ * Gets how many rows fit in the visible area of the view, e.g. how many
+ * entries are needed to fill it.
+ * 
+ * Returns: The number of rows that fit in the view
+ */
+guint
+ggu_history_view_get_n_visible_rows (GguHistoryView *self)
+{
+  GdkRectangle  visible;
+  gint          row_height = 0;
+  gint          separator = 0;
+  
+  g_return_val_if_fail (GGU_IS_HISTORY_VIEW (self), 0);
+  
+  gtk_tree_view_get_visible_rect (GTK_TREE_VIEW (self), &visible);
+  gtk_tree_view_column_cell_get_size (self->priv->summary_column, NULL,
+                                      NULL, NULL, NULL, &row_height);
+  gtk_widget_style_get (GTK_WIDGET (self),
+                        "vertical-separator", &separator,
+                        NULL);
+  row_height += separator;
+  
+  if (row_height <= 0 || visible.height <= 0) {
+    return 0;
+  }
+  
+  return (guint) ((visible.height + row_height - 1) / row_height);
+}
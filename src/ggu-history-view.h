@@ -60,6 +60,12 @@ GtkWidget    *ggu_history_view_new                          (GguHistoryStore *mo
 gboolean      ggu_history_view_get_hash_column_visible      (GguHistoryView *self);
 void          ggu_history_view_set_hash_column_visible      (GguHistoryView *self,
                                                              gboolean        visible);
+gboolean      ggu_history_view_get_stats_column_visible     (GguHistoryView *self);
+void          ggu_history_view_set_stats_column_visible     (GguHistoryView *self,
+                                                             gboolean        visible);
+void          ggu_history_view_set_stats                    (GguHistoryView *self,
+                                                             GHashTable     *stats);
+guint         ggu_history_view_get_n_visible_rows           (GguHistoryView *self);
 
 
 G_END_DECLS
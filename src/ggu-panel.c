@@ -86,6 +86,36 @@ create_small_title_label (const gchar *text)
   return label;
 }
 
+/* history paging: pages are sized so fetching one takes about
+ * HISTORY_PAGE_TIME microseconds, and the next one is fetched when there is
+ * less than a screen of entries left below the visible ones */
+#define HISTORY_PAGE_TIME     (G_USEC_PER_SEC / 10)
+#define HISTORY_PAGE_MIN_SIZE 32
+#define HISTORY_PAGE_MAX_SIZE 4096
+/* time spent inserting history entries before letting GTK redraw */
+#define HISTORY_INSERT_TIME   (G_USEC_PER_SEC / 120)
+#define HISTORY_INSERT_CHUNK  64
+/* commit messages are loaded on demand, for the selected commit and the ones
+ * around it in the history */
+#define DETAILS_BATCH_SIZE    32
+/* what is fetched for the selected commit waits for the selection to stay
+ * the same this many milliseconds, so moving it quickly doesn't start and
+ * cancel a load for each row.  the changes of this many commits on each
+ * side of it are then fetched in the background */
+#define SELECTION_DELAY       150
+#define PREFETCH_COUNT        4
+/* commits changing more files than this are shown as a tree of directories
+ * even when the user didn't ask for it, a list would be too long to use */
+#define FILES_CHANGED_LIST_MAX 1000
+
+enum
+{
+  PROP_0,
+  
+  PROP_SELECTION_DELAY,
+  PROP_PREFETCH_COUNT
+};
+
 enum
 {
   BRANCH_CURRENT,
@@ -104,12 +134,31 @@ struct _GguPanelPrivate
   
   GguGitLog        *logger;
   GCancellable     *log_cancellable;
+  gboolean          log_loading;
+  gint64            log_page_start;
+  guint             log_page_n_signaled;
+  gchar            *log_rev;
+  guint             log_n_loaded;   /* entries in the complete pages */
+  GguGitShow       *stats_loader;
+  GCancellable     *stats_cancellable;
+  GHashTable       *history_stats;  /* GguGitOid -> displayed changes */
+  GQueue            history_pending; /* entries waiting to be inserted */
+  guint             history_insert_id;
   GguGitBranch     *brancher;
   GCancellable     *branch_cancellable;
   GguGitShow       *shower;
   GCancellable     *show_cancellable;
   GguGitShow       *changed_files_lister;
   GCancellable     *changed_files_list_cancellable;
+  GguGitLog        *details_loader;
+  GCancellable     *details_cancellable;
+  gint              details_start;  /* history rows being loaded, */
+  gint              details_end;    /* from start to end excluded */
+  guint             selection_delay;
+  guint             selection_update_id;
+  guint             prefetch_count;
+  GguGitShow       *prefetcher;
+  GCancellable     *prefetch_cancellable;
   
   GtkWidget        *loading_spinner;
   GtkWidget        *file_path; /* FIXME: use a custom widget that shows repo root/current path */
@@ -128,6 +177,8 @@ struct _GguPanelPrivate
   GtkTextBuffer    *commit_message_buffer;
   GguFilesChangedStore *commit_files_changed_store;
   GtkWidget        *commit_files_changed_view;
+  GtkWidget        *commit_files_changed_filter;
+  gboolean          files_changed_tree; /* whether the user wants trees */
   
   /* message displaying */
   GtkWidget        *message_area;
@@ -143,9 +194,31 @@ static void       ggu_panel_show_rev                        (GguPanel      *self
                                                              GeanyDocument *doc);
 static void       ggu_panel_update_history                  (GguPanel    *self,
                                                              const gchar *rev);
+static void       ggu_panel_clear_history                   (GguPanel *self);
+static void       ggu_panel_clear_history_pending           (GguPanel *self);
+static void       ggu_panel_drop_logger                     (GguPanel *self);
+static void       ggu_panel_load_more_history               (GguPanel *self);
+static void       ggu_panel_load_history_stats              (GguPanel *self,
+                                                             guint     skip,
+                                                             guint     count);
 static void       ggu_panel_update_branch_list              (GguPanel *self);
+static void       ggu_panel_clear_changed_files_list        (GguPanel *self);
 static void       ggu_panel_update_changed_files_list       (GguPanel    *self,
                                                              const gchar *rev);
+static void       ggu_panel_prefetch_changed_files_lists    (GguPanel    *self,
+                                                             GtkTreePath *path);
+static void       ggu_panel_load_details                    (GguPanel    *self,
+                                                             GtkTreePath *path);
+static void       ggu_panel_cancel_load_details             (GguPanel *self);
+static void       ggu_panel_cancel_selection_update         (GguPanel *self);
+static void       ggu_panel_get_property                    (GObject    *object,
+                                                             guint       prop_id,
+                                                             GValue     *value,
+                                                             GParamSpec *pspec);
+static void       ggu_panel_set_property                    (GObject      *object,
+                                                             guint         prop_id,
+                                                             const GValue *value,
+                                                             GParamSpec   *pspec);
 
 static void       history_view_selection_changed_handler    (GtkTreeSelection *selection,
                                                              GguPanel         *self);
@@ -154,6 +227,8 @@ static void       history_view_populate_popup_handler       (GguHistoryView *vie
                                                              GtkTreeIter    *iter,
                                                              GtkMenu        *menu,
                                                              GguPanel       *self);
+static void       history_view_adjustment_changed_handler   (GtkAdjustment *adjustment,
+                                                             GguPanel      *self);
 static void       branch_combo_changed_handler              (GtkComboBox *combo,
                                                              GguPanel    *self);
 static void       files_changed_view_populate_popup_handler (GguFilesChangedView *view,
@@ -165,6 +240,8 @@ static void       files_changed_view_row_activated_handler  (GtkTreeView       *
                                                              GtkTreePath       *path,
                                                              GtkTreeViewColumn *column,
                                                              GguPanel          *self);
+static void       files_changed_filter_changed_handler      (GtkEditable *editable,
+                                                             GguPanel    *self);
 
 
 G_DEFINE_TYPE (GguPanel,
@@ -179,14 +256,27 @@ ggu_panel_finalize (GObject *object)
   
   GGU_USPTR (self->priv->root);
   GGU_USPTR (self->priv->path);
-  GGU_USOPTR (self->priv->logger);
+  ggu_panel_clear_history_pending (self);
+  ggu_panel_drop_logger (self);
   GGU_USOPTR (self->priv->log_cancellable);
+  GGU_USPTR (self->priv->log_rev);
+  GGU_USOPTR (self->priv->stats_loader);
+  GGU_USOPTR (self->priv->stats_cancellable);
+  if (self->priv->history_stats) {
+    g_hash_table_unref (self->priv->history_stats);
+    self->priv->history_stats = NULL;
+  }
   GGU_USOPTR (self->priv->brancher);
   GGU_USOPTR (self->priv->branch_cancellable);
   GGU_USOPTR (self->priv->shower);
   GGU_USOPTR (self->priv->show_cancellable);
   GGU_USOPTR (self->priv->changed_files_lister);
   GGU_USOPTR (self->priv->changed_files_list_cancellable);
+  GGU_USOPTR (self->priv->details_loader);
+  GGU_USOPTR (self->priv->details_cancellable);
+  ggu_panel_cancel_selection_update (self);
+  GGU_USOPTR (self->priv->prefetcher);
+  GGU_USOPTR (self->priv->prefetch_cancellable);
   
   G_OBJECT_CLASS (ggu_panel_parent_class)->finalize (object);
 }
@@ -197,11 +287,32 @@ ggu_panel_class_init (GguPanelClass *klass)
   GObjectClass   *object_class = G_OBJECT_CLASS (klass);
   GtkWidgetClass *widget_class = GTK_WIDGET_CLASS (klass);
   
-  object_class->finalize = ggu_panel_finalize;
+  object_class->finalize      = ggu_panel_finalize;
+  object_class->get_property  = ggu_panel_get_property;
+  object_class->set_property  = ggu_panel_set_property;
   
   widget_class->show_all = gtk_widget_show;
   widget_class->hide_all = gtk_widget_hide;
   
+  g_object_class_install_property (object_class,
+                                   PROP_SELECTION_DELAY,
+                                   g_param_spec_uint ("selection-delay",
+                                                      "Selection delay",
+                                                      "Milliseconds the history selection has to stay the same before the commit's data is fetched",
+                                                      0, G_MAXUINT,
+                                                      SELECTION_DELAY,
+                                                      G_PARAM_READWRITE |
+                                                      G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (object_class,
+                                   PROP_PREFETCH_COUNT,
+                                   g_param_spec_uint ("prefetch-count",
+                                                      "Prefetch count",
+                                                      "Number of commits on each side of the selected one whose changes are fetched in the background",
+                                                      0, DETAILS_BATCH_SIZE,
+                                                      PREFETCH_COUNT,
+                                                      G_PARAM_READWRITE |
+                                                      G_PARAM_STATIC_STRINGS));
+  
   g_type_class_add_private (klass, sizeof (GguPanelPrivate));
 }
 
@@ -218,6 +329,7 @@ ggu_panel_init (GguPanel *self)
   GtkWidget          *label;
   GtkCellRenderer    *cell;
   GtkTreeSelection   *selection;
+  GtkAdjustment      *adjustment;
   PangoAttrList      *attrs;
   GtkWidget          *commit_message_view;
   
@@ -230,12 +342,35 @@ ggu_panel_init (GguPanel *self)
   self->priv->loading_count = 0;
   self->priv->logger = NULL;
   self->priv->log_cancellable = g_cancellable_new ();
+  self->priv->log_loading = FALSE;
+  self->priv->log_page_start = 0;
+  self->priv->log_page_n_signaled = 0;
+  self->priv->log_rev = NULL;
+  self->priv->log_n_loaded = 0;
+  self->priv->stats_loader = NULL;
+  self->priv->stats_cancellable = g_cancellable_new ();
+  self->priv->history_stats = g_hash_table_new_full (g_direct_hash,
+                                                     g_direct_equal,
+                                                     (GDestroyNotify) ggu_git_oid_unref,
+                                                     g_free);
+  g_queue_init (&self->priv->history_pending);
+  self->priv->history_insert_id = 0;
   self->priv->brancher = NULL;
   self->priv->branch_cancellable = g_cancellable_new ();
   self->priv->shower = NULL;
   self->priv->show_cancellable = g_cancellable_new ();
   self->priv->changed_files_lister = NULL;
   self->priv->changed_files_list_cancellable = g_cancellable_new ();
+  self->priv->details_loader = NULL;
+  self->priv->details_cancellable = g_cancellable_new ();
+  self->priv->details_start = 0;
+  self->priv->details_end = 0;
+  self->priv->selection_delay = SELECTION_DELAY;
+  self->priv->selection_update_id = 0;
+  self->priv->prefetch_count = PREFETCH_COUNT;
+  self->priv->prefetcher = NULL;
+  self->priv->prefetch_cancellable = g_cancellable_new ();
+  self->priv->files_changed_tree = FALSE;
   
   /* file path and spinner */
   hbox = gtk_hbox_new (FALSE, 6);
@@ -298,12 +433,20 @@ ggu_panel_init (GguPanel *self)
   self->priv->history_view = ggu_history_view_new (self->priv->history_store);
   gtk_tree_view_set_search_column (GTK_TREE_VIEW (self->priv->history_view),
                                    GGU_HISTORY_STORE_COLUMN_ENTRY);
+  ggu_history_view_set_stats (GGU_HISTORY_VIEW (self->priv->history_view),
+                              self->priv->history_stats);
   g_signal_connect_after (self->priv->history_view, "populate-popup",
                           G_CALLBACK (history_view_populate_popup_handler), self);
   gtk_container_add (GTK_CONTAINER (scrolled), self->priv->history_view);
   selection = gtk_tree_view_get_selection (GTK_TREE_VIEW (self->priv->history_view));
   g_signal_connect (selection, "changed",
                     G_CALLBACK (history_view_selection_changed_handler), self);
+  /* load more history when scrolling near the end */
+  adjustment = gtk_scrolled_window_get_vadjustment (GTK_SCROLLED_WINDOW (scrolled));
+  g_signal_connect (adjustment, "value-changed",
+                    G_CALLBACK (history_view_adjustment_changed_handler), self);
+  g_signal_connect (adjustment, "changed",
+                    G_CALLBACK (history_view_adjustment_changed_handler), self);
   
   /* ...and the second pane content */
   self->priv->commit_container = gtk_vbox_new (FALSE, 0);
@@ -358,13 +501,22 @@ ggu_panel_init (GguPanel *self)
   gtk_container_add (GTK_CONTAINER (scrolled), commit_message_view);
   
   /* the files changed */
+  vbox = gtk_vbox_new (FALSE, 2);
+  gtk_notebook_append_page (GTK_NOTEBOOK (notebook),
+                            vbox, gtk_label_new (_("Changes")));
+  self->priv->commit_files_changed_filter = gtk_entry_new ();
+  gtk_widget_set_tooltip_text (self->priv->commit_files_changed_filter,
+                               _("Only show the files whose path starts with this"));
+  g_signal_connect (self->priv->commit_files_changed_filter, "changed",
+                    G_CALLBACK (files_changed_filter_changed_handler), self);
+  gtk_box_pack_start (GTK_BOX (vbox), self->priv->commit_files_changed_filter,
+                      FALSE, TRUE, 0);
   scrolled = g_object_new (GTK_TYPE_SCROLLED_WINDOW,
                            "hscrollbar-policy", GTK_POLICY_AUTOMATIC,
                            "vscrollbar-policy", GTK_POLICY_AUTOMATIC,
                            "shadow-type", GTK_SHADOW_IN,
                            NULL);
-  gtk_notebook_append_page (GTK_NOTEBOOK (notebook),
-                            scrolled, gtk_label_new (_("Changes")));
+  gtk_box_pack_start (GTK_BOX (vbox), scrolled, TRUE, TRUE, 0);
   self->priv->commit_files_changed_store = ggu_files_changed_store_new ();
   self->priv->commit_files_changed_view = ggu_files_changed_view_new (self->priv->commit_files_changed_store);
   g_signal_connect (self->priv->commit_files_changed_view, "populate-popup",
@@ -394,6 +546,52 @@ ggu_panel_init (GguPanel *self)
   gtk_widget_set_sensitive (self->priv->branch_switch, FALSE);
 }
 
+static void
+ggu_panel_get_property (GObject    *object,
+                        guint       prop_id,
+                        GValue     *value,
+                        GParamSpec *pspec)
+{
+  GguPanel *self = GGU_PANEL (object);
+  
+  switch (prop_id) {
+    case PROP_SELECTION_DELAY:
+      g_value_set_uint (value, self->priv->selection_delay);
+      break;
+    
+    case PROP_PREFETCH_COUNT:
+      g_value_set_uint (value, self->priv->prefetch_count);
+      break;
+    
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+ggu_panel_set_property (GObject      *object,
+                        guint         prop_id,
+                        const GValue *value,
+                        GParamSpec   *pspec)
+{
+  GguPanel *self = GGU_PANEL (object);
+  
+  switch (prop_id) {
+    case PROP_SELECTION_DELAY:
+      self->priv->selection_delay = g_value_get_uint (value);
+      break;
+    
+    case PROP_PREFETCH_COUNT:
+      self->priv->prefetch_count = g_value_get_uint (value);
+      break;
+    
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
 /* tells that a loading operation has started
  * if it is the first operation, reports to the user the loading started */
 static void
@@ -455,9 +653,11 @@ show_commit_diff_activate_handler (GtkMenuItem *item,
                                    GguPanel    *self)
 {
   GguGitLogEntry *entry;
+  gchar           hex[GGU_GIT_OID_HEX_SIZE];
   
   entry = g_object_get_data (G_OBJECT (item), LOG_ENTRY_KEY);
-  ggu_panel_show_rev (self, NULL, entry->hash, TRUE, NULL);
+  ggu_panel_show_rev (self, NULL, ggu_git_oid_to_hex (entry->oid, hex), TRUE,
+                      NULL);
 }
 
 static void
@@ -465,9 +665,11 @@ show_diff_activate_handler (GtkMenuItem *item,
                             GguPanel    *self)
 {
   GguGitLogEntry *entry;
+  gchar           hex[GGU_GIT_OID_HEX_SIZE];
   
   entry = g_object_get_data (G_OBJECT (item), LOG_ENTRY_KEY);
-  ggu_panel_show_rev (self, self->priv->path, entry->hash, TRUE, NULL);
+  ggu_panel_show_rev (self, self->priv->path,
+                      ggu_git_oid_to_hex (entry->oid, hex), TRUE, NULL);
 }
 
 static void
@@ -475,9 +677,11 @@ show_content_activate_handler (GtkMenuItem *item,
                                GguPanel    *self)
 {
   GguGitLogEntry *entry;
+  gchar           hex[GGU_GIT_OID_HEX_SIZE];
   
   entry = g_object_get_data (G_OBJECT (item), LOG_ENTRY_KEY);
-  ggu_panel_show_rev (self, self->priv->path, entry->hash, FALSE, NULL);
+  ggu_panel_show_rev (self, self->priv->path,
+                      ggu_git_oid_to_hex (entry->oid, hex), FALSE, NULL);
 }
 
 static void
@@ -485,9 +689,11 @@ replace_content_activate_handler (GtkMenuItem *item,
                                   GguPanel    *self)
 {
   GguGitLogEntry *entry;
+  gchar           hex[GGU_GIT_OID_HEX_SIZE];
   
   entry = g_object_get_data (G_OBJECT (item), LOG_ENTRY_KEY);
-  ggu_panel_show_rev (self, self->priv->path, entry->hash, FALSE,
+  ggu_panel_show_rev (self, self->priv->path,
+                      ggu_git_oid_to_hex (entry->oid, hex), FALSE,
                       self->priv->doc);
 }
 
@@ -586,6 +792,39 @@ ensure_tree_selection_visible_callback (gpointer view)
   return FALSE;
 }
 
+/* fetches what the selected commit's display is missing, once the selection
+ * stayed the same long enough */
+static gboolean
+selection_update_timeout (gpointer data)
+{
+  GguPanel         *self = data;
+  GtkTreeSelection *selection;
+  GtkTreeModel     *model;
+  GtkTreeIter       iter;
+  
+  self->priv->selection_update_id = 0;
+  
+  selection = gtk_tree_view_get_selection (GTK_TREE_VIEW (self->priv->history_view));
+  if (gtk_tree_selection_get_selected (selection, &model, &iter)) {
+    GguGitLogEntry *entry;
+    GtkTreePath    *path;
+    gchar           hex[GGU_GIT_OID_HEX_SIZE];
+    
+    entry = ggu_history_store_get_entry (GGU_HISTORY_STORE (model), &iter);
+    path = gtk_tree_model_get_path (model, &iter);
+    
+    ggu_panel_update_changed_files_list (self,
+                                         ggu_git_oid_to_hex (entry->oid, hex));
+    if (! entry->details) {
+      ggu_panel_load_details (self, path);
+    }
+    ggu_panel_prefetch_changed_files_lists (self, path);
+    gtk_tree_path_free (path);
+  }
+  
+  return FALSE;
+}
+
 static void
 history_view_selection_changed_handler (GtkTreeSelection *selection,
                                         GguPanel         *self)
@@ -595,16 +834,28 @@ history_view_selection_changed_handler (GtkTreeSelection *selection,
   
   if (gtk_tree_selection_get_selected (selection, &model, &iter)) {
     GguGitLogEntry *entry;
+    gchar           hex[GGU_GIT_OID_HEX_SIZE];
     
     entry = ggu_history_store_get_entry (GGU_HISTORY_STORE (model), &iter);
     
-    ggu_panel_update_changed_files_list (self, entry->hash);
-    
-    gtk_label_set_text (GTK_LABEL (self->priv->commit_hash), entry->hash);
-    gtk_label_set_text (GTK_LABEL (self->priv->commit_date), entry->date);
+    /* show what we already know right away, and fetch the rest once the
+     * selection settles */
+    gtk_label_set_text (GTK_LABEL (self->priv->commit_hash),
+                        ggu_git_oid_to_hex (entry->oid, hex));
+    gtk_label_set_text (GTK_LABEL (self->priv->commit_date),
+                        ggu_git_log_entry_get_date (entry));
     gtk_label_set_text (GTK_LABEL (self->priv->commit_author), entry->author);
     gtk_text_buffer_set_text (self->priv->commit_message_buffer,
-                              entry->details, -1);
+                              entry->details ? entry->details : "", -1);
+    ggu_panel_clear_changed_files_list (self);
+    ggu_panel_cancel_selection_update (self);
+    if (self->priv->selection_delay > 0) {
+      self->priv->selection_update_id = g_timeout_add (self->priv->selection_delay,
+                                                       selection_update_timeout,
+                                                       self);
+    } else {
+      selection_update_timeout (self);
+    }
     
     if (! gtk_widget_get_visible (self->priv->commit_container)) {
       gtk_widget_show (self->priv->commit_container);
@@ -612,6 +863,7 @@ history_view_selection_changed_handler (GtkTreeSelection *selection,
                   self->priv->history_view);
     }
   } else {
+    ggu_panel_cancel_selection_update (self);
     gtk_widget_hide (self->priv->commit_container);
   }
 }
@@ -622,7 +874,7 @@ branch_combo_changed_handler (GtkComboBox *combo,
 {
   GtkTreeIter iter;
   
-  gtk_list_store_clear (GTK_LIST_STORE (self->priv->history_store));
+  ggu_panel_clear_history (self);
   gtk_widget_set_sensitive (self->priv->branch_switch, FALSE);
   if (gtk_combo_box_get_active_iter (combo, &iter)) {
     gchar  *branch;
@@ -651,8 +903,10 @@ files_changed_view_show_diff_activate_handler (GtkMenuItem *item,
 {
   GguGitFilesChangedEntry *entry = g_object_get_data (G_OBJECT (item),
                                                       FILES_CHANGED_ENTRY_KEY);
+  gchar                    hex[GGU_GIT_OID_HEX_SIZE];
   
-  ggu_panel_show_rev (self, entry->path, entry->hash, TRUE, NULL);
+  ggu_panel_show_rev (self, entry->path, ggu_git_oid_to_hex (entry->oid, hex),
+                      TRUE, NULL);
 }
 
 static void
@@ -661,8 +915,10 @@ files_changed_view_show_content_activate_handler (GtkMenuItem *item,
 {
   GguGitFilesChangedEntry *entry = g_object_get_data (G_OBJECT (item),
                                                       FILES_CHANGED_ENTRY_KEY);
+  gchar                    hex[GGU_GIT_OID_HEX_SIZE];
   
-  ggu_panel_show_rev (self, entry->path, entry->hash, FALSE, NULL);
+  ggu_panel_show_rev (self, entry->path, ggu_git_oid_to_hex (entry->oid, hex),
+                      FALSE, NULL);
 }
 
 static void
@@ -675,6 +931,15 @@ files_changed_view_open_activate_handler (GtkMenuItem *item,
   ggu_panel_open_repository_file (self, entry->path);
 }
 
+static void
+files_changed_view_tree_mode_activate_handler (GtkMenuItem *item,
+                                               GguPanel    *self)
+{
+  self->priv->files_changed_tree = gtk_check_menu_item_get_active (GTK_CHECK_MENU_ITEM (item));
+  ggu_files_changed_store_set_tree_mode (self->priv->commit_files_changed_store,
+                                         self->priv->files_changed_tree);
+}
+
 static GtkWidget *
 files_changed_view_create_popup_menu_item (GguPanel                *self,
                                            const gchar             *mnemonic,
@@ -732,6 +997,16 @@ files_changed_view_populate_popup_handler (GguFilesChangedView *view,
                                  gtk_image_new_from_stock (GTK_STOCK_OPEN,
                                                            GTK_ICON_SIZE_MENU));
   gtk_menu_shell_append (GTK_MENU_SHELL (menu), item);
+  /* <sep> */
+  gtk_menu_shell_append (GTK_MENU_SHELL (menu), gtk_separator_menu_item_new ());
+  /* show as tree */
+  item = gtk_check_menu_item_new_with_mnemonic (_("Show as _tree"));
+  gtk_check_menu_item_set_active (GTK_CHECK_MENU_ITEM (item),
+                                  ggu_files_changed_store_get_tree_mode (self->priv->commit_files_changed_store));
+  g_signal_connect (item, "activate",
+                    G_CALLBACK (files_changed_view_tree_mode_activate_handler),
+                    self);
+  gtk_menu_shell_append (GTK_MENU_SHELL (menu), item);
   
   gtk_widget_show_all (GTK_WIDGET (menu));
 }
@@ -745,10 +1020,26 @@ files_changed_view_row_activated_handler (GtkTreeView       *view,
   GtkTreeIter               iter;
   GguGitFilesChangedEntry  *entry;
   GguFilesChangedStore     *store = self->priv->commit_files_changed_store;
+  gchar                     hex[GGU_GIT_OID_HEX_SIZE];
   
   gtk_tree_model_get_iter (GTK_TREE_MODEL (store), &iter, path);
   entry = ggu_files_changed_store_get_entry (store, &iter);
-  ggu_panel_show_rev (self, entry->path, entry->hash, TRUE, NULL);
+  if (entry) {
+    ggu_panel_show_rev (self, entry->path,
+                        ggu_git_oid_to_hex (entry->oid, hex), TRUE, NULL);
+  } else if (gtk_tree_view_row_expanded (view, path)) {
+    gtk_tree_view_collapse_row (view, path);
+  } else {
+    gtk_tree_view_expand_row (view, path, FALSE);
+  }
+}
+
+static void
+files_changed_filter_changed_handler (GtkEditable *editable,
+                                      GguPanel    *self)
+{
+  ggu_files_changed_store_set_filter (self->priv->commit_files_changed_store,
+                                      gtk_entry_get_text (GTK_ENTRY (editable)));
 }
 
 static void
@@ -887,6 +1178,100 @@ ggu_panel_show_rev (GguPanel       *self,
                            ggu_panel_show_rev_async_finished_handler, self);
 }
 
+/* sizes the next history page from how fast the last one was fetched */
+static void
+ggu_panel_update_history_page_size (GguPanel *self,
+                                    guint     n_entries)
+{
+  gint64  elapsed = g_get_monotonic_time () - self->priv->log_page_start;
+  guint   size;
+  
+  if (n_entries == 0) {
+    return;
+  }
+  
+  size = (guint) MIN (HISTORY_PAGE_MAX_SIZE,
+                      n_entries * HISTORY_PAGE_TIME / MAX (elapsed, 1));
+  g_object_set (self->priv->logger,
+                "max-count", MAX (size, HISTORY_PAGE_MIN_SIZE),
+                NULL);
+}
+
+/* inserts pending history entries for at most HISTORY_INSERT_TIME, so the
+ * UI is still redrawn and responsive while inserting lots of entries */
+static gboolean
+history_insert_idle (gpointer data)
+{
+  GguPanel *self = data;
+  gint64    deadline = g_get_monotonic_time () + HISTORY_INSERT_TIME;
+  
+  do {
+    GguGitLogEntry *entries[HISTORY_INSERT_CHUNK];
+    guint           n;
+    
+    for (n = 0; n < G_N_ELEMENTS (entries); n++) {
+      entries[n] = g_queue_pop_head (&self->priv->history_pending);
+      if (! entries[n]) {
+        break;
+      }
+    }
+    if (n == 0) {
+      break;
+    }
+    ggu_history_store_append_entries (self->priv->history_store, entries, n);
+    while (n > 0) {
+      ggu_git_log_entry_unref (entries[--n]);
+    }
+  } while (g_get_monotonic_time () < deadline);
+  
+  if (! g_queue_is_empty (&self->priv->history_pending)) {
+    return TRUE;
+  }
+  
+  self->priv->history_insert_id = 0;
+  /* the history might not be enough to fill the view */
+  ggu_panel_load_more_history (self);
+  
+  return FALSE;
+}
+
+static void
+ggu_panel_queue_history_entry (GguPanel       *self,
+                               GguGitLogEntry *entry)
+{
+  g_queue_push_tail (&self->priv->history_pending,
+                     ggu_git_log_entry_ref (entry));
+  if (! self->priv->history_insert_id) {
+    /* lower priority than redrawing */
+    self->priv->history_insert_id = g_idle_add_full (G_PRIORITY_DEFAULT_IDLE,
+                                                     history_insert_idle,
+                                                     self, NULL);
+  }
+}
+
+static void
+ggu_panel_clear_history_pending (GguPanel *self)
+{
+  if (self->priv->history_insert_id) {
+    g_source_remove (self->priv->history_insert_id);
+    self->priv->history_insert_id = 0;
+  }
+  while (! g_queue_is_empty (&self->priv->history_pending)) {
+    ggu_git_log_entry_unref (g_queue_pop_head (&self->priv->history_pending));
+  }
+}
+
+static void
+history_entries_added_handler (GguGitLog *logger,
+                               GList     *entries,
+                               GguPanel  *self)
+{
+  for (; entries; entries = entries->next) {
+    ggu_panel_queue_history_entry (self, entries->data);
+    self->priv->log_page_n_signaled++;
+  }
+}
+
 static void
 ggu_panel_update_history_async_finished_handler (GObject      *object,
                                                  GAsyncResult *result,
@@ -905,6 +1290,7 @@ ggu_panel_update_history_async_finished_handler (GObject      *object,
     return;
   }
   
+  self->priv->log_loading = FALSE;
   entries = ggu_git_log_log_finish (GGU_GIT_LOG (object), result, &error);
   if (error) {
     if (error->domain != G_IO_ERROR || error->code != G_IO_ERROR_CANCELLED) {
@@ -912,22 +1298,71 @@ ggu_panel_update_history_async_finished_handler (GObject      *object,
                               "History update failed", "%s", error->message);
     }
     g_error_free (error);
+    /* don't try to load more */
+    ggu_panel_drop_logger (self);
   } else {
+    guint n_entries = g_list_length (entries);
+    
+    ggu_panel_update_history_page_size (self, n_entries);
+    ggu_panel_load_history_stats (self, self->priv->log_n_loaded, n_entries);
+    self->priv->log_n_loaded += n_entries;
+    /* most entries were already queued as they were signaled */
+    entries = g_list_nth (entries, self->priv->log_page_n_signaled);
     for (; entries; entries = entries->next) {
-      ggu_history_store_append (self->priv->history_store, entries->data);
+      ggu_panel_queue_history_entry (self, entries->data);
     }
+    ggu_panel_load_more_history (self);
+  }
+}
+
+static void
+ggu_panel_drop_logger (GguPanel *self)
+{
+  if (self->priv->logger) {
+    g_signal_handlers_disconnect_by_func (self->priv->logger,
+                                          history_entries_added_handler,
+                                          self);
+    GGU_USOPTR (self->priv->logger);
   }
 }
 
+static void
+ggu_panel_clear_history (GguPanel *self)
+{
+  g_cancellable_cancel (self->priv->log_cancellable);
+  ggu_panel_drop_logger (self);
+  ggu_panel_clear_history_pending (self);
+  ggu_panel_cancel_load_details (self);
+  ggu_panel_cancel_selection_update (self);
+  g_cancellable_cancel (self->priv->stats_cancellable);
+  GGU_USOPTR (self->priv->stats_loader);
+  g_hash_table_remove_all (self->priv->history_stats);
+  self->priv->log_loading = FALSE;
+  self->priv->log_n_loaded = 0;
+  ggu_history_store_clear (self->priv->history_store);
+}
+
 static void
 ggu_panel_update_history (GguPanel    *self,
                           const gchar *rev)
 {
-  g_cancellable_cancel (self->priv->log_cancellable);
-  gtk_list_store_clear (GTK_LIST_STORE (self->priv->history_store));
-  
-  GGU_SOPTR (self->priv->logger, ggu_git_log_new ());
+  guint n_rows;
+  
+  ggu_panel_clear_history (self);
+  GGU_SPTR (self->priv->log_rev, g_strdup (rev));
+  
+  /* the first page only needs to fill the view */
+  n_rows = ggu_history_view_get_n_visible_rows (GGU_HISTORY_VIEW (self->priv->history_view));
+  self->priv->logger = g_object_new (GGU_TYPE_GIT_LOG,
+                                     "max-count", MAX (n_rows,
+                                                       HISTORY_PAGE_MIN_SIZE),
+                                     NULL);
+  g_signal_connect (self->priv->logger, "entries-added",
+                    G_CALLBACK (history_entries_added_handler), self);
   g_cancellable_reset (self->priv->log_cancellable);
+  self->priv->log_loading = TRUE;
+  self->priv->log_page_start = g_get_monotonic_time ();
+  self->priv->log_page_n_signaled = 0;
   ggu_panel_loading_push (self);
   ggu_git_log_log_async (self->priv->logger,
                          self->priv->root, rev, self->priv->path,
@@ -935,6 +1370,102 @@ ggu_panel_update_history (GguPanel    *self,
                          ggu_panel_update_history_async_finished_handler, self);
 }
 
+/* fetches the next history page if the view is scrolled near the end */
+static void
+ggu_panel_load_more_history (GguPanel *self)
+{
+  GtkAdjustment  *adjustment;
+  gdouble         remaining;
+  
+  if (! self->priv->logger || self->priv->log_loading ||
+      ! g_queue_is_empty (&self->priv->history_pending) ||
+      ggu_git_log_is_complete (self->priv->logger)) {
+    return;
+  }
+  
+  adjustment = gtk_tree_view_get_vadjustment (GTK_TREE_VIEW (self->priv->history_view));
+  remaining = gtk_adjustment_get_upper (adjustment) -
+              gtk_adjustment_get_value (adjustment) -
+              gtk_adjustment_get_page_size (adjustment);
+  if (remaining > gtk_adjustment_get_page_size (adjustment)) {
+    return;
+  }
+  
+  self->priv->log_loading = TRUE;
+  self->priv->log_page_start = g_get_monotonic_time ();
+  self->priv->log_page_n_signaled = 0;
+  ggu_panel_loading_push (self);
+  ggu_git_log_log_more_async (self->priv->logger,
+                              self->priv->log_cancellable,
+                              ggu_panel_update_history_async_finished_handler,
+                              self);
+}
+
+static void
+ggu_panel_load_history_stats_async_finished_handler (GObject      *object,
+                                                     GAsyncResult *result,
+                                                     gpointer      data)
+{
+  GguPanel       *self = data;
+  GHashTable     *stats;
+  GHashTableIter  iter;
+  gpointer        oid;
+  gpointer        commit_stats;
+  
+  /* ignore pages of a previous history */
+  if (GGU_GIT_SHOW (object) != self->priv->stats_loader) {
+    return;
+  }
+  
+  /* the stats are only a hint, the history is fine without them */
+  stats = ggu_git_show_load_stats_finish (GGU_GIT_SHOW (object), result, NULL);
+  if (! stats) {
+    return;
+  }
+  
+  /* the result's table may be shared with other callers.  format the text
+   * now rather than each time the view draws a row */
+  g_hash_table_iter_init (&iter, stats);
+  while (g_hash_table_iter_next (&iter, &oid, &commit_stats)) {
+    const GguGitCommitStats *s = commit_stats;
+    
+    g_hash_table_replace (self->priv->history_stats, ggu_git_oid_ref (oid),
+                          g_strdup_printf ("+%u -%u", s->added, s->removed));
+  }
+  gtk_widget_queue_draw (self->priv->history_view);
+}
+
+/* loads the stats of @count history entries after the first @skip ones in
+ * the background, all at once rather than as each commit gets selected */
+static void
+ggu_panel_load_history_stats (GguPanel *self,
+                              guint     skip,
+                              guint     count)
+{
+  if (count == 0) {
+    return;
+  }
+  
+  if (! self->priv->stats_loader) {
+    self->priv->stats_loader = ggu_git_show_new ();
+    ggu_git_set_priority (GGU_GIT (self->priv->stats_loader), G_PRIORITY_LOW);
+    g_cancellable_reset (self->priv->stats_cancellable);
+  }
+  ggu_git_show_load_stats_async (self->priv->stats_loader,
+                                 self->priv->root, self->priv->log_rev,
+                                 self->priv->path, skip, count,
+                                 self->priv->stats_cancellable,
+                                 ggu_panel_load_history_stats_async_finished_handler,
+                                 self);
+}
+
+static void
+history_view_adjustment_changed_handler (GtkAdjustment *adjustment,
+                                         GguPanel      *self)
+{
+  ggu_panel_load_more_history (self);
+}
+
 static void
 ggu_panel_update_branch_list_async_finished_handler (GObject      *object,
                                                      GAsyncResult *result,
@@ -1023,19 +1554,26 @@ ggu_panel_update_changed_files_list_async_finished_handler (GObject      *object
     }
     g_error_free (error);
   } else {
-    for (; entries; entries = entries->next) {
-      ggu_files_changed_store_append (self->priv->commit_files_changed_store,
-                                      entries->data);
-    }
+    ggu_files_changed_store_set_tree_mode (self->priv->commit_files_changed_store,
+                                           (self->priv->files_changed_tree ||
+                                            g_list_length (entries) > FILES_CHANGED_LIST_MAX));
+    ggu_files_changed_store_set_entries (self->priv->commit_files_changed_store,
+                                         entries);
   }
 }
 
+static void
+ggu_panel_clear_changed_files_list (GguPanel *self)
+{
+  g_cancellable_cancel (self->priv->changed_files_list_cancellable);
+  ggu_files_changed_store_clear (self->priv->commit_files_changed_store);
+}
+
 static void
 ggu_panel_update_changed_files_list (GguPanel    *self,
                                      const gchar *rev)
 {
-  g_cancellable_cancel (self->priv->changed_files_list_cancellable);
-  gtk_list_store_clear (GTK_LIST_STORE (self->priv->commit_files_changed_store));
+  ggu_panel_clear_changed_files_list (self);
   
   GGU_SOPTR (self->priv->changed_files_lister,  ggu_git_show_new ());
   g_cancellable_reset (self->priv->changed_files_list_cancellable);
@@ -1048,6 +1586,170 @@ ggu_panel_update_changed_files_list (GguPanel    *self,
                                     self);
 }
 
+static void
+ggu_panel_prefetch_async_finished_handler (GObject      *object,
+                                           GAsyncResult *result,
+                                           gpointer      data)
+{
+  /* only done to have the result cached, errors will be reported if the
+   * commit gets selected */
+  ggu_git_list_files_changed_finish (GGU_GIT_SHOW (object), result, NULL);
+}
+
+/* fetches the changes of the commits around the history row at @path in the
+ * background, so moving the selection to them finds them in the cache */
+static void
+ggu_panel_prefetch_changed_files_lists (GguPanel    *self,
+                                        GtkTreePath *path)
+{
+  GtkTreeModel *model = GTK_TREE_MODEL (self->priv->history_store);
+  gint          index = gtk_tree_path_get_indices (path)[0];
+  gint          count = (gint) self->priv->prefetch_count;
+  gint          i;
+  
+  g_cancellable_cancel (self->priv->prefetch_cancellable);
+  if (count < 1) {
+    return;
+  }
+  
+  GGU_SOPTR (self->priv->prefetcher, ggu_git_show_new ());
+  ggu_git_set_priority (GGU_GIT (self->priv->prefetcher), G_PRIORITY_LOW);
+  g_cancellable_reset (self->priv->prefetch_cancellable);
+  /* nearest first, the scheduler runs jobs of equal priority in order */
+  for (i = 1; i <= count; i++) {
+    gint rows[2];
+    gint j;
+    
+    rows[0] = index + i;
+    rows[1] = index - i;
+    for (j = 0; j < 2; j++) {
+      GtkTreeIter iter;
+      
+      if (rows[j] >= 0 &&
+          gtk_tree_model_iter_nth_child (model, &iter, NULL, rows[j])) {
+        GguGitLogEntry *entry;
+        gchar           hex[GGU_GIT_OID_HEX_SIZE];
+        
+        entry = ggu_history_store_get_entry (self->priv->history_store, &iter);
+        ggu_git_list_files_changed_async (self->priv->prefetcher,
+                                          self->priv->root,
+                                          ggu_git_oid_to_hex (entry->oid, hex),
+                                          self->priv->prefetch_cancellable,
+                                          ggu_panel_prefetch_async_finished_handler,
+                                          NULL);
+      }
+    }
+  }
+}
+
+static void
+ggu_panel_cancel_selection_update (GguPanel *self)
+{
+  if (self->priv->selection_update_id) {
+    g_source_remove (self->priv->selection_update_id);
+    self->priv->selection_update_id = 0;
+  }
+  g_cancellable_cancel (self->priv->prefetch_cancellable);
+}
+
+static void
+ggu_panel_load_details_async_finished_handler (GObject      *object,
+                                               GAsyncResult *result,
+                                               gpointer      data)
+{
+  GguPanel   *self = data;
+  GError     *error = NULL;
+  gboolean    current = GGU_GIT_LOG (object) == self->priv->details_loader;
+  
+  ggu_panel_loading_pop (self);
+  
+  /* even a previous load's details are worth keeping */
+  if (! ggu_git_log_load_details_finish (GGU_GIT_LOG (object), result,
+                                        &error)) {
+    if (current &&
+        (error->domain != G_IO_ERROR || error->code != G_IO_ERROR_CANCELLED)) {
+      ggu_panel_show_message (self, GTK_MESSAGE_ERROR,
+                              "Commit message loading failed",
+                              "%s", error->message);
+    }
+    g_error_free (error);
+  } else if (current) {
+    GtkTreeSelection *selection;
+    GtkTreeModel     *model;
+    GtkTreeIter       iter;
+    
+    selection = gtk_tree_view_get_selection (GTK_TREE_VIEW (self->priv->history_view));
+    if (gtk_tree_selection_get_selected (selection, &model, &iter)) {
+      GguGitLogEntry *entry;
+      
+      entry = ggu_history_store_get_entry (GGU_HISTORY_STORE (model), &iter);
+      if (entry->details) {
+        gtk_text_buffer_set_text (self->priv->commit_message_buffer,
+                                  entry->details, -1);
+      }
+    }
+  }
+  if (current) {
+    self->priv->details_start = self->priv->details_end = 0;
+  }
+}
+
+/* loads the commit message of the history row at @path, and of the rows
+ * around it so moving the selection doesn't need a new load each time */
+static void
+ggu_panel_load_details (GguPanel    *self,
+                        GtkTreePath *path)
+{
+  GtkTreeModel   *model = GTK_TREE_MODEL (self->priv->history_store);
+  GguGitLogEntry *entries[DETAILS_BATCH_SIZE];
+  guint           n_entries = 0;
+  gint            index = gtk_tree_path_get_indices (path)[0];
+  gint            n_rows;
+  gint            start;
+  gint            end;
+  gint            i;
+  
+  if (index >= self->priv->details_start && index < self->priv->details_end) {
+    /* already loading */
+    return;
+  }
+  
+  n_rows = gtk_tree_model_iter_n_children (model, NULL);
+  start = MAX (0, index - DETAILS_BATCH_SIZE / 4);
+  end = MIN (n_rows, start + DETAILS_BATCH_SIZE);
+  for (i = start; i < end; i++) {
+    GtkTreeIter     iter;
+    GguGitLogEntry *entry;
+    
+    if (gtk_tree_model_iter_nth_child (model, &iter, NULL, i)) {
+      entry = ggu_history_store_get_entry (self->priv->history_store, &iter);
+      if (! entry->details) {
+        entries[n_entries++] = entry;
+      }
+    }
+  }
+  
+  ggu_panel_cancel_load_details (self);
+  GGU_SOPTR (self->priv->details_loader, ggu_git_log_new ());
+  g_cancellable_reset (self->priv->details_cancellable);
+  self->priv->details_start = start;
+  self->priv->details_end = end;
+  ggu_panel_loading_push (self);
+  ggu_git_log_load_details_async (self->priv->details_loader,
+                                  self->priv->root,
+                                  entries, n_entries,
+                                  self->priv->details_cancellable,
+                                  ggu_panel_load_details_async_finished_handler,
+                                  self);
+}
+
+static void
+ggu_panel_cancel_load_details (GguPanel *self)
+{
+  g_cancellable_cancel (self->priv->details_cancellable);
+  self->priv->details_start = self->priv->details_end = 0;
+}
+
 gboolean
 ggu_panel_open_repository_file (GguPanel    *self,
                                 const gchar *intern_path)
@@ -1095,10 +1797,9 @@ ggu_panel_set_document (GguPanel       *self,
   ggu_panel_set_git_path (self, root, inner_path);
   if (! is_valid) {
     /* cancel possible running operation */
-    g_cancellable_cancel (self->priv->log_cancellable);
     g_cancellable_cancel (self->priv->branch_cancellable);
     
-    gtk_list_store_clear (GTK_LIST_STORE (self->priv->history_store));
+    ggu_panel_clear_history (self);
     gtk_list_store_clear (self->priv->branch_store);
   } else {
     /*ggu_panel_update_history (self, root, NULL, inner_path);*/
@@ -41,6 +41,24 @@ enum
 static gboolean   ggu_tree_view_button_press_event    (GtkWidget       *widget,
                                                        GdkEventButton  *event);
 static gboolean   ggu_tree_view_popup_menu            (GtkWidget *widget);
+static void       ggu_tree_view_style_set             (GtkWidget *widget,
+                                                       GtkStyle  *previous_style);
+static void       ggu_tree_view_finalize              (GObject *object);
+
+
+/* a column with a fixed width, enough to show a sample text */
+typedef struct _FixedColumn FixedColumn;
+struct _FixedColumn
+{
+  GtkTreeViewColumn  *column;
+  GtkCellRenderer    *cell;
+  gchar              *text;
+};
+
+struct _GguTreeViewPrivate
+{
+  GSList *fixed_columns;
+};
 
 
 G_DEFINE_ABSTRACT_TYPE (GguTreeView,
@@ -54,10 +72,14 @@ static guint signals[N_SIGNALS] = { 0 };
 static void
 ggu_tree_view_class_init (GguTreeViewClass *klass)
 {
+  GObjectClass   *object_class = G_OBJECT_CLASS (klass);
   GtkWidgetClass *widget_class = GTK_WIDGET_CLASS (klass);
   
+  object_class->finalize            = ggu_tree_view_finalize;
+  
   widget_class->button_press_event  = ggu_tree_view_button_press_event;
   widget_class->popup_menu          = ggu_tree_view_popup_menu;
+  widget_class->style_set           = ggu_tree_view_style_set;
   
   /**
    * GguTreeView:populate-popup:
@@ -80,12 +102,70 @@ ggu_tree_view_class_init (GguTreeViewClass *klass)
     GTK_TYPE_TREE_PATH,
     GTK_TYPE_TREE_ITER,
     GTK_TYPE_MENU);
+  
+  g_type_class_add_private (klass, sizeof (GguTreeViewPrivate));
 }
 
 static void
 ggu_tree_view_init (GguTreeView *self)
 {
+  self->priv = G_TYPE_INSTANCE_GET_PRIVATE (self, GGU_TYPE_TREE_VIEW,
+                                            GguTreeViewPrivate);
+  
+  self->priv->fixed_columns = NULL;
+}
+
+static void
+fixed_column_free (FixedColumn *fixed)
+{
+  g_object_unref (fixed->column);
+  g_object_unref (fixed->cell);
+  g_free (fixed->text);
+  g_slice_free1 (sizeof *fixed, fixed);
+}
+
+static void
+ggu_tree_view_finalize (GObject *object)
+{
+  GguTreeView *self = GGU_TREE_VIEW (object);
   
+  g_slist_free_full (self->priv->fixed_columns,
+                     (GDestroyNotify) fixed_column_free);
+  self->priv->fixed_columns = NULL;
+  
+  G_OBJECT_CLASS (ggu_tree_view_parent_class)->finalize (object);
+}
+
+static void
+fixed_column_update_width (FixedColumn *fixed,
+                           GtkWidget   *widget)
+{
+  gint width = 0;
+  gint separator = 0;
+  
+  /* the data functions set the text again before rendering */
+  g_object_set (fixed->cell, "text", fixed->text, NULL);
+  gtk_cell_renderer_get_size (fixed->cell, widget, NULL, NULL, NULL,
+                              &width, NULL);
+  gtk_widget_style_get (widget, "horizontal-separator", &separator, NULL);
+  gtk_tree_view_column_set_fixed_width (fixed->column,
+                                        MAX (1, width + separator));
+}
+
+/* the font might have changed, update the fixed widths */
+static void
+ggu_tree_view_style_set (GtkWidget *widget,
+                         GtkStyle  *previous_style)
+{
+  GguTreeView *self = GGU_TREE_VIEW (widget);
+  GSList      *item;
+  
+  GTK_WIDGET_CLASS (ggu_tree_view_parent_class)->style_set (widget,
+                                                            previous_style);
+  
+  for (item = self->priv->fixed_columns; item; item = item->next) {
+    fixed_column_update_width (item->data, widget);
+  }
 }
 
 static void
@@ -231,3 +311,38 @@ ggu_tree_view_popup_menu (GtkWidget *widget)
   
   return handled;
 }
+
+/**
+ * ggu_tree_view_set_column_fixed_text:
+ * @self: A #GguTreeView
+ * @column: A column of @self
+ * @cell: The text cell renderer of @column
+ * @text: A text as wide as the widest one @cell will render
+ * 
+ * Gives @column a fixed width, large enough to show @text.  The width
+ * follows the font changes.  This lets the view use fixed height mode with
+ * columns that would otherwise need measuring every row.
+ */
+void
+ggu_tree_view_set_column_fixed_text (GguTreeView       *self,
+                                     GtkTreeViewColumn *column,
+                                     GtkCellRenderer   *cell,
+                                     const gchar       *text)
+{
+  FixedColumn *fixed;
+  
+  g_return_if_fail (GGU_IS_TREE_VIEW (self));
+  g_return_if_fail (GTK_IS_TREE_VIEW_COLUMN (column));
+  g_return_if_fail (GTK_IS_CELL_RENDERER_TEXT (cell));
+  g_return_if_fail (text != NULL);
+  
+  fixed = g_slice_alloc (sizeof *fixed);
+  fixed->column = g_object_ref (column);
+  fixed->cell   = g_object_ref (cell);
+  fixed->text   = g_strdup (text);
+  self->priv->fixed_columns = g_slist_prepend (self->priv->fixed_columns,
+                                               fixed);
+  
+  gtk_tree_view_column_set_sizing (column, GTK_TREE_VIEW_COLUMN_FIXED);
+  fixed_column_update_width (fixed, GTK_WIDGET (self));
+}
@@ -38,10 +38,12 @@ G_BEGIN_DECLS
 
 typedef struct _GguTreeView         GguTreeView;
 typedef struct _GguTreeViewClass    GguTreeViewClass;
+typedef struct _GguTreeViewPrivate  GguTreeViewPrivate;
 
 struct _GguTreeView
 {
   GtkTreeView parent_instance;
+  GguTreeViewPrivate *priv;
 };
 
 struct _GguTreeViewClass
@@ -55,7 +57,11 @@ struct _GguTreeViewClass
 };
 
 
-GType     ggu_tree_view_get_type      (void) G_GNUC_CONST;
+GType     ggu_tree_view_get_type              (void) G_GNUC_CONST;
+void      ggu_tree_view_set_column_fixed_text (GguTreeView       *self,
+                                               GtkTreeViewColumn *column,
+                                               GtkCellRenderer   *cell,
+                                               const gchar       *text);
 
 
 G_END_DECLS
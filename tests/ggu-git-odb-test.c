@@ -0,0 +1,643 @@
+/*
+ * Copyright 2011 Colomban Wendling <ban@herbesfolles.org>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+/*
+ * Checks of the native object database and history walk against Git.
+ * 
+ * Each test creates a small repository with Git, packs it in the way it
+ * checks, and compares what git-lib reads with what Git reads.  Git has to
+ * be in the PATH.
+ */
+
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "ggu-git-odb.h"
+#include "ggu-git-rev-walk.h"
+
+
+/* pack entry types of deltas */
+#define PACK_OFS_DELTA  6
+#define PACK_REF_DELTA  7
+
+/* number of commits of the main line of the test histories */
+#define N_COMMITS       30
+
+
+typedef struct _Object Object;
+struct _Object
+{
+  guint8            oid[GGU_GIT_ODB_OID_SIZE];
+  GguGitObjectType  type;
+  const gchar      *data;
+  gsize             length;
+};
+
+
+/* runs Git in @dir with the %NULL-terminated arguments in @args, failing
+ * the test if it fails.  returns its output, of @length bytes */
+static gchar *
+git_va (const gchar *dir,
+        gsize       *length,
+        va_list      args)
+{
+  GPtrArray    *argv = g_ptr_array_new ();
+  GString      *output = g_string_new (NULL);
+  const gchar  *arg;
+  GPid          pid;
+  gint          out_fd;
+  gint          status = 0;
+  gssize        n_read;
+  GError       *error = NULL;
+  
+  g_ptr_array_add (argv, (gchar *) "git");
+  while ((arg = va_arg (args, const gchar *))) {
+    g_ptr_array_add (argv, (gchar *) arg);
+  }
+  g_ptr_array_add (argv, NULL);
+  
+  g_spawn_async_with_pipes (dir, (gchar **) argv->pdata, NULL,
+                            G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD,
+                            NULL, NULL, &pid, NULL, &out_fd, NULL, &error);
+  g_assert_no_error (error);
+  /* the output may be binary */
+  do {
+    gchar buf[4096];
+    
+    n_read = read (out_fd, buf, sizeof buf);
+    if (n_read > 0) {
+      g_string_append_len (output, buf, n_read);
+    }
+  } while (n_read > 0 || (n_read < 0 && errno == EINTR));
+  close (out_fd);
+  while (waitpid (pid, &status, 0) < 0 && errno == EINTR);
+  g_spawn_close_pid (pid);
+  
+  if (status != 0) {
+    gchar *command = g_strjoinv (" ", (gchar **) argv->pdata);
+    
+    g_error ("\"%s\" failed in %s", command, dir);
+  }
+  g_ptr_array_free (argv, TRUE);
+  if (length) {
+    *length = output->len;
+  }
+  
+  return g_string_free (output, FALSE);
+}
+
+static gchar *
+git_output (const gchar *dir,
+            gsize       *length,
+            ...)
+{
+  va_list  args;
+  gchar   *output;
+  
+  va_start (args, length);
+  output = git_va (dir, length, args);
+  va_end (args);
+  
+  return output;
+}
+
+static void
+git (const gchar *dir,
+     ...)
+{
+  va_list args;
+  
+  va_start (args, dir);
+  g_free (git_va (dir, NULL, args));
+  va_end (args);
+}
+
+static void
+remove_tree (const gchar *path)
+{
+  GDir *dir = g_dir_open (path, 0, NULL);
+  
+  if (dir) {
+    const gchar *name;
+    
+    while ((name = g_dir_read_name (dir))) {
+      gchar *child = g_build_filename (path, name, NULL);
+      
+      remove_tree (child);
+      g_free (child);
+    }
+    g_dir_close (dir);
+    g_rmdir (path);
+  } else {
+    g_remove (path);
+  }
+}
+
+/* writes @path in the repository @dir and commits it, with a date later than
+ * the one of the previous commit */
+static void
+commit_file (const gchar *dir,
+             const gchar *path,
+             const gchar *contents,
+             const gchar *message)
+{
+  static gint64  date = 1300000000;
+  gchar         *full_path = g_build_filename (dir, path, NULL);
+  gchar         *parent = g_path_get_dirname (full_path);
+  gchar         *date_str;
+  GError        *error = NULL;
+  
+  g_mkdir_with_parents (parent, 0755);
+  g_file_set_contents (full_path, contents, -1, &error);
+  g_assert_no_error (error);
+  
+  date_str = g_strdup_printf ("%" G_GINT64_FORMAT " +0100", date);
+  date += 3600;
+  g_setenv ("GIT_AUTHOR_DATE", date_str, TRUE);
+  g_setenv ("GIT_COMMITTER_DATE", date_str, TRUE);
+  git (dir, "add", path, NULL);
+  git (dir, "commit", "-q", "-m", message, NULL);
+  
+  g_free (date_str);
+  g_free (parent);
+  g_free (full_path);
+}
+
+/* a long file with line @changed changed, so that its versions delta well */
+static gchar *
+make_contents (const gchar *name,
+               guint        changed)
+{
+  GString *contents = g_string_new (NULL);
+  guint    i;
+  
+  for (i = 0; i < 200; i++) {
+    if (i == changed) {
+      g_string_append_printf (contents, "%s: line %u, changed\n", name, i);
+    } else {
+      g_string_append_printf (contents, "%s: line %u of the file\n", name, i);
+    }
+  }
+  
+  return g_string_free (contents, FALSE);
+}
+
+/* commits the versions @from to @to of the test history in @dir: a.txt
+ * changes in every commit, dir/b.txt in some, and c.txt is added and changed
+ * on a branch merged back */
+static void
+commit_history (const gchar *dir,
+                guint        from,
+                guint        to)
+{
+  guint i;
+  
+  for (i = from; i < to; i++) {
+    gchar *contents = make_contents ("a", i);
+    gchar *message = g_strdup_printf ("Change a.txt, version %u", i);
+    
+    commit_file (dir, "a.txt", contents, message);
+    g_free (message);
+    g_free (contents);
+    
+    if (i % 7 == 3) {
+      contents = make_contents ("b", i);
+      commit_file (dir, "dir/b.txt", contents, "Change dir/b.txt");
+      g_free (contents);
+    }
+    if (i == 12) {
+      git (dir, "checkout", "-q", "-b", "topic", NULL);
+      commit_file (dir, "c.txt", "c\n", "Add c.txt");
+      commit_file (dir, "c.txt", "c, changed\n", "Change c.txt");
+      git (dir, "checkout", "-q", "master", NULL);
+    } else if (i == 16) {
+      git (dir, "merge", "-q", "--no-ff", "--no-edit", "topic", NULL);
+    }
+  }
+}
+
+/* creates an empty repository, to remove with remove_tree() */
+static gchar *
+create_repository (void)
+{
+  GError *error = NULL;
+  gchar  *dir;
+  
+  dir = g_dir_make_tmp ("ggu-git-odb-test-XXXXXX", &error);
+  g_assert_no_error (error);
+  git (dir, "init", "-q", NULL);
+  git (dir, "symbolic-ref", "HEAD", "refs/heads/master", NULL);
+  
+  return dir;
+}
+
+/* reads every object of @dir with Git.  the objects point inside
+ * *@contents, to free once done with them */
+static GArray *
+get_objects (const gchar  *dir,
+             gchar       **contents)
+{
+  GArray      *objects = g_array_new (FALSE, FALSE, sizeof (Object));
+  gsize        length;
+  const gchar *p;
+  const gchar *end;
+  
+  *contents = git_output (dir, &length, "cat-file", "--batch-all-objects",
+                          "--batch", NULL);
+  /* "<oid> <type> <size>\n<data>\n" for each object */
+  for (p = *contents, end = p + length; p < end; ) {
+    Object       object;
+    const gchar *eol = memchr (p, '\n', (gsize) (end - p));
+    gchar       *header;
+    gchar      **fields;
+    
+    g_assert (eol != NULL);
+    header = g_strndup (p, (gsize) (eol - p));
+    fields = g_strsplit (header, " ", 0);
+    g_assert_cmpuint (g_strv_length (fields), ==, 3);
+    g_assert (_ggu_git_odb_parse_oid (fields[0], object.oid));
+    if (strcmp (fields[1], "commit") == 0) {
+      object.type = GGU_GIT_OBJECT_COMMIT;
+    } else if (strcmp (fields[1], "tree") == 0) {
+      object.type = GGU_GIT_OBJECT_TREE;
+    } else if (strcmp (fields[1], "blob") == 0) {
+      object.type = GGU_GIT_OBJECT_BLOB;
+    } else {
+      object.type = GGU_GIT_OBJECT_TAG;
+    }
+    object.length = (gsize) g_ascii_strtoull (fields[2], NULL, 10);
+    object.data = eol + 1;
+    g_assert (object.data + object.length < end);
+    g_array_append_val (objects, object);
+    p = object.data + object.length + 1;
+    g_strfreev (fields);
+    g_free (header);
+  }
+  
+  return objects;
+}
+
+/* checks that git-lib reads @objects the same as Git in @dir */
+static void
+check_objects (const gchar *dir,
+               GArray      *objects)
+{
+  GguGitOdb  *odb;
+  GError     *error = NULL;
+  guint       i;
+  
+  odb = _ggu_git_odb_open (dir, &error);
+  g_assert_no_error (error);
+  for (i = 0; i < objects->len; i++) {
+    const Object     *object = &g_array_index (objects, Object, i);
+    GguGitObjectType  type = GGU_GIT_OBJECT_NONE;
+    gsize             length = 0;
+    gchar            *data;
+    
+    data = _ggu_git_odb_read (odb, object->oid, &type, &length, &error);
+    g_assert_no_error (error);
+    g_assert (data != NULL);
+    g_assert_cmpint (type, ==, object->type);
+    g_assert_cmpuint (length, ==, object->length);
+    g_assert (memcmp (data, object->data, length) == 0);
+    g_free (data);
+  }
+  _ggu_git_odb_unref (odb);
+}
+
+/* checks that git-lib reads all the objects of @dir like Git does.  if
+ * @remove_indexes, Git reads them before the pack indexes are removed */
+static void
+check_repository (const gchar *dir,
+                  gboolean     remove_indexes)
+{
+  GArray *objects;
+  gchar  *contents;
+  
+  objects = get_objects (dir, &contents);
+  g_assert_cmpuint (objects->len, >, N_COMMITS * 3);
+  if (remove_indexes) {
+    gchar       *pack_dir = g_build_filename (dir, ".git", "objects", "pack",
+                                              NULL);
+    GDir        *pack_files = g_dir_open (pack_dir, 0, NULL);
+    const gchar *name;
+    
+    g_assert (pack_files != NULL);
+    while ((name = g_dir_read_name (pack_files))) {
+      if (g_str_has_prefix (name, "pack-") && g_str_has_suffix (name, ".idx")) {
+        gchar *path = g_build_filename (pack_dir, name, NULL);
+        
+        g_remove (path);
+        g_free (path);
+      }
+    }
+    g_dir_close (pack_files);
+    g_free (pack_dir);
+  }
+  check_objects (dir, objects);
+  g_array_free (objects, TRUE);
+  g_free (contents);
+}
+
+static guint32
+get_be32 (const guint8 *p)
+{
+  return ((guint32) p[0] << 24 | (guint32) p[1] << 16 |
+          (guint32) p[2] << 8 | (guint32) p[3]);
+}
+
+/* counts the entries of the packs of @dir whose pack type is @type, making
+ * sure the tests really go through the code they are meant to check */
+static guint
+count_pack_entries (const gchar *dir,
+                    guint        type)
+{
+  gchar       *pack_dir = g_build_filename (dir, ".git", "objects", "pack",
+                                            NULL);
+  GDir        *pack_files = g_dir_open (pack_dir, 0, NULL);
+  const gchar *name;
+  guint        count = 0;
+  
+  g_assert (pack_files != NULL);
+  while ((name = g_dir_read_name (pack_files))) {
+    gchar        *base;
+    gchar        *path;
+    gchar        *idx;
+    gchar        *pack;
+    const guint8 *offsets;
+    guint32       n_objects;
+    guint32       i;
+    
+    if (! g_str_has_suffix (name, ".idx")) {
+      continue;
+    }
+    base = g_build_filename (pack_dir, name, NULL);
+    base[strlen (base) - 4] = 0;
+    path = g_strconcat (base, ".idx", NULL);
+    g_assert (g_file_get_contents (path, &idx, NULL, NULL));
+    g_free (path);
+    path = g_strconcat (base, ".pack", NULL);
+    g_assert (g_file_get_contents (path, &pack, NULL, NULL));
+    g_free (path);
+    
+    /* version 2 index: header, fanout, OIDs, CRCs then offsets */
+    n_objects = get_be32 ((const guint8 *) idx + 8 + 255 * 4);
+    offsets = (const guint8 *) idx + 8 + 256 * 4 + n_objects * (20 + 4);
+    for (i = 0; i < n_objects; i++) {
+      guint32 offset = get_be32 (offsets + i * 4);
+      
+      g_assert_cmpuint (offset & 0x80000000, ==, 0);
+      if ((((guint8) pack[offset] >> 4) & 7) == type) {
+        count++;
+      }
+    }
+    g_free (pack);
+    g_free (idx);
+    g_free (base);
+  }
+  g_dir_close (pack_files);
+  g_free (pack_dir);
+  
+  return count;
+}
+
+/* whether some delta chains of the packs of @dir are longer than 1 */
+static gboolean
+has_delta_chains (const gchar *dir)
+{
+  gchar       *pack_dir = g_build_filename (dir, ".git", "objects", "pack",
+                                            NULL);
+  GDir        *pack_files = g_dir_open (pack_dir, 0, NULL);
+  const gchar *name;
+  gboolean     found = FALSE;
+  
+  while (! found && (name = g_dir_read_name (pack_files))) {
+    if (g_str_has_suffix (name, ".idx")) {
+      gchar *path = g_build_filename (pack_dir, name, NULL);
+      gchar *output = git_output (dir, NULL, "verify-pack", "-v", path, NULL);
+      
+      found = strstr (output, "chain length = 2:") != NULL;
+      g_free (output);
+      g_free (path);
+    }
+  }
+  g_dir_close (pack_files);
+  g_free (pack_dir);
+  
+  return found;
+}
+
+static void
+test_loose (void)
+{
+  gchar *dir = create_repository ();
+  
+  commit_history (dir, 0, N_COMMITS);
+  check_repository (dir, FALSE);
+  remove_tree (dir);
+  g_free (dir);
+}
+
+static void
+test_ofs_deltas (void)
+{
+  gchar *dir = create_repository ();
+  
+  commit_history (dir, 0, N_COMMITS);
+  git (dir, "-c", "repack.useDeltaBaseOffset=true",
+       "repack", "-a", "-d", "-f", "-q", "--depth=50", "--window=50", NULL);
+  g_assert_cmpuint (count_pack_entries (dir, PACK_OFS_DELTA), >, 0);
+  g_assert_cmpuint (count_pack_entries (dir, PACK_REF_DELTA), ==, 0);
+  g_assert (has_delta_chains (dir));
+  check_repository (dir, FALSE);
+  remove_tree (dir);
+  g_free (dir);
+}
+
+static void
+test_ref_deltas (void)
+{
+  gchar *dir = create_repository ();
+  
+  commit_history (dir, 0, N_COMMITS);
+  git (dir, "-c", "repack.useDeltaBaseOffset=false",
+       "repack", "-a", "-d", "-f", "-q", "--depth=50", "--window=50", NULL);
+  g_assert_cmpuint (count_pack_entries (dir, PACK_REF_DELTA), >, 0);
+  g_assert_cmpuint (count_pack_entries (dir, PACK_OFS_DELTA), ==, 0);
+  g_assert (has_delta_chains (dir));
+  check_repository (dir, FALSE);
+  remove_tree (dir);
+  g_free (dir);
+}
+
+/* objects in 3 packs and loose ones, found only through the multi-pack-index
+ * as the pack indexes get removed */
+static void
+test_multi_pack_index (void)
+{
+  gchar *dir = create_repository ();
+  
+  commit_history (dir, 0, N_COMMITS / 3);
+  git (dir, "repack", "-d", "-q", NULL);
+  commit_history (dir, N_COMMITS / 3, N_COMMITS * 2 / 3);
+  git (dir, "repack", "-d", "-q", NULL);
+  commit_history (dir, N_COMMITS * 2 / 3, N_COMMITS - 2);
+  git (dir, "repack", "-d", "-q", NULL);
+  commit_history (dir, N_COMMITS - 2, N_COMMITS);
+  git (dir, "multi-pack-index", "write", NULL);
+  g_assert_cmpuint (count_pack_entries (dir, PACK_OFS_DELTA), >, 0);
+  check_repository (dir, TRUE);
+  remove_tree (dir);
+  g_free (dir);
+}
+
+/* the history of @path natively, @page commits at a time */
+static GPtrArray *
+walk_path (GguGitOdb   *odb,
+           const gchar *path,
+           guint        page)
+{
+  GPtrArray      *hashes = g_ptr_array_new_with_free_func (g_free);
+  GPtrArray      *commits = g_ptr_array_new_with_free_func (g_free);
+  GguGitRevWalk  *walk;
+  guint8          head[GGU_GIT_ODB_OID_SIZE];
+  GError         *error = NULL;
+  guint           i;
+  
+  g_assert (_ggu_git_odb_resolve (odb, "HEAD", head));
+  walk = _ggu_git_rev_walk_new (odb, head, path, &error);
+  g_assert_no_error (error);
+  g_assert (walk != NULL);
+  do {
+    g_assert (_ggu_git_rev_walk_next (walk, commits, page, NULL, &error));
+    g_assert_no_error (error);
+  } while (page > 0 && ! _ggu_git_rev_walk_is_done (walk));
+  _ggu_git_rev_walk_free (walk);
+  
+  for (i = 0; i < commits->len; i++) {
+    gchar hex[GGU_GIT_ODB_OID_SIZE * 2 + 1];
+    
+    _ggu_git_odb_format_oid (g_ptr_array_index (commits, i), hex);
+    g_ptr_array_add (hashes, g_strdup (hex));
+  }
+  g_ptr_array_free (commits, TRUE);
+  
+  return hashes;
+}
+
+/* a history written in 3 commit-graph layers, plus commits newer than the
+ * graph, walked natively like `git log -- path` does */
+static void
+test_split_commit_graph (void)
+{
+  static const gchar *const paths[] = {
+    "a.txt", "dir/b.txt", "dir", "c.txt", "missing.txt"
+  };
+  gchar      *dir = create_repository ();
+  gchar      *chain_path;
+  gchar      *chain;
+  gchar     **layers;
+  GguGitOdb  *odb;
+  GError     *error = NULL;
+  guint       i;
+  
+  for (i = 0; i < 3; i++) {
+    commit_history (dir, N_COMMITS * i / 4, N_COMMITS * (i + 1) / 4);
+    git (dir, "commit-graph", "write", "--reachable", "--split=no-merge",
+         "--changed-paths", NULL);
+  }
+  commit_history (dir, N_COMMITS * 3 / 4, N_COMMITS);
+  
+  chain_path = g_build_filename (dir, ".git", "objects", "info",
+                                 "commit-graphs", "commit-graph-chain", NULL);
+  g_assert (g_file_get_contents (chain_path, &chain, NULL, NULL));
+  layers = g_strsplit (g_strstrip (chain), "\n", 0);
+  g_assert_cmpuint (g_strv_length (layers), ==, 3);
+  g_strfreev (layers);
+  g_free (chain);
+  g_free (chain_path);
+  
+  odb = _ggu_git_odb_open (dir, &error);
+  g_assert_no_error (error);
+  for (i = 0; i < G_N_ELEMENTS (paths); i++) {
+    gchar      *output;
+    gchar     **expected;
+    guint       page;
+    
+    output = git_output (dir, NULL, "log", "--format=%H", "--", paths[i],
+                         NULL);
+    expected = g_strsplit (g_strstrip (output), "\n", 0);
+    /* all at once, then by pages like the history view loads it */
+    for (page = 0; page <= 4; page += 4) {
+      GPtrArray  *hashes = walk_path (odb, paths[i], page);
+      guint       j;
+      
+      g_assert_cmpuint (hashes->len, ==, g_strv_length (expected));
+      for (j = 0; j < hashes->len; j++) {
+        g_assert_cmpstr (g_ptr_array_index (hashes, j), ==, expected[j]);
+      }
+      g_ptr_array_free (hashes, TRUE);
+    }
+    g_strfreev (expected);
+    g_free (output);
+  }
+  _ggu_git_odb_unref (odb);
+  remove_tree (dir);
+  g_free (dir);
+}
+
+int
+main (int     argc,
+      char  **argv)
+{
+  gchar *home;
+  int    rv;
+  
+  g_test_init (&argc, &argv, NULL);
+  
+  /* don't let the user's configuration change what Git writes */
+  home = g_dir_make_tmp ("ggu-git-odb-test-home-XXXXXX", NULL);
+  g_assert (home != NULL);
+  g_setenv ("HOME", home, TRUE);
+  g_setenv ("XDG_CONFIG_HOME", home, TRUE);
+  g_setenv ("GIT_CONFIG_NOSYSTEM", "1", TRUE);
+  g_setenv ("GIT_AUTHOR_NAME", "Test", TRUE);
+  g_setenv ("GIT_AUTHOR_EMAIL", "test@example.com", TRUE);
+  g_setenv ("GIT_COMMITTER_NAME", "Test", TRUE);
+  g_setenv ("GIT_COMMITTER_EMAIL", "test@example.com", TRUE);
+  
+  g_test_add_func ("/odb/loose", test_loose);
+  g_test_add_func ("/odb/ofs-deltas", test_ofs_deltas);
+  g_test_add_func ("/odb/ref-deltas", test_ref_deltas);
+  g_test_add_func ("/odb/multi-pack-index", test_multi_pack_index);
+  g_test_add_func ("/rev-walk/split-commit-graph", test_split_commit_graph);
+  
+  rv = g_test_run ();
+  remove_tree (home);
+  g_free (home);
+  
+  return rv;
+}
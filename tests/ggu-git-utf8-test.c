@@ -0,0 +1,191 @@
+/*
+ * Copyright 2011 Colomban Wendling <ban@herbesfolles.org>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+/*
+ * Checks of ggu_git_utf8_normalize() against the straightforward
+ * implementations it replaced, on random strings.
+ */
+
+#include <string.h>
+#include <glib.h>
+
+#include "ggu-git-utils.h"
+
+
+#define N_RANDOM_STRINGS  100000
+
+
+/* the former ggu_git_utf8_ensure_valid() */
+static gchar *
+reference_ensure_valid (const gchar *str)
+{
+  const gchar  *end;
+  gboolean      valid;
+  GString      *valid_str;
+  
+  valid_str = g_string_new (NULL);
+  do {
+    valid = g_utf8_validate (str, -1, &end);
+    g_string_append_len (valid_str, str, end - str);
+    if (! valid) {
+      g_string_append_unichar (valid_str, 0xfffd);
+      str = end + 1;
+    }
+  } while (! valid);
+  
+  return g_string_free (valid_str, FALSE);
+}
+
+/* whether the character at @p is alphanumeric.  The former parse_message()
+ * passed the byte after the newline to g_unichar_isalnum(), which decided
+ * for non-ASCII letters depending on whether char is signed */
+static gboolean
+reference_is_alnum (const gchar *p)
+{
+  gunichar wc = g_utf8_get_char_validated (p, -1);
+  
+  return ! (wc & 0x80000000) && g_unichar_isalnum (wc);
+}
+
+/* the former parse_message() of ggu-git-log.c */
+static gchar *
+reference_parse_message (const gchar *msg)
+{
+  GString  *builder;
+  gboolean  prev_newline = FALSE;
+  gchar    *formatted;
+  
+  builder = g_string_new (NULL);
+  while (*msg) {
+    gunichar wc = g_utf8_get_char_validated (msg, -1);
+    
+    if (G_UNLIKELY (wc & 0x80000000)) {
+      /* replace invalid UTF-8 characters by U+FFFD */
+      g_string_append_unichar (builder, 0xfffd);
+      prev_newline = FALSE;
+      msg ++;
+    } else {
+      if (! prev_newline && *msg == '\n' && reference_is_alnum (msg + 1)) {
+        /* transform this newline by a space */
+        g_string_append_c (builder, ' ');
+      } else {
+        g_string_append_unichar (builder, wc);
+      }
+      prev_newline = *msg == '\n';
+      msg = g_utf8_next_char (msg);
+    }
+  }
+  
+  formatted = g_string_free (builder, FALSE);
+  return g_strchomp (formatted);
+}
+
+static void
+check_normalize (const gchar *str)
+{
+  gsize   length = strlen (str);
+  gchar  *expected;
+  gchar  *result;
+  
+  expected = reference_ensure_valid (str);
+  result = ggu_git_utf8_normalize (str, length, FALSE);
+  g_assert_cmpstr (result ? result : str, ==, expected);
+  g_free (result);
+  g_free (expected);
+  
+  expected = reference_parse_message (str);
+  result = ggu_git_utf8_normalize (str, length, TRUE);
+  g_assert_cmpstr (result ? result : str, ==, expected);
+  g_free (result);
+  g_free (expected);
+}
+
+static void
+test_examples (void)
+{
+  static const struct {
+    const gchar *str;
+    const gchar *expected;
+  } examples[] = {
+    { "Fix the build\n\nThe header was\nmissing.\n",
+      "Fix the build\n\nThe header was missing." },
+    { "two\n\n\nparagraphs", NULL },
+    { "a list:\n- one\n- two", NULL },
+    { "non-ASCII\n\303\251t\303\251", "non-ASCII \303\251t\303\251" },
+    { "not a letter\n\342\202\254", NULL },
+    { "invalid \377 byte", "invalid \357\277\275 byte" },
+    { "truncated \342\202", "truncated \357\277\275\357\277\275" },
+    { "trailing spaces \t\n \n", "trailing spaces" },
+    { "", NULL }
+  };
+  guint i;
+  
+  for (i = 0; i < G_N_ELEMENTS (examples); i++) {
+    const gchar  *str = examples[i].str;
+    gchar        *result = ggu_git_utf8_normalize (str, strlen (str), TRUE);
+    
+    g_assert_cmpstr (result, ==, examples[i].expected);
+    g_free (result);
+    check_normalize (str);
+  }
+}
+
+static void
+test_random (void)
+{
+  /* pieces that hit both the word-at-a-time ASCII path and the rest */
+  static const gchar *const pieces[] = {
+    "a", "Z", "1", " ", "\t", "\r", "\n", "\n\n", "hello world ",
+    "\303\251",             /* U+00E9 */
+    "\316\273",             /* U+03BB */
+    "\344\270\255",         /* U+4E2D */
+    "\342\202\254",         /* U+20AC */
+    "\360\237\230\200",     /* U+1F600 */
+    "\377", "\303", "\342\202", "\355\240\200"
+  };
+  GString  *str = g_string_new (NULL);
+  guint     i;
+  
+  for (i = 0; i < N_RANDOM_STRINGS; i++) {
+    gint n = g_test_rand_int_range (0, 24);
+    
+    g_string_truncate (str, 0);
+    while (n-- > 0) {
+      gint piece = g_test_rand_int_range (0, G_N_ELEMENTS (pieces));
+      
+      g_string_append (str, pieces[piece]);
+    }
+    check_normalize (str->str);
+  }
+  g_string_free (str, TRUE);
+}
+
+int
+main (int     argc,
+      char  **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+  
+  g_test_add_func ("/utf8/normalize/examples", test_examples);
+  g_test_add_func ("/utf8/normalize/random", test_random);
+  
+  return g_test_run ();
+}